@@ -27,22 +27,31 @@
 #include "jpge.h"
 #include <string>
 #include <iostream>
+#include <stdlib.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <string.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#define SOCKET_ERROR (-1)
 #else
 #undef min
 #undef max
 #include <windows.h>
 
 #define sleep(n)    Sleep(n)
-#endif
 
 #include <WinSock.h>
 #include<WinSock2.h>
+#endif
 
 #include "Core/Logger.h"
 #include "Core/StringConverter.h"
 #include "ZMQVideo.h"
+#include "../SensorPlugin/SocketMonitor.h"
+#include "../SensorPlugin/AsyncLog.h"
+#include "../SensorPlugin/Trace.h"
 #include "Simulation/Controller/ControllerManager.h"
 #include "Simulation/Vehicles/Vehicle.h"
 #include "Simulation/Vehicles/VehicleManager.h"
@@ -62,6 +71,11 @@ namespace VANE
 	namespace Commands
 	{
 		CommandID kCommandUseZMQVideo = kInvalidCommand;
+		CommandID kCommandWriteControllerTrace = kInvalidCommand;
+		CommandID kCommandStartControllerRecording = kInvalidCommand;
+		CommandID kCommandStopControllerRecording = kInvalidCommand;
+		CommandID kCommandStartControllerReplay = kInvalidCommand;
+		CommandID kCommandStopControllerReplay = kInvalidCommand;
 	}
 
 	namespace Controller
@@ -192,6 +206,13 @@ ObjectPropertySet ZMQVideoFactory::GetProperties( VaneID objID )
 	result.properties.push_back(Property(simCtrlr.ipaddr));
 	result.properties.push_back(Property(simCtrlr.m_desired_speed));
 	result.properties.push_back(Property(simCtrlr.m_desired_yaw));
+	result.properties.push_back(Property(simCtrlr.m_statCommandRate));
+	result.properties.push_back(Property(simCtrlr.m_statRoundTrip));
+	result.properties.push_back(Property(simCtrlr.m_statClientLatency));
+	result.properties.push_back(Property(simCtrlr.m_statClientJitter));
+	result.properties.push_back(Property(simCtrlr.m_statInvalidCommands));
+	result.properties.push_back(Property(simCtrlr.m_statPeers));
+	result.properties.push_back(Property(simCtrlr.m_statDisconnects));
 
 	return result;
 }
@@ -215,6 +236,13 @@ void ZMQVideoFactory::RegisterZMQVideoProperties()
 	propMgr.RegisterProperty(Types::ZMQVideo, "IP Address", "Current IP of this device", true);
 	propMgr.RegisterProperty(Types::ZMQVideo, "Desired Speed", "Robot Desired Forward Speed Command", true);
 	propMgr.RegisterProperty(Types::ZMQVideo, "Desired Yaw Rate", "Robot Desired Yaw Rate Command", true);
+	propMgr.RegisterProperty(Types::ZMQVideo, "Command Rate", "Commands received per second", true);
+	propMgr.RegisterProperty(Types::ZMQVideo, "Round Trip", "Best recent control round trip, in milliseconds", true);
+	propMgr.RegisterProperty(Types::ZMQVideo, "Client Frame Latency", "Frame latency reported by the client, in milliseconds", true);
+	propMgr.RegisterProperty(Types::ZMQVideo, "Client Frame Jitter", "Frame jitter reported by the client, in milliseconds", true);
+	propMgr.RegisterProperty(Types::ZMQVideo, "Invalid Commands", "Commands that were not a known direction", true);
+	propMgr.RegisterProperty(Types::ZMQVideo, "Connected Controllers", "Peers connected to the control socket", true);
+	propMgr.RegisterProperty(Types::ZMQVideo, "Controller Disconnects", "Connections lost on the control socket", true);
 }
 
 /************************************************************************/
@@ -241,6 +269,13 @@ zmq::context_t context_;
 //Get the IP address of the computer
 bool getMyIP(String& myIP)
 {
+    //ANVEL_BIND_ADDRESS picks the interface on machines that are not on a 192.168.1.x network
+    const char* pBindAddress = getenv("ANVEL_BIND_ADDRESS");
+    if (pBindAddress && *pBindAddress) {
+        myIP = pBindAddress;
+        return true;
+    }
+
     char szBuffer[1024];
 
     #ifdef WIN32
@@ -294,7 +329,11 @@ bool getMyIP(String& myIP)
 ZMQVideo::ZMQVideo()
 : m_controllableID( kInvalidVaneID )
 , m_elapsedTime( 0 )
+, m_pControlMonitor( NULL )
+, m_pLog( new AsyncLog() )
 {
+	m_pLog->Start();
+
 	//Get the current IP address
 	String ip;
 	if(!getMyIP(ip)) {
@@ -306,11 +345,20 @@ ZMQVideo::ZMQVideo()
 		ipaddr = ip;
 		running = true;
 
-		//Bind to the computer's IP adress
 		socket1_.init(context_, ZMQ_PAIR);
+
+		//Watch the socket before binding so a failed bind shows up as well
+		m_pControlMonitor = new SocketMonitor();
+		if(!m_pControlMonitor->Start(socket1_, "control")) {
+			LogMessage("Failed to monitor the control socket", kLogMsgWarning);
+			delete m_pControlMonitor;
+			m_pControlMonitor = NULL;
+		}
+
+		//Bind to the computer's IP adress
 		socket1_.bind("tcp://" + ip + ":5555");
 
-		LogMessage("Connected", kLogMsgSpecial);
+		LogMessage("Waiting for a controller on port 5555", kLogMsgSpecial);
 	}
 	m_desired_speed = 0;
 	m_desired_yaw = 0;
@@ -324,22 +372,68 @@ ZMQVideo::ZMQVideo()
 	m_inputValues.resize(2, ControlValue(0));
 
 	frame = 0;
+
+	m_hasClientLatency = false;
+	m_clientLatency = 0;
+	m_clientJitter = 0;
+	m_clientTimingReported = ClockSync::Now();
+
+	Trace::SetThreadName("ANVEL update");
+
+	m_statCommandRate = 0;
+	m_statRoundTrip = 0;
+	m_statClientLatency = 0;
+	m_statClientJitter = 0;
+	m_statInvalidCommands = 0;
+	m_statPeers = 0;
+	m_statDisconnects = 0;
+	m_windowCommands = 0;
+	m_statsWindowStart = m_clientTimingReported;
+
+	m_recordInput = false;
+	m_appliedSpeed = 0;
+	m_appliedYaw = 0;
+
+	m_replaying = false;
+	m_replayStarted = false;
+	m_replayDone = false;
+	m_replayNextInput = 0;
+	m_replayNextState = 0;
+	m_replayOffset = 0;
+	m_replayTime = 0;
+	m_replayEnd = 0;
+	m_replayMaxError = 0;
+	m_replayLastError = 0;
+	m_replayCompared = 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
 
 ZMQVideo::~ZMQVideo()
 {
+	StopRecording();
+	StopMonitor();
 	socket1_.close();
 	context_.close();
+
+	//Stopping closes the rate limit windows, log their summaries before going
+	m_pLog->Stop();
+	TakeLogLines();
+	delete m_pLog;
 }
 
 //////////////////////////////////////////////////////////////////////////
 
 void ZMQVideo::Update(TimeValue dt)
 {
+	Trace::Span updateSpan("ZMQVideo::Update");
+
 	m_elapsedTime += dt;
 
+	if ( m_pControlMonitor )
+		TakeSocketEvents();
+	TakeLogLines();
+
 	if ( m_controllableID == kInvalidVaneID ) 
 		return;
 	
@@ -348,18 +442,50 @@ void ZMQVideo::Update(TimeValue dt)
 	if ( !pVehicle )
 		return;
 	
-	//Sending the image is dependent on the frame rate and if the user has closed the connection
-	if((frame % (int) (100 / 15) == 0) && running) {
-		//Keep both sockets syncronized
-		zmq::message_t dummy(1);
-		//snprintf((char *) dummy.data(), 5,"%d", frame);
+	//Sending the image is dependent on the frame rate and if the user has closed the connection.
+	//While a recording is replayed the client is left waiting.
+	char received = 0;
+	if((frame % (int) (100 / 15) == 0) && running && !m_replaying) {
+		//Keep both sockets syncronized. The request is also timed so clients can work out our clock.
+		Trace::Span exchangeSpan("control exchange");
+		ClockSync::Request request;
+		request.m_sent = ClockSync::Now();
+		request.m_offset = m_clockSync.GetOffset();
+		request.m_roundTrip = m_clockSync.IsValid() ? m_clockSync.GetRoundTrip() : 0;
+
+		zmq::message_t dummy(ClockSync::kRequestSize);
+		ClockSync::WriteRequest(request, static_cast<uint8_t*>(dummy.data()));
 		socket1_.send(dummy);
 
 		//Recieve a response with the direction the vehicle should move
 		zmq::message_t direction;
 		socket1_.recv(&direction);
-		String command = static_cast<char*>(direction.data());
-		command.resize(1);
+		int64_t replyReceived = ClockSync::Now();
+		exchangeSpan.End();
+
+		if (m_recording.IsOpen())
+			Record(Recording::kRecordControl, direction.data(), direction.size());
+
+		Trace::Span decodeSpan("command decode");
+
+		//Clients that take part in the clock exchange follow the direction with their timestamps
+		ClockSync::Reply reply;
+		if (ClockSync::ReadReply(static_cast<const uint8_t*>(direction.data()), direction.size(), reply)
+			&& reply.m_requestSent == request.m_sent) {
+			m_clockSync.AddSample(reply.m_requestSent, reply.m_received, reply.m_replied, replyReceived);
+			if (reply.m_hasLatency) {
+				m_hasClientLatency = true;
+				m_clientLatency = reply.m_latency;
+				m_clientJitter = reply.m_jitter;
+			}
+			if (replyReceived - m_clientTimingReported >= 10 * 1000000)
+				ReportClientTiming();
+		}
+
+		++m_windowCommands;
+		String command(static_cast<const char*>(direction.data()), direction.size() > 0 ? 1 : 0);
+		if (!command.empty())
+			received = command[0];
 
 		//Set desired speed and yaw based on the direction given
 		if(!command.compare("s")) { 
@@ -410,19 +536,348 @@ void ZMQVideo::Update(TimeValue dt)
 		else if(!command.compare("c")) {
 			//close
 			//Close the socket and continue playing without going through the ZMQ loop
+			StopMonitor();
 			socket1_.close();
 			context_.close();
 			running = false;
 			LogMessage("Connection has been closed. To reconnect please restart ANVEL", kLogMsgWarning);
 		}
 		else {
-			LogMessage("Invalid Direction Received", kLogMsgError);
-			LogMessage(command);
+			m_pLog->Post("Invalid Direction Received", kLogMsgError, command);
+			++m_statInvalidCommands;
 		}
+		decodeSpan.End();
+
+		if (replyReceived - m_statsWindowStart >= 1000000)
+			UpdateStats(replyReceived);
 	}
 	frame++;
 
+	if (m_replaying && !m_replayDone)
+		received = ApplyReplay();
+
+	//Inputs are recorded as they go into the calibration, so a replay repeats it exactly
+	if (m_recording.IsOpen() && (m_recordInput || received != 0 || m_desired_speed != m_appliedSpeed || m_desired_yaw != m_appliedYaw))
+		RecordControlInput(received);
+
 	CalculateControlValues(dt);
+	m_appliedSpeed = m_desired_speed;
+	m_appliedYaw = m_desired_yaw;
+
+	if (m_recording.IsOpen())
+		RecordVehicleState(*pVehicle);
+
+	if (m_replaying && !m_replayDone)
+		CheckReplay(*pVehicle);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool ZMQVideo::StartRecording(const String& base, uint32 segmentMB)
+{
+	StopRecording();
+
+	if (!m_recording.Open(base, segmentMB)) {
+		LogMessage("Failed to start the controller recording " + base, kLogMsgError);
+		return false;
+	}
+
+	//The inputs in effect when the recording starts are where a replay starts from
+	m_recordInput = true;
+
+	LogMessage("Recording commands, control inputs and vehicle state to " + base, kLogMsgSpecial);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::StopRecording()
+{
+	if (!m_recording.IsOpen())
+		return;
+
+	m_recording.Close();
+	LogMessage("Recorded " + StringConverter::ToString(static_cast<uint32>(m_recording.GetRecordCount())) + " controller records to "
+		+ m_recording.GetBase() + " in " + StringConverter::ToString(m_recording.GetSegmentCount()) + " segment(s)");
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::RecordVehicleState(const Vehicles::Vehicle& vehicle)
+{
+	Vector3 position = vehicle.GetPosition();
+	Quaternion orientation = vehicle.GetOrientation();
+
+	Recording::VehicleState state;
+	state.m_position[0] = position.x;
+	state.m_position[1] = position.y;
+	state.m_position[2] = position.z;
+	state.m_orientation[0] = orientation.w;
+	state.m_orientation[1] = orientation.x;
+	state.m_orientation[2] = orientation.y;
+	state.m_orientation[3] = orientation.z;
+	state.m_forwardSpeed = static_cast<float64>(vehicle.GetForwardSpeed());
+	state.m_yawRate = vehicle.GetYawRateAsDouble();
+	state.m_throttle = m_throttle;
+	state.m_steering = m_steering;
+
+	uint8_t payload[Recording::kVehicleStateSize];
+	Recording::WriteVehicleState(state, payload);
+	Record(Recording::kRecordVehicleState, payload, sizeof(payload));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::RecordControlInput(char command)
+{
+	Recording::ControlInput input;
+	input.m_desiredSpeed = m_desired_speed;
+	input.m_desiredYaw = m_desired_yaw;
+	input.m_command = static_cast<uint8_t>(command);
+
+	uint8_t payload[Recording::kControlInputSize];
+	Recording::WriteControlInput(input, payload);
+	Record(Recording::kRecordControlInput, payload, sizeof(payload));
+	m_recordInput = false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::Record(uint32_t kind, const void* pPayload, size_t size)
+{
+	Trace::Span span("record");
+	int64_t simTime = static_cast<int64_t>(m_elapsedTime * 1000000.0 + 0.5);
+	if (!m_recording.Append(kind, 0, 0, simTime, pPayload, size)) {
+		//The writer closes the recording when a write fails, so this is only logged once
+		LogMessage("Failed to write to the controller recording " + m_recording.GetBase() + ", recording stopped after "
+			+ StringConverter::ToString(static_cast<uint32>(m_recording.GetRecordCount())) + " records", kLogMsgError);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool ZMQVideo::StartReplay(const String& base)
+{
+	StopReplay();
+
+	//Only the inputs and the vehicle's path are needed, and they are small enough to hold
+	Recording::Reader reader;
+	if (!reader.Open(base)) {
+		LogMessage("Failed to open the controller recording " + base, kLogMsgError);
+		return false;
+	}
+
+	std::vector<uint8_t> payload;
+	for (uint64_t i = 0; i < reader.GetRecordCount(); ++i) {
+		Recording::RecordInfo info;
+		reader.GetInfo(i, info);
+		if (info.m_kind != Recording::kRecordControlInput && info.m_kind != Recording::kRecordVehicleState)
+			continue;
+
+		if (!reader.Read(i, info, payload) || payload.empty()) {
+			LogMessage("Failed to read record " + StringConverter::ToString(static_cast<uint32>(i)) + " of " + base + ", replaying up to it", kLogMsgWarning);
+			break;
+		}
+
+		Recording::ControlInput input;
+		Recording::VehicleState state;
+		if (info.m_kind == Recording::kRecordControlInput && Recording::ReadControlInput(&payload[0], payload.size(), input))
+			m_replayInputs.push_back(std::make_pair(info.m_simTime, input));
+		else if (info.m_kind == Recording::kRecordVehicleState && Recording::ReadVehicleState(&payload[0], payload.size(), state))
+			m_replayStates.push_back(std::make_pair(info.m_simTime, state));
+	}
+
+	if (m_replayInputs.empty()) {
+		LogMessage(base + " has no control inputs to replay", kLogMsgError);
+		m_replayStates.clear();
+		return false;
+	}
+
+	m_replayBase = base;
+	m_replaying = true;
+	m_replayStarted = false;
+	m_replayDone = false;
+	m_replayNextInput = 0;
+	m_replayNextState = 0;
+	m_replayOffset = 0;
+	m_replayTime = 0;
+	m_replayEnd = m_replayInputs.back().first;
+	if (!m_replayStates.empty())
+		m_replayEnd = std::max(m_replayEnd, m_replayStates.back().first);
+	m_replayMaxError = 0;
+	m_replayLastError = 0;
+	m_replayCompared = 0;
+
+	LogMessage("Replaying " + StringConverter::ToString(static_cast<uint32>(m_replayInputs.size())) + " control inputs from "
+		+ base + " in place of the client", kLogMsgSpecial);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::StopReplay()
+{
+	if (!m_replaying)
+		return;
+
+	if (!m_replayDone) {
+		LogMessage("Controller replay of " + m_replayBase + " stopped after " + StringConverter::ToString(static_cast<uint32>(m_replayNextInput))
+			+ " of " + StringConverter::ToString(static_cast<uint32>(m_replayInputs.size())) + " inputs");
+	}
+
+	m_replaying = false;
+	m_replayInputs.clear();
+	m_replayStates.clear();
+
+	//The client takes over from a standstill
+	m_desired_speed = 0;
+	m_desired_yaw = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+char ZMQVideo::ApplyReplay()
+{
+	int64_t now = static_cast<int64_t>(m_elapsedTime * 1000000.0 + 0.5);
+
+	//The first input goes with the first update, the rest keep their distance from it
+	if (!m_replayStarted) {
+		m_replayOffset = now - m_replayInputs[0].first;
+		m_replayStarted = true;
+	}
+	m_replayTime = now - m_replayOffset;
+
+	char command = 0;
+	while (m_replayNextInput < m_replayInputs.size() && m_replayInputs[m_replayNextInput].first <= m_replayTime) {
+		const Recording::ControlInput& input = m_replayInputs[m_replayNextInput++].second;
+		m_desired_speed = input.m_desiredSpeed;
+		m_desired_yaw = input.m_desiredYaw;
+		command = static_cast<char>(input.m_command);
+	}
+	return command;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::CheckReplay(const Vehicles::Vehicle& vehicle)
+{
+	//States were recorded at the same point of the update as this
+	while (m_replayNextState < m_replayStates.size() && m_replayStates[m_replayNextState].first < m_replayTime)
+		++m_replayNextState;
+
+	if (m_replayNextState < m_replayStates.size() && m_replayStates[m_replayNextState].first == m_replayTime) {
+		const Recording::VehicleState& state = m_replayStates[m_replayNextState++].second;
+		Vector3 position = vehicle.GetPosition();
+		double dx = position.x - state.m_position[0];
+		double dy = position.y - state.m_position[1];
+		double dz = position.z - state.m_position[2];
+		m_replayLastError = sqrt(dx * dx + dy * dy + dz * dz);
+		m_replayMaxError = std::max(m_replayMaxError, m_replayLastError);
+		++m_replayCompared;
+	}
+
+	if (m_replayTime < m_replayEnd)
+		return;
+
+	//Stop the vehicle where the recording ends, the client gets it back with StopControllerReplay
+	m_replayDone = true;
+	m_desired_speed = 0;
+	m_desired_yaw = 0;
+
+	String message = "Replayed " + StringConverter::ToString(static_cast<uint32>(m_replayInputs.size())) + " control inputs from "
+		+ m_replayBase + " over " + StringConverter::ToString((m_replayEnd - m_replayInputs[0].first) / 1000000.0) + " s";
+	if (m_replayCompared > 0) {
+		message += ", the vehicle was at most " + StringConverter::ToString(m_replayMaxError) + " m from the recorded path over "
+			+ StringConverter::ToString(m_replayCompared) + " updates and ended " + StringConverter::ToString(m_replayLastError) + " m from it";
+	}
+	LogMessage(message, kLogMsgSpecial);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::ReportClientTiming()
+{
+	String message = "Client clock offset " + StringConverter::ToString(m_clockSync.GetOffset() / 1000.0)
+		+ " ms, round trip " + StringConverter::ToString(m_clockSync.GetRoundTrip() / 1000.0) + " ms";
+	if (m_hasClientLatency) {
+		message += ", frame latency " + StringConverter::ToString(m_clientLatency / 1000.0)
+			+ " ms, jitter " + StringConverter::ToString(m_clientJitter / 1000.0) + " ms";
+	}
+	LogMessage(message);
+
+	m_clientTimingReported = ClockSync::Now();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::UpdateStats(int64_t now)
+{
+	m_statCommandRate = m_windowCommands * 1000000.0 / (now - m_statsWindowStart);
+	m_statRoundTrip = m_clockSync.GetRoundTrip() / 1000.0;
+	m_statClientLatency = m_clientLatency / 1000.0;
+	m_statClientJitter = m_clientJitter / 1000.0;
+
+	m_windowCommands = 0;
+	m_statsWindowStart = now;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::TakeSocketEvents()
+{
+	std::vector<SocketEvent> events;
+	uint64_t lost = m_pControlMonitor->TakeEvents(events);
+
+	for (size_t i = 0; i < events.size(); ++i) {
+		const SocketEvent& event = events[i];
+		switch (event.m_event) {
+		case ZMQ_EVENT_ACCEPTED:
+			LogMessage("Controller connected on " + event.m_endpoint, kLogMsgSpecial);
+			break;
+		case ZMQ_EVENT_DISCONNECTED:
+			LogMessage("Controller disconnected from " + event.m_endpoint + " after "
+				+ StringConverter::ToString(event.m_duration / 1000000.0) + " s", kLogMsgWarning);
+			break;
+		case ZMQ_EVENT_BIND_FAILED:
+		case ZMQ_EVENT_ACCEPT_FAILED:
+		case ZMQ_EVENT_CLOSE_FAILED:
+			LogMessage(String("Control socket ") + GetSocketEventName(event.m_event) + " on " + event.m_endpoint
+				+ ": " + zmq_strerror(event.m_value), kLogMsgError);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (lost > 0)
+		LogMessage(StringConverter::ToString(static_cast<uint32>(lost)) + " control socket events were not logged", kLogMsgWarning);
+
+	EndpointStats totals = m_pControlMonitor->GetTotals();
+	m_statPeers = totals.m_peers;
+	m_statDisconnects = static_cast<uint32>(totals.m_disconnected);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::TakeLogLines()
+{
+	std::vector<AsyncLog::Line> lines;
+	uint64_t lost = m_pLog->TakeLines(lines);
+
+	for (size_t i = 0; i < lines.size(); ++i)
+		LogMessage(lines[i].m_text, static_cast<LogMsgType>(lines[i].m_type));
+
+	if (lost > 0)
+		LogMessage(StringConverter::ToString(static_cast<uint32>(lost)) + " controller messages were not logged", kLogMsgWarning);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ZMQVideo::StopMonitor()
+{
+	//The monitor has to let go of the control socket before it can be closed
+	delete m_pControlMonitor;
+	m_pControlMonitor = NULL;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -493,6 +948,8 @@ void ZMQVideo::OnAttachedToObject( VaneID objectID )
 
 void ZMQVideo::CalculateControlValues( TimeValue dt )
 {	
+	Trace::Span span("CalculateControlValues");
+
 	// Apply limits and deadzones to desired speed and yaw
 	//m_desired_speed = Math::Clamp(m_desired_speed, -1.0, 2.0);
 	//m_desired_yaw = Math::Clamp(m_desired_yaw, -1.15, 1.15);
@@ -553,6 +1010,39 @@ ZMQVideoFactory::ZMQVideoCommandGroup::ZMQVideoCommandGroup( ZMQVideoFactory& fa
 
 	cmdMgr.RegisterObjectAction( Commands::kCommandUseZMQVideo, Types::Vehicle, 0 );
 
+	Commands::kCommandWriteControllerTrace = cmdMgr.RegisterCommand( "WriteControllerTrace", this );
+	{
+		CommandDescription desc(Commands::kCommandWriteControllerTrace, "Append the controller's recent spans to a Chrome trace (JSON) file.");
+		desc.m_parameters.push_back(ParameterDescription(VariantType::kString, "File", "Trace file to append to."));
+		AddCommand(desc);
+	}
+
+	Commands::kCommandStartControllerRecording = cmdMgr.RegisterCommand( "StartControllerRecording", this );
+	{
+		CommandDescription desc(Commands::kCommandStartControllerRecording, "Record the commands the controller receives and the vehicle's state, for ReplayServer.");
+		desc.m_parameters.push_back(ParameterDescription(VariantType::kString, "File", "Recording name, the segment files are named after it."));
+		AddCommand(desc);
+	}
+
+	Commands::kCommandStopControllerRecording = cmdMgr.RegisterCommand( "StopControllerRecording", this );
+	{
+		CommandDescription desc(Commands::kCommandStopControllerRecording, "Finish the controller recording.");
+		AddCommand(desc);
+	}
+
+	Commands::kCommandStartControllerReplay = cmdMgr.RegisterCommand( "StartControllerReplay", this );
+	{
+		CommandDescription desc(Commands::kCommandStartControllerReplay, "Drive the vehicle from the control inputs of a controller recording instead of the client.");
+		desc.m_parameters.push_back(ParameterDescription(VariantType::kString, "File", "Recording name, as given to StartControllerRecording."));
+		AddCommand(desc);
+	}
+
+	Commands::kCommandStopControllerReplay = cmdMgr.RegisterCommand( "StopControllerReplay", this );
+	{
+		CommandDescription desc(Commands::kCommandStopControllerReplay, "Give the vehicle back to the client.");
+		AddCommand(desc);
+	}
+
 }
 
 CommandResult ZMQVideoFactory::ZMQVideoCommandGroup::HandleCommand( CommandID commandID, const CommandParamList& parameterList )
@@ -581,6 +1071,74 @@ CommandResult ZMQVideoFactory::ZMQVideoCommandGroup::HandleCommand( CommandID co
 			return CommandResult(kCommandFail, kParameterOutsideRange, "No valid vehicle was found with that ID.");
 		}
 	}
+	else if (commandID == Commands::kCommandWriteControllerTrace)
+	{
+		if (parameterList.size() != 1 || parameterList[0].GetType() != VariantType::kString)
+			return CommandResult(kInvalidParameters, "Expected the name of the trace file.");
+
+		uint64_t lost = 0;
+		int64_t written = Trace::Flush(parameterList[0].GetStringValue(), &lost);
+		if (written < 0)
+			return CommandResult(kCommandFail, kParameterOutsideRange, "Could not open " + parameterList[0].GetStringValue());
+
+		LogMessage("Wrote " + StringConverter::ToString(static_cast<uint32>(written)) + " controller spans to "
+			+ parameterList[0].GetStringValue() + ", " + StringConverter::ToString(static_cast<uint32>(lost)) + " were overwritten before the flush");
+		return CommandResult(Success);
+	}
+	else if (commandID == Commands::kCommandStartControllerRecording)
+	{
+		if (parameterList.size() != 1 || parameterList[0].GetType() != VariantType::kString)
+			return CommandResult(kInvalidParameters, "Expected the name of the recording.");
+		if (m_factory.m_ownedControllers.empty())
+			return CommandResult(kCommandFail, kParameterOutsideRange, "There is no ZMQVideo controller to record.");
+
+		//Every controller gets its own recording, numbered after the first
+		uint32 index = 0;
+		for (ControllerPtrMap::iterator it = m_factory.m_ownedControllers.begin(); it != m_factory.m_ownedControllers.end(); ++it, ++index)
+		{
+			String base = parameterList[0].GetStringValue();
+			if (index > 0)
+				base += "-" + StringConverter::ToString(index);
+
+			ZMQVideo& controller = static_cast<ZMQVideo&>(*it->second.Get());
+			if (!controller.StartRecording(base))
+				return CommandResult(kCommandFail, kParameterOutsideRange, "Could not create " + base);
+		}
+		return CommandResult(Success);
+	}
+	else if (commandID == Commands::kCommandStopControllerRecording)
+	{
+		for (ControllerPtrMap::iterator it = m_factory.m_ownedControllers.begin(); it != m_factory.m_ownedControllers.end(); ++it)
+			static_cast<ZMQVideo&>(*it->second.Get()).StopRecording();
+		return CommandResult(Success);
+	}
+	else if (commandID == Commands::kCommandStartControllerReplay)
+	{
+		if (parameterList.size() != 1 || parameterList[0].GetType() != VariantType::kString)
+			return CommandResult(kInvalidParameters, "Expected the name of the recording.");
+		if (m_factory.m_ownedControllers.empty())
+			return CommandResult(kCommandFail, kParameterOutsideRange, "There is no ZMQVideo controller to drive.");
+
+		//Each controller replays the recording StartControllerRecording made for it
+		uint32 index = 0;
+		for (ControllerPtrMap::iterator it = m_factory.m_ownedControllers.begin(); it != m_factory.m_ownedControllers.end(); ++it, ++index)
+		{
+			String base = parameterList[0].GetStringValue();
+			if (index > 0)
+				base += "-" + StringConverter::ToString(index);
+
+			ZMQVideo& controller = static_cast<ZMQVideo&>(*it->second.Get());
+			if (!controller.StartReplay(base))
+				return CommandResult(kCommandFail, kParameterOutsideRange, "Could not replay " + base);
+		}
+		return CommandResult(Success);
+	}
+	else if (commandID == Commands::kCommandStopControllerReplay)
+	{
+		for (ControllerPtrMap::iterator it = m_factory.m_ownedControllers.begin(); it != m_factory.m_ownedControllers.end(); ++it)
+			static_cast<ZMQVideo&>(*it->second.Get()).StopReplay();
+		return CommandResult(Success);
+	}
 
 	return CommandResult(kInvalidCommand);
 }
\ No newline at end of file
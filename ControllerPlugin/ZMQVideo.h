@@ -35,9 +35,11 @@
 #include "Core/ControllerInterface.h"
 #include "Core/Core.h"
 #include "Core/Commands.h"
-#include "Simulation\Renderer.h"
-#include "Simulation\RendererManager.h"
-#include "Simulation\CameraSensor.h"
+#include "Simulation/Renderer.h"
+#include "Simulation/RendererManager.h"
+#include "Simulation/CameraSensor.h"
+#include "../SensorPlugin/ClockSync.h"
+#include "../SensorPlugin/Recording.h"
 
 namespace VANE
 {
@@ -45,6 +47,8 @@ namespace VANE
 	// Forward Declares
 	
 	namespace Vehicles { class Vehicle; }
+	class SocketMonitor;
+	class AsyncLog;
 	
 	//////////////////////////////////////////////////////////////////////////
 	// Types
@@ -60,6 +64,11 @@ namespace VANE
 	namespace Commands
 	{
 		extern CommandID kCommandUseZMQVideo;
+		extern CommandID kCommandWriteControllerTrace;
+		extern CommandID kCommandStartControllerRecording;
+		extern CommandID kCommandStopControllerRecording;
+		extern CommandID kCommandStartControllerReplay;
+		extern CommandID kCommandStopControllerReplay;
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -140,11 +149,39 @@ namespace VANE
 			virtual inline ControllerID GetControllerID() const {return m_id;}
 			virtual inline ControllerID GetBaseControllerID() const { return m_baseID; }
 			virtual void OnAttachedToObject( VaneID objectID );
+
+			/// The client's clock, estimated from the control exchanges
+			const ClockSync::Estimator& GetClockSync() const { return m_clockSync; }
+			/// Connection events on the control socket, NULL if it could not be monitored
+			const SocketMonitor* GetControlMonitor() const { return m_pControlMonitor; }
+
+			/// Record every command received and the vehicle's state each update, see Recording.h
+			bool StartRecording( const String& base, uint32 segmentMB = Recording::kDefaultSegmentMB );
+			void StopRecording();
+			bool IsRecording() const { return m_recording.IsOpen(); }
+
+			/// Drive the vehicle from the control inputs of a recording instead of the client,
+			/// starting with the next update and keeping their spacing in simulation time
+			bool StartReplay( const String& base );
+			void StopReplay();
+			bool IsReplaying() const { return m_replaying; }
 			
 		protected:
 
 			ZMQVideo();
 			void CalculateControlValues( TimeValue dt );
+			void ReportClientTiming();
+			void UpdateStats( int64_t now );
+			void TakeSocketEvents();
+			void TakeLogLines();
+			void StopMonitor();
+			void RecordVehicleState( const Vehicles::Vehicle& vehicle );
+			void RecordControlInput( char command );
+			void Record( uint32_t kind, const void* pPayload, size_t size );
+			/// Apply the inputs that are due, @return the command of the last one applied, 0 if none
+			char ApplyReplay();
+			/// Compare the vehicle with the recorded one at this time, and finish the replay at its end
+			void CheckReplay( const Vehicles::Vehicle& vehicle );
 			
 		protected:
 		
@@ -170,6 +207,48 @@ namespace VANE
 
 			int frame;
 			bool running;
+
+			//Client clock and the frame latency it reports, see ClockSync.h
+			ClockSync::Estimator m_clockSync;
+			bool m_hasClientLatency;
+			int32_t m_clientLatency;
+			int32_t m_clientJitter;
+			int64_t m_clientTimingReported;
+
+			//Control channel health, shown as read-only properties
+			float64 m_statCommandRate;
+			float64 m_statRoundTrip;
+			float64 m_statClientLatency;
+			float64 m_statClientJitter;
+			uint32 m_statInvalidCommands;
+			uint32 m_statPeers;
+			uint32 m_statDisconnects;
+			uint32 m_windowCommands;
+			int64_t m_statsWindowStart;
+
+			SocketMonitor* m_pControlMonitor;
+			AsyncLog* m_pLog;  ///< For errors a client can raise on every exchange, see AsyncLog.h
+
+			Recording::Writer m_recording;
+			bool m_recordInput;      ///< Record the inputs in the next update even if they have not changed
+			double m_appliedSpeed;   ///< Desired speed and yaw as of the last update, to notice changes
+			double m_appliedYaw;
+
+			//Scripted client, see StartReplay
+			bool m_replaying;
+			bool m_replayStarted;
+			bool m_replayDone;
+			String m_replayBase;
+			std::vector< std::pair<int64_t, Recording::ControlInput> > m_replayInputs;
+			std::vector< std::pair<int64_t, Recording::VehicleState> > m_replayStates;
+			size_t m_replayNextInput;
+			size_t m_replayNextState;
+			int64_t m_replayOffset;   ///< Our simulation time less the recording's
+			int64_t m_replayTime;     ///< Position in the recording in this update
+			int64_t m_replayEnd;      ///< Simulation time of the recording's last input or state
+			double m_replayMaxError;  ///< Furthest the vehicle has been from the recorded one, in meters
+			double m_replayLastError;
+			uint32 m_replayCompared;
 		};
 	}
 }
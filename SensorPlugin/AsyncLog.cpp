@@ -0,0 +1,249 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AsyncLog.cpp - Rate-limited logging for messages raised in the hot path.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AsyncLog.h"
+#include "ClockSync.h"
+#include "Trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+namespace VANE
+{
+	//How often the drain thread wakes up, posts never signal it
+	static const int kDrainIntervalMs = 10;
+
+	//////////////////////////////////////////////////////////////////////////
+
+	AsyncLog::AsyncLog( int64_t windowUs, uint32_t burst )
+		: m_windowUs( windowUs )
+		, m_burst( burst )
+		, m_enqueue( 0 )
+		, m_dequeue( 0 )
+		, m_posted( 0 )
+		, m_dropped( 0 )
+		, m_stop( false )
+		, m_lostLines( 0 )
+		, m_droppedTaken( 0 )
+		, m_logged( 0 )
+		, m_suppressed( 0 )
+	{
+		for ( uint64_t i = 0; i < kQueueSize; ++i )
+			m_cells[i].m_sequence.store( i, std::memory_order_relaxed );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	AsyncLog::~AsyncLog()
+	{
+		Stop();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void AsyncLog::Start()
+	{
+		if ( IsRunning() )
+			return;
+
+		m_stop = false;
+		m_thread = std::thread( &AsyncLog::Run, this );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void AsyncLog::Stop()
+	{
+		if ( !IsRunning() )
+			return;
+
+		m_stop = true;
+		m_thread.join();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void AsyncLog::Post( const char* pKey, uint32_t type, const char* pDetail )
+	{
+		m_posted.fetch_add( 1, std::memory_order_relaxed );
+
+		//Claim a cell, its sequence equals the position while it is free for it
+		uint64_t position = m_enqueue.load( std::memory_order_relaxed );
+		Cell* pCell;
+		for ( ;; )
+		{
+			pCell = &m_cells[position & (kQueueSize - 1)];
+			int64_t difference = static_cast<int64_t>( pCell->m_sequence.load( std::memory_order_acquire ) - position );
+			if ( difference == 0 )
+			{
+				if ( m_enqueue.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+					break;
+			}
+			else if ( difference < 0 )
+			{
+				m_dropped.fetch_add( 1, std::memory_order_relaxed );
+				return;
+			}
+			else
+			{
+				position = m_enqueue.load( std::memory_order_relaxed );
+			}
+		}
+
+		pCell->m_pKey = pKey;
+		pCell->m_type = type;
+		pCell->m_time = ClockSync::Now();
+		if ( pDetail )
+		{
+			strncpy( pCell->m_detail, pDetail, kMaxDetail - 1 );
+			pCell->m_detail[kMaxDetail - 1] = 0;
+		}
+		else
+		{
+			pCell->m_detail[0] = 0;
+		}
+
+		pCell->m_sequence.store( position + 1, std::memory_order_release );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void AsyncLog::Run()
+	{
+		Trace::SetThreadName( "Log drain" );
+
+		while ( !m_stop.load( std::memory_order_relaxed ) )
+		{
+			Drain( ClockSync::Now() );
+			std::this_thread::sleep_for( std::chrono::milliseconds( kDrainIntervalMs ) );
+		}
+
+		int64_t now = ClockSync::Now();
+		Drain( now );
+		CloseWindows( now, true );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void AsyncLog::Drain( int64_t now )
+	{
+		for ( ;; )
+		{
+			Cell& cell = m_cells[m_dequeue & (kQueueSize - 1)];
+			if ( cell.m_sequence.load( std::memory_order_acquire ) != m_dequeue + 1 )
+				break;
+
+			const char* pKey = cell.m_pKey;
+			uint32_t type = cell.m_type;
+			int64_t time = cell.m_time;
+			std::string detail( cell.m_detail );
+			cell.m_sequence.store( m_dequeue + kQueueSize, std::memory_order_release );
+			++m_dequeue;
+
+			Window& window = m_windows[WindowKey( pKey, type )];
+			if ( window.m_logged == 0 && window.m_suppressed == 0 )
+				window.m_start = time;
+
+			if ( window.m_logged < m_burst )
+			{
+				++window.m_logged;
+				AddLine( detail.empty() ? std::string( pKey ) : std::string( pKey ) + ": " + detail, type );
+
+				std::lock_guard<std::mutex> lock( m_mutex );
+				++m_logged;
+			}
+			else
+			{
+				++window.m_suppressed;
+				window.m_lastDetail.swap( detail );
+			}
+		}
+
+		CloseWindows( now, false );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void AsyncLog::CloseWindows( int64_t now, bool all )
+	{
+		std::map<WindowKey, Window>::iterator it = m_windows.begin();
+		while ( it != m_windows.end() )
+		{
+			const Window& window = it->second;
+			if ( !all && now - window.m_start < m_windowUs )
+			{
+				++it;
+				continue;
+			}
+
+			if ( window.m_suppressed > 0 )
+			{
+				char summary[96];
+				sprintf( summary, ": repeated %llu more times in %.1f s", static_cast<unsigned long long>( window.m_suppressed ),
+					(now - window.m_start) / 1000000.0 );
+
+				std::string text = std::string( it->first.first ) + summary;
+				if ( !window.m_lastDetail.empty() )
+					text += ", last: " + window.m_lastDetail;
+				AddLine( text, it->first.second );
+
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_suppressed += window.m_suppressed;
+			}
+
+			//The next post with this key starts a new window
+			m_windows.erase( it++ );
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void AsyncLog::AddLine( const std::string& text, uint32_t type )
+	{
+		Line line;
+		line.m_text = text;
+		line.m_type = type;
+
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if ( m_lines.size() >= kMaxLines )
+		{
+			m_lines.pop_front();
+			++m_lostLines;
+		}
+		m_lines.push_back( line );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	uint64_t AsyncLog::TakeLines( std::vector<Line>& lines )
+	{
+		uint64_t dropped = m_dropped.load( std::memory_order_relaxed );
+
+		std::lock_guard<std::mutex> lock( m_mutex );
+		lines.insert( lines.end(), m_lines.begin(), m_lines.end() );
+		m_lines.clear();
+
+		uint64_t lost = m_lostLines + (dropped - m_droppedTaken);
+		m_lostLines = 0;
+		m_droppedTaken = dropped;
+		return lost;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	AsyncLog::Counts AsyncLog::GetCounts() const
+	{
+		Counts counts;
+		counts.m_posted = m_posted.load( std::memory_order_relaxed );
+		counts.m_dropped = m_dropped.load( std::memory_order_relaxed );
+
+		std::lock_guard<std::mutex> lock( m_mutex );
+		counts.m_logged = m_logged;
+		counts.m_suppressed = m_suppressed;
+		return counts;
+	}
+}
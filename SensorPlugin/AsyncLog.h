@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AsyncLog.h - Rate-limited logging for messages raised in the hot path.
+//
+// A client sending garbage, or an encoder failing on every frame, can raise
+// the same error hundreds of times a second from inside the simulation tick,
+// and every ANVEL LogMessage is a synchronous, flushed write. Post() instead
+// copies the message into a bounded lock-free queue and returns; it never
+// blocks or allocates, and when the queue is full the message is counted and
+// dropped. A thread of its own drains the queue, and per message (the key,
+// which must be a string literal) lets the first few through in each window
+// and counts the rest. When the window closes it adds one line saying how
+// many repeats were held back, with the detail of the last one.
+//
+// The resulting lines are queued again for the plugin to hand to ANVEL from
+// its update (the ANVEL logger is not called from other threads), so a storm
+// costs the tick a queue push per event and a few log writes per second.
+//
+// Like FrameRing.h, this header does not depend on any ANVEL headers; types
+// are passed through untouched, so they can be LogMsgType values.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef AsyncLog_h__
+#define AsyncLog_h__
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace VANE
+{
+	class AsyncLog
+	{
+	public:
+		struct Line
+		{
+			std::string m_text;
+			uint32_t    m_type;
+		};
+
+		struct Counts
+		{
+			uint64_t m_posted;
+			uint64_t m_logged;      ///< Lines made from posts, not counting summaries
+			uint64_t m_suppressed;  ///< Repeats held back by the rate limit
+			uint64_t m_dropped;     ///< Posts lost because the queue was full
+		};
+
+		///@param windowUs Length of a rate limit window, in microseconds
+		///@param burst Messages with the same key logged per window before repeats are held back
+		AsyncLog( int64_t windowUs = 1000000, uint32_t burst = 3 );
+		~AsyncLog();
+
+		void Start();
+		///Drains what is left and closes every window, so the last summaries are in TakeLines()
+		void Stop();
+		bool IsRunning() const { return m_thread.joinable(); }
+
+		///Queue a message from any thread, without blocking
+		///@param pKey The message, also what identifies repeats. Kept as a pointer, so it must be a literal.
+		///@param pDetail Appended after ": ", copied and cut to kMaxDetail - 1 characters
+		void Post( const char* pKey, uint32_t type, const char* pDetail = NULL );
+		void Post( const char* pKey, uint32_t type, const std::string& detail ) { Post( pKey, type, detail.c_str() ); }
+
+		///Move the lines ready to log into lines
+		///@return messages lost, because the queue was full or nobody took the lines in time
+		uint64_t TakeLines( std::vector<Line>& lines );
+
+		Counts GetCounts() const;
+
+	private:
+		enum { kQueueSize = 1024, kMaxDetail = 96, kMaxLines = 256 };
+
+		struct Cell
+		{
+			std::atomic<uint64_t> m_sequence;
+			const char* m_pKey;
+			uint32_t    m_type;
+			int64_t     m_time;
+			char        m_detail[kMaxDetail];
+		};
+
+		struct Window
+		{
+			Window() : m_start( 0 ), m_logged( 0 ), m_suppressed( 0 ) { }
+
+			int64_t     m_start;
+			uint32_t    m_logged;
+			uint64_t    m_suppressed;
+			std::string m_lastDetail;
+		};
+
+		typedef std::pair<const char*, uint32_t> WindowKey;
+
+		void Run();
+		void Drain( int64_t now );
+		void CloseWindows( int64_t now, bool all );
+		void AddLine( const std::string& text, uint32_t type );
+
+		const int64_t  m_windowUs;
+		const uint32_t m_burst;
+
+		//Bounded MPMC queue (Vyukov), only the drain thread dequeues
+		Cell m_cells[kQueueSize];
+		std::atomic<uint64_t> m_enqueue;
+		uint64_t m_dequeue;
+
+		std::atomic<uint64_t> m_posted;
+		std::atomic<uint64_t> m_dropped;
+		std::atomic<bool> m_stop;
+		std::thread m_thread;
+
+		//Drain thread only
+		std::map<WindowKey, Window> m_windows;
+
+		mutable std::mutex m_mutex;
+		std::deque<Line> m_lines;
+		uint64_t m_lostLines;
+		uint64_t m_droppedTaken;  ///< Drops already returned by TakeLines()
+		uint64_t m_logged;
+		uint64_t m_suppressed;
+	};
+}
+
+#endif // AsyncLog_h__
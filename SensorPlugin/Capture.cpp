@@ -0,0 +1,708 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Capture.cpp - Dataset capture of every camera frame at the full sample rate.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "Capture.h"
+#include "ClockSync.h"
+#include "Trace.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#undef min
+#undef max
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VANE
+{
+	namespace Recording
+	{
+		//Unbuffered writes start and end on a multiple of the sector size, which is at most this
+		static const size_t kBlockSize = 4096;
+
+		//A batch this old is handed to the writer on the next Append() even if it is not full
+		static const int64_t kFlushAgeUs = 250000;
+
+		static uint8_t* AllocateBlocks( size_t size )
+		{
+#ifdef _WIN32
+			return static_cast<uint8_t*>( _aligned_malloc( size, kBlockSize ) );
+#else
+			void* p = NULL;
+			return posix_memalign( &p, kBlockSize, size ) == 0 ? static_cast<uint8_t*>( p ) : NULL;
+#endif
+		}
+
+		static void FreeBlocks( uint8_t* p )
+		{
+#ifdef _WIN32
+			_aligned_free( p );
+#else
+			free( p );
+#endif
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		CaptureWriter::CaptureWriter()
+			: m_segmentLimit( 0 )
+			, m_batchSize( 0 )
+			, m_pCurrent( NULL )
+			, m_segment( 0 )
+			, m_segmentOffset( 0 )
+			, m_sequence( 0 )
+			, m_dropped( 0 )
+			, m_peakQueued( 0 )
+			, m_stop( false )
+			, m_failed( false )
+			, m_bytesWritten( 0 )
+			, m_segmentsOpened( 0 )
+			, m_unbuffered( false )
+			, m_openSegment( 0 )
+			, m_openSize( 0 )
+#ifdef _WIN32
+			, m_hData( INVALID_HANDLE_VALUE )
+#else
+			, m_fd( -1 )
+#endif
+			, m_pIndex( NULL )
+		{
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		CaptureWriter::~CaptureWriter()
+		{
+			Close();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureWriter::Open( const std::string& base, uint32_t segmentMB, uint32_t batchMB, uint32_t queueMB )
+		{
+			Close();
+			RemoveRecording( base );
+
+			m_base = base;
+			m_segmentLimit = static_cast<uint64_t>( segmentMB > 0 ? segmentMB : kDefaultCaptureSegmentMB ) << 20;
+			m_batchSize = static_cast<size_t>( batchMB > 0 ? batchMB : kDefaultCaptureBatchMB ) << 20;
+
+			//One to fill, one being written and at least one waiting
+			size_t count = queueMB / (m_batchSize >> 20);
+			if ( count < 3 )
+				count = 3;
+
+			for ( size_t i = 0; i < count; ++i )
+			{
+				Batch* pBatch = new Batch();
+				pBatch->m_pData = AllocateBlocks( m_batchSize );
+				if ( !pBatch->m_pData )
+				{
+					delete pBatch;
+					break;
+				}
+				pBatch->m_index.reserve( 1024 * kIndexEntrySize );
+				m_batches.push_back( pBatch );
+			}
+			if ( m_batches.size() < count )
+			{
+				Close();
+				return false;
+			}
+
+			m_free.assign( m_batches.begin(), m_batches.end() );
+			m_queue.clear();
+			m_peakQueued = 0;
+			m_stop = false;
+			m_failed = false;
+			m_bytesWritten = 0;
+			m_segmentsOpened = 0;
+			m_unbuffered = false;
+			m_sequence = 0;
+			m_dropped = 0;
+
+			TakeBatch();
+			StartSegment( 0 );
+
+			m_thread = std::thread( &CaptureWriter::Run, this );
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureWriter::Close()
+		{
+			if ( IsOpen() )
+			{
+				if ( m_pCurrent )
+					HandOver( true );
+				{
+					std::lock_guard<std::mutex> lock( m_mutex );
+					m_stop = true;
+				}
+				m_wake.notify_one();
+				m_thread.join();
+			}
+
+			for ( size_t i = 0; i < m_batches.size(); ++i )
+			{
+				FreeBlocks( m_batches[i]->m_pData );
+				delete m_batches[i];
+			}
+			m_batches.clear();
+			m_free.clear();
+			m_queue.clear();
+			m_pCurrent = NULL;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureWriter::Append( uint32_t kind, uint32_t format, uint32_t channel, uint32_t lens, int64_t simTime,
+			const void* pHead, size_t headSize, const void* pPayload, size_t size )
+		{
+			if ( !IsOpen() || HasFailed() )
+			{
+				++m_dropped;
+				return false;
+			}
+
+			int64_t now = ClockSync::Now();
+			size_t freeCount = GetFreeCount();
+			if ( m_pCurrent->m_started != 0 && now - m_pCurrent->m_started >= kFlushAgeUs && freeCount > 0 )
+			{
+				HandOver( false );
+				--freeCount;
+			}
+
+			//A record is never split between segments, so a big one can take a segment past the limit
+			uint64_t recordSize = kRecordHeaderSize + headSize + size;
+			bool newSegment = m_segmentOffset > kFileHeaderSize && m_segmentOffset + recordSize > m_segmentLimit;
+
+			//Every batch the record fills up is handed over, and needs a free one to carry on in
+			uint64_t start = newSegment ? kFileHeaderSize : m_pCurrent->m_used;
+			uint64_t needed = (newSegment ? 1 : 0) + (start + recordSize) / m_batchSize;
+			if ( needed > freeCount )
+			{
+				++m_dropped;
+				return false;
+			}
+
+			if ( newSegment )
+			{
+				HandOver( true );
+				TakeBatch();
+				StartSegment( m_segment + 1 );
+			}
+
+			RecordInfo info;
+			info.m_kind = kind;
+			info.m_format = format;
+			info.m_channel = channel;
+			info.m_lens = lens;
+			info.m_size = static_cast<uint32_t>( headSize + size );
+			info.m_sequence = m_sequence;
+			info.m_simTime = simTime;
+			info.m_wallTime = now;
+
+			uint8_t header[kRecordHeaderSize];
+			WriteRecordHeader( info, header );
+			uint8_t entry[kIndexEntrySize];
+			WriteIndexEntry( m_segmentOffset, info, entry );
+
+			if ( m_pCurrent->m_started == 0 )
+				m_pCurrent->m_started = now;
+			Copy( header, sizeof(header) );
+			Copy( pHead, headSize );
+			Copy( pPayload, size );
+
+			//The entry goes with the batch the record ends in, which is written after the rest of it
+			m_pCurrent->m_index.insert( m_pCurrent->m_index.end(), entry, entry + sizeof(entry) );
+
+			m_segmentOffset += recordSize;
+			++m_sequence;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		CaptureWriter::Counts CaptureWriter::GetCounts() const
+		{
+			Counts counts;
+			counts.m_records = m_sequence;
+			counts.m_dropped = m_dropped;
+			counts.m_bytesWritten = m_bytesWritten.load( std::memory_order_relaxed );
+			counts.m_segments = m_segmentsOpened.load( std::memory_order_relaxed );
+			counts.m_unbuffered = m_unbuffered.load( std::memory_order_relaxed );
+
+			std::lock_guard<std::mutex> lock( m_mutex );
+			counts.m_peakQueued = m_peakQueued;
+			return counts;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureWriter::TakeBatch()
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			if ( m_free.empty() )
+				return false;
+
+			m_pCurrent = m_free.back();
+			m_free.pop_back();
+
+			m_pCurrent->m_used = 0;
+			m_pCurrent->m_endsSegment = false;
+			m_pCurrent->m_started = 0;
+			m_pCurrent->m_index.clear();
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureWriter::StartSegment( uint32_t segment )
+		{
+			m_segment = segment;
+			m_pCurrent->m_segment = segment;
+			m_pCurrent->m_fileOffset = 0;
+			WriteFileHeader( kSegmentMagic, segment, m_pCurrent->m_pData );
+			m_pCurrent->m_used = kFileHeaderSize;
+			m_segmentOffset = kFileHeaderSize;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureWriter::HandOver( bool endsSegment )
+		{
+			Batch* pDone = m_pCurrent;
+			pDone->m_endsSegment = endsSegment;
+			m_pCurrent = NULL;
+
+			//The next batch carries on in the same segment from the last block boundary, and
+			//the writer writes that block again with it. The writer only touches the padding
+			//after m_used meanwhile.
+			if ( !endsSegment && TakeBatch() )
+			{
+				size_t carried = pDone->m_used & (kBlockSize - 1);
+				size_t aligned = pDone->m_used - carried;
+				m_pCurrent->m_segment = pDone->m_segment;
+				m_pCurrent->m_fileOffset = pDone->m_fileOffset + aligned;
+				memcpy( m_pCurrent->m_pData, pDone->m_pData + aligned, carried );
+				m_pCurrent->m_used = carried;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_queue.push_back( pDone );
+				if ( m_queue.size() > m_peakQueued )
+					m_peakQueued = static_cast<uint32_t>( m_queue.size() );
+			}
+			m_wake.notify_one();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureWriter::Copy( const void* pData, size_t size )
+		{
+			const uint8_t* p = static_cast<const uint8_t*>( pData );
+			while ( size > 0 )
+			{
+				size_t room = m_batchSize - m_pCurrent->m_used;
+				size_t chunk = size < room ? size : room;
+				memcpy( m_pCurrent->m_pData + m_pCurrent->m_used, p, chunk );
+				m_pCurrent->m_used += chunk;
+				p += chunk;
+				size -= chunk;
+
+				if ( m_pCurrent->m_used == m_batchSize )
+					HandOver( false );
+			}
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		size_t CaptureWriter::GetFreeCount()
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			return m_free.size();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureWriter::Run()
+		{
+			Trace::SetThreadName( "Capture writer" );
+
+			for ( ;; )
+			{
+				Batch* pBatch;
+				{
+					std::unique_lock<std::mutex> lock( m_mutex );
+					while ( m_queue.empty() && !m_stop )
+						m_wake.wait( lock );
+					if ( m_queue.empty() )
+						break;
+
+					pBatch = m_queue.front();
+					m_queue.pop_front();
+				}
+
+				//After a failure the batches are only given back, so Append() sees the failure and not a full queue
+				if ( !HasFailed() && !WriteBatch( *pBatch ) )
+				{
+					m_failed = true;
+					CloseSegment( m_openSize );
+				}
+
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_free.push_back( pBatch );
+			}
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureWriter::WriteBatch( Batch& batch )
+		{
+			Trace::Span span( "capture write" );
+
+			if ( !IsSegmentOpen() || batch.m_segment != m_openSegment )
+			{
+				CloseSegment( m_openSize );
+				if ( !OpenSegment( batch.m_segment ) )
+					return false;
+			}
+
+			size_t length = (batch.m_used + kBlockSize - 1) & ~(kBlockSize - 1);
+			memset( batch.m_pData + batch.m_used, 0, length - batch.m_used );
+			if ( length > 0 && !WriteAt( batch.m_pData, length, batch.m_fileOffset ) )
+				return false;
+
+			//Only now are the records the entries name on the disk
+			if ( !batch.m_index.empty()
+				&& (fwrite( &batch.m_index[0], batch.m_index.size(), 1, m_pIndex ) != 1 || fflush( m_pIndex ) != 0) )
+				return false;
+
+			uint64_t end = batch.m_fileOffset + batch.m_used;
+			if ( end > m_openSize )
+			{
+				m_bytesWritten.fetch_add( end - m_openSize, std::memory_order_relaxed );
+				m_openSize = end;
+			}
+
+			if ( batch.m_endsSegment )
+				CloseSegment( m_openSize );
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureWriter::OpenSegment( uint32_t segment )
+		{
+			std::string fileName = GetSegmentFileName( m_base, segment );
+
+#ifdef _WIN32
+			//Not every volume takes unbuffered writes
+			bool unbuffered = true;
+			m_hData = CreateFileA( fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS,
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, NULL );
+			if ( m_hData == INVALID_HANDLE_VALUE )
+			{
+				unbuffered = false;
+				m_hData = CreateFileA( fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS,
+					FILE_ATTRIBUTE_NORMAL, NULL );
+			}
+			if ( m_hData == INVALID_HANDLE_VALUE )
+				return false;
+
+			//Reserve the whole segment so it is not extended a batch at a time. The size stays
+			//at what has been written, so a reader never takes the reserved space for records.
+			FILE_ALLOCATION_INFO allocation;
+			allocation.AllocationSize.QuadPart = static_cast<LONGLONG>( m_segmentLimit );
+			SetFileInformationByHandle( m_hData, FileAllocationInfo, &allocation, sizeof(allocation) );
+#else
+			bool unbuffered = false;
+#ifdef O_DIRECT
+			//tmpfs and some others refuse O_DIRECT
+			m_fd = open( fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644 );
+			unbuffered = m_fd >= 0;
+#endif
+			if ( m_fd < 0 )
+				m_fd = open( fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+			if ( m_fd < 0 )
+				return false;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+			//Reserve the whole segment so it is not extended a batch at a time. The size stays
+			//at what has been written, so a reader never takes the reserved space for records.
+			fallocate( m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>( m_segmentLimit ) );
+#endif
+#endif
+			m_unbuffered = unbuffered;
+
+			m_pIndex = fopen( GetIndexFileName( m_base, segment ).c_str(), "wb" );
+			uint8_t header[kFileHeaderSize];
+			WriteFileHeader( kIndexMagic, segment, header );
+			if ( !m_pIndex || fwrite( header, sizeof(header), 1, m_pIndex ) != 1 || fflush( m_pIndex ) != 0 )
+			{
+				CloseSegment( 0 );
+				return false;
+			}
+
+			m_openSegment = segment;
+			m_openSize = 0;
+			++m_segmentsOpened;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureWriter::CloseSegment( uint64_t size )
+		{
+			//Trim the padding of the last block, and with it the space reserved and not used
+#ifdef _WIN32
+			if ( m_hData != INVALID_HANDLE_VALUE )
+			{
+				FILE_END_OF_FILE_INFO end;
+				end.EndOfFile.QuadPart = static_cast<LONGLONG>( size );
+				SetFileInformationByHandle( m_hData, FileEndOfFileInfo, &end, sizeof(end) );
+				CloseHandle( m_hData );
+				m_hData = INVALID_HANDLE_VALUE;
+			}
+#else
+			if ( m_fd >= 0 )
+			{
+				if ( ftruncate( m_fd, static_cast<off_t>( size ) ) != 0 )
+				{
+					//The padding is zeros past the last index entry, readers do not look at it
+				}
+				close( m_fd );
+				m_fd = -1;
+			}
+#endif
+
+			if ( m_pIndex )
+				fclose( m_pIndex );
+			m_pIndex = NULL;
+			m_openSize = 0;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureWriter::IsSegmentOpen() const
+		{
+#ifdef _WIN32
+			return m_hData != INVALID_HANDLE_VALUE;
+#else
+			return m_fd >= 0;
+#endif
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureWriter::WriteAt( const uint8_t* pData, size_t size, uint64_t offset )
+		{
+#ifdef _WIN32
+			while ( size > 0 )
+			{
+				OVERLAPPED overlapped;
+				memset( &overlapped, 0, sizeof(overlapped) );
+				overlapped.Offset = static_cast<DWORD>( offset );
+				overlapped.OffsetHigh = static_cast<DWORD>( offset >> 32 );
+
+				DWORD written = 0;
+				if ( !WriteFile( m_hData, pData, static_cast<DWORD>( size ), &written, &overlapped ) || written == 0 )
+					return false;
+				pData += written;
+				offset += written;
+				size -= written;
+			}
+			return true;
+#else
+			while ( size > 0 )
+			{
+				ssize_t written = pwrite( m_fd, pData, size, static_cast<off_t>( offset ) );
+				if ( written < 0 && errno == EINTR )
+					continue;
+#ifdef O_DIRECT
+				//Some file systems open with O_DIRECT and then refuse the writes
+				if ( written < 0 && errno == EINVAL && m_unbuffered )
+				{
+					fcntl( m_fd, F_SETFL, fcntl( m_fd, F_GETFL ) & ~O_DIRECT );
+					m_unbuffered = false;
+					continue;
+				}
+#endif
+				if ( written <= 0 )
+					return false;
+				pData += written;
+				offset += static_cast<uint64_t>( written );
+				size -= static_cast<size_t>( written );
+			}
+			return true;
+#endif
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// CaptureEncoder
+
+		CaptureEncoder::CaptureEncoder()
+			: m_pCapture( NULL )
+			, m_queueLimit( 0 )
+			, m_queuedBytes( 0 )
+			, m_stop( false )
+			, m_dropped( 0 )
+			, m_failed( 0 )
+		{
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		CaptureEncoder::~CaptureEncoder()
+		{
+			Close();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureEncoder::Open( CaptureWriter& capture, const FrameEncoderParams& params, uint32_t queueMB )
+		{
+			Close();
+			if ( !capture.IsOpen() )
+				return false;
+
+			m_pCapture = &capture;
+			m_params = params;
+			m_queueLimit = static_cast<size_t>( queueMB > 0 ? queueMB : kDefaultCaptureEncodeQueueMB ) << 20;
+			m_queuedBytes = 0;
+			m_stop = false;
+			m_dropped = 0;
+			m_failed = 0;
+
+			m_thread = std::thread( &CaptureEncoder::Run, this );
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureEncoder::Close()
+		{
+			if ( IsOpen() )
+			{
+				{
+					std::lock_guard<std::mutex> lock( m_mutex );
+					m_stop = true;
+				}
+				m_wake.notify_one();
+				m_thread.join();
+			}
+
+			for ( size_t i = 0; i < m_free.size(); ++i )
+				delete m_free[i];
+			m_free.clear();
+
+			for ( std::map<std::pair<uint32_t, uint32_t>, IFrameEncoder*>::iterator it = m_encoders.begin(); it != m_encoders.end(); ++it )
+				delete it->second;
+			m_encoders.clear();
+			m_pCapture = NULL;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool CaptureEncoder::Submit( uint32_t channel, uint32_t lens, int64_t simTime, const uint8_t* pPixels, uint32_t width, uint32_t height )
+		{
+			const size_t size = static_cast<size_t>( width ) * height * 3;
+
+			Frame* pFrame = NULL;
+			{
+				std::lock_guard<std::mutex> lock( m_mutex );
+				if ( m_queuedBytes + size > m_queueLimit && !m_queue.empty() )
+				{
+					m_dropped.fetch_add( 1, std::memory_order_relaxed );
+					return false;
+				}
+				m_queuedBytes += size;
+
+				if ( !m_free.empty() )
+				{
+					pFrame = m_free.back();
+					m_free.pop_back();
+				}
+			}
+
+			//Frames are reused, only the first few at a new size allocate
+			if ( !pFrame )
+				pFrame = new Frame();
+			pFrame->m_pixels.assign( pPixels, pPixels + size );
+			pFrame->m_channel = channel;
+			pFrame->m_lens = lens;
+			pFrame->m_width = width;
+			pFrame->m_height = height;
+			pFrame->m_simTime = simTime;
+
+			{
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_queue.push_back( pFrame );
+			}
+			m_wake.notify_one();
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureEncoder::Run()
+		{
+			Trace::SetThreadName( "Capture encoder" );
+
+			for ( ;; )
+			{
+				Frame* pFrame;
+				{
+					std::unique_lock<std::mutex> lock( m_mutex );
+					while ( m_queue.empty() && !m_stop )
+						m_wake.wait( lock );
+					if ( m_queue.empty() )
+						break;
+
+					pFrame = m_queue.front();
+					m_queue.pop_front();
+				}
+
+				Encode( *pFrame );
+
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_queuedBytes -= pFrame->m_pixels.size();
+				m_free.push_back( pFrame );
+			}
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void CaptureEncoder::Encode( const Frame& frame )
+		{
+			IFrameEncoder*& pEncoder = m_encoders[std::make_pair( frame.m_channel, frame.m_lens )];
+			if ( !pEncoder )
+				pEncoder = CreateFrameEncoder( m_params );
+
+			if ( !pEncoder || !pEncoder->Encode( &frame.m_pixels[0], frame.m_width, frame.m_height, 3, m_encoded ) )
+			{
+				m_failed.fetch_add( 1, std::memory_order_relaxed );
+				return;
+			}
+			if ( m_encoded.empty() )
+				return;
+
+			//The writer counts what it drops
+			m_pCapture->Append( kRecordFrame, m_params.m_codec, frame.m_channel, frame.m_lens, frame.m_simTime,
+				NULL, 0, &m_encoded[0], m_encoded.size() );
+		}
+	}
+}
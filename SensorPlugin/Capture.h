@@ -0,0 +1,231 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Capture.h - Dataset capture of every camera frame at the full sample rate.
+//
+// Recording::Writer is fine for the frames the sensor streams, but capturing
+// every lens of every camera, raw, runs to hundreds of megabytes a second and
+// stdio writes from the simulation tick would stall it. CaptureWriter writes
+// the same recording format (see Recording.h, so Recording::Reader and
+// ReplayServer read captures too) in two halves.
+//
+// Append() only copies the record into a batch buffer. Full batches, and
+// batches older than a quarter of a second, go on a queue to a writer thread,
+// which writes them with one call each to segment files preallocated to the
+// segment size, opened unbuffered (FILE_FLAG_NO_BUFFERING, O_DIRECT) so the
+// data does not pass through the page cache on its way. Unbuffered writes
+// have to start and end on a block boundary, so a batch handed over part full
+// is written padded to the next block, and the next batch begins with that
+// last block again. The writer writes each batch's index entries once the
+// batch is on disk and trims the padding off a segment when it is finished.
+//
+// The buffers are all allocated up front, and when the disk falls behind and
+// none is free Append() drops the record and counts it rather than wait, so a
+// capture never changes the simulation's timing. Only one thread may call
+// Append(): the simulation thread, or the CaptureEncoder's.
+//
+// An encoded capture costs far more than the copy, too much for the tick at
+// the sample rate with a few cameras. CaptureEncoder takes the frames off the
+// simulation thread the same way: Submit() copies the pixels into a queue,
+// and a thread of its own encodes them in order, one encoder per lens, and
+// appends them to the writer. Past queueMB of frames waiting to be encoded it
+// drops the new ones, so a codec that can not keep up costs frames, not
+// simulation time.
+//
+// Like FrameRing.h, this header does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Capture_h__
+#define Capture_h__
+
+#include "Recording.h"
+#include "FrameCodec.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace VANE
+{
+	namespace Recording
+	{
+		const uint32_t kDefaultCaptureSegmentMB = 1024;
+		const uint32_t kDefaultCaptureBatchMB   = 8;
+		const uint32_t kDefaultCaptureQueueMB   = 256;
+		const uint32_t kDefaultCaptureEncodeQueueMB = 128;
+
+		class CaptureWriter
+		{
+		public:
+			struct Counts
+			{
+				uint64_t m_records;       ///< Appended, including those not written yet
+				uint64_t m_dropped;       ///< Records dropped because no buffer was free, or after a write failed
+				uint64_t m_bytesWritten;  ///< Bytes of records on disk
+				uint32_t m_segments;
+				uint32_t m_peakQueued;    ///< Most batches waiting for the writer at once
+				bool     m_unbuffered;    ///< The segments are written without the page cache
+			};
+
+			CaptureWriter();
+			~CaptureWriter();
+
+			///Start a capture. Segments left by an earlier recording of the same name are deleted.
+			///@param segmentMB Size the segment files are preallocated to, the next record after it starts a new one
+			///@param batchMB Size of a batch buffer, the most written in one call
+			///@param queueMB Memory for batch buffers, which sets how far the disk can fall behind
+			bool Open( const std::string& base, uint32_t segmentMB = kDefaultCaptureSegmentMB,
+				uint32_t batchMB = kDefaultCaptureBatchMB, uint32_t queueMB = kDefaultCaptureQueueMB );
+			///Write out what is left, wait for the writer and free the buffers
+			void Close();
+
+			bool IsOpen() const { return m_thread.joinable(); }
+			const std::string& GetBase() const { return m_base; }
+			///A write failed, the capture has stopped and the files end at the last complete batch
+			bool HasFailed() const { return m_failed.load( std::memory_order_relaxed ); }
+
+			///Copy a record into the current batch, the payload is pHead followed by pPayload
+			///@return false if it was dropped
+			bool Append( uint32_t kind, uint32_t format, uint32_t channel, uint32_t lens, int64_t simTime,
+				const void* pHead, size_t headSize, const void* pPayload, size_t size );
+
+			Counts GetCounts() const;
+
+		private:
+			CaptureWriter( const CaptureWriter& );
+			CaptureWriter& operator=( const CaptureWriter& );
+
+			struct Batch
+			{
+				uint8_t* m_pData;
+				size_t   m_used;
+				uint32_t m_segment;
+				uint64_t m_fileOffset;       ///< Where m_pData[0] goes in the segment, always block aligned
+				bool     m_endsSegment;      ///< The segment ends with this batch
+				int64_t  m_started;          ///< ClockSync::Now() of the first record in it
+				std::vector<uint8_t> m_index;  ///< Entries of the records that end in this batch
+			};
+
+			//Simulation thread
+			bool TakeBatch();
+			void StartSegment( uint32_t segment );
+			void HandOver( bool endsSegment );
+			void Copy( const void* pData, size_t size );
+			size_t GetFreeCount();
+
+			//Writer thread
+			void Run();
+			bool WriteBatch( Batch& batch );
+			bool OpenSegment( uint32_t segment );
+			void CloseSegment( uint64_t size );
+			bool IsSegmentOpen() const;
+			bool WriteAt( const uint8_t* pData, size_t size, uint64_t offset );
+
+			std::string m_base;
+			uint64_t m_segmentLimit;
+			size_t   m_batchSize;
+			std::vector<Batch*> m_batches;  ///< Every buffer, for freeing them
+
+			//Simulation thread only
+			Batch*   m_pCurrent;
+			uint32_t m_segment;
+			uint64_t m_segmentOffset;  ///< End of the current segment's records
+			uint64_t m_sequence;
+			uint64_t m_dropped;
+
+			//Shared, under m_mutex
+			mutable std::mutex m_mutex;
+			std::condition_variable m_wake;
+			std::vector<Batch*> m_free;
+			std::deque<Batch*>  m_queue;
+			uint32_t m_peakQueued;
+			bool     m_stop;
+
+			std::atomic<bool> m_failed;
+			std::atomic<uint64_t> m_bytesWritten;
+			std::atomic<uint32_t> m_segmentsOpened;
+			std::atomic<bool> m_unbuffered;
+			std::thread m_thread;
+
+			//Writer thread only
+			uint32_t m_openSegment;
+			uint64_t m_openSize;      ///< Bytes on disk in the open segment, without the padding
+#ifdef _WIN32
+			void*    m_hData;
+#else
+			int      m_fd;
+#endif
+			FILE*    m_pIndex;
+		};
+
+		///Encodes captured frames on a thread of its own and appends them to a CaptureWriter
+		class CaptureEncoder
+		{
+		public:
+			CaptureEncoder();
+			~CaptureEncoder();
+
+			///Start encoding into an open capture, only the encoder may append to it until Close()
+			///@param queueMB Memory for frames waiting to be encoded
+			bool Open( CaptureWriter& capture, const FrameEncoderParams& params, uint32_t queueMB = kDefaultCaptureEncodeQueueMB );
+			///Encode what is queued and stop, before the capture is closed
+			void Close();
+
+			bool IsOpen() const { return m_thread.joinable(); }
+
+			///Copy a frame of RGB pixels to be encoded, from the simulation thread
+			///@return false if it was dropped because the encoder is too far behind
+			bool Submit( uint32_t channel, uint32_t lens, int64_t simTime, const uint8_t* pPixels, uint32_t width, uint32_t height );
+
+			///Frames dropped because the queue was full
+			uint64_t GetDropped() const { return m_dropped.load( std::memory_order_relaxed ); }
+			///Frames the codec failed on
+			uint64_t GetFailed() const { return m_failed.load( std::memory_order_relaxed ); }
+
+		private:
+			CaptureEncoder( const CaptureEncoder& );
+			CaptureEncoder& operator=( const CaptureEncoder& );
+
+			struct Frame
+			{
+				std::vector<uint8_t> m_pixels;
+				uint32_t m_channel;
+				uint32_t m_lens;
+				uint32_t m_width;
+				uint32_t m_height;
+				int64_t  m_simTime;
+			};
+
+			void Run();
+			void Encode( const Frame& frame );
+
+			CaptureWriter*     m_pCapture;
+			FrameEncoderParams m_params;
+			size_t             m_queueLimit;
+
+			//Shared, under m_mutex
+			std::mutex m_mutex;
+			std::condition_variable m_wake;
+			std::deque<Frame*>  m_queue;
+			std::vector<Frame*> m_free;    ///< Frames to reuse, their pixels already allocated
+			size_t   m_queuedBytes;
+			bool     m_stop;
+
+			std::atomic<uint64_t> m_dropped;
+			std::atomic<uint64_t> m_failed;
+			std::thread m_thread;
+
+			//Encoder thread only
+			std::map<std::pair<uint32_t, uint32_t>, IFrameEncoder*> m_encoders;  ///< By camera and lens
+			std::vector<uint8_t> m_encoded;
+		};
+	}
+}
+
+#endif // Capture_h__
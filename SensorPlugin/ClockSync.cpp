@@ -0,0 +1,195 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// ClockSync.cpp - Frame capture timestamps and client clock estimation.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "ClockSync.h"
+
+#include <chrono>
+
+namespace VANE
+{
+	namespace ClockSync
+	{
+		static inline void Put32( uint8_t*& p, uint32_t value )
+		{
+			for ( int i = 0; i < 4; ++i )
+				*p++ = static_cast<uint8_t>( value >> (8 * i) );
+		}
+
+		static inline void Put64( uint8_t*& p, int64_t value )
+		{
+			uint64_t bits = static_cast<uint64_t>( value );
+			for ( int i = 0; i < 8; ++i )
+				*p++ = static_cast<uint8_t>( bits >> (8 * i) );
+		}
+
+		static inline uint32_t Get32( const uint8_t*& p )
+		{
+			uint32_t value = 0;
+			for ( int i = 0; i < 4; ++i )
+				value |= static_cast<uint32_t>( *p++ ) << (8 * i);
+			return value;
+		}
+
+		static inline int64_t Get64( const uint8_t*& p )
+		{
+			uint64_t bits = 0;
+			for ( int i = 0; i < 8; ++i )
+				bits |= static_cast<uint64_t>( *p++ ) << (8 * i);
+			return static_cast<int64_t>( bits );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		int64_t Now()
+		{
+			return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Frame trailer
+
+		void WriteTrailer( const FrameTimes& times, uint8_t* pTrailer )
+		{
+			Put64( pTrailer, times.m_captured );
+			Put64( pTrailer, times.m_encoded );
+			Put32( pTrailer, times.m_sequence );
+			Put32( pTrailer, kTrailerMagic );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool ReadTrailer( const uint8_t* pFrame, size_t size, FrameTimes& times )
+		{
+			if ( size < kTrailerSize )
+				return false;
+
+			const uint8_t* p = pFrame + size - kTrailerSize;
+			times.m_captured = Get64( p );
+			times.m_encoded  = Get64( p );
+			times.m_sequence = Get32( p );
+			return Get32( p ) == kTrailerMagic;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Control channel
+
+		void WriteRequest( const Request& request, uint8_t* pMessage )
+		{
+			*pMessage++ = kSyncMarker;
+			Put64( pMessage, request.m_sent );
+			Put64( pMessage, request.m_offset );
+			Put64( pMessage, request.m_roundTrip );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool ReadRequest( const uint8_t* pMessage, size_t size, Request& request )
+		{
+			if ( size < kRequestSize || pMessage[0] != kSyncMarker )
+				return false;
+
+			const uint8_t* p = pMessage + 1;
+			request.m_sent      = Get64( p );
+			request.m_offset    = Get64( p );
+			request.m_roundTrip = Get64( p );
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		size_t WriteReply( const Reply& reply, uint8_t* pMessage )
+		{
+			uint8_t* p = pMessage;
+			*p++ = static_cast<uint8_t>( reply.m_direction );
+			*p++ = kSyncMarker;
+			Put64( p, reply.m_requestSent );
+			Put64( p, reply.m_received );
+			Put64( p, reply.m_replied );
+			if ( reply.m_hasLatency )
+			{
+				Put32( p, static_cast<uint32_t>( reply.m_latency ) );
+				Put32( p, static_cast<uint32_t>( reply.m_jitter ) );
+			}
+			return p - pMessage;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool ReadReply( const uint8_t* pMessage, size_t size, Reply& reply )
+		{
+			if ( size < kReplySize || pMessage[1] != kSyncMarker )
+				return false;
+
+			const uint8_t* p = pMessage;
+			reply.m_direction   = static_cast<char>( *p++ );
+			++p;
+			reply.m_requestSent = Get64( p );
+			reply.m_received    = Get64( p );
+			reply.m_replied     = Get64( p );
+
+			reply.m_hasLatency = size >= kReplyWithLatencySize;
+			reply.m_latency = reply.m_hasLatency ? static_cast<int32_t>( Get32( p ) ) : 0;
+			reply.m_jitter  = reply.m_hasLatency ? static_cast<int32_t>( Get32( p ) ) : 0;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Estimator
+
+		Estimator::Estimator()
+		{
+			Reset();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void Estimator::Reset()
+		{
+			m_samples = 0;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void Estimator::AddSample( int64_t requestSent, int64_t received, int64_t replied, int64_t replyReceived )
+		{
+			Sample& sample = m_window[m_samples % kWindow];
+			sample.m_offset = ((received - requestSent) + (replied - replyReceived)) / 2;
+			sample.m_roundTrip = (replyReceived - requestSent) - (replied - received);
+			if ( sample.m_roundTrip < 0 )
+				sample.m_roundTrip = 0;
+			++m_samples;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		//The exchange that spent the least time in flight has the least room for asymmetry
+		int64_t Estimator::GetOffset() const
+		{
+			uint64_t count = m_samples < kWindow ? m_samples : static_cast<uint64_t>( kWindow );
+			const Sample* pBest = NULL;
+			for ( uint64_t i = 0; i < count; ++i )
+			{
+				if ( !pBest || m_window[i].m_roundTrip < pBest->m_roundTrip )
+					pBest = &m_window[i];
+			}
+			return pBest ? pBest->m_offset : 0;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		int64_t Estimator::GetRoundTrip() const
+		{
+			uint64_t count = m_samples < kWindow ? m_samples : static_cast<uint64_t>( kWindow );
+			int64_t best = 0;
+			for ( uint64_t i = 0; i < count; ++i )
+			{
+				if ( i == 0 || m_window[i].m_roundTrip < best )
+					best = m_window[i].m_roundTrip;
+			}
+			return best;
+		}
+	}
+}
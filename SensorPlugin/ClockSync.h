@@ -0,0 +1,137 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// ClockSync.h - Frame capture timestamps and client clock estimation.
+//
+// Server side timings stop at the socket. To measure what the operator sees,
+// the plugins give a client what it needs to put a frame's age in its own
+// clock:
+//
+//   - every JPEG frame carries a trailer after its EOI marker with the time
+//     the sensor took the frame and finished encoding it, on the server clock.
+//     Decoders stop at EOI, so clients that do not know about it are unaffected.
+//
+//   - ZMQVideo's request for a direction on the control channel carries the
+//     time it was sent (T1) and the current estimate of the client clock. A
+//     client that knows the protocol answers with its direction followed by
+//     T1, the time it received the request (T2) and the time it replied (T3),
+//     and ZMQVideo notes when the reply arrived (T4). As in NTP,
+//
+//       offset     = ((T2 - T1) + (T3 - T4)) / 2    (client clock - server clock)
+//       round trip = (T4 - T1) - (T3 - T2)
+//
+//     and the exchange with the smallest round trip out of the last few is
+//     the most accurate. A client that replies with a bare direction, like
+//     the original Android app, is served as before.
+//
+//   - a client can append the latency and jitter it measured from the
+//     trailers to its replies, and ZMQVideo logs them.
+//
+// All values are little endian, times are microseconds on the server's
+// monotonic clock (Now()). Both plugins live in the same process and read
+// the same clock. Like FrameRing.h, this header does not depend on any ANVEL
+// headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef ClockSync_h__
+#define ClockSync_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace VANE
+{
+	namespace ClockSync
+	{
+		///Microseconds on the monotonic clock frame and control timestamps use
+		int64_t Now();
+
+		//////////////////////////////////////////////////////////////////////////
+		// Frame trailer
+
+		///Layout: int64 capture time, int64 encode end time, uint32 sequence, uint32 magic
+		const uint32_t kTrailerMagic = 0x53544E41; // "ANTS"
+		const uint32_t kTrailerSize  = 24;
+
+		struct FrameTimes
+		{
+			int64_t  m_captured;  ///< The sensor tick that took the frame started
+			int64_t  m_encoded;   ///< Encoding finished
+			uint32_t m_sequence;  ///< Frames sent before this one
+		};
+
+		void WriteTrailer( const FrameTimes& times, uint8_t* pTrailer );
+
+		///@return false if the frame does not end in a trailer
+		bool ReadTrailer( const uint8_t* pFrame, size_t size, FrameTimes& times );
+
+		//////////////////////////////////////////////////////////////////////////
+		// Control channel
+
+		const uint8_t kSyncMarker = 'T';
+
+		///Request: marker, int64 T1, int64 offset, int64 round trip (0 until there is an estimate)
+		const uint32_t kRequestSize = 25;
+
+		///Reply: direction, marker, int64 T1, int64 T2, int64 T3
+		const uint32_t kReplySize = 26;
+
+		///Optional reply extension: int32 frame latency, int32 jitter, both in microseconds
+		const uint32_t kReplyWithLatencySize = kReplySize + 8;
+
+		struct Request
+		{
+			int64_t m_sent;       ///< T1
+			int64_t m_offset;     ///< Client clock - server clock, as estimated by the server
+			int64_t m_roundTrip;  ///< 0 while the server has no estimate
+		};
+
+		struct Reply
+		{
+			char    m_direction;
+			int64_t m_requestSent;   ///< T1, echoed
+			int64_t m_received;      ///< T2, client clock
+			int64_t m_replied;       ///< T3, client clock
+			bool    m_hasLatency;
+			int32_t m_latency;       ///< Client's recent frame latency, capture to complete frame
+			int32_t m_jitter;
+		};
+
+		void WriteRequest( const Request& request, uint8_t* pMessage );
+		bool ReadRequest( const uint8_t* pMessage, size_t size, Request& request );
+
+		///@return the number of bytes written, kReplySize or kReplyWithLatencySize
+		size_t WriteReply( const Reply& reply, uint8_t* pMessage );
+		///@return false for a bare direction from a client that does not take part
+		bool ReadReply( const uint8_t* pMessage, size_t size, Reply& reply );
+
+		///Offset and round trip from the best of the last few exchanges
+		class Estimator
+		{
+		public:
+			Estimator();
+
+			void AddSample( int64_t requestSent, int64_t received, int64_t replied, int64_t replyReceived );
+			void Reset();
+
+			bool IsValid() const { return m_samples > 0; }
+			int64_t GetOffset() const;
+			int64_t GetRoundTrip() const;
+			uint64_t GetSampleCount() const { return m_samples; }
+
+		private:
+			enum { kWindow = 8 };
+
+			struct Sample
+			{
+				int64_t m_offset;
+				int64_t m_roundTrip;
+			};
+
+			Sample   m_window[kWindow];
+			uint64_t m_samples;
+		};
+	}
+}
+
+#endif // ClockSync_h__
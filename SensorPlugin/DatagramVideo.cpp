@@ -0,0 +1,809 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// DatagramVideo.cpp - Loss tolerant UDP transport for JPEG camera frames.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+//winsock2.h has to come before anything that pulls in windows.h
+#include <winsock2.h>
+#undef min
+#undef max
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "DatagramVideo.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef SIO_UDP_CONNRESET
+#define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
+#endif
+#endif
+
+namespace VANE
+{
+	namespace DatagramVideo
+	{
+		//Large socket buffers absorb the burst of datagrams that make up one frame
+		static const int kSocketBufferSize = 1 << 20;
+
+		static inline void Put16( uint8_t*& p, uint16_t v )
+		{
+			p[0] = static_cast<uint8_t>( v );
+			p[1] = static_cast<uint8_t>( v >> 8 );
+			p += 2;
+		}
+
+		static inline void Put32( uint8_t*& p, uint32_t v )
+		{
+			Put16( p, static_cast<uint16_t>( v ) );
+			Put16( p, static_cast<uint16_t>( v >> 16 ) );
+		}
+
+		static inline uint16_t Get16( const uint8_t*& p )
+		{
+			uint16_t v = static_cast<uint16_t>( p[0] | (p[1] << 8) );
+			p += 2;
+			return v;
+		}
+
+		static inline uint32_t Get32( const uint8_t*& p )
+		{
+			uint32_t lo = Get16( p );
+			uint32_t hi = Get16( p );
+			return lo | (hi << 16);
+		}
+
+		static inline bool IsRestartMarker( uint8_t marker )
+		{
+			return marker >= 0xD0 && marker <= 0xD7;
+		}
+
+		static inline uint32_t ElapsedMs( std::chrono::steady_clock::time_point since )
+		{
+			return static_cast<uint32_t>( std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - since ).count() );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Packet headers and segmentation
+
+		void WriteHeader( const PacketHeader& header, uint8_t* pData )
+		{
+			uint8_t* p = pData;
+			Put16( p, header.m_magic );
+			*p++ = header.m_version;
+			*p++ = header.m_type;
+			Put32( p, header.m_frameNumber );
+			Put16( p, header.m_segmentCount );
+			Put16( p, header.m_segmentIndex );
+			Put16( p, header.m_segmentsInPacket );
+			Put16( p, header.m_fragmentIndex );
+			Put16( p, header.m_fragmentCount );
+			Put16( p, header.m_stream );
+			Put32( p, header.m_fragmentOffset );
+			Put32( p, header.m_segmentSize );
+		}
+
+		bool ReadHeader( const uint8_t* pData, size_t size, PacketHeader& header )
+		{
+			if ( size < kPacketHeaderSize )
+				return false;
+
+			const uint8_t* p = pData;
+			header.m_magic            = Get16( p );
+			header.m_version          = *p++;
+			header.m_type             = *p++;
+			header.m_frameNumber      = Get32( p );
+			header.m_segmentCount     = Get16( p );
+			header.m_segmentIndex     = Get16( p );
+			header.m_segmentsInPacket = Get16( p );
+			header.m_fragmentIndex    = Get16( p );
+			header.m_fragmentCount    = Get16( p );
+			header.m_stream           = Get16( p );
+			header.m_fragmentOffset   = Get32( p );
+			header.m_segmentSize      = Get32( p );
+
+			return header.m_magic == kPacketMagic && header.m_version == kPacketVersion;
+		}
+
+		bool FindSegments( const uint8_t* pJpeg, uint32_t size, std::vector<uint32_t>& offsets )
+		{
+			offsets.clear();
+			if ( size < 4 || pJpeg[0] != 0xFF || pJpeg[1] != 0xD8 )
+				return false;
+
+			//Walk the marker segments up to the end of SOS
+			uint32_t pos = 2;
+			uint32_t headerEnd = 0;
+			while ( pos + 4 <= size )
+			{
+				if ( pJpeg[pos] != 0xFF )
+					return false;
+
+				const uint8_t marker = pJpeg[pos + 1];
+				if ( marker == 0xFF )
+				{
+					++pos;
+					continue;
+				}
+
+				pos += 2 + ((pJpeg[pos + 2] << 8) | pJpeg[pos + 3]);
+				if ( marker == 0xDA )
+				{
+					headerEnd = pos;
+					break;
+				}
+			}
+
+			if ( headerEnd == 0 || headerEnd >= size )
+				return false;
+
+			offsets.push_back( 0 );
+			offsets.push_back( headerEnd );
+
+			//Inside entropy coded data an 0xFF is always followed by a stuffed zero or a marker
+			for ( uint32_t i = headerEnd; i + 1 < size; ++i )
+			{
+				if ( pJpeg[i] != 0xFF )
+					continue;
+				if ( IsRestartMarker( pJpeg[i + 1] ) )
+					offsets.push_back( i );
+				++i;
+			}
+
+			offsets.push_back( size );
+			return offsets.size() - 1 <= 0xFFFF;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Addresses
+
+		bool ResolveAddress( const std::string& host, uint16_t port, Address& address )
+		{
+			address.m_port = htons( port );
+			if ( host.empty() || host == "*" )
+			{
+				address.m_ip = htonl( INADDR_ANY );
+				return true;
+			}
+
+			uint32_t ip = inet_addr( host.c_str() );
+			if ( ip != INADDR_NONE )
+			{
+				address.m_ip = ip;
+				return true;
+			}
+
+#ifdef _WIN32
+			WSADATA wsaData;
+			if ( ::WSAStartup( MAKEWORD(2, 2), &wsaData ) != 0 )
+				return false;
+#endif
+
+			bool resolved = false;
+			struct hostent* pHost = gethostbyname( host.c_str() );
+			if ( pHost != NULL && pHost->h_addrtype == AF_INET && pHost->h_addr_list[0] != NULL )
+			{
+				memcpy( &address.m_ip, pHost->h_addr_list[0], sizeof(address.m_ip) );
+				resolved = true;
+			}
+
+#ifdef _WIN32
+			WSACleanup();
+#endif
+			return resolved;
+		}
+
+		static void ToSockAddr( const Address& address, sockaddr_in& addr )
+		{
+			memset( &addr, 0, sizeof(addr) );
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = address.m_ip;
+			addr.sin_port = address.m_port;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// UdpSocket
+
+#ifdef _WIN32
+		static const uintptr_t kInvalidSocket = static_cast<uintptr_t>( INVALID_SOCKET );
+#else
+		static const int kInvalidSocket = -1;
+#endif
+
+		UdpSocket::UdpSocket()
+			: m_socket( kInvalidSocket )
+			, m_open( false )
+			, m_dropRate( 0.0 )
+			, m_dropSeed( 0x9E3779B9 )
+			, m_injectedDrops( 0 )
+		{
+		}
+
+		UdpSocket::~UdpSocket()
+		{
+			Close();
+		}
+
+		bool UdpSocket::Open( const Address& local )
+		{
+			Close();
+
+#ifdef _WIN32
+			WSADATA wsaData;
+			if ( ::WSAStartup( MAKEWORD(2, 2), &wsaData ) != 0 )
+				return false;
+
+			SOCKET s = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+			if ( s == INVALID_SOCKET )
+			{
+				WSACleanup();
+				return false;
+			}
+
+			u_long nonBlocking = 1;
+			ioctlsocket( s, FIONBIO, &nonBlocking );
+
+			//Otherwise an ICMP port unreachable from a departed client fails the next recvfrom
+			BOOL reportReset = FALSE;
+			DWORD bytesReturned = 0;
+			WSAIoctl( s, SIO_UDP_CONNRESET, &reportReset, sizeof(reportReset), NULL, 0, &bytesReturned, NULL, NULL );
+#else
+			int s = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+			if ( s < 0 )
+				return false;
+
+			fcntl( s, F_SETFL, fcntl( s, F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+
+			int bufferSize = kSocketBufferSize;
+			setsockopt( s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize) );
+			setsockopt( s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize) );
+
+			sockaddr_in addr;
+			ToSockAddr( local, addr );
+			m_socket = s;
+			m_open = true;
+
+			if ( bind( s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr) ) != 0 )
+			{
+				Close();
+				return false;
+			}
+
+			return true;
+		}
+
+		void UdpSocket::Close()
+		{
+			if ( !m_open )
+				return;
+
+#ifdef _WIN32
+			closesocket( static_cast<SOCKET>(m_socket) );
+			WSACleanup();
+#else
+			close( m_socket );
+#endif
+			m_socket = kInvalidSocket;
+			m_open = false;
+		}
+
+		bool UdpSocket::InjectDrop()
+		{
+			if ( m_dropRate <= 0.0 )
+				return false;
+
+			//xorshift32, only needs to be cheap and repeatable
+			m_dropSeed ^= m_dropSeed << 13;
+			m_dropSeed ^= m_dropSeed >> 17;
+			m_dropSeed ^= m_dropSeed << 5;
+			if ( (m_dropSeed >> 8) * (1.0 / 16777216.0) >= m_dropRate )
+				return false;
+
+			++m_injectedDrops;
+			return true;
+		}
+
+		bool UdpSocket::SendTo( const void* pData, size_t size, const Address& to )
+		{
+			if ( !m_open )
+				return false;
+			if ( InjectDrop() )
+				return true;
+
+			sockaddr_in addr;
+			ToSockAddr( to, addr );
+			return sendto( m_socket, static_cast<const char*>(pData), static_cast<int>(size), 0,
+				reinterpret_cast<sockaddr*>(&addr), sizeof(addr) ) == static_cast<int>(size);
+		}
+
+		int UdpSocket::RecvFrom( void* pData, size_t size, Address& from )
+		{
+			if ( !m_open )
+				return -1;
+
+			while ( true )
+			{
+				sockaddr_in addr;
+#ifdef _WIN32
+				int addrLen = sizeof(addr);
+#else
+				socklen_t addrLen = sizeof(addr);
+#endif
+				int received = static_cast<int>( recvfrom( m_socket, static_cast<char*>(pData), static_cast<int>(size), 0,
+					reinterpret_cast<sockaddr*>(&addr), &addrLen ) );
+				if ( received < 0 )
+					return -1;
+				if ( InjectDrop() )
+					continue;
+
+				from.m_ip = addr.sin_addr.s_addr;
+				from.m_port = addr.sin_port;
+				return received;
+			}
+		}
+
+		bool UdpSocket::WaitReadable( uint32_t timeoutMs )
+		{
+			if ( !m_open )
+				return false;
+
+			fd_set readSet;
+			FD_ZERO( &readSet );
+			FD_SET( m_socket, &readSet );
+
+			timeval timeout;
+			timeout.tv_sec = timeoutMs / 1000;
+			timeout.tv_usec = (timeoutMs % 1000) * 1000;
+			return select( static_cast<int>(m_socket) + 1, &readSet, NULL, NULL, &timeout ) > 0;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Sender
+
+		Sender::Sender()
+			: m_datagramSize( kDefaultDatagramSize )
+			, m_datagramsSent( 0 )
+		{
+		}
+
+		bool Sender::Open( const Address& local, uint32_t datagramSize )
+		{
+			if ( datagramSize < kMinDatagramSize )
+				datagramSize = kMinDatagramSize;
+			if ( datagramSize > kMaxDatagramSize )
+				datagramSize = kMaxDatagramSize;
+
+			m_datagramSize = datagramSize;
+			m_packet.resize( kMaxDatagramSize );
+			m_subscribers.clear();
+			return m_socket.Open( local );
+		}
+
+		void Sender::Close()
+		{
+			m_socket.Close();
+			m_subscribers.clear();
+		}
+
+		void Sender::ServiceSubscribers()
+		{
+			Address from;
+			int size;
+			while ( (size = m_socket.RecvFrom( &m_packet[0], m_packet.size(), from )) >= 0 )
+			{
+				PacketHeader header;
+				if ( !ReadHeader( &m_packet[0], size, header ) || header.m_type != kPacketSubscribe )
+					continue;
+
+				size_t i = 0;
+				while ( i < m_subscribers.size() && !(m_subscribers[i].m_address == from) )
+					++i;
+				if ( i == m_subscribers.size() )
+				{
+					Subscriber subscriber;
+					subscriber.m_address = from;
+					m_subscribers.push_back( subscriber );
+				}
+				m_subscribers[i].m_lastSeen = std::chrono::steady_clock::now();
+			}
+
+			for ( size_t i = 0; i < m_subscribers.size(); )
+			{
+				if ( ElapsedMs( m_subscribers[i].m_lastSeen ) > kSubscriberTimeoutMs )
+				{
+					m_subscribers[i] = m_subscribers.back();
+					m_subscribers.pop_back();
+				}
+				else
+					++i;
+			}
+		}
+
+		void Sender::SendDatagram( const PacketHeader& header, const uint8_t* pPayload, uint32_t size )
+		{
+			WriteHeader( header, &m_packet[0] );
+			memcpy( &m_packet[kPacketHeaderSize], pPayload, size );
+
+			for ( size_t i = 0; i < m_subscribers.size(); ++i )
+			{
+				if ( m_socket.SendTo( &m_packet[0], kPacketHeaderSize + size, m_subscribers[i].m_address ) )
+					++m_datagramsSent;
+			}
+		}
+
+		bool Sender::SendFrame( const uint8_t* pJpeg, uint32_t size, uint16_t stream )
+		{
+			if ( !FindSegments( pJpeg, size, m_segments ) )
+				return false;
+
+			size_t s = 0;
+			while ( s < m_streams.size() && m_streams[s].m_id != stream )
+				++s;
+			if ( s == m_streams.size() )
+			{
+				Stream newStream;
+				newStream.m_id = stream;
+				newStream.m_frameNumber = 0;
+				m_streams.push_back( newStream );
+			}
+
+			const uint32_t segmentCount = static_cast<uint32_t>( m_segments.size() - 1 );
+			const uint32_t payloadSize = m_datagramSize - static_cast<uint32_t>( kPacketHeaderSize );
+
+			PacketHeader header;
+			memset( &header, 0, sizeof(header) );
+			header.m_magic        = kPacketMagic;
+			header.m_version      = kPacketVersion;
+			header.m_frameNumber  = m_streams[s].m_frameNumber++;
+			header.m_segmentCount = static_cast<uint16_t>( segmentCount );
+			header.m_stream       = stream;
+
+			uint32_t segment = 0;
+			while ( segment < segmentCount )
+			{
+				const uint32_t start = m_segments[segment];
+				const uint32_t segmentSize = m_segments[segment + 1] - start;
+				header.m_segmentIndex = static_cast<uint16_t>( segment );
+
+				if ( segmentSize > payloadSize )
+				{
+					//Too big for one datagram, the segment only survives if every fragment arrives
+					const uint32_t fragmentCount = (segmentSize + payloadSize - 1) / payloadSize;
+					header.m_type             = kPacketFragment;
+					header.m_segmentsInPacket = 0;
+					header.m_fragmentCount    = static_cast<uint16_t>( fragmentCount );
+					header.m_segmentSize      = segmentSize;
+
+					for ( uint32_t fragment = 0; fragment < fragmentCount; ++fragment )
+					{
+						const uint32_t offset = fragment * payloadSize;
+						const uint32_t length = segmentSize - offset < payloadSize ? segmentSize - offset : payloadSize;
+						header.m_fragmentIndex  = static_cast<uint16_t>( fragment );
+						header.m_fragmentOffset = offset;
+						SendDatagram( header, pJpeg + start + offset, length );
+					}
+
+					++segment;
+					continue;
+				}
+
+				//Pack as many whole segments as fit. The tables always travel alone because
+				//the receiver splits the rest of a datagram on its RST markers.
+				uint32_t end = segment + 1;
+				if ( segment != 0 )
+				{
+					while ( end < segmentCount && m_segments[end + 1] - start <= payloadSize )
+						++end;
+				}
+
+				header.m_type             = kPacketSegments;
+				header.m_segmentsInPacket = static_cast<uint16_t>( end - segment );
+				header.m_fragmentIndex    = 0;
+				header.m_fragmentCount    = 0;
+				header.m_fragmentOffset   = 0;
+				header.m_segmentSize      = 0;
+				SendDatagram( header, pJpeg + start, m_segments[end] - start );
+
+				segment = end;
+			}
+
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Receiver
+
+		Receiver::Receiver()
+			: m_frameTimeoutMs( 100 )
+			, m_completeFrames( 0 )
+			, m_concealedFrames( 0 )
+			, m_droppedFrames( 0 )
+			, m_lateDatagrams( 0 )
+		{
+		}
+
+		bool Receiver::Open( const Address& sender, uint16_t localPort )
+		{
+			Address local;
+			ResolveAddress( "", localPort, local );
+			if ( !m_socket.Open( local ) )
+				return false;
+
+			m_sender = sender;
+			m_packet.resize( kMaxDatagramSize );
+			m_streams.clear();
+			Subscribe();
+			return true;
+		}
+
+		void Receiver::Close()
+		{
+			m_socket.Close();
+		}
+
+		void Receiver::Subscribe()
+		{
+			PacketHeader header;
+			memset( &header, 0, sizeof(header) );
+			header.m_magic   = kPacketMagic;
+			header.m_version = kPacketVersion;
+			header.m_type    = kPacketSubscribe;
+
+			uint8_t packet[kPacketHeaderSize];
+			WriteHeader( header, packet );
+			m_socket.SendTo( packet, sizeof(packet), m_sender );
+			m_lastSubscribe = std::chrono::steady_clock::now();
+		}
+
+		bool Receiver::Receive( std::vector<uint8_t>& jpeg, FrameResult& result, uint32_t timeoutMs )
+		{
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			while ( true )
+			{
+				if ( ElapsedMs( m_lastSubscribe ) >= kSubscribeIntervalMs )
+					Subscribe();
+
+				Address from;
+				int size;
+				while ( (size = m_socket.RecvFrom( &m_packet[0], m_packet.size(), from )) >= 0 )
+				{
+					if ( !(from == m_sender) )
+						continue;
+
+					bool ready = false;
+					HandleDatagram( &m_packet[0], size, jpeg, result, ready );
+					if ( ready )
+						return true;
+				}
+
+				//The rest of a frame is not coming, show what we have
+				for ( size_t i = 0; i < m_streams.size(); ++i )
+				{
+					Stream& stream = m_streams[i];
+					if ( stream.m_pending && ElapsedMs( stream.m_frameStarted ) >= m_frameTimeoutMs && FinishFrame( stream, jpeg, result ) )
+						return true;
+				}
+
+				const uint32_t elapsed = ElapsedMs( start );
+				if ( elapsed >= timeoutMs )
+					return false;
+
+				const uint32_t wait = timeoutMs - elapsed;
+				m_socket.WaitReadable( wait < 10 ? wait : 10 );
+			}
+		}
+
+		Receiver::Stream* Receiver::GetStream( uint16_t id )
+		{
+			for ( size_t i = 0; i < m_streams.size(); ++i )
+			{
+				if ( m_streams[i].m_id == id )
+					return &m_streams[i];
+			}
+
+			if ( m_streams.size() >= kMaxStreams )
+				return NULL;
+
+			m_streams.push_back( Stream() );
+			m_streams.back().m_id = id;
+			return &m_streams.back();
+		}
+
+		void Receiver::StartFrame( Stream& stream, const PacketHeader& header )
+		{
+			stream.m_pending = true;
+			stream.m_pendingFrame = header.m_frameNumber;
+			stream.m_segmentsComplete = 0;
+			stream.m_frameStarted = std::chrono::steady_clock::now();
+
+			stream.m_current.resize( header.m_segmentCount );
+			for ( size_t i = 0; i < stream.m_current.size(); ++i )
+			{
+				Segment& segment = stream.m_current[i];
+				segment.m_complete = false;
+				segment.m_fragments.clear();
+				segment.m_size = 0;
+				segment.m_fragmentCount = 0;
+				segment.m_fragmentsReceived = 0;
+			}
+		}
+
+		void Receiver::HandleDatagram( const uint8_t* pData, int size, std::vector<uint8_t>& jpeg, FrameResult& result, bool& ready )
+		{
+			PacketHeader header;
+			if ( !ReadHeader( pData, size, header ) || (header.m_type != kPacketSegments && header.m_type != kPacketFragment) )
+				return;
+
+			Stream* pStream = GetStream( header.m_stream );
+			if ( pStream == NULL )
+				return;
+			Stream& stream = *pStream;
+
+			if ( stream.m_haveDelivered && static_cast<int32_t>(header.m_frameNumber - stream.m_lastDelivered) <= 0 )
+			{
+				++m_lateDatagrams;
+				return;
+			}
+
+			if ( stream.m_pending && header.m_frameNumber != stream.m_pendingFrame )
+			{
+				if ( static_cast<int32_t>(header.m_frameNumber - stream.m_pendingFrame) < 0 )
+				{
+					++m_lateDatagrams;
+					return;
+				}
+
+				//A newer frame has started, never hold it up waiting for the old one
+				ready = FinishFrame( stream, jpeg, result );
+			}
+
+			if ( !stream.m_pending )
+				StartFrame( stream, header );
+
+			std::vector<Segment>& current = stream.m_current;
+			if ( header.m_segmentCount != current.size() || header.m_segmentIndex >= current.size() )
+				return;
+
+			const uint8_t* pPayload = pData + kPacketHeaderSize;
+			const uint32_t payloadSize = static_cast<uint32_t>( size - kPacketHeaderSize );
+
+			if ( header.m_type == kPacketSegments )
+			{
+				if ( header.m_segmentIndex + header.m_segmentsInPacket > current.size() || header.m_segmentsInPacket == 0 )
+					return;
+
+				//Split on the RST markers, there must be exactly as many pieces as the header says
+				std::vector<uint32_t>& bounds = m_bounds;
+				bounds.clear();
+				bounds.push_back( 0 );
+				for ( uint32_t i = 1; i + 1 < payloadSize && bounds.size() <= header.m_segmentsInPacket; ++i )
+				{
+					if ( pPayload[i] != 0xFF )
+						continue;
+					if ( IsRestartMarker( pPayload[i + 1] ) )
+						bounds.push_back( i );
+					++i;
+				}
+
+				const uint32_t pieces = static_cast<uint32_t>( bounds.size() );
+				if ( pieces != header.m_segmentsInPacket )
+					return;
+				bounds.push_back( payloadSize );
+
+				for ( uint32_t i = 0; i < pieces; ++i )
+				{
+					Segment& segment = current[header.m_segmentIndex + i];
+					if ( segment.m_complete )
+						continue;
+
+					segment.m_data.assign( pPayload + bounds[i], pPayload + bounds[i + 1] );
+					segment.m_complete = true;
+					++stream.m_segmentsComplete;
+				}
+			}
+			else
+			{
+				Segment& segment = current[header.m_segmentIndex];
+				if ( segment.m_complete || header.m_fragmentIndex >= header.m_fragmentCount )
+					return;
+
+				if ( segment.m_fragmentCount == 0 )
+				{
+					//The size is only trusted as far as that many fragments could carry it
+					const uint64_t carried = static_cast<uint64_t>( header.m_fragmentCount ) * (kMaxDatagramSize - kPacketHeaderSize);
+					if ( header.m_segmentSize == 0 || header.m_segmentSize > carried || header.m_segmentSize > kMaxSegmentSize )
+						return;
+
+					segment.m_size = header.m_segmentSize;
+					segment.m_fragmentCount = header.m_fragmentCount;
+					segment.m_fragments.assign( header.m_fragmentCount, 0 );
+					segment.m_fragmentsReceived = 0;
+					segment.m_data.resize( header.m_segmentSize );
+				}
+				//Every fragment has to agree with the first one on the layout of the segment
+				else if ( header.m_segmentSize != segment.m_size || header.m_fragmentCount != segment.m_fragmentCount )
+					return;
+
+				if ( header.m_fragmentOffset > segment.m_size || payloadSize > segment.m_size - header.m_fragmentOffset
+					|| segment.m_fragments[header.m_fragmentIndex] )
+					return;
+
+				memcpy( &segment.m_data[header.m_fragmentOffset], pPayload, payloadSize );
+				segment.m_fragments[header.m_fragmentIndex] = 1;
+				if ( ++segment.m_fragmentsReceived == segment.m_fragmentCount )
+				{
+					segment.m_complete = true;
+					++stream.m_segmentsComplete;
+				}
+			}
+
+			if ( stream.m_segmentsComplete == current.size() )
+				ready = FinishFrame( stream, jpeg, result );
+		}
+
+		bool Receiver::FinishFrame( Stream& stream, std::vector<uint8_t>& jpeg, FrameResult& result )
+		{
+			stream.m_pending = false;
+			stream.m_haveDelivered = true;
+			stream.m_lastDelivered = stream.m_pendingFrame;
+
+			//Whatever arrived intact becomes the reference for the frames that follow, even
+			//if this frame cannot be shown. After a bad start the reference fills in over a few frames.
+			std::vector<Segment>& current = stream.m_current;
+			std::vector<Segment>& previous = stream.m_previous;
+			const uint32_t segmentCount = static_cast<uint32_t>( current.size() );
+			if ( previous.size() != segmentCount )
+				previous.assign( segmentCount, Segment() );
+
+			uint32_t concealed = 0;
+			uint32_t missing = 0;
+			for ( uint32_t i = 0; i < segmentCount; ++i )
+			{
+				if ( current[i].m_complete )
+				{
+					previous[i].m_data.swap( current[i].m_data );
+					previous[i].m_complete = true;
+				}
+				else if ( previous[i].m_complete )
+					++concealed;
+				else
+					++missing;
+			}
+
+			//Nothing to patch a hole with, or nothing new to show
+			if ( missing || concealed == segmentCount )
+			{
+				++m_droppedFrames;
+				return false;
+			}
+
+			jpeg.clear();
+			for ( uint32_t i = 0; i < segmentCount; ++i )
+				jpeg.insert( jpeg.end(), previous[i].m_data.begin(), previous[i].m_data.end() );
+
+			result.m_stream = stream.m_id;
+			result.m_frameNumber = stream.m_pendingFrame;
+			result.m_segmentCount = segmentCount;
+			result.m_concealedSegments = concealed;
+
+			if ( concealed )
+				++m_concealedFrames;
+			else
+				++m_completeFrames;
+			return true;
+		}
+	}
+}
@@ -0,0 +1,299 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// DatagramVideo.h - Loss tolerant UDP transport for JPEG camera frames.
+//
+// The ZMQ transport runs over TCP, so a single lost packet on a lossy Wi-Fi
+// link stalls every frame queued behind it. For teleoperation a late frame is
+// worthless, so this transport sends frames as independent UDP datagrams and
+// never retransmits.
+//
+// Frames are encoded with restart markers (jpge::params::m_restart_interval).
+// Every restart interval can be entropy decoded on its own, so each frame is
+// cut at the RSTn markers into segments:
+//
+//   segment 0      SOI .. SOS (all the tables)
+//   segment 1      entropy data up to the first RST marker
+//   segment n > 1  RSTn and the entropy data that follows it (the last one
+//                  also carries EOI)
+//
+// Whole segments are packed into datagrams up to the configured size, and a
+// segment that does not fit in one datagram is split into fragments. Every
+// datagram carries a header describing where its bytes belong, so the
+// receiver can place them without any other datagram of the frame.
+//
+// Every camera is a stream of its own, with its own frame counter. The
+// receiver reassembles one frame of each stream at a time. As soon as a
+// datagram from a newer frame of the stream arrives (or the frame times out)
+// the pending frame is finished: segments that did not fully arrive are
+// replaced with the same segment from the stream's previous frame. With the
+// same size and quality the encoder emits the same tables and the same RST
+// numbering, so the result is always a valid JPEG in which only the damaged
+// rows show stale pixels.
+//
+// Clients subscribe by sending a kPacketSubscribe datagram to the sender's
+// port, and must repeat it at least every kSubscriberTimeoutMs.
+//
+// Like FrameRing.h, this header does not depend on any ANVEL headers so that
+// it can be shared with the receiving tools.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef DatagramVideo_h__
+#define DatagramVideo_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+namespace VANE
+{
+	namespace DatagramVideo
+	{
+		const uint16_t kPacketMagic   = 0x5641; // "AV"
+		const uint8_t  kPacketVersion = 1;
+
+		///Default datagram size, leaves room for IP/UDP headers and tunnels in a 1500 byte MTU
+		const uint32_t kDefaultDatagramSize = 1400;
+		const uint32_t kMinDatagramSize     = 256;
+		const uint32_t kMaxDatagramSize     = 65000;
+
+		///Streams a receiver keeps apart, datagrams of any more are dropped
+		const uint32_t kMaxStreams = 64;
+		///Largest segment a receiver reassembles from fragments
+		const uint32_t kMaxSegmentSize = 16 * 1024 * 1024;
+
+		///Subscribers that have not renewed within this time stop receiving frames
+		const uint32_t kSubscriberTimeoutMs = 5000;
+		///How often clients should renew their subscription
+		const uint32_t kSubscribeIntervalMs = 1000;
+
+		enum PacketType
+		{
+			kPacketSegments  = 1, ///< One or more whole segments
+			kPacketFragment  = 2, ///< Part of a single segment that is larger than a datagram
+			kPacketSubscribe = 3  ///< Client to sender, header only
+		};
+
+		///Header at the start of every datagram, sent little endian
+		struct PacketHeader
+		{
+			uint16_t m_magic;
+			uint8_t  m_version;
+			uint8_t  m_type;             ///< One of PacketType
+			uint32_t m_frameNumber;      ///< Stream's frame counter, wraps
+			uint16_t m_segmentCount;     ///< Total number of segments in the frame
+			uint16_t m_segmentIndex;     ///< First (or only) segment carried by the datagram
+			uint16_t m_segmentsInPacket; ///< Whole segments carried, kPacketSegments only
+			uint16_t m_fragmentIndex;    ///< kPacketFragment only
+			uint16_t m_fragmentCount;    ///< kPacketFragment only
+			uint16_t m_stream;           ///< Camera the frame came from
+			uint32_t m_fragmentOffset;   ///< Byte offset of the fragment within its segment
+			uint32_t m_segmentSize;      ///< Size of the fragmented segment
+		};
+
+		const size_t kPacketHeaderSize = 28;
+
+		void WriteHeader( const PacketHeader& header, uint8_t* pData );
+		///@return false if the datagram is too short or is not one of ours
+		bool ReadHeader( const uint8_t* pData, size_t size, PacketHeader& header );
+
+		///Find the segment boundaries of a baseline JPEG encoded with restart markers.
+		///offsets receives the start of every segment followed by the total size.
+		///@return false if the data is not a JPEG we can segment
+		bool FindSegments( const uint8_t* pJpeg, uint32_t size, std::vector<uint32_t>& offsets );
+
+		///IPv4 address and port, both in network byte order
+		struct Address
+		{
+			Address() : m_ip( 0 ), m_port( 0 ) { }
+
+			bool operator==( const Address& rhs ) const { return m_ip == rhs.m_ip && m_port == rhs.m_port; }
+
+			uint32_t m_ip;
+			uint16_t m_port;
+		};
+
+		///Resolve a host name or dotted address. An empty host means any address.
+		bool ResolveAddress( const std::string& host, uint16_t port, Address& address );
+
+		///Minimal non-blocking UDP socket
+		class UdpSocket
+		{
+		public:
+			UdpSocket();
+			~UdpSocket();
+
+			///Bind to the given local address, port 0 picks any free port
+			bool Open( const Address& local );
+			void Close();
+
+			bool IsOpen() const { return m_open; }
+
+			bool SendTo( const void* pData, size_t size, const Address& to );
+
+			///@return the size of the datagram read, or -1 if none is waiting
+			int RecvFrom( void* pData, size_t size, Address& from );
+
+			///Block for up to timeoutMs until a datagram can be read
+			bool WaitReadable( uint32_t timeoutMs );
+
+			///Loss injection for testing: drop datagrams sent or received with this probability
+			void SetDropRate( double rate ) { m_dropRate = rate; }
+			uint64_t GetInjectedDrops() const { return m_injectedDrops; }
+
+		private:
+			UdpSocket( const UdpSocket& );
+			UdpSocket& operator=( const UdpSocket& );
+
+			bool InjectDrop();
+
+#ifdef _WIN32
+			uintptr_t m_socket;
+#else
+			int       m_socket;
+#endif
+			bool      m_open;
+			double    m_dropRate;
+			uint32_t  m_dropSeed;
+			uint64_t  m_injectedDrops;
+		};
+
+		///Sending side, owned by the sensor plugin
+		class Sender
+		{
+		public:
+			Sender();
+
+			bool Open( const Address& local, uint32_t datagramSize = kDefaultDatagramSize );
+			void Close();
+
+			bool IsOpen() const { return m_socket.IsOpen(); }
+
+			///Read pending subscriptions and expire stale ones
+			void ServiceSubscribers();
+			bool HasSubscribers() const { return !m_subscribers.empty(); }
+			uint32_t GetSubscriberCount() const { return static_cast<uint32_t>( m_subscribers.size() ); }
+
+			///Split a frame into datagrams and send it to every subscriber
+			///@param stream Camera the frame came from, each one is numbered on its own
+			///@return false if the frame could not be segmented
+			bool SendFrame( const uint8_t* pJpeg, uint32_t size, uint16_t stream = 0 );
+
+			UdpSocket& GetSocket() { return m_socket; }
+			uint64_t GetDatagramsSent() const { return m_datagramsSent; }
+
+		private:
+			struct Subscriber
+			{
+				Address m_address;
+				std::chrono::steady_clock::time_point m_lastSeen;
+			};
+
+			struct Stream
+			{
+				uint16_t m_id;
+				uint32_t m_frameNumber;
+			};
+
+			void SendDatagram( const PacketHeader& header, const uint8_t* pPayload, uint32_t size );
+
+			UdpSocket m_socket;
+			uint32_t  m_datagramSize;
+			uint64_t  m_datagramsSent;
+			std::vector<Stream>     m_streams;
+			std::vector<Subscriber> m_subscribers;
+			std::vector<uint32_t>   m_segments;
+			std::vector<uint8_t>    m_packet;
+		};
+
+		///Details of a frame handed out by the Receiver
+		struct FrameResult
+		{
+			uint32_t m_stream;
+			uint32_t m_frameNumber;       ///< Counted per stream
+			uint32_t m_segmentCount;
+			uint32_t m_concealedSegments; ///< Segments copied from the previous frame
+		};
+
+		///Receiving side: reassembles frames and conceals lost segments
+		class Receiver
+		{
+		public:
+			Receiver();
+
+			///Bind a local port and subscribe to the sender
+			bool Open( const Address& sender, uint16_t localPort = 0 );
+			void Close();
+
+			///Wait up to timeoutMs for the next frame of any stream. Never waits for missing
+			///datagrams of a frame once a newer frame of its stream has started or frameTimeoutMs has passed.
+			bool Receive( std::vector<uint8_t>& jpeg, FrameResult& result, uint32_t timeoutMs );
+
+			///Time a partial frame is held before it is concealed and delivered
+			void SetFrameTimeout( uint32_t timeoutMs ) { m_frameTimeoutMs = timeoutMs; }
+
+			UdpSocket& GetSocket() { return m_socket; }
+
+			uint64_t GetCompleteFrames() const { return m_completeFrames; }
+			uint64_t GetConcealedFrames() const { return m_concealedFrames; }
+			uint64_t GetDroppedFrames() const { return m_droppedFrames; }
+			uint64_t GetLateDatagrams() const { return m_lateDatagrams; }
+
+		private:
+			struct Segment
+			{
+				Segment() : m_size( 0 ), m_fragmentCount( 0 ), m_fragmentsReceived( 0 ), m_complete( false ) { }
+
+				std::vector<uint8_t> m_data;
+				std::vector<uint8_t> m_fragments; ///< Received flags for a fragmented segment
+				uint32_t m_size;                  ///< Of a fragmented segment, from its first fragment
+				uint32_t m_fragmentCount;
+				uint32_t m_fragmentsReceived;
+				bool     m_complete;
+			};
+
+			///Reassembly state of one camera
+			struct Stream
+			{
+				Stream() : m_id( 0 ), m_pending( false ), m_pendingFrame( 0 ), m_segmentsComplete( 0 ), m_haveDelivered( false ), m_lastDelivered( 0 ) { }
+
+				uint16_t m_id;
+				bool     m_pending;
+				uint32_t m_pendingFrame;
+				uint32_t m_segmentsComplete;
+				std::chrono::steady_clock::time_point m_frameStarted;
+				std::vector<Segment> m_current;
+				std::vector<Segment> m_previous; ///< Last delivered frame, m_complete marks usable segments
+				bool     m_haveDelivered;
+				uint32_t m_lastDelivered;
+			};
+
+			void Subscribe();
+			///@return the stream's state, NULL if there are kMaxStreams already
+			Stream* GetStream( uint16_t id );
+			void HandleDatagram( const uint8_t* pData, int size, std::vector<uint8_t>& jpeg, FrameResult& result, bool& ready );
+			void StartFrame( Stream& stream, const PacketHeader& header );
+			///Conceal what is missing and build the output frame
+			bool FinishFrame( Stream& stream, std::vector<uint8_t>& jpeg, FrameResult& result );
+
+			UdpSocket m_socket;
+			Address   m_sender;
+			uint32_t  m_frameTimeoutMs;
+			std::chrono::steady_clock::time_point m_lastSubscribe;
+
+			std::vector<Stream> m_streams;
+
+			std::vector<uint8_t>  m_packet;
+			std::vector<uint32_t> m_bounds;
+
+			uint64_t m_completeFrames;
+			uint64_t m_concealedFrames;
+			uint64_t m_droppedFrames;
+			uint64_t m_lateDatagrams;
+		};
+	}
+}
+
+#endif // DatagramVideo_h__
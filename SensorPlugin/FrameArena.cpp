@@ -0,0 +1,110 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FrameArena.cpp - Per-stream bump allocator for transient frame memory.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FrameArena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace VANE
+{
+	static inline size_t AlignUp( size_t size )
+	{
+		return (size + FrameArena::kAlignment - 1) & ~(FrameArena::kAlignment - 1);
+	}
+
+	///malloc does not promise more than 8 byte alignment everywhere, so over-allocate and
+	///keep the original pointer just in front of the aligned one
+	static void* AlignedAlloc( size_t size )
+	{
+		void* pRaw = malloc( size + FrameArena::kAlignment + sizeof(void*) );
+		if ( !pRaw )
+			return NULL;
+
+		uint8_t* pAligned = reinterpret_cast<uint8_t*>( AlignUp( reinterpret_cast<size_t>( pRaw ) + sizeof(void*) ) );
+		memcpy( pAligned - sizeof(void*), &pRaw, sizeof(void*) );
+		return pAligned;
+	}
+
+	static void AlignedFree( void* p )
+	{
+		if ( !p )
+			return;
+
+		void* pRaw;
+		memcpy( &pRaw, static_cast<uint8_t*>(p) - sizeof(void*), sizeof(void*) );
+		free( pRaw );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	FrameArena::FrameArena( size_t initialCapacity )
+		: m_pBlock( NULL )
+		, m_used( 0 )
+	{
+		memset( &m_stats, 0, sizeof(m_stats) );
+
+		if ( initialCapacity )
+		{
+			m_pBlock = static_cast<uint8_t*>( AlignedAlloc( AlignUp( initialCapacity ) ) );
+			if ( m_pBlock )
+				m_stats.m_capacity = AlignUp( initialCapacity );
+			++m_stats.m_heapAllocations;
+		}
+	}
+
+	FrameArena::~FrameArena()
+	{
+		Reset();
+		AlignedFree( m_pBlock );
+	}
+
+	void* FrameArena::Allocate( size_t size )
+	{
+		size = AlignUp( size ? size : 1 );
+		++m_stats.m_allocations;
+		m_stats.m_frameBytes += size;
+
+		if ( m_used + size <= m_stats.m_capacity )
+		{
+			void* p = m_pBlock + m_used;
+			m_used += size;
+			return p;
+		}
+
+		//Out of room, serve this frame from the heap and grow the block at the next reset
+		void* p = AlignedAlloc( size );
+		if ( p )
+			m_overflow.push_back( p );
+		++m_stats.m_heapAllocations;
+		return p;
+	}
+
+	void FrameArena::Reset()
+	{
+		if ( m_stats.m_frameBytes > m_stats.m_peakFrameBytes )
+			m_stats.m_peakFrameBytes = m_stats.m_frameBytes;
+
+		if ( !m_overflow.empty() )
+		{
+			for ( size_t i = 0; i < m_overflow.size(); ++i )
+				AlignedFree( m_overflow[i] );
+			m_overflow.clear();
+
+			//One block big enough for the largest frame so far
+			AlignedFree( m_pBlock );
+			m_stats.m_capacity = 0;
+			m_pBlock = static_cast<uint8_t*>( AlignedAlloc( m_stats.m_peakFrameBytes ) );
+			if ( m_pBlock )
+				m_stats.m_capacity = m_stats.m_peakFrameBytes;
+			++m_stats.m_heapAllocations;
+		}
+
+		m_used = 0;
+		m_stats.m_frameBytes = 0;
+		++m_stats.m_frames;
+	}
+}
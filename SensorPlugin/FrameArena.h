@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FrameArena.h - Per-stream bump allocator for transient frame memory.
+//
+// Encoders allocate their working buffers from a FrameArena and Reset() it
+// at the start of every frame instead of going to the global heap. Memory is
+// handed out by bumping an offset into one block, and freeing is a no-op.
+// If a frame needs more than the block holds, the extra requests fall back
+// to the heap and the next Reset() replaces the block with one large enough
+// for the whole frame. After the first few frames a stream therefore runs
+// with no heap traffic at all, and long runs do not fragment the heap.
+//
+// Like FrameRing.h, this header does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef FrameArena_h__
+#define FrameArena_h__
+
+#include "jpge.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace VANE
+{
+	class FrameArena : public jpge::allocator
+	{
+	public:
+		struct Stats
+		{
+			uint64_t m_frames;          ///< Number of Reset() calls
+			uint64_t m_allocations;     ///< Allocations served, from the block or the heap
+			uint64_t m_heapAllocations; ///< Allocations that had to go to the heap, including block growth
+			size_t   m_frameBytes;      ///< Bytes allocated during the current frame
+			size_t   m_peakFrameBytes;  ///< Most bytes any one frame has needed
+			size_t   m_capacity;        ///< Size of the block
+		};
+
+		///@param initialCapacity Size of the first block, 0 to size it from the first frame
+		explicit FrameArena( size_t initialCapacity = 0 );
+		virtual ~FrameArena();
+
+		///Allocate size bytes aligned to kAlignment, valid until the next Reset()
+		void* Allocate( size_t size );
+
+		///Release everything allocated since the last reset
+		void Reset();
+
+		const Stats& GetStats() const { return m_stats; }
+
+	public: //[jpge::allocator methods]
+		virtual void* alloc( jpge::uint size ) { return Allocate( size ); }
+		virtual void free( void* /*p*/ ) { }
+
+	public:
+		static const size_t kAlignment = 16;
+
+	private:
+		FrameArena( const FrameArena& );
+		FrameArena& operator=( const FrameArena& );
+
+		uint8_t* m_pBlock;
+		size_t   m_used;
+		std::vector<void*> m_overflow; ///< Heap allocations made this frame because the block was full
+		Stats    m_stats;
+	};
+}
+
+#endif // FrameArena_h__
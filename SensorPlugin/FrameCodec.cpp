@@ -0,0 +1,648 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FrameCodec.cpp - Pluggable encoders for streamed camera frames.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FrameCodec.h"
+#include "jpge.h"
+#include "Qoi.h"
+
+#include <string.h>
+
+#ifdef ANVEL_WITH_X264
+extern "C"
+{
+#include <x264.h>
+}
+#endif
+
+namespace VANE
+{
+	bool ParseFrameCodec( const std::string& name, FrameCodecType& codec )
+	{
+		if ( name.empty() || name == "jpeg" || name == "jpg" )
+			codec = kFrameCodecJpeg;
+		else if ( name == "qoi" )
+			codec = kFrameCodecQoi;
+		else if ( name == "tiles" )
+			codec = kFrameCodecTiles;
+		else if ( name == "h264" || name == "x264" )
+			codec = kFrameCodecH264;
+		else
+			return false;
+		return true;
+	}
+
+	const char* GetFrameCodecName( FrameCodecType codec )
+	{
+		switch ( codec )
+		{
+		case kFrameCodecJpeg: return "jpeg";
+		case kFrameCodecQoi:  return "qoi";
+		case kFrameCodecTiles: return "tiles";
+		case kFrameCodecH264: return "h264";
+		}
+		return "unknown";
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// IFrameEncoder
+
+	bool IFrameEncoder::EncodeStreamed( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, IFrameSink& sink )
+	{
+		std::vector<uint8_t> output;
+		if ( !Encode( pPixels, width, height, channels, output ) )
+			return false;
+		return output.empty() || sink.Write( &output[0], output.size() );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// JpegFrameEncoder
+
+	///jpge stream that forwards each flush of the encoder's output buffer
+	class SinkStream : public jpge::output_stream
+	{
+	public:
+		explicit SinkStream( IFrameSink& sink ) : m_sink( sink ) { }
+
+		virtual bool put_buf( const void* pBuf, int len )
+		{
+			return m_sink.Write( static_cast<const uint8_t*>( pBuf ), len );
+		}
+
+	private:
+		SinkStream& operator=( const SinkStream& );
+
+		IFrameSink& m_sink;
+	};
+
+	///Lets jpge write straight into a vector, growing it as needed
+	static bool GrowVector( jpge::output_buffer& buffer, jpge::uint minCapacity )
+	{
+		std::vector<uint8_t>& output = *static_cast<std::vector<uint8_t>*>( buffer.m_pUser );
+		output.resize( minCapacity > output.size() * 2 ? minCapacity : output.size() * 2 );
+		buffer.m_pBuf = &output[0];
+		buffer.m_capacity = static_cast<jpge::uint>( output.size() );
+		return true;
+	}
+
+	///Compress rows that are stride bytes apart, appending to the first offset bytes of output
+	static bool CompressToVector( const uint8_t* pFirst, size_t stride, uint32_t width, uint32_t height, uint32_t channels,
+		const jpge::params& params, FrameArena& arena, std::vector<uint8_t>& output, size_t offset )
+	{
+		//Start with room for a typical frame, the vector grows if that is not enough
+		const size_t sizeHint = static_cast<size_t>(width) * height * channels / 8 + 1024;
+		if ( output.size() < offset + sizeHint )
+			output.resize( offset + sizeHint );
+
+		jpge::output_buffer buffer( &output[0], static_cast<jpge::uint>( output.size() ) );
+		buffer.m_size = static_cast<jpge::uint>( offset );
+		buffer.m_pGrow = GrowVector;
+		buffer.m_pUser = &output;
+
+		jpge::jpeg_encoder encoder;
+		encoder.set_allocator( &arena );
+		if ( !encoder.init( &buffer, width, height, channels, params ) )
+			return false;
+
+		for ( jpge::uint pass = 0; pass < encoder.get_total_passes(); ++pass )
+		{
+			for ( uint32_t row = 0; row < height; ++row )
+			{
+				if ( !encoder.process_scanline( pFirst + row * stride ) )
+					return false;
+			}
+			if ( !encoder.process_scanline( NULL ) )
+				return false;
+		}
+
+		output.resize( buffer.m_size );
+		return true;
+	}
+
+	static jpge::params GetJpegParams( const FrameEncoderParams& encoderParams, uint32_t width, uint32_t channels )
+	{
+		jpge::params params;
+		params.m_quality = encoderParams.m_quality;
+
+		//Grey images are coded as a single component with 8x8 MCUs, colour ones are subsampled H2V2 into 16x16 MCUs
+		if ( channels == 1 )
+			params.m_subsampling = jpge::Y_ONLY;
+		if ( encoderParams.m_restartMarkers )
+			params.m_restart_interval = channels == 1 ? (width + 7) / 8 : (width + 15) / 16;
+
+		return params;
+	}
+
+	JpegFrameEncoder::JpegFrameEncoder( const FrameEncoderParams& params )
+		: m_params( params )
+	{
+	}
+
+	void JpegFrameEncoder::Reconfigure( const FrameEncoderParams& params )
+	{
+		m_params = params;
+	}
+
+	bool JpegFrameEncoder::Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output )
+	{
+		const jpge::params params = GetJpegParams( m_params, width, channels );
+		m_arena.Reset();
+		if ( !CompressToVector( pPixels, static_cast<size_t>(width) * channels, width, height, channels, params, m_arena, output, 0 ) )
+		{
+			output.clear();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool JpegFrameEncoder::EncodeStreamed( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, IFrameSink& sink )
+	{
+		//The encoder flushes its small output buffer to the sink as MCU rows complete
+		SinkStream stream( sink );
+		m_arena.Reset();
+		jpge::jpeg_encoder encoder;
+		encoder.set_allocator( &m_arena );
+		if ( !encoder.init( &stream, width, height, channels, GetJpegParams( m_params, width, channels ) ) )
+			return false;
+
+		const size_t stride = static_cast<size_t>(width) * channels;
+		for ( jpge::uint pass = 0; pass < encoder.get_total_passes(); ++pass )
+		{
+			for ( uint32_t row = 0; row < height; ++row )
+			{
+				if ( !encoder.process_scanline( pPixels + row * stride ) )
+					return false;
+			}
+			if ( !encoder.process_scanline( NULL ) )
+				return false;
+		}
+
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// QoiFrameEncoder
+
+	bool QoiFrameEncoder::Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output )
+	{
+		size_t size = Qoi::GetMaxEncodedSize( width, height, channels );
+		output.resize( size );
+
+		if ( !Qoi::EncodeImage( pPixels, width, height, channels, &output[0], size ) )
+		{
+			output.clear();
+			return false;
+		}
+
+		output.resize( size );
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// TileFrameEncoder
+
+	static inline void Append16( std::vector<uint8_t>& output, uint32_t v )
+	{
+		output.push_back( static_cast<uint8_t>( v ) );
+		output.push_back( static_cast<uint8_t>( v >> 8 ) );
+	}
+
+	static inline void Append32( std::vector<uint8_t>& output, uint32_t v )
+	{
+		Append16( output, v & 0xFFFF );
+		Append16( output, v >> 16 );
+	}
+
+	static inline void Store32( uint8_t* p, uint32_t v )
+	{
+		p[0] = static_cast<uint8_t>( v );
+		p[1] = static_cast<uint8_t>( v >> 8 );
+		p[2] = static_cast<uint8_t>( v >> 16 );
+		p[3] = static_cast<uint8_t>( v >> 24 );
+	}
+
+	///Hash a rectangle of pixels eight bytes at a time. Only has to notice change, not resist attack.
+	static uint64_t HashRect( const uint8_t* pFirst, size_t stride, uint32_t rowBytes, uint32_t rows )
+	{
+		const uint64_t kMul = 0x9E3779B97F4A7C15ULL;
+		uint64_t hash = rowBytes * kMul;
+
+		for ( uint32_t y = 0; y < rows; ++y )
+		{
+			const uint8_t* pRow = pFirst + y * stride;
+			uint32_t i = 0;
+			for ( ; i + 8 <= rowBytes; i += 8 )
+			{
+				uint64_t v;
+				memcpy( &v, pRow + i, 8 );
+				hash = (hash ^ v) * kMul;
+				hash ^= hash >> 29;
+			}
+			for ( ; i < rowBytes; ++i )
+				hash = (hash ^ pRow[i]) * kMul;
+		}
+
+		return hash;
+	}
+
+	TileFrameEncoder::TileFrameEncoder( const FrameEncoderParams& params )
+		: m_params( params )
+		, m_width( 0 )
+		, m_height( 0 )
+		, m_tileSize( 0 )
+		, m_framesSinceRefresh( 0 )
+		, m_refreshRequested( true )
+	{
+	}
+
+	void TileFrameEncoder::Reconfigure( const FrameEncoderParams& params )
+	{
+		//New quality or tiling only looks right after a full frame
+		if ( params.m_quality != m_params.m_quality || params.m_tileSize != m_params.m_tileSize )
+			m_refreshRequested = true;
+		m_params = params;
+	}
+
+	bool TileFrameEncoder::EncodePatch( const uint8_t* pPixels, uint32_t width, uint32_t channels,
+		uint32_t x, uint32_t y, uint32_t patchWidth, uint32_t patchHeight, std::vector<uint8_t>& output )
+	{
+		const size_t patchHeader = output.size();
+		Append16( output, x );
+		Append16( output, y );
+		Append16( output, patchWidth );
+		Append16( output, patchHeight );
+		Append32( output, 0 );
+
+		jpge::params params;
+		params.m_quality = m_params.m_quality;
+
+		//Feed the rows straight out of the frame, no need to copy the patch out first
+		const size_t stride = static_cast<size_t>(width) * channels;
+		const uint8_t* pFirst = pPixels + y * stride + x * channels;
+		if ( !CompressToVector( pFirst, stride, patchWidth, patchHeight, channels, params, m_arena, output, output.size() ) )
+			return false;
+
+		Store32( &output[patchHeader + 8], static_cast<uint32_t>( output.size() - patchHeader - kTilePatchHeaderSize ) );
+		return true;
+	}
+
+	bool TileFrameEncoder::Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output )
+	{
+		output.clear();
+		m_arena.Reset();
+		if ( width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF )
+			return false;
+
+		//Tiles are whole MCUs so patch edges line up with the blocks of a full frame
+		uint32_t tileSize = (m_params.m_tileSize + 15) & ~15u;
+		if ( tileSize == 0 )
+			tileSize = 64;
+
+		const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+		const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+		const size_t stride = static_cast<size_t>(width) * channels;
+
+		//Hash the whole frame
+		m_newHashes.resize( tilesX * tilesY );
+		for ( uint32_t ty = 0; ty < tilesY; ++ty )
+		{
+			const uint32_t y = ty * tileSize;
+			const uint32_t rows = height - y < tileSize ? height - y : tileSize;
+			for ( uint32_t tx = 0; tx < tilesX; ++tx )
+			{
+				const uint32_t x = tx * tileSize;
+				const uint32_t columns = width - x < tileSize ? width - x : tileSize;
+				m_newHashes[ty * tilesX + tx] = HashRect( pPixels + y * stride + x * channels, stride, columns * channels, rows );
+			}
+		}
+
+		bool full = m_refreshRequested || width != m_width || height != m_height || tileSize != m_tileSize
+			|| (m_params.m_refreshInterval && m_framesSinceRefresh + 1 >= m_params.m_refreshInterval);
+
+		uint32_t dirtyTiles = 0;
+		if ( !full )
+		{
+			for ( size_t i = 0; i < m_newHashes.size(); ++i )
+			{
+				if ( m_newHashes[i] != m_tileHashes[i] )
+					++dirtyTiles;
+			}
+
+			//Past about half the frame, one JPEG is smaller than many patches and their headers
+			full = dirtyTiles * 2 > m_newHashes.size();
+		}
+
+		Append32( output, kTileFrameMagic );
+		Append16( output, kTileFrameVersion );
+		Append16( output, full ? kTileFrameFull : 0 );
+		Append32( output, width );
+		Append32( output, height );
+		Append32( output, 0 );
+
+		uint32_t patchCount = 0;
+		if ( full )
+		{
+			if ( !EncodePatch( pPixels, width, channels, 0, 0, width, height, output ) )
+				return false;
+			patchCount = 1;
+		}
+		else
+		{
+			//One patch for each horizontal run of changed tiles
+			for ( uint32_t ty = 0; ty < tilesY && dirtyTiles; ++ty )
+			{
+				const uint32_t y = ty * tileSize;
+				const uint32_t rows = height - y < tileSize ? height - y : tileSize;
+
+				uint32_t tx = 0;
+				while ( tx < tilesX )
+				{
+					const size_t tile = ty * tilesX + tx;
+					if ( m_newHashes[tile] == m_tileHashes[tile] )
+					{
+						++tx;
+						continue;
+					}
+
+					uint32_t end = tx + 1;
+					while ( end < tilesX && m_newHashes[ty * tilesX + end] != m_tileHashes[ty * tilesX + end] )
+						++end;
+
+					const uint32_t x = tx * tileSize;
+					const uint32_t columns = (end * tileSize < width ? end * tileSize : width) - x;
+					if ( !EncodePatch( pPixels, width, channels, x, y, columns, rows, output ) )
+						return false;
+
+					++patchCount;
+					dirtyTiles -= end - tx;
+					tx = end;
+				}
+			}
+		}
+
+		Store32( &output[16], patchCount );
+
+		m_tileHashes.swap( m_newHashes );
+		m_width = width;
+		m_height = height;
+		m_tileSize = tileSize;
+		m_framesSinceRefresh = full ? 0 : m_framesSinceRefresh + 1;
+		m_refreshRequested = false;
+		return true;
+	}
+
+#ifdef ANVEL_WITH_X264
+
+	//////////////////////////////////////////////////////////////////////////
+	// X264FrameEncoder
+
+	///Convert interleaved RGB(A) to BT.601 limited range I420. The destination may be
+	///one pixel larger than the source in each direction, the edge is repeated.
+	static void ConvertToI420( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, const x264_image_t& image,
+		uint32_t paddedWidth, uint32_t paddedHeight )
+	{
+		for ( uint32_t y = 0; y < paddedHeight; y += 2 )
+		{
+			const uint32_t y0 = y < height ? y : height - 1;
+			const uint32_t y1 = y + 1 < height ? y + 1 : height - 1;
+			const uint8_t* pRows[2] = { pPixels + static_cast<size_t>(y0) * width * channels, pPixels + static_cast<size_t>(y1) * width * channels };
+			uint8_t* pY[2] = { image.plane[0] + y * image.i_stride[0], image.plane[0] + (y + 1) * image.i_stride[0] };
+			uint8_t* pU = image.plane[1] + (y / 2) * image.i_stride[1];
+			uint8_t* pV = image.plane[2] + (y / 2) * image.i_stride[2];
+
+			for ( uint32_t x = 0; x < paddedWidth; x += 2 )
+			{
+				const uint32_t x0 = (x < width ? x : width - 1) * channels;
+				const uint32_t x1 = (x + 1 < width ? x + 1 : width - 1) * channels;
+
+				int sumR = 0, sumG = 0, sumB = 0;
+				for ( int row = 0; row < 2; ++row )
+				{
+					const uint8_t* pA = pRows[row] + x0;
+					const uint8_t* pB = pRows[row] + x1;
+					pY[row][x]     = static_cast<uint8_t>( ((66 * pA[0] + 129 * pA[1] + 25 * pA[2] + 128) >> 8) + 16 );
+					pY[row][x + 1] = static_cast<uint8_t>( ((66 * pB[0] + 129 * pB[1] + 25 * pB[2] + 128) >> 8) + 16 );
+					sumR += pA[0] + pB[0];
+					sumG += pA[1] + pB[1];
+					sumB += pA[2] + pB[2];
+				}
+
+				//Chroma from the average of the 2x2 block
+				pU[x / 2] = static_cast<uint8_t>( ((-38 * sumR - 74 * sumG + 112 * sumB + 512) >> 10) + 128 );
+				pV[x / 2] = static_cast<uint8_t>( ((112 * sumR - 94 * sumG - 18 * sumB + 512) >> 10) + 128 );
+			}
+		}
+	}
+
+	class X264FrameEncoder : public IFrameEncoder
+	{
+	public:
+		explicit X264FrameEncoder( const FrameEncoderParams& params )
+			: m_params( params )
+			, m_pEncoder( NULL )
+			, m_width( 0 )
+			, m_height( 0 )
+			, m_pts( 0 )
+			, m_keyframeRequested( true )
+		{
+			memset( &m_picture, 0, sizeof(m_picture) );
+		}
+
+		virtual ~X264FrameEncoder()
+		{
+			Close();
+		}
+
+		virtual FrameCodecType GetType() const { return kFrameCodecH264; }
+
+		virtual void Reconfigure( const FrameEncoderParams& params )
+		{
+			const bool rateChanged = params.m_bitrateKbps != m_params.m_bitrateKbps || params.m_frameRate != m_params.m_frameRate;
+			m_params = params;
+
+			if ( m_pEncoder && rateChanged )
+			{
+				x264_param_t param;
+				x264_encoder_parameters( m_pEncoder, &param );
+				SetRateControl( param );
+				x264_encoder_reconfig( m_pEncoder, &param );
+			}
+		}
+
+		virtual bool Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output )
+		{
+			output.clear();
+			if ( channels < 3 || width == 0 || height == 0 )
+				return false;
+
+			if ( !m_pEncoder || width != m_width || height != m_height )
+			{
+				Close();
+				if ( !Open( width, height ) )
+					return false;
+			}
+
+			ConvertToI420( pPixels, width, height, channels, m_picture.img, (width + 1) & ~1u, (height + 1) & ~1u );
+			m_picture.i_pts = m_pts++;
+			m_picture.i_type = m_keyframeRequested ? X264_TYPE_IDR : X264_TYPE_AUTO;
+			m_keyframeRequested = false;
+
+			x264_picture_t pictureOut;
+			x264_nal_t* pNals = NULL;
+			int nalCount = 0;
+			const int size = x264_encoder_encode( m_pEncoder, &pNals, &nalCount, &m_picture, &pictureOut );
+			if ( size < 0 )
+				return false;
+
+			//The NAL units of one frame are laid out back to back
+			if ( size > 0 )
+				output.assign( pNals[0].p_payload, pNals[0].p_payload + size );
+			return true;
+		}
+
+		virtual void RequestKeyframe()
+		{
+			m_keyframeRequested = true;
+		}
+
+	private:
+		void SetRateControl( x264_param_t& param ) const
+		{
+			const uint32_t frameRate = m_params.m_frameRate ? m_params.m_frameRate : 1;
+			param.i_fps_num = frameRate;
+			param.i_fps_den = 1;
+
+			//A VBV buffer of about one frame keeps every frame close to the average size,
+			//so no single frame takes much longer to send than the others
+			param.rc.i_rc_method       = X264_RC_ABR;
+			param.rc.i_bitrate         = m_params.m_bitrateKbps;
+			param.rc.i_vbv_max_bitrate = m_params.m_bitrateKbps;
+			param.rc.i_vbv_buffer_size = m_params.m_bitrateKbps / frameRate > 1 ? m_params.m_bitrateKbps / frameRate : 1;
+		}
+
+		bool Open( uint32_t width, uint32_t height )
+		{
+			x264_param_t param;
+			if ( x264_param_default_preset( &param, "ultrafast", "zerolatency" ) < 0 )
+				return false;
+
+			param.i_log_level = X264_LOG_NONE;
+			param.i_csp       = X264_CSP_I420;
+
+			//4:2:0 needs even dimensions, pad and crop the padding away again in the decoder
+			param.i_width  = static_cast<int>( (width + 1) & ~1u );
+			param.i_height = static_cast<int>( (height + 1) & ~1u );
+			param.crop_rect.i_right  = param.i_width - static_cast<int>( width );
+			param.crop_rect.i_bottom = param.i_height - static_cast<int>( height );
+
+			//Intra refresh still needs a period to sweep the refresh column over the frame
+			const uint32_t frameRate = m_params.m_frameRate ? m_params.m_frameRate : 1;
+			if ( m_params.m_keyframeInterval )
+				param.i_keyint_max = m_params.m_keyframeInterval;
+			else
+				param.i_keyint_max = m_params.m_intraRefresh ? frameRate * 2 : X264_KEYINT_MAX_INFINITE;
+			param.b_intra_refresh = m_params.m_intraRefresh ? 1 : 0;
+
+			//Every keyframe carries SPS/PPS so a client can join at any of them
+			param.b_repeat_headers = 1;
+			param.b_annexb = 1;
+
+			SetRateControl( param );
+
+			//Baseline is what hardware decoders on phones are guaranteed to handle
+			if ( x264_param_apply_profile( &param, "baseline" ) < 0 )
+				return false;
+
+			m_pEncoder = x264_encoder_open( &param );
+			if ( !m_pEncoder )
+				return false;
+
+			if ( x264_picture_alloc( &m_picture, X264_CSP_I420, param.i_width, param.i_height ) < 0 )
+			{
+				x264_encoder_close( m_pEncoder );
+				m_pEncoder = NULL;
+				return false;
+			}
+
+			m_width = width;
+			m_height = height;
+			m_keyframeRequested = true;
+			return true;
+		}
+
+		void Close()
+		{
+			if ( !m_pEncoder )
+				return;
+
+			x264_picture_clean( &m_picture );
+			x264_encoder_close( m_pEncoder );
+			m_pEncoder = NULL;
+			memset( &m_picture, 0, sizeof(m_picture) );
+		}
+
+		FrameEncoderParams m_params;
+		x264_t*        m_pEncoder;
+		x264_picture_t m_picture;
+		uint32_t       m_width;
+		uint32_t       m_height;
+		int64_t        m_pts;
+		bool           m_keyframeRequested;
+	};
+
+#endif // ANVEL_WITH_X264
+
+	//////////////////////////////////////////////////////////////////////////
+
+	IFrameEncoder* CreateFrameEncoder( const FrameEncoderParams& params )
+	{
+		switch ( params.m_codec )
+		{
+		case kFrameCodecJpeg:
+			return new JpegFrameEncoder( params );
+		case kFrameCodecQoi:
+			return new QoiFrameEncoder();
+		case kFrameCodecTiles:
+			return new TileFrameEncoder( params );
+		case kFrameCodecH264:
+#ifdef ANVEL_WITH_X264
+			return new X264FrameEncoder( params );
+#else
+			return NULL;
+#endif
+		}
+		return NULL;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void DownscaleFrame( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor, std::vector<uint8_t>& output )
+	{
+		uint32_t outWidth = width / factor;
+		uint32_t outHeight = height / factor;
+		output.resize( outWidth * outHeight * channels );
+
+		uint32_t blockSize = factor * factor;
+		uint32_t sums[4];
+		uint8_t* pOut = output.empty() ? NULL : &output[0];
+		for ( uint32_t y = 0; y < outHeight; ++y )
+		{
+			for ( uint32_t x = 0; x < outWidth; ++x )
+			{
+				memset( sums, 0, sizeof(sums) );
+				for ( uint32_t by = 0; by < factor; ++by )
+				{
+					const uint8_t* pIn = pPixels + ((y * factor + by) * width + x * factor) * channels;
+					for ( uint32_t i = 0; i < factor * channels; ++i )
+						sums[i % channels] += pIn[i];
+				}
+
+				for ( uint32_t c = 0; c < channels; ++c )
+					*pOut++ = static_cast<uint8_t>( (sums[c] + blockSize / 2) / blockSize );
+			}
+		}
+	}
+}
@@ -0,0 +1,193 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FrameCodec.h - Pluggable encoders for streamed camera frames.
+//
+// SampleSensor compresses every lens frame through an IFrameEncoder, one
+// encoder per camera since inter-frame codecs keep state between frames.
+//
+//   jpeg  Intra-only JPEG through jpge. Always available, and the only codec
+//         the UDP transport and the Android client understand.
+//   qoi   Lossless QOI (see Qoi.h). Larger than JPEG on textured scenes but
+//         several times cheaper to encode and free of artifacts, for a
+//         gigabit LAN or for capturing training data.
+//   tiles JPEG patches of only the tiles that changed since the previous
+//         frame, with a periodic full frame. Cost scales with how much of
+//         the scene changes rather than with resolution.
+//   h264  Low latency x264 (ultrafast/zerolatency, baseline profile) with a
+//         fixed bitrate and optional periodic intra refresh instead of large
+//         keyframes. Only built when ANVEL_WITH_X264 is defined and x264 is
+//         linked, since x264 is GPL licensed.
+//
+// Like FrameRing.h, this header does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef FrameCodec_h__
+#define FrameCodec_h__
+
+#include "FrameArena.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace VANE
+{
+	enum FrameCodecType
+	{
+		kFrameCodecJpeg = 0,
+		kFrameCodecQoi,
+		kFrameCodecTiles,
+		kFrameCodecH264
+	};
+
+	///Look up a codec by the name used in the sensor XML
+	bool ParseFrameCodec( const std::string& name, FrameCodecType& codec );
+	const char* GetFrameCodecName( FrameCodecType codec );
+
+	///Settings shared by all encoders, each codec uses the ones that apply to it
+	struct FrameEncoderParams
+	{
+		FrameEncoderParams()
+			: m_codec( kFrameCodecJpeg )
+			, m_quality( 85 )
+			, m_restartMarkers( false )
+			, m_tileSize( 64 )
+			, m_refreshInterval( 30 )
+			, m_bitrateKbps( 2000 )
+			, m_frameRate( 15 )
+			, m_keyframeInterval( 0 )
+			, m_intraRefresh( true )
+		{
+		}
+
+		FrameCodecType m_codec;
+
+		//JPEG
+		int      m_quality;          ///< 1-100
+		bool     m_restartMarkers;   ///< Restart marker on every MCU row, needed by the UDP transport
+
+		//Tiles
+		uint32_t m_tileSize;         ///< Tile edge in pixels, a multiple of 16
+		uint32_t m_refreshInterval;  ///< Frames between full frames, 0 for only on request
+
+		//Inter-frame codecs
+		uint32_t m_bitrateKbps;      ///< Target (and VBV cap) bitrate
+		uint32_t m_frameRate;        ///< Frames actually sent per second, used for rate control
+		uint32_t m_keyframeInterval; ///< Frames between forced keyframes, 0 relies on intra refresh and requests
+		bool     m_intraRefresh;     ///< Spread keyframes out as a moving column of intra blocks
+	};
+
+	///Receives encoded bytes while the rest of the frame is still being encoded
+	class IFrameSink
+	{
+	public:
+		virtual ~IFrameSink() { }
+
+		///@return false to abandon the frame
+		virtual bool Write( const uint8_t* pData, size_t size ) = 0;
+	};
+
+	///Interface for a stateful frame encoder
+	class IFrameEncoder
+	{
+	public:
+		virtual ~IFrameEncoder() { }
+
+		virtual FrameCodecType GetType() const = 0;
+
+		///Apply changed settings, the codec itself can not be changed
+		virtual void Reconfigure( const FrameEncoderParams& params ) = 0;
+
+		///Encode one frame of interleaved 8 bit pixels (1, 3 or 4 channels).
+		///output is replaced with the encoded frame.
+		virtual bool Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output ) = 0;
+
+		///Encode one frame, passing the bytes to sink as soon as they are produced.
+		///Codecs that can not stream write the whole frame once it is done.
+		virtual bool EncodeStreamed( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, IFrameSink& sink );
+
+		///Make the next frame decodable on its own, e.g. for a client that just connected
+		virtual void RequestKeyframe() = 0;
+	};
+
+	///Baseline JPEG through jpge
+	class JpegFrameEncoder : public IFrameEncoder
+	{
+	public:
+		explicit JpegFrameEncoder( const FrameEncoderParams& params );
+
+		virtual FrameCodecType GetType() const { return kFrameCodecJpeg; }
+		virtual void Reconfigure( const FrameEncoderParams& params );
+		virtual bool Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output );
+		virtual bool EncodeStreamed( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, IFrameSink& sink );
+		virtual void RequestKeyframe() { }
+
+		const FrameArena& GetArena() const { return m_arena; }
+
+	private:
+		FrameEncoderParams m_params;
+		FrameArena         m_arena; ///< jpge's working memory, reset every frame
+	};
+
+	///Lossless QOI
+	class QoiFrameEncoder : public IFrameEncoder
+	{
+	public:
+		QoiFrameEncoder() { }
+
+		virtual FrameCodecType GetType() const { return kFrameCodecQoi; }
+		virtual void Reconfigure( const FrameEncoderParams& /*params*/ ) { }
+		virtual bool Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output );
+		virtual void RequestKeyframe() { }
+	};
+
+	///Layout of a tiles frame, all fields little endian:
+	///  uint32 magic, uint16 version, uint16 flags, uint32 width, uint32 height, uint32 patch count
+	///followed by each patch:
+	///  uint16 x, uint16 y, uint16 width, uint16 height, uint32 JPEG size, JPEG data
+	///A client keeps the last frame and draws each patch over it at (x, y).
+	const uint32_t kTileFrameMagic   = 0x4C544E41; // "ANTL"
+	const uint16_t kTileFrameVersion = 1;
+	const uint16_t kTileFrameFull    = 0x0001;  ///< The single patch is the whole frame
+	const uint32_t kTileFrameHeaderSize = 20;
+	const uint32_t kTilePatchHeaderSize = 12;
+
+	///Dirty tile JPEG patches
+	class TileFrameEncoder : public IFrameEncoder
+	{
+	public:
+		explicit TileFrameEncoder( const FrameEncoderParams& params );
+
+		virtual FrameCodecType GetType() const { return kFrameCodecTiles; }
+		virtual void Reconfigure( const FrameEncoderParams& params );
+		virtual bool Encode( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, std::vector<uint8_t>& output );
+		virtual void RequestKeyframe() { m_refreshRequested = true; }
+
+		const FrameArena& GetArena() const { return m_arena; }
+
+	private:
+		bool EncodePatch( const uint8_t* pPixels, uint32_t width, uint32_t channels,
+			uint32_t x, uint32_t y, uint32_t patchWidth, uint32_t patchHeight, std::vector<uint8_t>& output );
+
+		FrameEncoderParams    m_params;
+		FrameArena            m_arena; ///< jpge's working memory for every patch, reset every frame
+		std::vector<uint64_t> m_tileHashes; ///< Hash of every tile as last sent
+		std::vector<uint64_t> m_newHashes;
+		uint32_t m_width;
+		uint32_t m_height;
+		uint32_t m_tileSize;
+		uint32_t m_framesSinceRefresh;
+		bool     m_refreshRequested;
+	};
+
+	///Create an encoder for params.m_codec.
+	///@return NULL if that codec was not compiled in
+	IFrameEncoder* CreateFrameEncoder( const FrameEncoderParams& params );
+
+	///Shrink a frame by a whole factor, each output pixel the average of a factor x factor block.
+	///Rows and columns past the last whole block are left out.
+	void DownscaleFrame( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor, std::vector<uint8_t>& output );
+}
+
+#endif // FrameCodec_h__
@@ -0,0 +1,419 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FrameRing.cpp - Shared memory ring buffer of raw camera frames.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FrameRing.h"
+
+#include <string.h>
+#include <new>
+
+#ifdef _WIN32
+#undef min
+#undef max
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VANE
+{
+	namespace FrameRing
+	{
+		const char* kDefaultRingName = "anvel_frames";
+
+		//Slots and headers are kept on cache line boundaries so that the
+		//writer and the readers never share a line between neighbouring slots
+		static const size_t kCacheLine = 64;
+
+		static inline size_t AlignUp( size_t value, size_t alignment )
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+
+		static inline size_t GetSlotHeaderSize()
+		{
+			return AlignUp( sizeof(SlotHeader), kCacheLine );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// SharedMapping
+
+		SharedMapping::SharedMapping()
+			: m_pData( NULL )
+			, m_size( 0 )
+			, m_owner( false )
+#ifdef _WIN32
+			, m_hMapping( NULL )
+#else
+			, m_fd( -1 )
+#endif
+		{
+		}
+
+		SharedMapping::~SharedMapping()
+		{
+			Close();
+		}
+
+#ifdef _WIN32
+
+		bool SharedMapping::Create( const std::string& name, size_t size )
+		{
+			Close();
+
+			std::string objectName = "Local\\" + name;
+			DWORD sizeHigh = static_cast<DWORD>( static_cast<uint64_t>(size) >> 32 );
+			DWORD sizeLow  = static_cast<DWORD>( size & 0xFFFFFFFF );
+			m_hMapping = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, sizeHigh, sizeLow, objectName.c_str() );
+			if ( m_hMapping == NULL )
+				return false;
+
+			m_pData = static_cast<uint8_t*>( MapViewOfFile( m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, size ) );
+			if ( m_pData == NULL )
+			{
+				//An existing mapping held open by a reader may be too small for us
+				Close();
+				return false;
+			}
+
+			m_size = size;
+			m_name = name;
+			m_owner = true;
+			return true;
+		}
+
+		bool SharedMapping::Open( const std::string& name )
+		{
+			Close();
+
+			std::string objectName = "Local\\" + name;
+			m_hMapping = OpenFileMappingA( FILE_MAP_READ, FALSE, objectName.c_str() );
+			if ( m_hMapping == NULL )
+				return false;
+
+			m_pData = static_cast<uint8_t*>( MapViewOfFile( m_hMapping, FILE_MAP_READ, 0, 0, 0 ) );
+			if ( m_pData == NULL )
+			{
+				Close();
+				return false;
+			}
+
+			MEMORY_BASIC_INFORMATION info;
+			VirtualQuery( m_pData, &info, sizeof(info) );
+			m_size = info.RegionSize;
+			m_name = name;
+			m_owner = false;
+			return true;
+		}
+
+		void SharedMapping::Close()
+		{
+			if ( m_pData )
+				UnmapViewOfFile( m_pData );
+			if ( m_hMapping )
+				CloseHandle( m_hMapping );
+
+			m_pData = NULL;
+			m_hMapping = NULL;
+			m_size = 0;
+			m_owner = false;
+		}
+
+#else
+
+		bool SharedMapping::Create( const std::string& name, size_t size )
+		{
+			Close();
+
+			//Unlink first so readers still attached to an old ring keep their
+			//own copy alive and notice the writer went away
+			std::string objectName = "/" + name;
+			shm_unlink( objectName.c_str() );
+
+			m_fd = shm_open( objectName.c_str(), O_CREAT | O_RDWR, 0666 );
+			if ( m_fd < 0 )
+				return false;
+
+			if ( ftruncate( m_fd, static_cast<off_t>(size) ) != 0 )
+			{
+				Close();
+				shm_unlink( objectName.c_str() );
+				return false;
+			}
+
+			void* pData = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+			if ( pData == MAP_FAILED )
+			{
+				Close();
+				shm_unlink( objectName.c_str() );
+				return false;
+			}
+
+			m_pData = static_cast<uint8_t*>( pData );
+			m_size = size;
+			m_name = name;
+			m_owner = true;
+			return true;
+		}
+
+		bool SharedMapping::Open( const std::string& name )
+		{
+			Close();
+
+			std::string objectName = "/" + name;
+			m_fd = shm_open( objectName.c_str(), O_RDONLY, 0 );
+			if ( m_fd < 0 )
+				return false;
+
+			struct stat st;
+			if ( fstat( m_fd, &st ) != 0 || st.st_size < static_cast<off_t>(sizeof(RingHeader)) )
+			{
+				Close();
+				return false;
+			}
+
+			void* pData = mmap( NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, m_fd, 0 );
+			if ( pData == MAP_FAILED )
+			{
+				Close();
+				return false;
+			}
+
+			m_pData = static_cast<uint8_t*>( pData );
+			m_size = static_cast<size_t>( st.st_size );
+			m_name = name;
+			m_owner = false;
+			return true;
+		}
+
+		void SharedMapping::Close()
+		{
+			if ( m_pData )
+				munmap( m_pData, m_size );
+			if ( m_fd >= 0 )
+				close( m_fd );
+			if ( m_owner )
+				shm_unlink( ("/" + m_name).c_str() );
+
+			m_pData = NULL;
+			m_fd = -1;
+			m_size = 0;
+			m_owner = false;
+		}
+
+#endif
+
+		//////////////////////////////////////////////////////////////////////////
+		// Writer
+
+		Writer::Writer()
+			: m_pHeader( NULL )
+			, m_frameNumber( 0 )
+		{
+		}
+
+		Writer::~Writer()
+		{
+			Close();
+		}
+
+		bool Writer::Create( const std::string& name, uint32_t slotCount, uint32_t slotPayloadSize )
+		{
+			Close();
+
+			if ( slotCount == 0 || slotPayloadSize == 0 )
+				return false;
+
+			const size_t headerSize = AlignUp( sizeof(RingHeader), kCacheLine );
+			const size_t slotStride = GetSlotHeaderSize() + AlignUp( slotPayloadSize, kCacheLine );
+			const size_t totalSize  = headerSize + slotStride * slotCount;
+
+			if ( !m_mapping.Create( name, totalSize ) )
+				return false;
+
+			uint8_t* pBase = m_mapping.GetData();
+			memset( pBase, 0, totalSize );
+
+			//Construct the shared atomics in place
+			m_pHeader = new (pBase) RingHeader();
+			for ( uint32_t i = 0; i < slotCount; ++i )
+				new (pBase + headerSize + slotStride * i) SlotHeader();
+
+			m_pHeader->m_slotCount       = slotCount;
+			m_pHeader->m_slotPayloadSize = slotPayloadSize;
+			m_pHeader->m_slotStride      = static_cast<uint32_t>( slotStride );
+			m_pHeader->m_firstSlotOffset = static_cast<uint32_t>( headerSize );
+			m_pHeader->m_version         = kRingVersion;
+			m_pHeader->m_writeCount.store( 0, std::memory_order_relaxed );
+			m_pHeader->m_writerAlive.store( 1, std::memory_order_relaxed );
+
+			//The magic goes in last so a reader never sees a half initialized header
+			std::atomic_thread_fence( std::memory_order_release );
+			m_pHeader->m_magic = kRingMagic;
+
+			m_frameNumber = 0;
+			return true;
+		}
+
+		void Writer::Close()
+		{
+			if ( m_pHeader )
+				m_pHeader->m_writerAlive.store( 0, std::memory_order_release );
+
+			m_pHeader = NULL;
+			m_mapping.Close();
+		}
+
+		bool Writer::Publish( const FrameInfo& info, const void* pPixels )
+		{
+			if ( !m_pHeader || info.m_payloadSize > m_pHeader->m_slotPayloadSize )
+				return false;
+
+			const uint32_t slot = static_cast<uint32_t>( m_frameNumber % m_pHeader->m_slotCount );
+			uint8_t* pSlot = m_mapping.GetData() + m_pHeader->m_firstSlotOffset + static_cast<size_t>(m_pHeader->m_slotStride) * slot;
+			SlotHeader* pSlotHeader = reinterpret_cast<SlotHeader*>( pSlot );
+
+			//Mark the slot as being written
+			const uint32_t sequence = pSlotHeader->m_sequence.load( std::memory_order_relaxed );
+			pSlotHeader->m_sequence.store( sequence + 1, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+
+			pSlotHeader->m_info = info;
+			pSlotHeader->m_info.m_frameNumber = m_frameNumber;
+			memcpy( pSlot + GetSlotHeaderSize(), pPixels, info.m_payloadSize );
+
+			//Complete the slot, then advance the write count readers poll on
+			pSlotHeader->m_sequence.store( sequence + 2, std::memory_order_release );
+			m_pHeader->m_writeCount.store( static_cast<uint32_t>(m_frameNumber + 1), std::memory_order_release );
+
+			++m_frameNumber;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Reader
+
+		Reader::Reader()
+			: m_pHeader( NULL )
+			, m_nextIndex( 0 )
+			, m_lapped( 0 )
+			, m_torn( 0 )
+		{
+		}
+
+		bool Reader::Open( const std::string& name )
+		{
+			Close();
+
+			if ( !m_mapping.Open( name ) )
+				return false;
+
+			RingHeader* pHeader = reinterpret_cast<RingHeader*>( m_mapping.GetData() );
+			std::atomic_thread_fence( std::memory_order_acquire );
+
+			const size_t expectedSize = pHeader->m_firstSlotOffset + static_cast<size_t>(pHeader->m_slotStride) * pHeader->m_slotCount;
+			if ( pHeader->m_magic != kRingMagic || pHeader->m_version != kRingVersion || pHeader->m_slotCount == 0 || expectedSize > m_mapping.GetSize() )
+			{
+				m_mapping.Close();
+				return false;
+			}
+
+			m_pHeader = pHeader;
+
+			//Start with whatever is currently the newest frame
+			const uint32_t writeCount = GetWriteCount();
+			m_nextIndex = writeCount ? writeCount - 1 : 0;
+			return true;
+		}
+
+		void Reader::Close()
+		{
+			m_pHeader = NULL;
+			m_mapping.Close();
+		}
+
+		bool Reader::IsWriterAlive() const
+		{
+			return m_pHeader && m_pHeader->m_writerAlive.load( std::memory_order_acquire ) != 0;
+		}
+
+		uint32_t Reader::GetWriteCount() const
+		{
+			return m_pHeader ? m_pHeader->m_writeCount.load( std::memory_order_acquire ) : 0;
+		}
+
+		SlotHeader* Reader::GetSlot( uint32_t slot ) const
+		{
+			uint8_t* pSlot = m_mapping.GetData() + m_pHeader->m_firstSlotOffset + static_cast<size_t>(m_pHeader->m_slotStride) * slot;
+			return reinterpret_cast<SlotHeader*>( pSlot );
+		}
+
+		bool Reader::AcquireLatest( FrameView& view )
+		{
+			const uint32_t writeCount = GetWriteCount();
+			if ( static_cast<int32_t>(writeCount - m_nextIndex) <= 0 )
+				return false;
+
+			//Anything between the last frame we took and the newest one is skipped on purpose
+			m_lapped += writeCount - 1 - m_nextIndex;
+			return Acquire( writeCount - 1, view );
+		}
+
+		bool Reader::AcquireNext( FrameView& view )
+		{
+			const uint32_t writeCount = GetWriteCount();
+			if ( static_cast<int32_t>(writeCount - m_nextIndex) <= 0 )
+				return false;
+
+			//If the writer lapped us, jump to the oldest frame that is still intact
+			const uint32_t slotCount = m_pHeader->m_slotCount;
+			if ( writeCount - m_nextIndex > slotCount )
+			{
+				m_lapped += writeCount - m_nextIndex - slotCount;
+				m_nextIndex = writeCount - slotCount;
+			}
+
+			return Acquire( m_nextIndex, view );
+		}
+
+		bool Reader::Acquire( uint32_t writeIndex, FrameView& view )
+		{
+			m_nextIndex = writeIndex + 1;
+
+			const uint32_t slot = writeIndex % m_pHeader->m_slotCount;
+			SlotHeader* pSlotHeader = GetSlot( slot );
+
+			const uint32_t sequence = pSlotHeader->m_sequence.load( std::memory_order_acquire );
+			view.m_info = pSlotHeader->m_info;
+			std::atomic_thread_fence( std::memory_order_acquire );
+
+			if ( (sequence & 1) != 0
+				|| pSlotHeader->m_sequence.load( std::memory_order_relaxed ) != sequence
+				|| static_cast<uint32_t>(view.m_info.m_frameNumber) != writeIndex
+				|| view.m_info.m_payloadSize > m_pHeader->m_slotPayloadSize )
+			{
+				++m_torn;
+				return false;
+			}
+
+			view.m_pPixels  = reinterpret_cast<const uint8_t*>( pSlotHeader ) + GetSlotHeaderSize();
+			view.m_slot     = slot;
+			view.m_sequence = sequence;
+			return true;
+		}
+
+		bool Reader::Validate( const FrameView& view ) const
+		{
+			if ( !m_pHeader )
+				return false;
+
+			std::atomic_thread_fence( std::memory_order_acquire );
+			return GetSlot( view.m_slot )->m_sequence.load( std::memory_order_relaxed ) == view.m_sequence;
+		}
+	}
+}
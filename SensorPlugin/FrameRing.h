@@ -0,0 +1,192 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FrameRing.h - Shared memory ring buffer of raw camera frames.
+//
+// The sensor plugin publishes every lens frame it samples into a named
+// shared memory region so that processes on the same host (perception,
+// dataset recording, the standalone FrameStreamer) can read the raw pixels
+// without a copy through a socket and without any encoding cost inside ANVEL.
+//
+// There is exactly one writer per ring. Each slot is protected by a sequence
+// counter (a seqlock): the writer makes the counter odd while it copies a
+// frame in and even again once the frame is complete. Readers never block the
+// writer; they read the counter, use the pixels in place and then check that
+// the counter did not move. If it did, the frame was overwritten underneath
+// them and must be discarded.
+//
+// This header intentionally does not depend on any ANVEL headers so that it
+// can be shared with external reader processes.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef FrameRing_h__
+#define FrameRing_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace VANE
+{
+	namespace FrameRing
+	{
+		const uint32_t kRingMagic   = 0x52464E41; // "ANFR"
+		const uint32_t kRingVersion = 1;
+
+		///Pixel layouts that can be published into the ring
+		enum PixelFormat
+		{
+			kPixelFormatGray = 1,
+			kPixelFormatRGB  = 3,
+			kPixelFormatRGBA = 4
+		};
+
+		///Metadata describing the frame held in a slot
+		struct FrameInfo
+		{
+			uint64_t m_frameNumber;     ///< Monotonic publish index, starts at 0
+			uint64_t m_sensorID;        ///< ID of the camera sensor that produced the frame
+			uint32_t m_lens;            ///< Lens index on that camera
+			uint32_t m_width;
+			uint32_t m_height;
+			uint32_t m_channels;        ///< One of PixelFormat
+			uint32_t m_stride;          ///< Bytes per row
+			uint32_t m_renderTimeStamp; ///< Renderer time stamp of the lens buffer
+			double   m_simTime;         ///< Simulation time when the frame was sampled
+			uint32_t m_payloadSize;     ///< Bytes of pixel data in the slot
+			uint32_t m_reserved;
+		};
+
+		///Fixed header at the start of the mapping
+		struct RingHeader
+		{
+			uint32_t m_magic;
+			uint32_t m_version;
+			uint32_t m_slotCount;
+			uint32_t m_slotPayloadSize;  ///< Capacity of each slot's pixel area
+			uint32_t m_slotStride;       ///< Distance in bytes between consecutive slots
+			uint32_t m_firstSlotOffset;  ///< Offset of slot 0 from the start of the mapping
+			std::atomic<uint32_t> m_writeCount; ///< Number of frames published so far
+			std::atomic<uint32_t> m_writerAlive;  ///< Cleared when the writer shuts down
+		};
+
+		///Header in front of every slot's pixel data
+		struct SlotHeader
+		{
+			std::atomic<uint32_t> m_sequence; ///< Odd while being written
+			uint32_t m_pad;
+			FrameInfo m_info;
+		};
+
+		///Platform specific handle to a named shared memory mapping
+		class SharedMapping
+		{
+		public:
+			SharedMapping();
+			~SharedMapping();
+
+			///Create (or recreate) a named mapping of the given size
+			bool Create( const std::string& name, size_t size );
+			///Open an existing named mapping
+			bool Open( const std::string& name );
+			void Close();
+
+			uint8_t* GetData() const { return m_pData; }
+			size_t GetSize() const { return m_size; }
+
+		private:
+			SharedMapping( const SharedMapping& );
+			SharedMapping& operator=( const SharedMapping& );
+
+			uint8_t* m_pData;
+			size_t   m_size;
+			std::string m_name;
+			bool     m_owner;
+#ifdef _WIN32
+			void*    m_hMapping;
+#else
+			int      m_fd;
+#endif
+		};
+
+		///Single producer side of the ring, owned by the sensor plugin
+		class Writer
+		{
+		public:
+			Writer();
+			~Writer();
+
+			///Create the ring. Any existing ring with the same name is replaced.
+			bool Create( const std::string& name, uint32_t slotCount, uint32_t slotPayloadSize );
+			void Close();
+
+			bool IsOpen() const { return m_pHeader != NULL; }
+			uint32_t GetSlotPayloadSize() const { return m_pHeader ? m_pHeader->m_slotPayloadSize : 0; }
+
+			///Copy a frame into the next slot and publish it.
+			///@return false if the ring is closed or the frame does not fit in a slot
+			bool Publish( const FrameInfo& info, const void* pPixels );
+
+		private:
+			SharedMapping m_mapping;
+			RingHeader*   m_pHeader;
+			uint64_t      m_frameNumber;
+		};
+
+		///A reference to a frame that lives inside the ring. The pixel pointer
+		///is only trustworthy if Reader::Validate() succeeds after it was used.
+		struct FrameView
+		{
+			FrameInfo      m_info;
+			const uint8_t* m_pPixels;
+			uint32_t       m_slot;
+			uint32_t       m_sequence;
+		};
+
+		///Consumer side of the ring. Any number of readers may attach.
+		class Reader
+		{
+		public:
+			Reader();
+
+			bool Open( const std::string& name );
+			void Close();
+
+			bool IsOpen() const { return m_pHeader != NULL; }
+			bool IsWriterAlive() const;
+
+			///Number of frames published by the writer so far
+			uint32_t GetWriteCount() const;
+
+			///Get the most recently published frame, skipping any older ones.
+			///@return false if there is no frame newer than the last one acquired
+			bool AcquireLatest( FrameView& view );
+
+			///Get the next frame after the last one acquired, in publish order.
+			///Frames that were overwritten before we got to them are counted in GetLappedCount().
+			bool AcquireNext( FrameView& view );
+
+			///Check that the frame was not overwritten while it was being used
+			bool Validate( const FrameView& view ) const;
+
+			uint64_t GetLappedCount() const { return m_lapped; }
+			uint64_t GetTornCount() const { return m_torn; }
+
+		private:
+			bool Acquire( uint32_t writeIndex, FrameView& view );
+			SlotHeader* GetSlot( uint32_t slot ) const;
+
+			SharedMapping m_mapping;
+			RingHeader*   m_pHeader;
+			uint32_t      m_nextIndex;
+			uint64_t      m_lapped;
+			uint64_t      m_torn;
+		};
+
+		///Name used when no ring name is configured
+		extern const char* kDefaultRingName;
+	}
+}
+
+#endif // FrameRing_h__
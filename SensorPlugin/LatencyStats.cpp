@@ -0,0 +1,179 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LatencyStats.cpp - Per-stream latency histograms for the frame pipeline.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "LatencyStats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace VANE
+{
+	//A renderer clock that jumps by more than this (a restart, or a pause) is learned again
+	static const int64_t kMaxRenderAge = 10 * 1000000;
+
+	static inline int64_t ToMicros( LatencyClock::duration duration )
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>( duration ).count();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// LatencyHistogram
+
+	void LatencyHistogram::Reset()
+	{
+		memset( m_counts, 0, sizeof(m_counts) );
+		m_count = 0;
+		m_max = 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	uint32_t LatencyHistogram::GetIndex( uint64_t value )
+	{
+		if ( value < kSubBuckets )
+			return static_cast<uint32_t>( value );
+
+		if ( value >> kMaxBits )
+			return kBucketCount - 1;
+
+		uint32_t highBit = kSubBucketBits;
+		while ( value >> (highBit + 1) )
+			++highBit;
+
+		//The top kSubBucketBits + 1 bits pick the bucket, the first of them is always set
+		uint32_t shift = highBit - kSubBucketBits;
+		return (shift + 1) * kSubBuckets + static_cast<uint32_t>( value >> shift ) - kSubBuckets;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	uint64_t LatencyHistogram::GetUpperBound( uint32_t index )
+	{
+		if ( index < kSubBuckets )
+			return index;
+
+		uint32_t shift = index / kSubBuckets - 1;
+		uint64_t top = index % kSubBuckets + kSubBuckets;
+		return ((top + 1) << shift) - 1;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void LatencyHistogram::Record( uint64_t micros )
+	{
+		++m_counts[GetIndex( micros )];
+		++m_count;
+		if ( micros > m_max )
+			m_max = micros;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	uint64_t LatencyHistogram::GetPercentile( double fraction ) const
+	{
+		if ( m_count == 0 )
+			return 0;
+
+		uint64_t target = static_cast<uint64_t>( fraction * m_count + 0.5 );
+		if ( target < 1 )
+			target = 1;
+
+		uint64_t seen = 0;
+		for ( uint32_t i = 0; i < kBucketCount; ++i )
+		{
+			seen += m_counts[i];
+			if ( seen >= target )
+			{
+				uint64_t bound = GetUpperBound( i );
+				return bound < m_max ? bound : m_max;
+			}
+		}
+		return m_max;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// StreamLatency
+
+	const char* GetLatencyStageName( LatencyStage stage )
+	{
+		switch ( stage )
+		{
+		case kLatencyRender: return "render";
+		case kLatencyQueue:  return "queue";
+		case kLatencyEncode: return "encode";
+		case kLatencySend:   return "send";
+		case kLatencyTotal:  return "total";
+		default:             return "unknown";
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	StreamLatency::StreamLatency()
+		: m_renderOffset( 0 )
+		, m_haveRenderOffset( false )
+		, m_lastRenderTimeStamp( 0 )
+		, m_repeatedFrames( 0 )
+	{
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void StreamLatency::Reset()
+	{
+		for ( int i = 0; i < kLatencyStageCount; ++i )
+			m_stages[i].Reset();
+		m_repeatedFrames = 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void StreamLatency::Record( const FrameTimestamps& frame )
+	{
+		//Both clocks in microseconds, the renderer's one has no meaningful epoch
+		int64_t snapshot = ToMicros( frame.m_snapshot.time_since_epoch() );
+		int64_t offset = snapshot - static_cast<int64_t>( frame.m_renderTimeStamp ) * 1000;
+
+		if ( !m_haveRenderOffset || offset < m_renderOffset || offset - m_renderOffset > kMaxRenderAge )
+		{
+			m_renderOffset = offset;
+			m_haveRenderOffset = true;
+		}
+		else if ( frame.m_renderTimeStamp == m_lastRenderTimeStamp )
+		{
+			++m_repeatedFrames;
+		}
+		m_lastRenderTimeStamp = frame.m_renderTimeStamp;
+
+		int64_t render = offset - m_renderOffset;
+		int64_t queue = ToMicros( frame.m_encodeStart - frame.m_snapshot );
+		int64_t encode = ToMicros( frame.m_encodeEnd - frame.m_encodeStart );
+		int64_t send = ToMicros( frame.m_sent - frame.m_encodeEnd );
+
+		m_stages[kLatencyRender].Record( render );
+		m_stages[kLatencyQueue].Record( queue );
+		m_stages[kLatencyEncode].Record( encode );
+		m_stages[kLatencySend].Record( send );
+		m_stages[kLatencyTotal].Record( render + queue + encode + send );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	std::string StreamLatency::Format() const
+	{
+		std::string text;
+		char buffer[128];
+		for ( int i = 0; i < kLatencyStageCount; ++i )
+		{
+			const LatencyHistogram& stage = m_stages[i];
+			sprintf( buffer, "%s%s %.1f/%.1f/%.1f/%.1f", i ? ", " : "", GetLatencyStageName( static_cast<LatencyStage>( i ) ),
+				stage.GetPercentile( 0.5 ) / 1000.0, stage.GetPercentile( 0.95 ) / 1000.0,
+				stage.GetPercentile( 0.99 ) / 1000.0, stage.GetMax() / 1000.0 );
+			text += buffer;
+		}
+		return text;
+	}
+}
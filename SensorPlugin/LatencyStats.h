@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LatencyStats.h - Per-stream latency histograms for the frame pipeline.
+//
+// SampleSensor stamps every frame it sends at each stage on the way from the
+// renderer to the socket:
+//
+//   render    the renderer finished the frame (m_renderTimeStamp)
+//   snapshot  the sensor tick that samples the cameras started
+//   encode    the codec started and finished compressing the frame
+//   sent      the transport took the last byte
+//
+// and StreamLatency adds the time spent between them to one histogram per
+// stage. Recording is a few additions into fixed tables, so it stays on for
+// every frame, and the sensor logs the percentiles at an interval.
+//
+// m_renderTimeStamp comes from the renderer's own millisecond clock, which
+// the sensor cannot read. The render stage is therefore measured against the
+// smallest offset seen so far between that clock and ours: it is how much
+// older a frame is than the freshest frame the sensor has picked up, which
+// is the time it waited for a sensor tick plus any jitter in the renderer.
+// This only holds while the renderer clock runs in real time.
+//
+// Like FrameRing.h, this header does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef LatencyStats_h__
+#define LatencyStats_h__
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+
+namespace VANE
+{
+	typedef std::chrono::steady_clock LatencyClock;
+
+	///Log-linear histogram of durations in microseconds, as in HdrHistogram.
+	///Values are grouped by their highest set bit and then split into
+	///kSubBuckets linear steps, so every value is kept to within about 3% of
+	///itself, from 1 us to several hours, in a fixed table.
+	class LatencyHistogram
+	{
+	public:
+		LatencyHistogram() { Reset(); }
+
+		void Reset();
+		void Record( uint64_t micros );
+
+		uint64_t GetCount() const { return m_count; }
+		uint64_t GetMax() const { return m_max; }
+
+		///@param fraction Between 0 and 1, e.g. 0.99
+		///@return the smallest value at least that fraction of the samples do not exceed
+		uint64_t GetPercentile( double fraction ) const;
+
+	private:
+		enum
+		{
+			kSubBucketBits = 5,
+			kSubBuckets    = 1 << kSubBucketBits,
+			kMaxBits       = 36,  ///< Values of 2^36 us (19 hours) and up are clamped
+			kBucketCount   = (kMaxBits - kSubBucketBits + 1) * kSubBuckets
+		};
+
+		static uint32_t GetIndex( uint64_t value );
+		static uint64_t GetUpperBound( uint32_t index );
+
+		uint32_t m_counts[kBucketCount];
+		uint64_t m_count;
+		uint64_t m_max;
+	};
+
+	enum LatencyStage
+	{
+		kLatencyRender,  ///< Render to snapshot, waiting for a sensor tick
+		kLatencyQueue,   ///< Snapshot to encode start, waiting behind other streams in the tick
+		kLatencyEncode,  ///< Encode start to end
+		kLatencySend,    ///< Encode end to the transport taking the frame
+		kLatencyTotal,   ///< Render to the transport taking the frame
+		kLatencyStageCount
+	};
+
+	const char* GetLatencyStageName( LatencyStage stage );
+
+	///When one frame passed each stage
+	struct FrameTimestamps
+	{
+		uint32_t m_renderTimeStamp;  ///< Renderer clock in milliseconds
+		LatencyClock::time_point m_snapshot;
+		LatencyClock::time_point m_encodeStart;
+		LatencyClock::time_point m_encodeEnd;
+		LatencyClock::time_point m_sent;
+	};
+
+	///The stage histograms of one camera's stream
+	class StreamLatency
+	{
+	public:
+		StreamLatency();
+
+		void Record( const FrameTimestamps& frame );
+
+		///Clear the histograms, but keep what has been learned about the renderer clock
+		void Reset();
+
+		const LatencyHistogram& GetStage( LatencyStage stage ) const { return m_stages[stage]; }
+
+		///Frames sent again because the renderer had not produced a new one
+		uint64_t GetRepeatedFrames() const { return m_repeatedFrames; }
+
+		///p50/p95/p99/max of every stage in milliseconds, on one line
+		std::string Format() const;
+
+	private:
+		LatencyHistogram m_stages[kLatencyStageCount];
+		int64_t  m_renderOffset;  ///< Smallest (our clock - renderer clock) seen, in microseconds
+		bool     m_haveRenderOffset;
+		uint32_t m_lastRenderTimeStamp;
+		uint64_t m_repeatedFrames;
+	};
+}
+
+#endif // LatencyStats_h__
@@ -0,0 +1,279 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Qoi.cpp - Lossless "Quite OK Image" format encoder and decoder.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "Qoi.h"
+
+#include <string.h>
+
+namespace VANE
+{
+	namespace Qoi
+	{
+		enum
+		{
+			kOpIndex = 0x00,
+			kOpDiff  = 0x40,
+			kOpLuma  = 0x80,
+			kOpRun   = 0xC0,
+			kOpRGB   = 0xFE,
+			kOpRGBA  = 0xFF,
+			kOpMask  = 0xC0
+		};
+
+		static const uint32_t kMagic = 0x716F6966; // "qoif"
+		static const uint32_t kMaxRun = 62;
+
+		///A pixel packed as r, g, b, a from the low byte up
+		static inline uint32_t Pack( uint8_t r, uint8_t g, uint8_t b, uint8_t a )
+		{
+			return r | (g << 8) | (b << 16) | (static_cast<uint32_t>(a) << 24);
+		}
+
+		static inline uint32_t Hash( uint32_t px )
+		{
+			const uint32_t r = px & 0xFF, g = (px >> 8) & 0xFF, b = (px >> 16) & 0xFF, a = px >> 24;
+			return (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+		}
+
+		static inline void Write32( uint8_t*& p, uint32_t v )
+		{
+			p[0] = static_cast<uint8_t>( v >> 24 );
+			p[1] = static_cast<uint8_t>( v >> 16 );
+			p[2] = static_cast<uint8_t>( v >> 8 );
+			p[3] = static_cast<uint8_t>( v );
+			p += 4;
+		}
+
+		static inline uint32_t Read32( const uint8_t* p )
+		{
+			return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		template <uint32_t Channels>
+		static inline uint32_t LoadPixel( const uint8_t* p )
+		{
+			if ( Channels == 1 )
+				return Pack( p[0], p[0], p[0], 255 );
+			if ( Channels == 3 )
+				return Pack( p[0], p[1], p[2], 255 );
+			return Pack( p[0], p[1], p[2], p[3] );
+		}
+
+		template <uint32_t Channels>
+		static uint8_t* EncodePixels( const uint8_t* pPixels, uint32_t pixelCount, uint8_t* pOut )
+		{
+			uint32_t index[64];
+			memset( index, 0, sizeof(index) );
+
+			uint32_t prev = Pack( 0, 0, 0, 255 );
+			uint32_t run = 0;
+			const uint8_t* pEnd = pPixels + static_cast<size_t>(pixelCount) * Channels;
+
+			for ( const uint8_t* p = pPixels; p != pEnd; p += Channels )
+			{
+				const uint32_t px = LoadPixel<Channels>( p );
+
+				if ( px == prev )
+				{
+					if ( ++run == kMaxRun )
+					{
+						*pOut++ = static_cast<uint8_t>( kOpRun | (run - 1) );
+						run = 0;
+					}
+					continue;
+				}
+
+				if ( run )
+				{
+					*pOut++ = static_cast<uint8_t>( kOpRun | (run - 1) );
+					run = 0;
+				}
+
+				const uint32_t hash = Hash( px );
+				if ( index[hash] == px )
+				{
+					*pOut++ = static_cast<uint8_t>( kOpIndex | hash );
+				}
+				else
+				{
+					index[hash] = px;
+
+					if ( (px ^ prev) >> 24 == 0 )
+					{
+						const int8_t dr = static_cast<int8_t>( (px & 0xFF) - (prev & 0xFF) );
+						const int8_t dg = static_cast<int8_t>( ((px >> 8) & 0xFF) - ((prev >> 8) & 0xFF) );
+						const int8_t db = static_cast<int8_t>( ((px >> 16) & 0xFF) - ((prev >> 16) & 0xFF) );
+						const int8_t drg = static_cast<int8_t>( dr - dg );
+						const int8_t dbg = static_cast<int8_t>( db - dg );
+
+						if ( dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2 )
+						{
+							*pOut++ = static_cast<uint8_t>( kOpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2) );
+						}
+						else if ( drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8 )
+						{
+							*pOut++ = static_cast<uint8_t>( kOpLuma | (dg + 32) );
+							*pOut++ = static_cast<uint8_t>( ((drg + 8) << 4) | (dbg + 8) );
+						}
+						else
+						{
+							pOut[0] = kOpRGB;
+							pOut[1] = static_cast<uint8_t>( px );
+							pOut[2] = static_cast<uint8_t>( px >> 8 );
+							pOut[3] = static_cast<uint8_t>( px >> 16 );
+							pOut += 4;
+						}
+					}
+					else
+					{
+						pOut[0] = kOpRGBA;
+						pOut[1] = static_cast<uint8_t>( px );
+						pOut[2] = static_cast<uint8_t>( px >> 8 );
+						pOut[3] = static_cast<uint8_t>( px >> 16 );
+						pOut[4] = static_cast<uint8_t>( px >> 24 );
+						pOut += 5;
+					}
+				}
+
+				prev = px;
+			}
+
+			if ( run )
+				*pOut++ = static_cast<uint8_t>( kOpRun | (run - 1) );
+
+			return pOut;
+		}
+
+		bool EncodeImage( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, uint8_t* pOutput, size_t& size )
+		{
+			if ( width == 0 || height == 0 || (channels != 1 && channels != 3 && channels != 4) )
+				return false;
+			if ( size < GetMaxEncodedSize( width, height, channels ) )
+				return false;
+
+			uint8_t* p = pOutput;
+			Write32( p, kMagic );
+			Write32( p, width );
+			Write32( p, height );
+			*p++ = static_cast<uint8_t>( channels == 4 ? 4 : 3 );
+			*p++ = 0; // sRGB with linear alpha
+
+			const uint32_t pixelCount = width * height;
+			switch ( channels )
+			{
+			case 1: p = EncodePixels<1>( pPixels, pixelCount, p ); break;
+			case 3: p = EncodePixels<3>( pPixels, pixelCount, p ); break;
+			case 4: p = EncodePixels<4>( pPixels, pixelCount, p ); break;
+			}
+
+			static const uint8_t kEndMarker[kEndMarkerSize] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+			memcpy( p, kEndMarker, kEndMarkerSize );
+			p += kEndMarkerSize;
+
+			size = p - pOutput;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool ReadHeader( const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height, uint32_t& channels )
+		{
+			if ( size < kHeaderSize + kEndMarkerSize || Read32( pData ) != kMagic )
+				return false;
+
+			width = Read32( pData + 4 );
+			height = Read32( pData + 8 );
+			channels = pData[12];
+			return width != 0 && height != 0 && (channels == 3 || channels == 4);
+		}
+
+		bool DecodeImage( const uint8_t* pData, size_t size, uint8_t* pPixels, size_t pixelsSize )
+		{
+			uint32_t width, height, channels;
+			if ( !ReadHeader( pData, size, width, height, channels ) )
+				return false;
+
+			const size_t outSize = static_cast<size_t>(width) * height * channels;
+			if ( pixelsSize < outSize )
+				return false;
+
+			uint32_t index[64];
+			memset( index, 0, sizeof(index) );
+
+			uint32_t px = Pack( 0, 0, 0, 255 );
+			uint32_t run = 0;
+			const uint8_t* p = pData + kHeaderSize;
+			const uint8_t* pEnd = pData + size - kEndMarkerSize;
+
+			for ( size_t out = 0; out < outSize; out += channels )
+			{
+				if ( run )
+				{
+					--run;
+				}
+				else
+				{
+					if ( p >= pEnd )
+						return false;
+
+					const uint8_t op = *p++;
+					if ( op == kOpRGB )
+					{
+						if ( pEnd - p < 3 )
+							return false;
+						px = Pack( p[0], p[1], p[2], static_cast<uint8_t>(px >> 24) );
+						p += 3;
+					}
+					else if ( op == kOpRGBA )
+					{
+						if ( pEnd - p < 4 )
+							return false;
+						px = Pack( p[0], p[1], p[2], p[3] );
+						p += 4;
+					}
+					else if ( (op & kOpMask) == kOpIndex )
+					{
+						px = index[op];
+					}
+					else if ( (op & kOpMask) == kOpDiff )
+					{
+						const uint8_t r = static_cast<uint8_t>( (px & 0xFF) + ((op >> 4) & 3) - 2 );
+						const uint8_t g = static_cast<uint8_t>( ((px >> 8) & 0xFF) + ((op >> 2) & 3) - 2 );
+						const uint8_t b = static_cast<uint8_t>( ((px >> 16) & 0xFF) + (op & 3) - 2 );
+						px = Pack( r, g, b, static_cast<uint8_t>(px >> 24) );
+					}
+					else if ( (op & kOpMask) == kOpLuma )
+					{
+						if ( p >= pEnd )
+							return false;
+						const int dg = (op & 0x3F) - 32;
+						const uint8_t extra = *p++;
+						const uint8_t r = static_cast<uint8_t>( (px & 0xFF) + dg - 8 + (extra >> 4) );
+						const uint8_t g = static_cast<uint8_t>( ((px >> 8) & 0xFF) + dg );
+						const uint8_t b = static_cast<uint8_t>( ((px >> 16) & 0xFF) + dg - 8 + (extra & 0x0F) );
+						px = Pack( r, g, b, static_cast<uint8_t>(px >> 24) );
+					}
+					else
+					{
+						run = op & 0x3F;
+					}
+
+					index[Hash( px )] = px;
+				}
+
+				pPixels[out]     = static_cast<uint8_t>( px );
+				pPixels[out + 1] = static_cast<uint8_t>( px >> 8 );
+				pPixels[out + 2] = static_cast<uint8_t>( px >> 16 );
+				if ( channels == 4 )
+					pPixels[out + 3] = static_cast<uint8_t>( px >> 24 );
+			}
+
+			return true;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Qoi.h - Lossless "Quite OK Image" format encoder and decoder.
+//
+// QOI (https://qoiformat.org) codes each pixel as a run, a reference into a
+// 64 entry table of recently seen colours, a small difference from the
+// previous pixel or, failing all that, the raw value. It is a single pass
+// with no transform or entropy coder, which makes it many times faster than
+// JPEG while still compressing rendered images to a fraction of their size.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Qoi_h__
+#define Qoi_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace VANE
+{
+	namespace Qoi
+	{
+		const uint32_t kHeaderSize = 14;
+		const uint32_t kEndMarkerSize = 8;
+
+		///Largest possible encoded size of an image, for sizing output buffers
+		inline size_t GetMaxEncodedSize( uint32_t width, uint32_t height, uint32_t channels )
+		{
+			const uint32_t outChannels = channels == 4 ? 4 : 3;
+			return static_cast<size_t>(width) * height * (outChannels + 1) + kHeaderSize + kEndMarkerSize;
+		}
+
+		///Encode interleaved 8 bit pixels with 1 (grey, stored as RGB), 3 or 4 channels.
+		///@param size In: capacity of pOutput (see GetMaxEncodedSize). Out: encoded size.
+		bool EncodeImage( const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t channels, uint8_t* pOutput, size_t& size );
+
+		///Read the image dimensions and channel count (3 or 4) from an encoded header
+		bool ReadHeader( const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height, uint32_t& channels );
+
+		///Decode into width * height * channels bytes, using the channel count from the header
+		bool DecodeImage( const uint8_t* pData, size_t size, uint8_t* pPixels, size_t pixelsSize );
+	}
+}
+
+#endif // Qoi_h__
@@ -0,0 +1,301 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RateControl.cpp - Congestion control of the video stream from client acks.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "RateControl.h"
+
+#include <algorithm>
+
+namespace VANE
+{
+	namespace RateControl
+	{
+		//Decisions are spaced out so each one sees a few acks
+		static const int64_t kDecisionIntervalUs = 200000;
+		//Least time between steps down, for the step to show in the acks
+		static const int64_t kDecreaseHoldUs = 500000;
+		//Frames in flight and no ack for this long means the acks (or the frames) are stuck
+		static const int64_t kFeedbackTimeoutUs = 1000000;
+		//The base delay is kept for one to two of these, long enough to outlast a congested spell
+		static const int64_t kBaseBucketUs = 30000000;
+		//A step down this soon after a step up means the probe failed
+		static const int64_t kProbeWindowUs = 5000000;
+		static const int64_t kMinProbeHoldUs = 2000000;
+		static const int64_t kMaxProbeHoldUs = 32000000;
+
+		//Quality goes first since it costs the operator least, frame rate last since teleoperation needs it most
+		static const Settings kLadder[] =
+		{
+			{ 100, 1, 1 },
+			{  80, 1, 1 },
+			{  60, 1, 1 },
+			{  80, 2, 1 },
+			{  60, 2, 1 },
+			{  60, 2, 2 },
+			{  45, 2, 3 },
+			{  45, 4, 3 }
+		};
+		static const uint32_t kLevelCount = sizeof(kLadder) / sizeof(kLadder[0]);
+
+		static inline void Put32( uint8_t*& p, uint32_t value )
+		{
+			for ( int i = 0; i < 4; ++i )
+				*p++ = static_cast<uint8_t>( value >> (8 * i) );
+		}
+
+		static inline void Put64( uint8_t*& p, int64_t value )
+		{
+			uint64_t bits = static_cast<uint64_t>( value );
+			for ( int i = 0; i < 8; ++i )
+				*p++ = static_cast<uint8_t>( bits >> (8 * i) );
+		}
+
+		static inline uint32_t Get32( const uint8_t*& p )
+		{
+			uint32_t value = 0;
+			for ( int i = 0; i < 4; ++i )
+				value |= static_cast<uint32_t>( *p++ ) << (8 * i);
+			return value;
+		}
+
+		static inline int64_t Get64( const uint8_t*& p )
+		{
+			uint64_t bits = 0;
+			for ( int i = 0; i < 8; ++i )
+				bits |= static_cast<uint64_t>( *p++ ) << (8 * i);
+			return static_cast<int64_t>( bits );
+		}
+
+		///Sequences wrap, a is newer if it is less than half the range ahead
+		static inline bool IsNewer( uint32_t a, uint32_t b )
+		{
+			return static_cast<int32_t>( a - b ) > 0;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Acks
+
+		size_t WriteAcks( const Ack* pAcks, uint32_t count, uint8_t* pMessage )
+		{
+			if ( count == 0 || count > kMaxAcks )
+				return 0;
+
+			uint8_t* p = pMessage;
+			*p++ = kAckMarker;
+			*p++ = static_cast<uint8_t>( count );
+			for ( uint32_t i = 0; i < count; ++i )
+			{
+				Put32( p, pAcks[i].m_sequence );
+				Put64( p, pAcks[i].m_received );
+			}
+			return p - pMessage;
+		}
+
+		bool ReadAcks( const uint8_t* pMessage, size_t size, std::vector<Ack>& acks )
+		{
+			if ( size < 2 || pMessage[0] != kAckMarker )
+				return false;
+
+			uint32_t count = pMessage[1];
+			if ( count == 0 || count > kMaxAcks || size != 2 + count * kAckEntrySize )
+				return false;
+
+			const uint8_t* p = pMessage + 2;
+			for ( uint32_t i = 0; i < count; ++i )
+			{
+				Ack ack;
+				ack.m_sequence = Get32( p );
+				ack.m_received = Get64( p );
+				acks.push_back( ack );
+			}
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Controller
+
+		Controller::Controller()
+			: m_targetDelay( static_cast<int64_t>( kDefaultTargetDelayMs ) * 1000 )
+		{
+			Reset();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void Controller::Reset()
+		{
+			for ( uint32_t i = 0; i < kSentHistory; ++i )
+			{
+				m_sent[i].m_sequence = 0;
+				m_sent[i].m_size = 0;
+				m_sent[i].m_sent = 0;
+				m_sent[i].m_acked = true;
+			}
+			m_nextSequence = 0;
+			m_anySent = false;
+
+			m_baseCurrent = 0;
+			m_basePrevious = 0;
+			m_baseBucketStart = 0;
+
+			m_active = false;
+			m_queueDelay = 0;
+			m_decisionDelay = 0;
+			m_lastAck = 0;
+			m_newestAcked = 0;
+			m_newAcks = false;
+			m_lastProgress = 0;
+
+			m_ackedBytes = 0;
+			m_firstReceived = 0;
+			m_deliveryRate = 0;
+
+			m_level = 0;
+			m_lastDecision = 0;
+			m_lastChange = 0;
+			m_lastIncrease = 0;
+			m_probeHold = kMinProbeHoldUs;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		uint32_t Controller::GetLevelCount() const
+		{
+			return kLevelCount;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		const Settings& Controller::GetSettings() const
+		{
+			return kLadder[m_level];
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void Controller::OnFrameSent( uint32_t sequence, int64_t sent, size_t size )
+		{
+			SentFrame& frame = m_sent[sequence % kSentHistory];
+			frame.m_sequence = sequence;
+			frame.m_size = static_cast<uint32_t>( size );
+			frame.m_sent = sent;
+			frame.m_acked = false;
+
+			m_nextSequence = sequence + 1;
+			m_anySent = true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void Controller::OnAck( const Ack& ack )
+		{
+			//Frames from before a Reset(), or too old to be remembered, say nothing about the queue now
+			SentFrame& frame = m_sent[ack.m_sequence % kSentHistory];
+			if ( !m_anySent || frame.m_sequence != ack.m_sequence || frame.m_acked )
+				return;
+			frame.m_acked = true;
+
+			int64_t delay = ack.m_received - frame.m_sent;
+			if ( !m_active )
+			{
+				m_active = true;
+				m_baseCurrent = delay;
+				m_basePrevious = delay;
+				m_baseBucketStart = frame.m_sent;
+				m_newestAcked = ack.m_sequence;
+				m_lastChange = frame.m_sent;
+			}
+
+			if ( frame.m_sent - m_baseBucketStart >= kBaseBucketUs )
+			{
+				m_basePrevious = m_baseCurrent;
+				m_baseCurrent = delay;
+				m_baseBucketStart = frame.m_sent;
+			}
+			else
+			{
+				m_baseCurrent = std::min( m_baseCurrent, delay );
+			}
+
+			//Smoothed over a few frames, one frame stuck behind a large one is not congestion
+			int64_t queued = delay - std::min( m_baseCurrent, m_basePrevious );
+			m_queueDelay += (queued - m_queueDelay) / 4;
+
+			if ( m_ackedBytes == 0 )
+				m_firstReceived = ack.m_received;
+			m_ackedBytes += frame.m_size;
+			m_lastAck = ack.m_received;
+
+			if ( IsNewer( ack.m_sequence, m_newestAcked ) )
+				m_newestAcked = ack.m_sequence;
+			m_newAcks = true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool Controller::Update( int64_t now )
+		{
+			if ( !m_active || now - m_lastDecision < kDecisionIntervalUs )
+				return false;
+			m_lastDecision = now;
+
+			if ( m_ackedBytes > 0 && m_lastAck > m_firstReceived )
+				m_deliveryRate = static_cast<uint32_t>( m_ackedBytes * 8000 / (m_lastAck - m_firstReceived) );
+			m_ackedBytes = 0;
+
+			//Acks late behind a long queue still arrive, stalled is when they stop with frames in flight
+			if ( m_newAcks )
+				m_lastProgress = now;
+			m_newAcks = false;
+
+			bool stalled = false;
+			uint32_t next = m_newestAcked + 1;
+			if ( next != m_nextSequence && IsNewer( m_nextSequence, next ) )
+				stalled = m_nextSequence - next > kSentHistory || now - m_lastProgress > kFeedbackTimeoutUs;
+
+			//A queue over the target that is already draining needs no further step, as in GCC's trend
+			bool draining = m_queueDelay < m_decisionDelay;
+			m_decisionDelay = m_queueDelay;
+
+			if ( stalled || m_queueDelay > m_targetDelay )
+			{
+				if ( m_level + 1 >= kLevelCount || now - m_lastChange < kDecreaseHoldUs || (draining && !stalled) )
+					return false;
+
+				if ( m_lastIncrease != 0 && now - m_lastIncrease < kProbeWindowUs )
+					m_probeHold = std::min( m_probeHold * 2, kMaxProbeHoldUs );
+				m_lastIncrease = 0;
+
+				//A queue far over the target is not worth two decisions
+				Step( !stalled && m_queueDelay > 4 * m_targetDelay ? 2 : 1, now );
+				return true;
+			}
+
+			//A step up that held gets the next one sooner
+			if ( m_lastIncrease != 0 && now - m_lastIncrease >= kProbeWindowUs )
+			{
+				m_probeHold = std::max( m_probeHold / 2, kMinProbeHoldUs );
+				m_lastIncrease = 0;
+			}
+
+			if ( m_level > 0 && m_queueDelay < m_targetDelay / 2 && now - m_lastChange >= m_probeHold )
+			{
+				Step( -1, now );
+				m_lastIncrease = now;
+				return true;
+			}
+			return false;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void Controller::Step( int delta, int64_t now )
+		{
+			int level = static_cast<int>( m_level ) + delta;
+			m_level = static_cast<uint32_t>( std::min( std::max( level, 0 ), static_cast<int>( kLevelCount ) - 1 ) );
+			m_lastChange = now;
+		}
+	}
+}
@@ -0,0 +1,153 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RateControl.h - Congestion control of the video stream from client acks.
+//
+// The sensor encodes at a fixed quality and rate, and a viewer that can not
+// keep up (a weak Wi-Fi link, a slow phone) only shows as the socket's queue
+// growing until every frame it sees is seconds old. With acks the sensor can
+// tell and send less before that happens.
+//
+// A client that knows the protocol answers the frames it receives on the video
+// socket (the way it already asks for keyframes) with the frame's sequence
+// from its ClockSync trailer and the time it had the whole frame, on any
+// monotonic clock of its own. Acks can be batched, up to kMaxAcks a message.
+//
+// The send and receive times are on different clocks, so one frame's delay
+// means nothing on its own, but the offset between the clocks is constant:
+// the smallest delay seen lately is the path with empty queues (as in LEDBAT),
+// and anything over it is queueing. The controller works one session at a
+// time and steps the stream down a ladder of settings (quality first, then
+// resolution, then frame rate) while the queueing delay is over the target,
+// or when acks stop coming for frames that were sent. It steps back up once
+// the delay has stayed well under the target for a while, and every step up
+// that soon has to be taken back makes it wait longer before the next probe.
+//
+// Only frames with a trailer (JPEG with frameTimestamps) can be acked, and a
+// client that never acks, like the original Android app, leaves the stream
+// as it was configured.
+//
+// All values are little endian. Like FrameRing.h, this header does not
+// depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef RateControl_h__
+#define RateControl_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace VANE
+{
+	namespace RateControl
+	{
+		//////////////////////////////////////////////////////////////////////////
+		// Acks
+
+		const uint8_t  kAckMarker    = 'a';
+		const uint32_t kAckEntrySize = 12;
+		const uint32_t kMaxAcks      = 32;
+
+		///Largest ack message: marker, uint8 count, then per frame uint32 sequence, int64 received
+		const uint32_t kMaxAckMessageSize = 2 + kMaxAcks * kAckEntrySize;
+
+		struct Ack
+		{
+			uint32_t m_sequence;  ///< From the frame's trailer
+			int64_t  m_received;  ///< Microseconds on the client's clock
+		};
+
+		///@return the number of bytes written, 0 if count is not 1 to kMaxAcks
+		size_t WriteAcks( const Ack* pAcks, uint32_t count, uint8_t* pMessage );
+		///Append the acks in a message to acks
+		///@return false if the message is not an ack message
+		bool ReadAcks( const uint8_t* pMessage, size_t size, std::vector<Ack>& acks );
+
+		//////////////////////////////////////////////////////////////////////////
+		// Controller
+
+		const uint32_t kDefaultTargetDelayMs = 100;
+
+		///What the stream is sent with on one rung of the ladder
+		struct Settings
+		{
+			uint32_t m_qualityPercent;  ///< Of the configured quality, and bitrate for inter-frame codecs
+			uint32_t m_scale;           ///< Width and height are divided by this
+			uint32_t m_rateDivisor;     ///< Only every nth frame that is due is sent
+		};
+
+		class Controller
+		{
+		public:
+			Controller();
+
+			///Forget the session, for a new client. The stream goes back to its configured settings.
+			void Reset();
+			void SetTargetDelay( uint32_t ms ) { m_targetDelay = static_cast<int64_t>( ms ) * 1000; }
+
+			///A frame with a trailer went to the socket, sent on ClockSync::Now()
+			void OnFrameSent( uint32_t sequence, int64_t sent, size_t size );
+			void OnAck( const Ack& ack );
+
+			///Decide on the next step, call once per update
+			///@return true if the settings changed
+			bool Update( int64_t now );
+
+			///The client has acked a frame since the last Reset()
+			bool IsActive() const { return m_active; }
+			uint32_t GetLevel() const { return m_level; }
+			uint32_t GetLevelCount() const;
+			const Settings& GetSettings() const;
+
+			///Smoothed queueing delay, in microseconds
+			int64_t GetQueueDelay() const { return m_queueDelay; }
+			///Bytes the client received per second over the last decision, in kbit/s
+			uint32_t GetDeliveryRate() const { return m_deliveryRate; }
+
+		private:
+			enum { kSentHistory = 256 };
+
+			struct SentFrame
+			{
+				uint32_t m_sequence;
+				uint32_t m_size;
+				int64_t  m_sent;
+				bool     m_acked;
+			};
+
+			void Step( int delta, int64_t now );
+
+			int64_t  m_targetDelay;
+			SentFrame m_sent[kSentHistory];  ///< By sequence modulo kSentHistory
+			uint32_t m_nextSequence;         ///< One after the last frame sent
+			bool     m_anySent;
+
+			//Base delay as the lower of two buckets of kBaseBucketUs, as old as two buckets at most
+			int64_t  m_baseCurrent;
+			int64_t  m_basePrevious;
+			int64_t  m_baseBucketStart;
+
+			bool     m_active;
+			int64_t  m_queueDelay;
+			int64_t  m_decisionDelay;        ///< m_queueDelay at the last decision, to tell a queue that is draining
+			int64_t  m_lastAck;              ///< Client receive time of the newest ack
+			uint32_t m_newestAcked;
+			bool     m_newAcks;              ///< Acks came in since the last decision
+			int64_t  m_lastProgress;         ///< Decision that last saw new acks
+
+			//Delivery since the last decision
+			uint64_t m_ackedBytes;
+			int64_t  m_firstReceived;
+			uint32_t m_deliveryRate;
+
+			uint32_t m_level;
+			int64_t  m_lastDecision;
+			int64_t  m_lastChange;
+			int64_t  m_lastIncrease;
+			int64_t  m_probeHold;            ///< Time the delay must stay low before a step up
+		};
+	}
+}
+
+#endif // RateControl_h__
@@ -0,0 +1,665 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Recording.cpp - Recorded sessions for replay and offline benchmarking.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "Recording.h"
+#include "ClockSync.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#undef min
+#undef max
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VANE
+{
+	namespace Recording
+	{
+		//Records go to the disk through a buffer this size, the index through stdio's default
+		static const size_t kWriteBufferSize = 1 << 20;
+
+		static inline void Put( uint8_t*& p, uint64_t value, int bytes )
+		{
+			for ( int i = 0; i < bytes; ++i )
+				*p++ = static_cast<uint8_t>( value >> (8 * i) );
+		}
+
+		static inline uint64_t Get( const uint8_t*& p, int bytes )
+		{
+			uint64_t value = 0;
+			for ( int i = 0; i < bytes; ++i )
+				value |= static_cast<uint64_t>( *p++ ) << (8 * i);
+			return value;
+		}
+
+		static inline void PutDouble( uint8_t*& p, double value )
+		{
+			uint64_t bits;
+			memcpy( &bits, &value, sizeof(bits) );
+			Put( p, bits, 8 );
+		}
+
+		static inline double GetDouble( const uint8_t*& p )
+		{
+			uint64_t bits = Get( p, 8 );
+			double value;
+			memcpy( &value, &bits, sizeof(value) );
+			return value;
+		}
+
+		//Segments may be larger than 2 GB
+		static bool Seek( FILE* pFile, uint64_t offset, int origin )
+		{
+#ifdef _WIN32
+			return _fseeki64( pFile, static_cast<__int64>( offset ), origin ) == 0;
+#else
+			return fseeko( pFile, static_cast<off_t>( offset ), origin ) == 0;
+#endif
+		}
+
+		static uint64_t Tell( FILE* pFile )
+		{
+#ifdef _WIN32
+			return static_cast<uint64_t>( _ftelli64( pFile ) );
+#else
+			return static_cast<uint64_t>( ftello( pFile ) );
+#endif
+		}
+
+		static bool ReadFileHeader( const uint8_t* pHeader, uint32_t magic, uint32_t segment )
+		{
+			const uint8_t* p = pHeader;
+			return Get( p, 4 ) == magic && Get( p, 2 ) == kVersion && Get( p, 2 ) == 0 && Get( p, 4 ) == segment;
+		}
+
+		static void ReadIndexEntry( const uint8_t* pEntry, uint64_t& offset, RecordInfo& info )
+		{
+			const uint8_t* p = pEntry;
+			offset          = Get( p, 8 );
+			info.m_sequence = Get( p, 8 );
+			info.m_simTime  = static_cast<int64_t>( Get( p, 8 ) );
+			info.m_wallTime = static_cast<int64_t>( Get( p, 8 ) );
+			info.m_size     = static_cast<uint32_t>( Get( p, 4 ) );
+			info.m_kind     = static_cast<uint32_t>( Get( p, 1 ) );
+			info.m_format   = static_cast<uint32_t>( Get( p, 1 ) );
+			info.m_lens     = static_cast<uint32_t>( Get( p, 2 ) );
+			info.m_channel  = static_cast<uint32_t>( Get( p, 4 ) );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void WriteVehicleState( const VehicleState& state, uint8_t* pPayload )
+		{
+			uint8_t* p = pPayload;
+			for ( int i = 0; i < 3; ++i )
+				PutDouble( p, state.m_position[i] );
+			for ( int i = 0; i < 4; ++i )
+				PutDouble( p, state.m_orientation[i] );
+			PutDouble( p, state.m_forwardSpeed );
+			PutDouble( p, state.m_yawRate );
+			PutDouble( p, state.m_throttle );
+			PutDouble( p, state.m_steering );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool ReadVehicleState( const uint8_t* pPayload, size_t size, VehicleState& state )
+		{
+			if ( size != kVehicleStateSize )
+				return false;
+
+			const uint8_t* p = pPayload;
+			for ( int i = 0; i < 3; ++i )
+				state.m_position[i] = GetDouble( p );
+			for ( int i = 0; i < 4; ++i )
+				state.m_orientation[i] = GetDouble( p );
+			state.m_forwardSpeed = GetDouble( p );
+			state.m_yawRate      = GetDouble( p );
+			state.m_throttle     = GetDouble( p );
+			state.m_steering     = GetDouble( p );
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void WriteControlInput( const ControlInput& input, uint8_t* pPayload )
+		{
+			uint8_t* p = pPayload;
+			PutDouble( p, input.m_desiredSpeed );
+			PutDouble( p, input.m_desiredYaw );
+			Put( p, input.m_command, 1 );
+			Put( p, 0, 7 );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool ReadControlInput( const uint8_t* pPayload, size_t size, ControlInput& input )
+		{
+			if ( size != kControlInputSize )
+				return false;
+
+			const uint8_t* p = pPayload;
+			input.m_desiredSpeed = GetDouble( p );
+			input.m_desiredYaw   = GetDouble( p );
+			input.m_command      = static_cast<uint8_t>( Get( p, 1 ) );
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void WriteRawFrameHeader( const RawFrameHeader& header, uint8_t* pHeader )
+		{
+			uint8_t* p = pHeader;
+			Put( p, header.m_width, 4 );
+			Put( p, header.m_height, 4 );
+			Put( p, header.m_channels, 4 );
+			Put( p, header.m_stride, 4 );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool ReadRawFrameHeader( const uint8_t* pPayload, size_t size, RawFrameHeader& header )
+		{
+			if ( size < kRawFrameHeaderSize )
+				return false;
+
+			const uint8_t* p = pPayload;
+			header.m_width    = static_cast<uint32_t>( Get( p, 4 ) );
+			header.m_height   = static_cast<uint32_t>( Get( p, 4 ) );
+			header.m_channels = static_cast<uint32_t>( Get( p, 4 ) );
+			header.m_stride   = static_cast<uint32_t>( Get( p, 4 ) );
+			return header.m_stride >= static_cast<uint64_t>( header.m_width ) * header.m_channels
+				&& size - kRawFrameHeaderSize >= static_cast<uint64_t>( header.m_stride ) * header.m_height;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void WriteFileHeader( uint32_t magic, uint32_t segment, uint8_t* pHeader )
+		{
+			uint8_t* p = pHeader;
+			Put( p, magic, 4 );
+			Put( p, kVersion, 2 );
+			Put( p, 0, 2 );
+			Put( p, segment, 4 );
+			Put( p, 0, 4 );
+		}
+
+		void WriteRecordHeader( const RecordInfo& info, uint8_t* pHeader )
+		{
+			uint8_t* p = pHeader;
+			Put( p, info.m_size, 4 );
+			Put( p, info.m_kind, 1 );
+			Put( p, info.m_format, 1 );
+			Put( p, info.m_lens, 2 );
+			Put( p, info.m_channel, 4 );
+			Put( p, 0, 4 );
+			Put( p, info.m_sequence, 8 );
+			Put( p, static_cast<uint64_t>( info.m_simTime ), 8 );
+			Put( p, static_cast<uint64_t>( info.m_wallTime ), 8 );
+		}
+
+		void WriteIndexEntry( uint64_t offset, const RecordInfo& info, uint8_t* pEntry )
+		{
+			uint8_t* p = pEntry;
+			Put( p, offset, 8 );
+			Put( p, info.m_sequence, 8 );
+			Put( p, static_cast<uint64_t>( info.m_simTime ), 8 );
+			Put( p, static_cast<uint64_t>( info.m_wallTime ), 8 );
+			Put( p, info.m_size, 4 );
+			Put( p, info.m_kind, 1 );
+			Put( p, info.m_format, 1 );
+			Put( p, info.m_lens, 2 );
+			Put( p, info.m_channel, 4 );
+			Put( p, 0, 4 );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		std::string GetSegmentFileName( const std::string& base, uint32_t segment )
+		{
+			char suffix[32];
+			sprintf( suffix, ".%04u.anvr", segment );
+			return base + suffix;
+		}
+
+		std::string GetIndexFileName( const std::string& base, uint32_t segment )
+		{
+			char suffix[32];
+			sprintf( suffix, ".%04u.anvi", segment );
+			return base + suffix;
+		}
+
+		void RemoveRecording( const std::string& base )
+		{
+			for ( uint32_t segment = 0; ; ++segment )
+			{
+				bool removedSegment = remove( GetSegmentFileName( base, segment ).c_str() ) == 0;
+				bool removedIndex = remove( GetIndexFileName( base, segment ).c_str() ) == 0;
+				if ( !removedSegment && !removedIndex )
+					break;
+			}
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// MappedFile
+
+		MappedFile::MappedFile()
+			: m_pData( NULL )
+			, m_size( 0 )
+#ifdef _WIN32
+			, m_hFile( INVALID_HANDLE_VALUE )
+			, m_hMapping( NULL )
+#else
+			, m_fd( -1 )
+#endif
+		{
+		}
+
+		MappedFile::~MappedFile()
+		{
+			Close();
+		}
+
+#ifdef _WIN32
+
+		bool MappedFile::Open( const std::string& fileName )
+		{
+			Close();
+
+			//The writer may still be appending to it
+			m_hFile = CreateFileA( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+			if ( m_hFile == INVALID_HANDLE_VALUE )
+				return false;
+
+			//An empty file cannot be mapped
+			LARGE_INTEGER size;
+			if ( !GetFileSizeEx( m_hFile, &size ) || size.QuadPart == 0 || static_cast<uint64_t>( size.QuadPart ) > static_cast<size_t>( -1 ) )
+			{
+				Close();
+				return false;
+			}
+
+			m_hMapping = CreateFileMappingA( m_hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+			if ( m_hMapping == NULL )
+			{
+				Close();
+				return false;
+			}
+
+			m_pData = static_cast<const uint8_t*>( MapViewOfFile( m_hMapping, FILE_MAP_READ, 0, 0, 0 ) );
+			if ( m_pData == NULL )
+			{
+				Close();
+				return false;
+			}
+
+			m_size = static_cast<size_t>( size.QuadPart );
+			return true;
+		}
+
+		void MappedFile::Close()
+		{
+			if ( m_pData )
+				UnmapViewOfFile( m_pData );
+			if ( m_hMapping )
+				CloseHandle( m_hMapping );
+			if ( m_hFile != INVALID_HANDLE_VALUE )
+				CloseHandle( m_hFile );
+
+			m_pData = NULL;
+			m_hMapping = NULL;
+			m_hFile = INVALID_HANDLE_VALUE;
+			m_size = 0;
+		}
+
+#else
+
+		bool MappedFile::Open( const std::string& fileName )
+		{
+			Close();
+
+			m_fd = open( fileName.c_str(), O_RDONLY );
+			if ( m_fd < 0 )
+				return false;
+
+			//An empty file cannot be mapped
+			struct stat st;
+			if ( fstat( m_fd, &st ) != 0 || st.st_size == 0 )
+			{
+				Close();
+				return false;
+			}
+
+			void* pData = mmap( NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, m_fd, 0 );
+			if ( pData == MAP_FAILED )
+			{
+				Close();
+				return false;
+			}
+
+			m_pData = static_cast<const uint8_t*>( pData );
+			m_size = static_cast<size_t>( st.st_size );
+			return true;
+		}
+
+		void MappedFile::Close()
+		{
+			if ( m_pData )
+				munmap( const_cast<uint8_t*>( m_pData ), m_size );
+			if ( m_fd >= 0 )
+				close( m_fd );
+
+			m_pData = NULL;
+			m_fd = -1;
+			m_size = 0;
+		}
+
+#endif
+
+		//////////////////////////////////////////////////////////////////////////
+		// Writer
+
+		Writer::Writer()
+			: m_segmentLimit( 0 )
+			, m_segmentCount( 0 )
+			, m_pData( NULL )
+			, m_pIndex( NULL )
+			, m_offset( 0 )
+			, m_sequence( 0 )
+			, m_bytesWritten( 0 )
+		{
+		}
+
+		Writer::~Writer()
+		{
+			Close();
+		}
+
+		bool Writer::Open( const std::string& base, uint32_t segmentMB )
+		{
+			Close();
+			RemoveRecording( base );
+
+			m_base = base;
+			m_segmentLimit = static_cast<uint64_t>( segmentMB > 0 ? segmentMB : kDefaultSegmentMB ) << 20;
+			m_segmentCount = 0;
+			m_sequence = 0;
+			m_bytesWritten = 0;
+			return OpenSegment();
+		}
+
+		void Writer::Close()
+		{
+			CloseSegment();
+		}
+
+		bool Writer::OpenSegment()
+		{
+			m_pData = fopen( GetSegmentFileName( m_base, m_segmentCount ).c_str(), "wb" );
+			m_pIndex = fopen( GetIndexFileName( m_base, m_segmentCount ).c_str(), "wb" );
+			if ( !m_pData || !m_pIndex )
+			{
+				CloseSegment();
+				return false;
+			}
+			setvbuf( m_pData, NULL, _IOFBF, kWriteBufferSize );
+
+			uint8_t header[kFileHeaderSize];
+			WriteFileHeader( kSegmentMagic, m_segmentCount, header );
+			bool written = fwrite( header, sizeof(header), 1, m_pData ) == 1;
+			WriteFileHeader( kIndexMagic, m_segmentCount, header );
+			written = written && fwrite( header, sizeof(header), 1, m_pIndex ) == 1;
+			if ( !written )
+			{
+				CloseSegment();
+				return false;
+			}
+
+			m_offset = kFileHeaderSize;
+			++m_segmentCount;
+			return true;
+		}
+
+		void Writer::CloseSegment()
+		{
+			//The index goes last, so it never names a record the segment does not have
+			if ( m_pData )
+				fclose( m_pData );
+			if ( m_pIndex )
+				fclose( m_pIndex );
+
+			m_pData = NULL;
+			m_pIndex = NULL;
+		}
+
+		bool Writer::Append( uint32_t kind, uint32_t format, uint32_t channel, int64_t simTime, const void* pPayload, size_t size )
+		{
+			if ( !IsOpen() )
+				return false;
+
+			//A record is never split, so a big one can take a segment past the limit
+			if ( m_offset > kFileHeaderSize && m_offset + kRecordHeaderSize + size > m_segmentLimit )
+			{
+				CloseSegment();
+				if ( !OpenSegment() )
+					return false;
+			}
+
+			RecordInfo info;
+			info.m_kind = kind;
+			info.m_format = format;
+			info.m_channel = channel;
+			info.m_lens = 0;
+			info.m_size = static_cast<uint32_t>( size );
+			info.m_sequence = m_sequence;
+			info.m_simTime = simTime;
+			info.m_wallTime = ClockSync::Now();
+
+			uint8_t header[kRecordHeaderSize];
+			WriteRecordHeader( info, header );
+			uint8_t entry[kIndexEntrySize];
+			WriteIndexEntry( m_offset, info, entry );
+
+			if ( fwrite( header, sizeof(header), 1, m_pData ) != 1
+				|| (size > 0 && fwrite( pPayload, size, 1, m_pData ) != 1)
+				|| fwrite( entry, sizeof(entry), 1, m_pIndex ) != 1 )
+			{
+				Close();
+				return false;
+			}
+
+			m_offset += kRecordHeaderSize + size;
+			m_bytesWritten += kRecordHeaderSize + size;
+			++m_sequence;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Reader
+
+		Reader::Reader()
+			: m_recordCount( 0 )
+			, m_truncated( 0 )
+			, m_pData( NULL )
+			, m_pDataSegment( NULL )
+		{
+		}
+
+		Reader::~Reader()
+		{
+			Close();
+		}
+
+		bool Reader::Open( const std::string& base )
+		{
+			Close();
+
+			for ( uint32_t segment = 0; ; ++segment )
+			{
+				MappedFile* pIndex = new MappedFile();
+				std::string fileName = GetSegmentFileName( base, segment );
+				FILE* pData = fopen( fileName.c_str(), "rb" );
+				if ( !pData || !pIndex->Open( GetIndexFileName( base, segment ) )
+					|| pIndex->GetSize() < kFileHeaderSize || !ReadFileHeader( pIndex->GetData(), kIndexMagic, segment ) )
+				{
+					if ( pData )
+						fclose( pData );
+					delete pIndex;
+					break;
+				}
+
+				uint8_t header[kFileHeaderSize];
+				bool valid = fread( header, sizeof(header), 1, pData ) == 1 && ReadFileHeader( header, kSegmentMagic, segment )
+					&& Seek( pData, 0, SEEK_END );
+				uint64_t dataSize = valid ? Tell( pData ) : 0;
+				fclose( pData );
+				if ( !valid )
+				{
+					delete pIndex;
+					break;
+				}
+
+				Segment entry;
+				entry.m_pIndex = pIndex;
+				entry.m_first = m_recordCount;
+				entry.m_count = (pIndex->GetSize() - kFileHeaderSize) / kIndexEntrySize;
+				entry.m_fileName = fileName;
+
+				//Drop the tail of a recording that stopped in the middle of a record
+				uint64_t available = entry.m_count;
+				while ( entry.m_count > 0 )
+				{
+					uint64_t offset;
+					RecordInfo info;
+					ReadIndexEntry( pIndex->GetData() + kFileHeaderSize + (entry.m_count - 1) * kIndexEntrySize, offset, info );
+					if ( info.m_sequence == entry.m_first + entry.m_count - 1 && offset + kRecordHeaderSize + info.m_size <= dataSize )
+						break;
+					--entry.m_count;
+				}
+				m_truncated += available - entry.m_count;
+
+				m_segments.push_back( entry );
+				m_recordCount += entry.m_count;
+
+				//Records after a gap would have the wrong sequence numbers
+				if ( entry.m_count < available )
+					break;
+			}
+
+			return IsOpen();
+		}
+
+		void Reader::Close()
+		{
+			if ( m_pData )
+				fclose( m_pData );
+			m_pData = NULL;
+			m_pDataSegment = NULL;
+
+			for ( size_t i = 0; i < m_segments.size(); ++i )
+				delete m_segments[i].m_pIndex;
+			m_segments.clear();
+			m_recordCount = 0;
+			m_truncated = 0;
+		}
+
+		const Reader::Segment* Reader::FindSegment( uint64_t sequence ) const
+		{
+			if ( sequence >= m_recordCount )
+				return NULL;
+
+			size_t low = 0;
+			size_t high = m_segments.size();
+			while ( high - low > 1 )
+			{
+				size_t middle = (low + high) / 2;
+				if ( m_segments[middle].m_first <= sequence )
+					low = middle;
+				else
+					high = middle;
+			}
+			return &m_segments[low];
+		}
+
+		bool Reader::GetInfo( uint64_t sequence, RecordInfo& info ) const
+		{
+			const Segment* pSegment = FindSegment( sequence );
+			if ( !pSegment )
+				return false;
+
+			uint64_t offset;
+			ReadIndexEntry( pSegment->m_pIndex->GetData() + kFileHeaderSize + (sequence - pSegment->m_first) * kIndexEntrySize, offset, info );
+			return true;
+		}
+
+		uint64_t Reader::FindSimTime( int64_t simTime ) const
+		{
+			uint64_t low = 0;
+			uint64_t high = m_recordCount;
+			while ( low < high )
+			{
+				uint64_t middle = low + (high - low) / 2;
+				RecordInfo info;
+				GetInfo( middle, info );
+				if ( info.m_simTime < simTime )
+					low = middle + 1;
+				else
+					high = middle;
+			}
+			return low;
+		}
+
+		bool Reader::Read( uint64_t sequence, RecordInfo& info, std::vector<uint8_t>& payload )
+		{
+			const Segment* pSegment = FindSegment( sequence );
+			if ( !pSegment )
+				return false;
+
+			if ( pSegment != m_pDataSegment )
+			{
+				if ( m_pData )
+					fclose( m_pData );
+				m_pData = fopen( pSegment->m_fileName.c_str(), "rb" );
+				m_pDataSegment = m_pData ? pSegment : NULL;
+				if ( !m_pData )
+					return false;
+			}
+
+			uint64_t offset;
+			RecordInfo indexed;
+			ReadIndexEntry( pSegment->m_pIndex->GetData() + kFileHeaderSize + (sequence - pSegment->m_first) * kIndexEntrySize, offset, indexed );
+
+			uint8_t header[kRecordHeaderSize];
+			if ( !Seek( m_pData, offset, SEEK_SET ) || fread( header, sizeof(header), 1, m_pData ) != 1 )
+				return false;
+
+			const uint8_t* p = header;
+			info.m_size     = static_cast<uint32_t>( Get( p, 4 ) );
+			info.m_kind     = static_cast<uint32_t>( Get( p, 1 ) );
+			info.m_format   = static_cast<uint32_t>( Get( p, 1 ) );
+			info.m_lens     = static_cast<uint32_t>( Get( p, 2 ) );
+			info.m_channel  = static_cast<uint32_t>( Get( p, 4 ) );
+			Get( p, 4 );
+			info.m_sequence = Get( p, 8 );
+			info.m_simTime  = static_cast<int64_t>( Get( p, 8 ) );
+			info.m_wallTime = static_cast<int64_t>( Get( p, 8 ) );
+
+			//The index and the segment have to agree on what is there
+			if ( info.m_sequence != sequence || info.m_size != indexed.m_size || info.m_kind != indexed.m_kind )
+				return false;
+
+			payload.resize( info.m_size );
+			return info.m_size == 0 || fread( &payload[0], info.m_size, 1, m_pData ) == 1;
+		}
+	}
+}
@@ -0,0 +1,249 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Recording.h - Recorded sessions for replay and offline benchmarking.
+//
+// The sensor plugin can append every encoded frame it sends to a recording,
+// and ZMQVideo the commands it receives and the state of the vehicle it
+// drives. ReplayServer then serves a recording over the same ZMQ protocol
+// without ANVEL, at the recorded pace or faster, which makes load tests
+// reproducible and lets an incident be looked at from any point in it.
+//
+// A recording is a series of segment files, <base>.0000.anvr, .0001 and so
+// on, each followed by a new one once it reaches the segment size. A segment
+// is a small file header and then length-prefixed records: a fixed header
+// with the record's kind, format, camera, sequence and timestamps, and the
+// payload exactly as it went over the wire (frames without the timestamp
+// trailer). Next to every segment is an index, <base>.0000.anvi, with one
+// fixed size entry per record.
+//
+// The reader memory-maps the indexes. Records are numbered from 0 in the
+// order they were written, which is also their sequence number, so a record
+// is found by sequence directly and by simulation time with a binary search,
+// without reading any of the segments. An index entry is only written after
+// its record, and a record that did not make it to the disk whole (the
+// process died, the disk filled up) is left out when the recording is opened.
+//
+// Writer appends from the calling thread through stdio. Capture.h writes the
+// same format from a thread of its own, for rates stdio can not keep up with.
+//
+// Every field is little-endian, whatever the host. Like FrameRing.h, this
+// header does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Recording_h__
+#define Recording_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace VANE
+{
+	namespace Recording
+	{
+		const uint32_t kSegmentMagic = 0x52564E41; // "ANVR"
+		const uint32_t kIndexMagic   = 0x49564E41; // "ANVI"
+		const uint16_t kVersion      = 1;
+
+		const size_t kFileHeaderSize   = 16;
+		const size_t kRecordHeaderSize = 40;
+		const size_t kIndexEntrySize   = 48;
+		const size_t kVehicleStateSize = 88;
+		const size_t kRawFrameHeaderSize = 16;
+		const size_t kControlInputSize  = 24;
+
+		const uint32_t kDefaultSegmentMB = 256;
+
+		///What a record holds
+		enum RecordKind
+		{
+			kRecordFrame        = 1,  ///< An encoded frame, the format is its FrameCodecType
+			kRecordControl      = 2,  ///< A reply received on the control channel, as received
+			kRecordVehicleState = 3,  ///< A VehicleState
+			kRecordRawFrame     = 4,  ///< A RawFrameHeader and the pixels as rendered
+			kRecordControlInput = 5   ///< A ControlInput
+		};
+
+		struct RecordInfo
+		{
+			uint32_t m_kind;      ///< One of RecordKind
+			uint32_t m_format;    ///< FrameCodecType of a frame, 0 otherwise
+			uint32_t m_channel;   ///< Camera of a frame (the low bits of its ID), 0 otherwise
+			uint32_t m_lens;      ///< Lens of the camera a frame came from, up to 65535
+			uint32_t m_size;      ///< Bytes of payload
+			uint64_t m_sequence;  ///< Position in the recording, from 0
+			int64_t  m_simTime;   ///< Simulation time since the plugin started, in microseconds
+			int64_t  m_wallTime;  ///< ClockSync::Now() when the record was written
+		};
+
+		///Where the controlled vehicle was and what it was told to do
+		struct VehicleState
+		{
+			double m_position[3];     ///< x, y, z
+			double m_orientation[4];  ///< w, x, y, z
+			double m_forwardSpeed;    ///< m/s
+			double m_yawRate;         ///< rad/s
+			double m_throttle;        ///< Inputs the controller produced
+			double m_steering;
+		};
+
+		void WriteVehicleState( const VehicleState& state, uint8_t* pPayload );
+		bool ReadVehicleState( const uint8_t* pPayload, size_t size, VehicleState& state );
+
+		///What the controller was told to do, recorded whenever it changes or a command arrives
+		struct ControlInput
+		{
+			double  m_desiredSpeed;  ///< m/s, before the controller's deadzone
+			double  m_desiredYaw;    ///< rad/s
+			uint8_t m_command;       ///< Direction the client sent, 0 if it was set another way (a property)
+		};
+
+		void WriteControlInput( const ControlInput& input, uint8_t* pPayload );
+		bool ReadControlInput( const uint8_t* pPayload, size_t size, ControlInput& input );
+
+		///Layout of the pixels of a raw frame, which follow it in the record
+		struct RawFrameHeader
+		{
+			uint32_t m_width;
+			uint32_t m_height;
+			uint32_t m_channels;  ///< Interleaved 8 bit channels, 3 for RGB
+			uint32_t m_stride;    ///< Bytes from one row to the next
+		};
+
+		void WriteRawFrameHeader( const RawFrameHeader& header, uint8_t* pHeader );
+		///@return false if the record is too short for the pixels the header describes
+		bool ReadRawFrameHeader( const uint8_t* pPayload, size_t size, RawFrameHeader& header );
+
+		///Fixed parts of the files, for writers of the format
+		void WriteFileHeader( uint32_t magic, uint32_t segment, uint8_t* pHeader );
+		void WriteRecordHeader( const RecordInfo& info, uint8_t* pHeader );
+		void WriteIndexEntry( uint64_t offset, const RecordInfo& info, uint8_t* pEntry );
+
+		///Name of a segment or index file of a recording
+		std::string GetSegmentFileName( const std::string& base, uint32_t segment );
+		std::string GetIndexFileName( const std::string& base, uint32_t segment );
+		///Delete the files of a recording, a reader would take what is left of a longer one for more of a new one
+		void RemoveRecording( const std::string& base );
+
+		///Read-only mapping of a whole file
+		class MappedFile
+		{
+		public:
+			MappedFile();
+			~MappedFile();
+
+			bool Open( const std::string& fileName );
+			void Close();
+
+			const uint8_t* GetData() const { return m_pData; }
+			size_t GetSize() const { return m_size; }
+
+		private:
+			MappedFile( const MappedFile& );
+			MappedFile& operator=( const MappedFile& );
+
+			const uint8_t* m_pData;
+			size_t   m_size;
+#ifdef _WIN32
+			void*    m_hFile;
+			void*    m_hMapping;
+#else
+			int      m_fd;
+#endif
+		};
+
+		///Appends records to a recording, owned by the plugin that records
+		class Writer
+		{
+		public:
+			Writer();
+			~Writer();
+
+			///Start a recording. Segments left by an earlier recording of the same name are deleted.
+			///@param segmentMB Size at which the next record goes to a new segment
+			bool Open( const std::string& base, uint32_t segmentMB = kDefaultSegmentMB );
+			///Flush and close the current segment
+			void Close();
+
+			bool IsOpen() const { return m_pData != NULL; }
+			const std::string& GetBase() const { return m_base; }
+
+			///Append a record, its sequence and wall time are filled in here
+			///@return false if it could not be written, the recording is closed then
+			bool Append( uint32_t kind, uint32_t format, uint32_t channel, int64_t simTime, const void* pPayload, size_t size );
+
+			uint64_t GetRecordCount() const { return m_sequence; }
+			uint64_t GetBytesWritten() const { return m_bytesWritten; }
+			uint32_t GetSegmentCount() const { return m_segmentCount; }
+
+		private:
+			Writer( const Writer& );
+			Writer& operator=( const Writer& );
+
+			bool OpenSegment();
+			void CloseSegment();
+
+			std::string m_base;
+			uint64_t m_segmentLimit;
+			uint32_t m_segmentCount;  ///< Segments started, the last one is being written
+			FILE*    m_pData;
+			FILE*    m_pIndex;
+			uint64_t m_offset;        ///< End of the current segment
+			uint64_t m_sequence;
+			uint64_t m_bytesWritten;
+		};
+
+		///Reads a recording through its indexes, any number of readers may open it
+		class Reader
+		{
+		public:
+			Reader();
+			~Reader();
+
+			///Map the index of every segment of a recording
+			bool Open( const std::string& base );
+			void Close();
+
+			bool IsOpen() const { return !m_segments.empty(); }
+
+			uint64_t GetRecordCount() const { return m_recordCount; }
+			uint32_t GetSegmentCount() const { return static_cast<uint32_t>( m_segments.size() ); }
+			///Index entries left out because their record was incomplete
+			uint64_t GetTruncatedCount() const { return m_truncated; }
+
+			///Header of a record, from the index only
+			bool GetInfo( uint64_t sequence, RecordInfo& info ) const;
+			///First record at or after a simulation time, GetRecordCount() if there is none.
+			///Records are in simulation time order as long as one plugin wrote them.
+			uint64_t FindSimTime( int64_t simTime ) const;
+
+			///Read a record and its payload from its segment
+			bool Read( uint64_t sequence, RecordInfo& info, std::vector<uint8_t>& payload );
+
+		private:
+			Reader( const Reader& );
+			Reader& operator=( const Reader& );
+
+			struct Segment
+			{
+				MappedFile* m_pIndex;
+				uint64_t    m_first;   ///< Sequence of the segment's first record
+				uint64_t    m_count;
+				std::string m_fileName;
+			};
+
+			const Segment* FindSegment( uint64_t sequence ) const;
+
+			std::vector<Segment> m_segments;
+			uint64_t m_recordCount;
+			uint64_t m_truncated;
+			FILE*    m_pData;
+			const Segment* m_pDataSegment;  ///< Segment m_pData has open
+		};
+	}
+}
+
+#endif // Recording_h__
@@ -24,29 +24,44 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include "zmq.hpp"
-#include "jpge.h"
 #include <string>
 #include <iostream>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
 #ifndef _WIN32
 #include <unistd.h>
+#include <string.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#define SOCKET_ERROR (-1)
 #else
 #undef min
 #undef max
 #include <windows.h>
 
 #define sleep(n)    Sleep(n)
-#endif
 
 #include <WinSock.h>
 #include<WinSock2.h>
+#endif
 
 
 #include "SampleSensor.h"
+#include "ClockSync.h"
+#include "StreamStats.h"
+#include "SocketMonitor.h"
+#include "AsyncLog.h"
+#include "Trace.h"
 
 #include "Core/PropertyManager.h"
+#include "Core/StringConverter.h"
 #include "Simulation/World/WorldManager.h"
 #include "Simulation/Sensor.h"
-#include "Simulation\CameraSensor.h"
+#include "Simulation/CameraSensor.h"
+#include "Simulation/Vehicles/Vehicle.h"
+#include "Simulation/Vehicles/VehicleManager.h"
 
 namespace VANE
 {
@@ -67,15 +82,110 @@ namespace VANE
 
 	const SENSOR_API SensorType kSensorTypeSampleSensor = "SampleSensor";
 
+	namespace Commands
+	{
+		CommandID kCommandWriteSensorTrace = kInvalidCommand;
+	}
+
 	//////////////////////////////////////////////////////////////////////////
 	
 	
 	zmq::socket_t socket_;
 	zmq::context_t context_;
+
+	//Below these the vehicle counts as standing still, and going over them is the start of a motion
+	static const float64 kMovingSpeed = 0.05;
+	static const float64 kMovingYawRate = 0.01;
+
+	///Trailer with the frame's timestamps on the clock ClockSync::Now() reads
+	static void MakeTrailer( const FrameTimestamps& timestamps, uint64_t sequence, uint8_t* pTrailer )
+	{
+		ClockSync::FrameTimes times;
+		times.m_captured = std::chrono::duration_cast<std::chrono::microseconds>( timestamps.m_snapshot.time_since_epoch() ).count();
+		times.m_encoded = std::chrono::duration_cast<std::chrono::microseconds>( timestamps.m_encodeEnd.time_since_epoch() ).count();
+		times.m_sequence = static_cast<uint32_t>( sequence );
+		ClockSync::WriteTrailer( times, pTrailer );
+	}
+
+	///Sends a frame over the video socket in chunks while the rest of it is still
+	///being encoded. Every chunk is a message of its own, since ZMQ only hands a
+	///multipart (ZMQ_SNDMORE) message to the network once its last part is queued.
+	///The first byte of a chunk holds the flags below, and a client rebuilds the frame
+	///by appending the chunks from a kChunkFirst one through to the kChunkLast one.
+	///With pCopy, everything written is also appended there (for the recording).
+	class ZmqChunkSink : public IFrameSink
+	{
+	public:
+		enum
+		{
+			kChunkFirst = 0x01,
+			kChunkLast  = 0x02
+		};
+
+		///@param chunk Staging buffer, kept by the caller so its storage is reused from frame to frame
+		ZmqChunkSink( size_t chunkSize, std::vector<uint8_t>& chunk, std::vector<uint8_t>* pCopy = NULL )
+			: m_chunkSize( chunkSize + 1 )
+			, m_flags( kChunkFirst )
+			, m_chunk( chunk )
+			, m_pCopy( pCopy )
+			, m_size( 0 )
+		{
+			m_chunk.reserve( m_chunkSize + 4096 );
+			m_chunk.assign( 1, 0 );
+		}
+
+		virtual bool Write( const uint8_t* pData, size_t size )
+		{
+			m_chunk.insert( m_chunk.end(), pData, pData + size );
+			if ( m_pCopy )
+				m_pCopy->insert( m_pCopy->end(), pData, pData + size );
+			m_size += size;
+			if ( m_chunk.size() >= m_chunkSize )
+				Send();
+			return true;
+		}
+
+		///Send whatever is left as the last chunk
+		void Finish()
+		{
+			m_flags |= kChunkLast;
+			Send();
+		}
+
+		///Bytes of the frame written so far
+		size_t GetSize() const { return m_size; }
+
+	private:
+		void Send()
+		{
+			m_chunk[0] = m_flags;
+			zmq::message_t message( m_chunk.size() );
+			memcpy( message.data(), &m_chunk[0], m_chunk.size() );
+			socket_.send( message );
+
+			m_flags = 0;
+			m_chunk.resize( 1 );
+		}
+
+		ZmqChunkSink& operator=( const ZmqChunkSink& );
+
+		size_t m_chunkSize;
+		uint8_t m_flags;
+		std::vector<uint8_t>& m_chunk;
+		std::vector<uint8_t>* m_pCopy;
+		size_t m_size;
+	};
 	
 	//Get the IP address of the computer
 	bool getMyIP(String& myIP)
 	{
+		//ANVEL_BIND_ADDRESS picks the interface on machines that are not on a 192.168.1.x network
+		const char* pBindAddress = getenv("ANVEL_BIND_ADDRESS");
+		if (pBindAddress && *pBindAddress) {
+			myIP = pBindAddress;
+			return true;
+		}
+
 		char szBuffer[1024];
 
 		#ifdef WIN32
@@ -129,6 +239,9 @@ namespace VANE
 	SampleSensor::SampleSensor( VaneID specificId, SensorStaticAssetParams& params, DynamicAssetParams& dynamicParams )
 		: Sensor(specificId, params, dynamicParams)
 	{
+		m_pVideoMonitor = NULL;
+		m_pLog = new AsyncLog();
+		m_pLog->Start();
 		
 		//Get the current IP address
 		String ip;
@@ -142,21 +255,180 @@ namespace VANE
 			ipaddr = ip;
 			running = true;
 
-			//Bind to the computer's IP adress
 			socket_.init(context_, ZMQ_PAIR);
+
+			//Watch the socket before binding so a failed bind shows up as well
+			m_pVideoMonitor = new SocketMonitor();
+			if (!m_pVideoMonitor->Start(socket_, "video")) {
+				LogMessage("Failed to monitor the video socket", kLogMsgWarning);
+				delete m_pVideoMonitor;
+				m_pVideoMonitor = NULL;
+			}
+
+			//Bind to the computer's IP adress
 			socket_.bind("tcp://" + ip + ":9000");
 
-			LogMessage("Connected", kLogMsgSpecial);
+			LogMessage("Waiting for a viewer on port 9000", kLogMsgSpecial);
 		}
 
 		frame = 0;
+		m_framesSent = 0;
 		sendRate = 15;
 		quality_factor = 85;
+		m_simTime = 0;
 
 		
 		//cast to our specific type of asset params, and grab data 
 		const SampleSensorStaticAssetParams& sampleParams = static_cast<const SampleSensorStaticAssetParams&>( params );
 		m_sampleIntData = sampleParams.m_intData;
+
+		//The ring itself is created on the first frame, once we know the lens size
+		m_frameRingSlots = sampleParams.m_frameRingSlots;
+		m_frameRingName = sampleParams.m_frameRingName.empty() ? String(FrameRing::kDefaultRingName) : sampleParams.m_frameRingName;
+		m_encodeInProcess = sampleParams.m_encodeInProcess;
+
+		if ( !ParseFrameCodec( sampleParams.m_codec, m_encoderParams.m_codec ) )
+			LogMessage( "Unknown codec " + sampleParams.m_codec + ", using jpeg", kLogMsgWarning );
+		m_encoderParams.m_quality = quality_factor;
+		m_encoderParams.m_frameRate = sendRate;
+		m_encoderParams.m_bitrateKbps = sampleParams.m_bitrate;
+		m_bitrate = sampleParams.m_bitrate;
+		m_encoderParams.m_keyframeInterval = sampleParams.m_keyframeInterval;
+		m_encoderParams.m_intraRefresh = sampleParams.m_intraRefresh;
+		m_encoderParams.m_tileSize = sampleParams.m_tileSize;
+		m_encoderParams.m_refreshInterval = sampleParams.m_refreshInterval;
+		m_streamChunkSize = sampleParams.m_streamChunkSize;
+		m_latencyReportInterval = sampleParams.m_latencyReportInterval;
+		m_latencyReported = LatencyClock::now();
+		m_frameTimestamps = sampleParams.m_frameTimestamps;
+
+		Trace::SetEnabled( sampleParams.m_trace );
+		Trace::SetThreadName( "ANVEL update" );
+
+		m_statFps = 0;
+		m_statEncodeP50 = 0;
+		m_statEncodeP95 = 0;
+		m_statEncodeP99 = 0;
+		m_statBytesPerFrame = 0;
+		m_statBitrate = 0;
+		m_statQueueDepth = 0;
+		m_statDroppedFrames = 0;
+		m_statClients = 0;
+		m_statConnects = 0;
+		m_statDisconnects = 0;
+		m_statPeerlessTime = 0;
+		m_statsInterval = sampleParams.m_statsInterval > 0 ? sampleParams.m_statsInterval : 1000;
+		m_statsWindowStart = LatencyClock::now();
+		m_windowFrames = 0;
+		m_windowBytes = 0;
+		m_windowQueueDepth = 0;
+		m_windowZmqSent = false;
+		m_windowConnects = 0;
+		m_windowDisconnects = 0;
+		m_windowPeerlessStart = m_pVideoMonitor ? m_pVideoMonitor->GetTotals().GetPeerlessTime( ClockSync::Now() ) : 0;
+		m_framesDropped = 0;
+		m_pStatsSocket = NULL;
+
+		//Dashboards subscribe to the stats, nothing breaks if the port is taken
+		if ( running && sampleParams.m_statsPort != 0 )
+		{
+			try
+			{
+				m_pStatsSocket = new zmq::socket_t( context_, ZMQ_PUB );
+				m_pStatsSocket->bind( "tcp://" + ip + ":" + StringConverter::ToString( sampleParams.m_statsPort ) );
+				LogMessage( "Publishing streaming stats on port " + StringConverter::ToString( sampleParams.m_statsPort ), kLogMsgSpecial );
+			}
+			catch ( const zmq::error_t& error )
+			{
+				LogMessage( String("Failed to open the stats socket: ") + error.what(), kLogMsgError );
+				delete m_pStatsSocket;
+				m_pStatsSocket = NULL;
+			}
+		}
+
+		//Clients subscribe to the UDP port, there is nothing to connect to up front
+		if ( running && sampleParams.m_udpPort != 0 && m_encoderParams.m_codec != kFrameCodecJpeg )
+		{
+			LogMessage( "The UDP transport only carries jpeg frames, sending over ZMQ instead", kLogMsgWarning );
+		}
+		else if ( running && sampleParams.m_udpPort != 0 )
+		{
+			DatagramVideo::Address local;
+			if ( !DatagramVideo::ResolveAddress( ip, static_cast<uint16_t>(sampleParams.m_udpPort), local )
+				|| !m_udpSender.Open( local, sampleParams.m_udpDatagramSize ) )
+			{
+				LogMessage( "Failed to open UDP frame transport", kLogMsgError );
+			}
+			else
+			{
+				m_udpSender.GetSocket().SetDropRate( sampleParams.m_udpDropPercent / 100.0 );
+				LogMessage( "Streaming frames over UDP", kLogMsgSpecial );
+
+				//Restart markers every MCU row let the UDP receiver replace a lost row on its own
+				m_encoderParams.m_restartMarkers = true;
+			}
+		}
+
+		if ( !sampleParams.m_record.empty() )
+		{
+			if ( m_recording.Open( sampleParams.m_record, sampleParams.m_recordSegmentMB ) )
+				LogMessage( "Recording frames to " + sampleParams.m_record, kLogMsgSpecial );
+			else
+				LogMessage( "Failed to start the recording " + sampleParams.m_record, kLogMsgError );
+		}
+
+		m_motionVehicle = sampleParams.m_motionVehicle;
+		m_minSendRate = static_cast<int>( std::max( sampleParams.m_minSendRate, 1u ) );
+		m_motionFullSpeed = sampleParams.m_motionFullSpeed > 0 ? sampleParams.m_motionFullSpeed : 10.0;
+		m_motionFullYawRate = sampleParams.m_motionFullYawRate > 0 ? sampleParams.m_motionFullYawRate : 0.5;
+		m_moving = false;
+		m_motionVehicleMissing = false;
+		m_lastSendTime = -1.0;
+		m_statTargetRate = sendRate;
+		if ( !m_motionVehicle.empty() )
+		{
+			LogMessage( "Streaming between " + StringConverter::ToString( m_minSendRate ) + " fps and the Frame Rate as "
+				+ m_motionVehicle + " moves", kLogMsgSpecial );
+		}
+
+		m_rateControlEnabled = sampleParams.m_targetQueueDelay > 0;
+		m_rateControl.SetTargetDelay( sampleParams.m_targetQueueDelay );
+		m_dueFrames = 0;
+		m_statCongestionLevel = 0;
+		m_statQueueDelay = 0;
+		m_statDeliveredBitrate = 0;
+
+		//An encoded capture takes the stream's settings with a codec of its own
+		m_captureRaw = true;
+		m_captureParams = m_encoderParams;
+		m_captureFailureLogged = false;
+		if ( !sampleParams.m_capture.empty() )
+		{
+			if ( sampleParams.m_captureCodec != "raw" )
+			{
+				IFrameEncoder* pEncoder = NULL;
+				if ( ParseFrameCodec( sampleParams.m_captureCodec, m_captureParams.m_codec ) )
+					pEncoder = CreateFrameEncoder( m_captureParams );
+
+				if ( pEncoder )
+					m_captureRaw = false;
+				else
+					LogMessage( "Can not capture with the codec " + sampleParams.m_captureCodec + ", capturing raw frames", kLogMsgWarning );
+				delete pEncoder;
+			}
+
+			if ( m_capture.Open( sampleParams.m_capture, sampleParams.m_captureSegmentMB, sampleParams.m_captureBatchMB, sampleParams.m_captureQueueMB )
+				&& (m_captureRaw || m_captureEncoder.Open( m_capture, m_captureParams )) )
+			{
+				LogMessage( String("Capturing ") + (m_captureRaw ? "raw" : GetFrameCodecName( m_captureParams.m_codec ))
+					+ " frames to " + sampleParams.m_capture, kLogMsgSpecial );
+			}
+			else
+			{
+				m_capture.Close();
+				LogMessage( "Failed to start the capture " + sampleParams.m_capture, kLogMsgError );
+			}
+		}
 	}
 	
 	//////////////////////////////////////////////////////////////////////////
@@ -164,6 +436,431 @@ namespace VANE
 	SampleSensor::~SampleSensor()
 	{
 		//Any sensor resources should be shut down here
+		m_frameRing.Close();
+		m_udpSender.Close();
+
+		if ( m_recording.IsOpen() )
+		{
+			m_recording.Close();
+			LogMessage( "Recorded " + StringConverter::ToString( static_cast<uint32>( m_recording.GetRecordCount() ) ) + " frames to "
+				+ m_recording.GetBase() + " in " + StringConverter::ToString( m_recording.GetSegmentCount() ) + " segment(s)" );
+		}
+
+		if ( m_capture.IsOpen() )
+		{
+			//Waits for the encoder and then the writer to finish what they have queued
+			m_captureEncoder.Close();
+			uint64_t encodeDropped = m_captureEncoder.GetDropped();
+			uint64_t encodeFailed = m_captureEncoder.GetFailed();
+			m_capture.Close();
+			Recording::CaptureWriter::Counts counts = m_capture.GetCounts();
+			LogMessage( "Captured " + StringConverter::ToString( static_cast<uint32>( counts.m_records ) ) + " frames ("
+				+ StringConverter::ToString( static_cast<uint32>( counts.m_bytesWritten >> 20 ) ) + " MB) to " + m_capture.GetBase()
+				+ " in " + StringConverter::ToString( counts.m_segments ) + " segment(s)" + (counts.m_unbuffered ? ", unbuffered" : "") );
+			if ( counts.m_dropped > 0 )
+			{
+				LogMessage( StringConverter::ToString( static_cast<uint32>( counts.m_dropped ) )
+					+ " frames were left out of the capture because the disk fell behind, a larger captureQueueMB gives it more room", kLogMsgWarning );
+			}
+			if ( encodeDropped > 0 )
+			{
+				LogMessage( StringConverter::ToString( static_cast<uint32>( encodeDropped ) )
+					+ " frames were left out of the capture because the encoder fell behind", kLogMsgWarning );
+			}
+			if ( encodeFailed > 0 )
+			{
+				LogMessage( StringConverter::ToString( static_cast<uint32>( encodeFailed ) ) + " captured frames failed to compress", kLogMsgError );
+			}
+		}
+
+		if ( m_pStatsSocket )
+		{
+			int linger = 0;
+			m_pStatsSocket->setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+			delete m_pStatsSocket;
+			m_pStatsSocket = NULL;
+		}
+
+		//The monitor has to let go of the video socket before it can be closed
+		delete m_pVideoMonitor;
+		m_pVideoMonitor = NULL;
+
+		//Stopping closes the rate limit windows, log their summaries before going
+		m_pLog->Stop();
+		TakeLogLines();
+		delete m_pLog;
+		m_pLog = NULL;
+
+		//Drop frames no client is left to read, or the context would wait for them on shutdown
+		if ( running )
+		{
+			int linger = 0;
+			socket_.setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+			socket_.close();
+		}
+
+		for ( std::map<VaneID, IFrameEncoder*>::iterator it = m_encoders.begin(); it != m_encoders.end(); ++it )
+			delete it->second;
+		m_encoders.clear();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	IFrameEncoder* SampleSensor::GetEncoder( VaneID cameraID )
+	{
+		std::map<VaneID, IFrameEncoder*>::iterator it = m_encoders.find( cameraID );
+		if ( it != m_encoders.end() )
+			return it->second;
+
+		IFrameEncoder* pEncoder = CreateFrameEncoder( m_encoderParams );
+		if ( !pEncoder )
+		{
+			LogMessage( String("The ") + GetFrameCodecName( m_encoderParams.m_codec ) + " codec is not built into this plugin, using jpeg", kLogMsgWarning );
+			m_encoderParams.m_codec = kFrameCodecJpeg;
+			pEncoder = CreateFrameEncoder( m_encoderParams );
+		}
+
+		m_encoders[cameraID] = pEncoder;
+		return pEncoder;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::RequestKeyframes()
+	{
+		for ( std::map<VaneID, IFrameEncoder*>::iterator it = m_encoders.begin(); it != m_encoders.end(); ++it )
+			it->second->RequestKeyframe();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::ReportLatency()
+	{
+		//Per stage p50/p95/p99/max in milliseconds
+		for ( std::map<VaneID, StreamLatency>::iterator it = m_latency.begin(); it != m_latency.end(); ++it )
+		{
+			StreamLatency& stream = it->second;
+			if ( stream.GetStage( kLatencyTotal ).GetCount() == 0 )
+				continue;
+
+			LogMessage( "Latency camera " + StringConverter::ToString( static_cast<uint32>( it->first & 0xffffffff ) ) + ", "
+				+ StringConverter::ToString( static_cast<uint32>( stream.GetStage( kLatencyTotal ).GetCount() ) ) + " frames, "
+				+ StringConverter::ToString( static_cast<uint32>( stream.GetRepeatedFrames() ) ) + " repeated, p50/p95/p99/max ms: "
+				+ stream.Format() );
+			stream.Reset();
+		}
+		m_latencyReported = LatencyClock::now();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::RecordSentFrame( VaneID cameraID, const FrameTimestamps& timestamps, size_t size, bool overZmq )
+	{
+		m_latency[cameraID].Record( timestamps );
+		m_windowEncode.Record( std::chrono::duration_cast<std::chrono::microseconds>( timestamps.m_encodeEnd - timestamps.m_encodeStart ).count() );
+		++m_windowFrames;
+		m_windowBytes += size;
+		m_windowZmqSent |= overZmq;
+		++m_framesSent;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::TakeSocketEvents()
+	{
+		std::vector<SocketEvent> events;
+		uint64_t lost = m_pVideoMonitor->TakeEvents( events );
+
+		for ( size_t i = 0; i < events.size(); ++i )
+		{
+			const SocketEvent& event = events[i];
+			switch ( event.m_event )
+			{
+			case ZMQ_EVENT_ACCEPTED:
+				//Congestion control is per viewer, a new one starts from the configured settings
+				m_rateControl.Reset();
+				++m_windowConnects;
+				LogMessage( "Viewer connected on " + event.m_endpoint, kLogMsgSpecial );
+				break;
+			case ZMQ_EVENT_DISCONNECTED:
+				++m_windowDisconnects;
+				LogMessage( "Viewer disconnected from " + event.m_endpoint + " after "
+					+ StringConverter::ToString( event.m_duration / 1000000.0 ) + " s", kLogMsgWarning );
+				break;
+			case ZMQ_EVENT_BIND_FAILED:
+			case ZMQ_EVENT_ACCEPT_FAILED:
+			case ZMQ_EVENT_CLOSE_FAILED:
+				LogMessage( String("Video socket ") + GetSocketEventName( event.m_event ) + " on " + event.m_endpoint
+					+ ": " + zmq_strerror( event.m_value ), kLogMsgError );
+				break;
+			default:
+				break;
+			}
+		}
+
+		if ( lost > 0 )
+			LogMessage( StringConverter::ToString( static_cast<uint32>( lost ) ) + " video socket events were not logged", kLogMsgWarning );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::TakeLogLines()
+	{
+		std::vector<AsyncLog::Line> lines;
+		uint64_t lost = m_pLog->TakeLines( lines );
+
+		for ( size_t i = 0; i < lines.size(); ++i )
+			LogMessage( lines[i].m_text, static_cast<LogMsgType>( lines[i].m_type ) );
+
+		if ( lost > 0 )
+			LogMessage( StringConverter::ToString( static_cast<uint32>( lost ) ) + " sensor messages were not logged", kLogMsgWarning );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::RecordFrame( VaneID cameraID, FrameCodecType format, const uint8_t* pData, size_t size )
+	{
+		Trace::Span span( "record" );
+		int64_t simTime = static_cast<int64_t>( m_simTime * 1000000.0 + 0.5 );
+		if ( !m_recording.Append( Recording::kRecordFrame, format, static_cast<uint32_t>( cameraID ), simTime, pData, size ) )
+		{
+			//The writer closes the recording when a write fails, so this is only logged once
+			LogMessage( "Failed to write to the recording " + m_recording.GetBase() + ", recording stopped after "
+				+ StringConverter::ToString( static_cast<uint32>( m_recording.GetRecordCount() ) ) + " frames", kLogMsgError );
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::CaptureFrames( const CameraSensor& camera )
+	{
+		Trace::Span span( "capture" );
+		int64_t simTime = static_cast<int64_t>( m_simTime * 1000000.0 + 0.5 );
+
+		const std::vector<LensData>& lenses = camera.GetLensData();
+		const std::vector<LensParams>& lensParams = camera.GetLensParams();
+		for ( uint32 i = 0; i < lenses.size() && i < lensParams.size(); ++i )
+		{
+			const uint8_t* pPixels = static_cast<const uint8_t*>( lenses[i].m_renderRequest.m_pOutputBuffer );
+			if ( pPixels == NULL )
+				continue;
+
+			uint32 sizeX = lensParams[i].m_resolutionX;
+			uint32 sizeY = lensParams[i].m_resolutionY;
+			bool captured;
+			if ( m_captureRaw )
+			{
+				Recording::RawFrameHeader header;
+				header.m_width = sizeX;
+				header.m_height = sizeY;
+				header.m_channels = 3;
+				header.m_stride = sizeX * 3;
+
+				uint8_t head[Recording::kRawFrameHeaderSize];
+				Recording::WriteRawFrameHeader( header, head );
+				captured = m_capture.Append( Recording::kRecordRawFrame, 0, static_cast<uint32_t>( camera.GetID() ), i, simTime,
+					head, sizeof(head), pPixels, header.m_stride * sizeY );
+			}
+			else
+			{
+				//Only copied here, the encoder's thread compresses and appends it
+				captured = m_captureEncoder.Submit( static_cast<uint32_t>( camera.GetID() ), i, simTime, pPixels, sizeX, sizeY );
+			}
+
+			if ( captured )
+				continue;
+
+			if ( !m_captureRaw )
+				m_pLog->Post( "Capture encoder fell behind, frame dropped", kLogMsgWarning );
+			else if ( !m_capture.HasFailed() )
+				m_pLog->Post( "Capture fell behind the disk, frame dropped", kLogMsgWarning );
+		}
+
+		//The writer is appended to from the encoder's thread too, so its record count is only read once it is closed
+		if ( m_capture.HasFailed() && !m_captureFailureLogged )
+		{
+			m_captureFailureLogged = true;
+			LogMessage( "Failed to write to the capture " + m_capture.GetBase() + ", capture stopped", kLogMsgError );
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	bool SampleSensor::IsSendDue()
+	{
+		//Without a vehicle to follow, every sendRate'th sample of a 100 Hz sensor
+		if ( m_motionVehicle.empty() )
+		{
+			m_statTargetRate = sendRate;
+			return frame % (int) (100 / sendRate) == 0;
+		}
+
+		//A vehicle that can not be found gets the full rate, there is no telling how it moves
+		float64 motion = 1.0;
+		bool moving = true;
+		Vehicles::Vehicle* pVehicle = Vehicles::Manager::GetSingleton().GetVehicle( m_motionVehicle );
+		if ( pVehicle )
+		{
+			float64 speed = fabs( static_cast<float64>( pVehicle->GetForwardSpeed() ) );
+			float64 yawRate = fabs( pVehicle->GetYawRateAsDouble() );
+
+			//Turning sweeps the view as much as driving does, whichever is further along sets the rate
+			motion = std::min( std::max( speed / m_motionFullSpeed, yawRate / m_motionFullYawRate ), 1.0 );
+			moving = speed >= kMovingSpeed || yawRate >= kMovingYawRate;
+			m_motionVehicleMissing = false;
+		}
+		else if ( !m_motionVehicleMissing )
+		{
+			m_motionVehicleMissing = true;
+			LogMessage( "There is no vehicle named " + m_motionVehicle + " to follow, streaming at the full frame rate", kLogMsgWarning );
+		}
+
+		float64 maxRate = std::max( sendRate, 1 );
+		float64 minRate = std::min( static_cast<float64>( m_minSendRate ), maxRate );
+		m_statTargetRate = minRate + (maxRate - minRate) * motion;
+
+		//A vehicle pulling away gets a frame at once rather than at the standing rate's next one
+		bool started = moving && !m_moving;
+		m_moving = moving;
+
+		//Half a sample early is on time, the samples rarely land on the interval exactly
+		float64 interval = 1.0 / m_statTargetRate;
+		TimeValue due = m_lastSendTime + interval;
+		if ( !started && m_simTime + m_sampleStep * 0.5 < due )
+			return false;
+
+		//Keep to the average rate, unless the samples have fallen a whole interval behind
+		m_lastSendTime = (started || m_simTime - due >= interval) ? m_simTime : due;
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::TakeAcks( const uint8_t* pMessage, size_t size )
+	{
+		m_acks.clear();
+		if ( !RateControl::ReadAcks( pMessage, size, m_acks ) )
+		{
+			m_pLog->Post( "Invalid message on the video socket", kLogMsgWarning, StringConverter::ToString( static_cast<uint32>( size ) ) + " bytes" );
+			return;
+		}
+
+		bool wasActive = m_rateControl.IsActive();
+		for ( size_t i = 0; i < m_acks.size(); ++i )
+			m_rateControl.OnAck( m_acks[i] );
+
+		if ( !wasActive && m_rateControl.IsActive() )
+			LogMessage( "The viewer acks frames, the stream follows its queueing delay", kLogMsgSpecial );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::UpdateStats()
+	{
+		LatencyClock::time_point now = LatencyClock::now();
+		double seconds = std::chrono::duration<double>( now - m_statsWindowStart ).count();
+
+		m_statFps = m_windowFrames / seconds;
+		m_statEncodeP50 = m_windowEncode.GetPercentile( 0.5 ) / 1000.0;
+		m_statEncodeP95 = m_windowEncode.GetPercentile( 0.95 ) / 1000.0;
+		m_statEncodeP99 = m_windowEncode.GetPercentile( 0.99 ) / 1000.0;
+		m_statBytesPerFrame = m_windowFrames > 0 ? static_cast<float64>( m_windowBytes ) / m_windowFrames : 0.0;
+		m_statBitrate = m_windowBytes * 8 / seconds / 1000;
+		m_statQueueDepth = m_windowQueueDepth;
+		m_statDroppedFrames = static_cast<uint32>( m_framesDropped );
+		m_statCongestionLevel = m_rateControl.GetLevel();
+		m_statQueueDelay = m_rateControl.GetQueueDelay() / 1000.0;
+		m_statDeliveredBitrate = m_rateControl.GetDeliveryRate();
+
+		//Connection events on the video socket, from its monitor
+		EndpointStats connections;
+		uint32 peerlessMs = 0;
+		if ( m_pVideoMonitor )
+		{
+			connections = m_pVideoMonitor->GetTotals();
+			int64_t peerless = connections.GetPeerlessTime( ClockSync::Now() );
+			peerlessMs = static_cast<uint32>( (peerless - m_windowPeerlessStart) / 1000 );
+			m_windowPeerlessStart = peerless;
+		}
+		m_statConnects = static_cast<uint32>( connections.m_accepted );
+		m_statDisconnects = static_cast<uint32>( connections.m_disconnected );
+		m_statPeerlessTime = peerlessMs;
+
+		//Without a monitor, a PAIR socket has a single peer and frames only go out while it is there
+		if ( m_udpSender.IsOpen() )
+			m_statClients = m_udpSender.GetSubscriberCount();
+		else if ( m_pVideoMonitor )
+			m_statClients = connections.m_peers;
+		else
+			m_statClients = m_windowZmqSent ? 1 : 0;
+
+		if ( m_pStatsSocket )
+		{
+			StreamStatsSnapshot snapshot;
+			snapshot.m_time = std::chrono::duration_cast<std::chrono::microseconds>( now.time_since_epoch() ).count();
+			snapshot.m_windowMs = static_cast<uint32_t>( seconds * 1000 );
+			snapshot.m_fps = static_cast<float>( m_statFps );
+			snapshot.m_encodeP50 = static_cast<float>( m_statEncodeP50 );
+			snapshot.m_encodeP95 = static_cast<float>( m_statEncodeP95 );
+			snapshot.m_encodeP99 = static_cast<float>( m_statEncodeP99 );
+			snapshot.m_bytesPerFrame = static_cast<float>( m_statBytesPerFrame );
+			snapshot.m_bitrateKbps = static_cast<float>( m_statBitrate );
+			snapshot.m_queueDepth = m_statQueueDepth;
+			snapshot.m_clients = m_statClients;
+			snapshot.m_framesSent = m_framesSent;
+			snapshot.m_framesDropped = m_framesDropped;
+			snapshot.m_connects = m_windowConnects;
+			snapshot.m_disconnects = m_windowDisconnects;
+			snapshot.m_peerlessMs = peerlessMs;
+			snapshot.m_longestGapMs = static_cast<uint32_t>( connections.m_longestGap / 1000 );
+
+			zmq::message_t message( kStatsSnapshotSize );
+			WriteStatsSnapshot( snapshot, static_cast<uint8_t*>( message.data() ) );
+			m_pStatsSocket->send( message, ZMQ_DONTWAIT );
+		}
+
+		m_statsWindowStart = now;
+		m_windowEncode.Reset();
+		m_windowFrames = 0;
+		m_windowBytes = 0;
+		m_windowQueueDepth = 0;
+		m_windowZmqSent = false;
+		m_windowConnects = 0;
+		m_windowDisconnects = 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SampleSensor::PublishFrame( const CameraSensor& camera, const LensData& lens, uint32 sizeX, uint32 sizeY )
+	{
+		uint32 payloadSize = sizeX * sizeY * 3;
+
+		//Size the slots from the first frame, and grow them if a larger camera shows up.
+		//Readers notice the old ring going away and reattach to the new one.
+		if ( payloadSize > m_frameRing.GetSlotPayloadSize() )
+		{
+			if ( !m_frameRing.Create( m_frameRingName, m_frameRingSlots, payloadSize ) )
+			{
+				LogMessage( "Failed to create shared memory frame ring " + m_frameRingName, kLogMsgError );
+				m_frameRingSlots = 0;
+				return;
+			}
+			LogMessage( "Publishing frames to shared memory ring " + m_frameRingName, kLogMsgSpecial );
+		}
+
+		FrameRing::FrameInfo info;
+		memset( &info, 0, sizeof(info) );
+		info.m_sensorID        = camera.GetID();
+		info.m_lens            = 0;
+		info.m_width           = sizeX;
+		info.m_height          = sizeY;
+		info.m_channels        = FrameRing::kPixelFormatRGB;
+		info.m_stride          = sizeX * 3;
+		info.m_renderTimeStamp = lens.m_renderRequest.m_renderTimeStamp;
+		info.m_simTime         = m_simTime;
+		info.m_payloadSize     = payloadSize;
+
+		m_frameRing.Publish( info, lens.m_renderRequest.m_pOutputBuffer );
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -171,6 +868,8 @@ namespace VANE
 
 	void SampleSensor::Update(TimeValue dt)
 	{
+		m_simTime += dt;
+
 		//check to see if it is time to write an update to this sensor
 		m_sampleTimeLeft -= dt;
 
@@ -178,10 +877,81 @@ namespace VANE
 		if (m_sampleTimeLeft > 0.0) 
 			return;
 
-		//Sending the image is dependent on the frame rate and if the user has closed the connection
-		if((frame % (int) (100 / sendRate) == 0) && running) {
+		Trace::Span updateSpan("SampleSensor::Update");
+
+		//Sending the image is dependent on the frame rate and if the user has closed the connection.
+		//When an external streamer reads the ring we leave the encoding to it.
+		bool sendFrame = running && m_encodeInProcess && IsSendDue();
+
+		//Local readers get every sampled frame, and so does a capture
+		bool publishFrame = m_frameRingSlots > 0;
+		bool captureFrame = m_capture.IsOpen();
+
+		if (m_pVideoMonitor)
+			TakeSocketEvents();
+		TakeLogLines();
+
+		//A client that (re)connects sends "k" so it does not have to wait for the next keyframe,
+		//and one that knows the protocol acks the frames it receives
+		if (running) {
+			zmq::message_t request;
+			while (socket_.recv(&request, ZMQ_DONTWAIT)) {
+				const uint8_t* pRequest = static_cast<const uint8_t*>(request.data());
+				if (request.size() == 1 && pRequest[0] == 'k')
+					RequestKeyframes();
+				else if (m_rateControlEnabled)
+					TakeAcks(pRequest, request.size());
+			}
+		}
+
+		uint32 congestionLevel = m_rateControl.GetLevel();
+		if (m_rateControlEnabled && m_rateControl.Update(ClockSync::Now())) {
+			const RateControl::Settings& settings = m_rateControl.GetSettings();
+			String detail = "level " + StringConverter::ToString(m_rateControl.GetLevel()) + ", "
+				+ StringConverter::ToString(settings.m_qualityPercent) + "% quality, 1/" + StringConverter::ToString(settings.m_scale)
+				+ " size, 1/" + StringConverter::ToString(settings.m_rateDivisor) + " rate, queueing "
+				+ StringConverter::ToString(m_rateControl.GetQueueDelay() / 1000.0) + " ms, delivered "
+				+ StringConverter::ToString(m_rateControl.GetDeliveryRate()) + " kbit/s";
+			if (m_rateControl.GetLevel() > congestionLevel)
+				m_pLog->Post("Stream stepped down for a congested viewer", kLogMsgWarning, detail);
+			else
+				m_pLog->Post("Stream stepped back up", kLogMsgSpecial, detail);
+		}
+
+		//Pick up changes made through the property system, and the congestion controller's steps
+		const RateControl::Settings& congestion = m_rateControl.GetSettings();
+		int quality = std::max(quality_factor * (int) congestion.m_qualityPercent / 100, 1);
+		uint32 frameRate = (uint32) std::max(sendRate / (int) congestion.m_rateDivisor, 1);
+		uint32 bitrate = m_bitrate * congestion.m_qualityPercent / 100;
+		if (quality != m_encoderParams.m_quality || frameRate != m_encoderParams.m_frameRate || bitrate != m_encoderParams.m_bitrateKbps) {
+			m_encoderParams.m_quality = quality;
+			m_encoderParams.m_frameRate = frameRate;
+			m_encoderParams.m_bitrateKbps = bitrate;
+			for (std::map<VaneID, IFrameEncoder*>::iterator it = m_encoders.begin(); it != m_encoders.end(); ++it)
+				it->second->Reconfigure(m_encoderParams);
+		}
+
+		//The controller thins out the frames that are due as its last resort
+		if (sendFrame && congestion.m_rateDivisor > 1)
+			sendFrame = m_dueFrames++ % congestion.m_rateDivisor == 0;
+
+		//Over UDP there is no point encoding until a client subscribes
+		bool sendUdp = m_udpSender.IsOpen();
+		if (sendFrame && sendUdp) {
+			m_udpSender.ServiceSubscribers();
+			sendFrame = m_udpSender.HasSubscribers();
+		}
+
+		if(sendFrame || publishFrame || captureFrame) {
+			//Every camera's frame is taken in this tick, later ones wait for the earlier ones' encodes
+			FrameTimestamps timestamps;
+			timestamps.m_snapshot = LatencyClock::now();
+			uint32 tickFrames = 0;
+
 			// Get Video Data and Send as ZMQ Message
+			Trace::Span snapshotSpan("snapshot");
 			std::vector<SensorPtr> sensors = SensorManager::GetSingleton().GetAllSensors();
+			snapshotSpan.End();
 			for (uint32 i = 0; i < sensors.size(); ++i)
 			{
 				if (sensors[i]->GetSensorType() != "CameraSensor")
@@ -193,38 +963,130 @@ namespace VANE
 				if (lens.size() == 0)
 					continue;
 
+				if (captureFrame)
+					CaptureFrames(*pCam);
+
 				const LensData& thisLens = lens[0];
 				const LensParams & lensParams = pCam->GetLensParams()[0];
 
 				if (thisLens.m_renderRequest.m_pOutputBuffer != NULL) {
 					//Pull the dimensions of the camera
-					int size, sizeX, sizeY;
+					int sizeX, sizeY;
 					sizeX = lensParams.m_resolutionX;
 					sizeY = lensParams.m_resolutionY;
-					size = sizeX * sizeY * 3;
-				
-					//Make a buffer for the compressed jpeg
-					void *buf = malloc(size);
 
-					//Set the Quality Factor
-					jpge::params params;
-					params.m_quality = quality_factor;
+					if (publishFrame) {
+						Trace::Span publishSpan("publish to ring");
+						PublishFrame(*pCam, thisLens, sizeX, sizeY);
+					}
+
+					if (!sendFrame)
+						continue;
 
+					++tickFrames;
+				
 					//Compress the image to improve transfer speed
-					if(compress_image_to_jpeg_file_in_memory(buf, size, sizeX, sizeY, 3, thisLens.m_renderRequest.m_pOutputBuffer, params)) {
-						//Put the compressed data into a ZMQ message and send it over the socket
-						zmq::message_t image (size);
-						memcpy((void *) image.data(), buf, size);
-						socket_.send (image);
+					IFrameEncoder* pEncoder = GetEncoder(pCam->GetID());
+					const uint8_t* pPixels = static_cast<const uint8_t*>(thisLens.m_renderRequest.m_pOutputBuffer);
+					timestamps.m_renderTimeStamp = thisLens.m_renderRequest.m_renderTimeStamp;
+					timestamps.m_encodeStart = LatencyClock::now();
+
+					//A congested viewer gets fewer pixels
+					if (congestion.m_scale > 1 && sizeX >= (int) congestion.m_scale * 16 && sizeY >= (int) congestion.m_scale * 16) {
+						Trace::Span scaleSpan("downscale");
+						DownscaleFrame(pPixels, sizeX, sizeY, 3, congestion.m_scale, m_scaled);
+						pPixels = &m_scaled[0];
+						sizeX /= (int) congestion.m_scale;
+						sizeY /= (int) congestion.m_scale;
+					}
+
+					//Decoders stop at EOI, so only JPEG frames can carry the trailer unnoticed
+					bool addTrailer = m_frameTimestamps && pEncoder->GetType() == kFrameCodecJpeg;
+					uint8_t trailer[ClockSync::kTrailerSize];
+
+					//Overlap sending with encoding, the client starts receiving after the first few MCU rows.
+					//The send stage is then only the last chunk, the rest is counted as encoding.
+					if (!sendUdp && m_streamChunkSize > 0) {
+						Trace::Span streamSpan("encode and send");
+						bool recordFrame = m_recording.IsOpen();
+						m_recorded.clear();
+						ZmqChunkSink sink(m_streamChunkSize, m_streamChunk, recordFrame ? &m_recorded : NULL);
+						if (pEncoder->EncodeStreamed(pPixels, sizeX, sizeY, 3, sink)) {
+							timestamps.m_encodeEnd = LatencyClock::now();
+							if (recordFrame && !m_recorded.empty())
+								RecordFrame(pCam->GetID(), pEncoder->GetType(), &m_recorded[0], m_recorded.size());
+							if (addTrailer) {
+								MakeTrailer(timestamps, m_framesSent, trailer);
+								sink.Write(trailer, sizeof(trailer));
+							}
+							sink.Finish();
+							timestamps.m_sent = LatencyClock::now();
+							if (addTrailer)
+								m_rateControl.OnFrameSent(static_cast<uint32_t>(m_framesSent), ClockSync::Now(), sink.GetSize());
+							RecordSentFrame(pCam->GetID(), timestamps, sink.GetSize(), true);
+						}
+						else {
+							m_pLog->Post("Failed to compress image", kLogMsgError, GetFrameCodecName(pEncoder->GetType()));
+							++m_framesDropped;
+						}
+						continue;
+					}
+
+					Trace::Span encodeSpan("encode");
+					bool encoded = pEncoder->Encode(pPixels, sizeX, sizeY, 3, m_encoded);
+					encodeSpan.End();
+
+					if(encoded) {
+						if (m_encoded.empty())
+							continue;
+
+						timestamps.m_encodeEnd = LatencyClock::now();
+						if (m_recording.IsOpen())
+							RecordFrame(pCam->GetID(), pEncoder->GetType(), &m_encoded[0], m_encoded.size());
+						if (addTrailer) {
+							MakeTrailer(timestamps, m_framesSent, trailer);
+							m_encoded.insert(m_encoded.end(), trailer, trailer + sizeof(trailer));
+						}
+
+						Trace::Span sendSpan("send");
+						bool sent;
+						if (sendUdp) {
+							sent = m_udpSender.SendFrame(&m_encoded[0], static_cast<uint32_t>(m_encoded.size()), static_cast<uint16_t>(pCam->GetID()));
+						}
+						else {
+							//Put the compressed data into a ZMQ message and send it over the socket
+							zmq::message_t image (m_encoded.size());
+							memcpy((void *) image.data(), &m_encoded[0], m_encoded.size());
+							sent = socket_.send (image);
+						}
+
+						if (sent) {
+							timestamps.m_sent = LatencyClock::now();
+							if (addTrailer && !sendUdp)
+								m_rateControl.OnFrameSent(static_cast<uint32_t>(m_framesSent), ClockSync::Now(), m_encoded.size());
+							RecordSentFrame(pCam->GetID(), timestamps, m_encoded.size(), !sendUdp);
+						}
+						else
+							++m_framesDropped;
 					}
 					else {
-						LogMessage("Failed to compress image", kLogMsgError);
+						m_pLog->Post("Failed to compress image", kLogMsgError, GetFrameCodecName(pEncoder->GetType()));
+						++m_framesDropped;
 					}
 				}
 			}
+
+			if (tickFrames > m_windowQueueDepth)
+				m_windowQueueDepth = tickFrames;
 		}
 		frame++;
-		
+
+		if (LatencyClock::now() - m_statsWindowStart >= std::chrono::milliseconds(m_statsInterval))
+			UpdateStats();
+
+		if (m_latencyReportInterval > 0
+			&& LatencyClock::now() - m_latencyReported >= std::chrono::seconds(m_latencyReportInterval))
+			ReportLatency();
 		
 		m_sampleTimeLeft += m_sampleStep;
 	}
@@ -249,6 +1111,41 @@ namespace VANE
 
 		SensorManager::GetSingleton().RegisterSensorFactory( kSensorTypeSampleSensor, this );
 	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	SampleSensorFactory::SampleSensorCommandGroup::SampleSensorCommandGroup()
+		: CommandGroup( "SampleSensor" )
+	{
+		CommandManager& cmdMgr = CommandManager::GetSingleton();
+		Commands::kCommandWriteSensorTrace = cmdMgr.RegisterCommand( "WriteSensorTrace", this );
+
+		CommandDescription desc( Commands::kCommandWriteSensorTrace, "Append the sensor's recent spans to a Chrome trace (JSON) file." );
+		desc.m_parameters.push_back( ParameterDescription( VariantType::kString, "File", "Trace file to append to." ) );
+		AddCommand( desc );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	CommandResult SampleSensorFactory::SampleSensorCommandGroup::HandleCommand( CommandID commandID, const CommandParamList& parameterList )
+	{
+		if ( commandID == Commands::kCommandWriteSensorTrace )
+		{
+			if ( parameterList.size() != 1 || parameterList[0].GetType() != VariantType::kString )
+				return CommandResult( kInvalidParameters, "Expected the name of the trace file." );
+
+			uint64_t lost = 0;
+			int64_t written = Trace::Flush( parameterList[0].GetStringValue(), &lost );
+			if ( written < 0 )
+				return CommandResult( kCommandFail, kParameterOutsideRange, "Could not open " + parameterList[0].GetStringValue() );
+
+			LogMessage( "Wrote " + StringConverter::ToString( static_cast<uint32>( written ) ) + " sensor spans to "
+				+ parameterList[0].GetStringValue() + ", " + StringConverter::ToString( static_cast<uint32>( lost ) ) + " were overwritten before the flush" );
+			return CommandResult( Success );
+		}
+
+		return CommandResult( kInvalidCommand );
+	}
 	
 	//////////////////////////////////////////////////////////////////////////
 
@@ -273,6 +1170,22 @@ namespace VANE
 		PropertyGroupInstance properties;
 		properties.push_back( Property( sensor.sendRate ) );
 		properties.push_back( Property( sensor.quality_factor ) );
+		properties.push_back( Property( sensor.m_statFps ) );
+		properties.push_back( Property( sensor.m_statEncodeP50 ) );
+		properties.push_back( Property( sensor.m_statEncodeP95 ) );
+		properties.push_back( Property( sensor.m_statEncodeP99 ) );
+		properties.push_back( Property( sensor.m_statBytesPerFrame ) );
+		properties.push_back( Property( sensor.m_statBitrate ) );
+		properties.push_back( Property( sensor.m_statQueueDepth ) );
+		properties.push_back( Property( sensor.m_statDroppedFrames ) );
+		properties.push_back( Property( sensor.m_statClients ) );
+		properties.push_back( Property( sensor.m_statConnects ) );
+		properties.push_back( Property( sensor.m_statDisconnects ) );
+		properties.push_back( Property( sensor.m_statPeerlessTime ) );
+		properties.push_back( Property( sensor.m_statTargetRate ) );
+		properties.push_back( Property( sensor.m_statCongestionLevel ) );
+		properties.push_back( Property( sensor.m_statQueueDelay ) );
+		properties.push_back( Property( sensor.m_statDeliveredBitrate ) );
 
 		return properties;
 	}
@@ -297,6 +1210,24 @@ namespace VANE
 		propMgr.RegisterPropertyProvider( Types::SampleSensor, this);
 		propMgr.RegisterProperty(Types::SampleSensor, "Frame Rate", "Frame rate to be sent", false);
 		propMgr.RegisterProperty(Types::SampleSensor, "Quality Factor", "Image compression quality factor", false);
+
+		//Streaming health, read only and refreshed every stats interval
+		propMgr.RegisterProperty(Types::SampleSensor, "Achieved Frame Rate", "Frames sent per second, all cameras together", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Encode Time p50", "Median time to encode a frame, in milliseconds", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Encode Time p95", "95th percentile time to encode a frame, in milliseconds", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Encode Time p99", "99th percentile time to encode a frame, in milliseconds", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Bytes Per Frame", "Average size of a sent frame", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Bitrate", "Video bitrate in kbit/s", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Queue Depth", "Most camera frames waiting to be encoded in one update", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Dropped Frames", "Frames that failed to encode or send", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Connected Clients", "Viewers connected to the stream, over ZMQ only the first one is sent frames", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Viewer Connects", "Connections accepted on the video socket", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Viewer Disconnects", "Connections lost on the video socket", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Time Without Viewer", "Milliseconds of the last stats window with no viewer connected", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Target Frame Rate", "Frame rate the motion of the vehicle calls for, the Frame Rate without a motion vehicle", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Congestion Level", "Steps the stream has taken down for the viewer, 0 when it is sent as configured", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Queueing Delay", "Delay of the viewer's frames over the emptiest path, from its acks, in milliseconds", true);
+		propMgr.RegisterProperty(Types::SampleSensor, "Delivered Bitrate", "Rate the viewer received frames at, from its acks, in kbit/s", true);
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -346,6 +1277,36 @@ namespace VANE
 
 			//Do sensor specific XML parsing here
 			pParams->m_intData = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "intData", 0 );
+			pParams->m_frameRingSlots = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "frameRingSlots", 0 );
+			pParams->m_frameRingName = XmlUtils::GetStringAttribute( pXmlParams, "frameRingName" );
+			pParams->m_encodeInProcess = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "encodeInProcess", 1 ) != 0;
+			pParams->m_udpPort = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "udpPort", 0 );
+			pParams->m_udpDatagramSize = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "udpDatagramSize", DatagramVideo::kDefaultDatagramSize );
+			pParams->m_udpDropPercent = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "udpDropPercent", 0 );
+			pParams->m_codec = XmlUtils::GetStringAttribute( pXmlParams, "codec" );
+			pParams->m_bitrate = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "bitrate", 2000 );
+			pParams->m_keyframeInterval = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "keyframeInterval", 0 );
+			pParams->m_intraRefresh = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "intraRefresh", 1 ) != 0;
+			pParams->m_tileSize = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "tileSize", 64 );
+			pParams->m_refreshInterval = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "refreshInterval", 30 );
+			pParams->m_streamChunkSize = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "streamChunkSize", 0 );
+			pParams->m_latencyReportInterval = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "latencyReportInterval", 10 );
+			pParams->m_frameTimestamps = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "frameTimestamps", 1 ) != 0;
+			pParams->m_statsInterval = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "statsInterval", 1000 );
+			pParams->m_statsPort = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "statsPort", 0 );
+			pParams->m_trace = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "trace", 1 ) != 0;
+			pParams->m_record = XmlUtils::GetStringAttribute( pXmlParams, "record" );
+			pParams->m_recordSegmentMB = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "recordSegmentMB", Recording::kDefaultSegmentMB );
+			pParams->m_capture = XmlUtils::GetStringAttribute( pXmlParams, "capture" );
+			pParams->m_captureCodec = XmlUtils::GetStringAttribute( pXmlParams, "captureCodec", "raw" );
+			pParams->m_captureSegmentMB = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "captureSegmentMB", Recording::kDefaultCaptureSegmentMB );
+			pParams->m_captureBatchMB = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "captureBatchMB", Recording::kDefaultCaptureBatchMB );
+			pParams->m_captureQueueMB = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "captureQueueMB", Recording::kDefaultCaptureQueueMB );
+			pParams->m_motionVehicle = XmlUtils::GetStringAttribute( pXmlParams, "motionVehicle" );
+			pParams->m_minSendRate = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "minSendRate", 2 );
+			pParams->m_motionFullSpeed = XmlUtils::GetDoubleAttribute( pXmlParams, "motionFullSpeed", 10.0 );
+			pParams->m_motionFullYawRate = XmlUtils::GetDoubleAttribute( pXmlParams, "motionFullYawRate", 0.5 );
+			pParams->m_targetQueueDelay = XmlUtils::GetUnsignedIntAttribute( pXmlParams, "targetQueueDelay", RateControl::kDefaultTargetDelayMs );
 		}
 		else
 		{
@@ -28,12 +28,32 @@
 #define RangeSensor_h__
 
 #include "SensorPlugin.h"
+#include "Core/Commands.h"
 #include "Simulation/Sensor.h"
+#include "FrameRing.h"
+#include "DatagramVideo.h"
+#include "FrameCodec.h"
+#include "LatencyStats.h"
+#include "Recording.h"
+#include "Capture.h"
+#include "RateControl.h"
+
+#include <map>
+
+namespace zmq { class socket_t; }
 
 namespace VANE
 {
 	extern const SENSOR_API SensorType kSensorTypeSampleSensor;
 
+	//////////////////////////////////////////////////////////////////////////
+	// Commands
+
+	namespace Commands
+	{
+		extern CommandID kCommandWriteSensorTrace;
+	}
+
 	//////////////////////////////////////////////////////////////////////////
 	// Parameters
 
@@ -43,10 +63,55 @@ namespace VANE
 	{
 	public:
 		uint32  m_intData; 	
+
+		uint32  m_frameRingSlots;  ///< Number of shared memory ring slots, 0 disables the ring
+		String  m_frameRingName;   ///< Name of the shared memory ring
+		bool    m_encodeInProcess; ///< Compress and send frames from inside ANVEL
+
+		uint32  m_udpPort;         ///< Port for the UDP frame transport, 0 keeps frames on ZMQ
+		uint32  m_udpDatagramSize; ///< Largest datagram the UDP transport sends
+		uint32  m_udpDropPercent;  ///< Loss injection for testing the UDP transport
+
+		String  m_codec;            ///< Frame codec name, see FrameCodec.h
+		uint32  m_bitrate;          ///< Inter-frame codec bitrate in kbit/s
+		uint32  m_keyframeInterval; ///< Frames between forced keyframes, 0 for none
+		bool    m_intraRefresh;     ///< Use intra refresh instead of periodic keyframes
+		uint32  m_tileSize;         ///< Tile edge in pixels for the tiles codec
+		uint32  m_refreshInterval;  ///< Frames between full frames for the tiles codec
+
+		uint32  m_streamChunkSize;  ///< Send ZMQ frames in chunks of this many bytes while encoding, 0 sends whole frames
+
+		uint32  m_latencyReportInterval; ///< Seconds between latency reports in the log, 0 for none
+		bool    m_frameTimestamps;       ///< Append capture timestamps to JPEG frames, see ClockSync.h
+
+		uint32  m_statsInterval;  ///< Milliseconds over which the streaming stats are gathered
+		uint32  m_statsPort;      ///< Port to publish the stats on, 0 for none (see StreamStats.h)
+
+		bool    m_trace;          ///< Record spans of the sensor's work, see Trace.h
+
+		String  m_record;          ///< Append every encoded frame to this recording, empty for none (see Recording.h)
+		uint32  m_recordSegmentMB; ///< Size at which the recording starts a new segment file
+
+		String  m_capture;           ///< Write every lens frame at the sample rate to this recording, empty for none (see Capture.h)
+		String  m_captureCodec;      ///< "raw" for the pixels as rendered, or a codec name to encode them first
+		uint32  m_captureSegmentMB;  ///< Size the capture's segment files are preallocated to
+		uint32  m_captureBatchMB;    ///< Size of a write to the capture's segments
+		uint32  m_captureQueueMB;    ///< Memory for frames waiting to be written, frames are dropped past it
+
+		String  m_motionVehicle;      ///< Vehicle carrying the cameras, the frame rate follows its motion. Empty streams at the Frame Rate.
+		uint32  m_minSendRate;        ///< Frame rate while the vehicle stands still, the Frame Rate property is the rate in full motion
+		float64 m_motionFullSpeed;    ///< Forward speed in m/s that calls for the full frame rate
+		float64 m_motionFullYawRate;  ///< Yaw rate in rad/s that calls for the full frame rate
+
+		uint32  m_targetQueueDelay;   ///< Milliseconds of queueing the viewer's acks may show before the stream steps down, 0 ignores acks
 	};
 
 	//Forward declare for use within the SampleSensor class
 	class SampleSensorFactory;
+	class SocketMonitor;
+	class AsyncLog;
+	class CameraSensor;
+	struct LensData;
 
 	//////////////////////////////////////////////////////////////////////////
 	// Sample Sensor
@@ -64,9 +129,44 @@ namespace VANE
 		/// Update our sensor
 		virtual void Update(TimeValue dt);
 
+		/// Number of encoded frames handed to the transport so far
+		uint64_t GetFramesSent() const { return m_framesSent; }
+
+		/// Stage latencies of each camera's stream since the last report
+		const std::map<VaneID, StreamLatency>& GetLatency() const { return m_latency; }
+
+		/// Connection events on the video socket, NULL if it could not be monitored
+		const SocketMonitor* GetVideoMonitor() const { return m_pVideoMonitor; }
+
 	protected:
 		SampleSensor( VaneID specificId, SensorStaticAssetParams& params, DynamicAssetParams& dynamicParams );
 
+		/// Copy a lens frame into the shared memory ring for local readers
+		void PublishFrame( const CameraSensor& camera, const LensData& lens, uint32 sizeX, uint32 sizeY );
+
+		/// Get (or create) the encoder for a camera's stream
+		IFrameEncoder* GetEncoder( VaneID cameraID );
+		/// Make the next frame of every stream a keyframe
+		void RequestKeyframes();
+		/// Log the stage latencies of every stream and start new histograms
+		void ReportLatency();
+		/// Account for a frame the transport has taken
+		void RecordSentFrame( VaneID cameraID, const FrameTimestamps& timestamps, size_t size, bool overZmq );
+		/// Log the video socket's connection events and count them into the stats window
+		void TakeSocketEvents();
+		/// Hand the lines of the rate-limited log to ANVEL's logger
+		void TakeLogLines();
+		/// Close the stats window: update the stats properties and publish them
+		void UpdateStats();
+		/// Append an encoded frame, without its trailer, to the recording
+		void RecordFrame( VaneID cameraID, FrameCodecType format, const uint8_t* pData, size_t size );
+		/// Queue every lens frame of a camera for the capture writer
+		void CaptureFrames( const CameraSensor& camera );
+		/// Whether this sample is streamed, at the frame rate the motion of the vehicle calls for
+		bool IsSendDue();
+		/// Feed the viewer's acks to the congestion controller and log its steps
+		void TakeAcks( const uint8_t* pMessage, size_t size );
+
 	protected:
 		// Sensor specific data goes here
 		uint32 m_sampleIntData;
@@ -77,6 +177,93 @@ namespace VANE
 		bool running;
 		String ipaddr;
 
+		TimeValue m_simTime;
+
+		//Raw frames for co-located consumers
+		FrameRing::Writer m_frameRing;
+		uint32 m_frameRingSlots;
+		String m_frameRingName;
+		bool m_encodeInProcess;
+
+		//Loss tolerant alternative to the ZMQ socket
+		DatagramVideo::Sender m_udpSender;
+
+		//One encoder per camera, inter-frame codecs keep state between frames
+		FrameEncoderParams m_encoderParams;
+		std::map<VaneID, IFrameEncoder*> m_encoders;
+		std::vector<uint8_t> m_encoded;
+		uint32 m_streamChunkSize;
+		std::vector<uint8_t> m_streamChunk;
+		uint64_t m_framesSent;
+
+		//Every encoded frame, for replay
+		Recording::Writer m_recording;
+		std::vector<uint8_t> m_recorded;
+
+		//Every lens frame at the sample rate, for datasets. Encoded captures are
+		//encoded off the simulation thread, with encoders of their own.
+		Recording::CaptureWriter m_capture;
+		Recording::CaptureEncoder m_captureEncoder;
+		bool m_captureRaw;
+		FrameEncoderParams m_captureParams;
+		bool m_captureFailureLogged;
+
+		//The frame rate follows the vehicle carrying the cameras, a stationary view needs few frames
+		String m_motionVehicle;
+		int m_minSendRate;
+		float64 m_motionFullSpeed;
+		float64 m_motionFullYawRate;
+		bool m_moving;
+		bool m_motionVehicleMissing;
+		TimeValue m_lastSendTime;
+		float64 m_statTargetRate;
+
+		//Steps the stream down while the viewer's acks show frames queueing, see RateControl.h
+		RateControl::Controller m_rateControl;
+		bool m_rateControlEnabled;
+		uint32 m_bitrate;     ///< As configured, the controller scales it with the quality
+		uint32 m_dueFrames;   ///< Frames due to be sent, for the controller's rate divisor
+		std::vector<RateControl::Ack> m_acks;
+		std::vector<uint8_t> m_scaled;
+		uint32 m_statCongestionLevel;
+		float64 m_statQueueDelay;
+		float64 m_statDeliveredBitrate;
+
+		//Where the time goes between the renderer and the socket
+		std::map<VaneID, StreamLatency> m_latency;
+		uint32 m_latencyReportInterval;
+		LatencyClock::time_point m_latencyReported;
+		bool m_frameTimestamps;
+
+		//Streaming health over the last stats window, shown as read-only properties
+		float64 m_statFps;
+		float64 m_statEncodeP50;
+		float64 m_statEncodeP95;
+		float64 m_statEncodeP99;
+		float64 m_statBytesPerFrame;
+		float64 m_statBitrate;
+		uint32 m_statQueueDepth;
+		uint32 m_statDroppedFrames;
+		uint32 m_statClients;
+		uint32 m_statConnects;
+		uint32 m_statDisconnects;
+		float64 m_statPeerlessTime;
+
+		//The window being gathered
+		uint32 m_statsInterval;
+		LatencyClock::time_point m_statsWindowStart;
+		LatencyHistogram m_windowEncode;
+		uint64_t m_windowFrames;
+		uint64_t m_windowBytes;
+		uint32 m_windowQueueDepth;
+		bool m_windowZmqSent;
+		uint32 m_windowConnects;
+		uint32 m_windowDisconnects;
+		int64_t m_windowPeerlessStart;
+		uint64_t m_framesDropped;
+		zmq::socket_t* m_pStatsSocket;
+		SocketMonitor* m_pVideoMonitor;
+		AsyncLog* m_pLog;  ///< For errors raised per frame, see AsyncLog.h
 	};
 
 	//////////////////////////////////////////////////////////////////////////
@@ -114,6 +301,16 @@ namespace VANE
 	private:
 
 		VaneID m_sensorIDCount;
+
+		//Internal class to handle command management
+		class SampleSensorCommandGroup : public CommandGroup
+		{
+		public:
+			SampleSensorCommandGroup();
+			CommandResult HandleCommand( CommandID commandID, const CommandParamList& parameterList );
+		};
+
+		SampleSensorCommandGroup m_commands;
 	};
 
 
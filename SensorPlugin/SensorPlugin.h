@@ -30,7 +30,9 @@
 #include "Core/Plugin.h"
 #include "Simulation/Sensor.h"
 
-#ifdef ANVEL_SENSOR_PLUGIN_EXPORT
+#ifndef _WIN32
+#define SENSOR_API
+#elif defined(ANVEL_SENSOR_PLUGIN_EXPORT)
 #define SENSOR_API __declspec(dllexport)
 #else
 #define SENSOR_API __declspec(dllimport)
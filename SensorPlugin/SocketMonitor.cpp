@@ -0,0 +1,282 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SocketMonitor.cpp - Connection events and counters for a ZMQ socket.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "SocketMonitor.h"
+#include "ClockSync.h"
+#include "Trace.h"
+
+#include <stdio.h>
+
+namespace VANE
+{
+	EndpointStats::EndpointStats()
+		: m_peers( 0 )
+		, m_accepted( 0 )
+		, m_connected( 0 )
+		, m_disconnected( 0 )
+		, m_connectRetried( 0 )
+		, m_failed( 0 )
+		, m_lastConnect( 0 )
+		, m_lastDisconnect( 0 )
+		, m_longestGap( 0 )
+		, m_peerlessSince( 0 )
+		, m_peerlessTime( 0 )
+	{
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	int64_t EndpointStats::GetPeerlessTime( int64_t now ) const
+	{
+		return m_peerlessTime + (m_peers == 0 && now > m_peerlessSince ? now - m_peerlessSince : 0);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	const char* GetSocketEventName( uint16_t event )
+	{
+		switch ( event )
+		{
+		case ZMQ_EVENT_CONNECTED:       return "connected";
+		case ZMQ_EVENT_CONNECT_DELAYED: return "connect delayed";
+		case ZMQ_EVENT_CONNECT_RETRIED: return "connect retried";
+		case ZMQ_EVENT_LISTENING:       return "listening";
+		case ZMQ_EVENT_BIND_FAILED:     return "bind failed";
+		case ZMQ_EVENT_ACCEPTED:        return "accepted";
+		case ZMQ_EVENT_ACCEPT_FAILED:   return "accept failed";
+		case ZMQ_EVENT_CLOSED:          return "closed";
+		case ZMQ_EVENT_CLOSE_FAILED:    return "close failed";
+		case ZMQ_EVENT_DISCONNECTED:    return "disconnected";
+		default:                        return "unknown";
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	SocketMonitor::SocketMonitor()
+		: m_started( false )
+		, m_failed( false )
+		, m_lostEvents( 0 )
+	{
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	SocketMonitor::~SocketMonitor()
+	{
+		Stop();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	bool SocketMonitor::Start( zmq::socket_t& socket, const std::string& name )
+	{
+		if ( IsRunning() )
+			return true;
+
+		m_started = false;
+		m_failed = false;
+		m_totals = EndpointStats();
+		m_totals.m_peerlessSince = ClockSync::Now();
+
+		//The monitor's own socket is on the same context, so an inproc name is enough
+		char address[128];
+		sprintf( address, "inproc://monitor.%s.%p", name.c_str(), static_cast<void*>( this ) );
+		m_thread = std::thread( &SocketMonitor::Run, this, &socket, std::string( address ) );
+
+		//monitor() only returns when it stops, so wait for it to be in place
+		std::unique_lock<std::mutex> lock( m_mutex );
+		while ( !m_started && !m_failed )
+			m_startedCondition.wait( lock );
+
+		if ( m_failed )
+		{
+			lock.unlock();
+			m_thread.join();
+			return false;
+		}
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SocketMonitor::Stop()
+	{
+		if ( !IsRunning() )
+			return;
+
+		//Ends monitor() with ZMQ_EVENT_MONITOR_STOPPED, or ETERM once the context goes
+		abort();
+		m_thread.join();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SocketMonitor::Run( zmq::socket_t* pSocket, std::string address )
+	{
+		Trace::SetThreadName( "ZMQ socket monitor" );
+
+		try
+		{
+			monitor( *pSocket, address );
+		}
+		catch ( const zmq::error_t& )
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			m_failed = true;
+			m_startedCondition.notify_all();
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SocketMonitor::on_monitor_started()
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_started = true;
+		m_startedCondition.notify_all();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SocketMonitor::Count( EndpointStats& stats, const zmq_event_t& event, int64_t now )
+	{
+		if ( stats.m_peerlessSince == 0 )
+			stats.m_peerlessSince = now;
+
+		switch ( event.event )
+		{
+		case ZMQ_EVENT_ACCEPTED:
+		case ZMQ_EVENT_CONNECTED:
+			if ( event.event == ZMQ_EVENT_ACCEPTED )
+				++stats.m_accepted;
+			else
+				++stats.m_connected;
+
+			if ( stats.m_peers++ == 0 )
+			{
+				stats.m_peerlessTime += now - stats.m_peerlessSince;
+				if ( stats.m_lastDisconnect != 0 && now - stats.m_lastDisconnect > stats.m_longestGap )
+					stats.m_longestGap = now - stats.m_lastDisconnect;
+			}
+			stats.m_lastConnect = now;
+			break;
+
+		case ZMQ_EVENT_DISCONNECTED:
+			++stats.m_disconnected;
+			if ( stats.m_peers > 0 && --stats.m_peers == 0 )
+				stats.m_peerlessSince = now;
+			stats.m_lastDisconnect = now;
+			break;
+
+		case ZMQ_EVENT_CONNECT_RETRIED:
+			++stats.m_connectRetried;
+			break;
+
+		case ZMQ_EVENT_BIND_FAILED:
+		case ZMQ_EVENT_ACCEPT_FAILED:
+		case ZMQ_EVENT_CLOSE_FAILED:
+			++stats.m_failed;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SocketMonitor::Record( const zmq_event_t& event, const char* pAddress )
+	{
+		Trace::Span span( "socket event" );
+		int64_t now = ClockSync::Now();
+
+		SocketEvent record;
+		record.m_time = now;
+		record.m_event = event.event;
+		record.m_value = event.value;
+		record.m_endpoint = pAddress;
+		record.m_duration = 0;
+
+		std::lock_guard<std::mutex> lock( m_mutex );
+
+		Count( m_endpoints[record.m_endpoint], event, now );
+		Count( m_totals, event, now );
+
+		//The connection's file descriptor ties a disconnect to its connect
+		if ( event.event == ZMQ_EVENT_ACCEPTED || event.event == ZMQ_EVENT_CONNECTED )
+		{
+			m_connectTimes[event.value] = now;
+		}
+		else if ( event.event == ZMQ_EVENT_DISCONNECTED )
+		{
+			std::map<int32_t, int64_t>::iterator it = m_connectTimes.find( event.value );
+			if ( it != m_connectTimes.end() )
+			{
+				record.m_duration = now - it->second;
+				m_connectTimes.erase( it );
+			}
+		}
+
+		if ( m_pending.size() >= kMaxPendingEvents )
+		{
+			m_pending.pop_front();
+			++m_lostEvents;
+		}
+		m_pending.push_back( record );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void SocketMonitor::on_event_connected( const zmq_event_t& event, const char* pAddress )       { Record( event, pAddress ); }
+	void SocketMonitor::on_event_connect_delayed( const zmq_event_t& event, const char* pAddress ) { Record( event, pAddress ); }
+	void SocketMonitor::on_event_connect_retried( const zmq_event_t& event, const char* pAddress ) { Record( event, pAddress ); }
+	void SocketMonitor::on_event_listening( const zmq_event_t& event, const char* pAddress )       { Record( event, pAddress ); }
+	void SocketMonitor::on_event_bind_failed( const zmq_event_t& event, const char* pAddress )     { Record( event, pAddress ); }
+	void SocketMonitor::on_event_accepted( const zmq_event_t& event, const char* pAddress )        { Record( event, pAddress ); }
+	void SocketMonitor::on_event_accept_failed( const zmq_event_t& event, const char* pAddress )   { Record( event, pAddress ); }
+	void SocketMonitor::on_event_closed( const zmq_event_t& event, const char* pAddress )          { Record( event, pAddress ); }
+	void SocketMonitor::on_event_close_failed( const zmq_event_t& event, const char* pAddress )    { Record( event, pAddress ); }
+	void SocketMonitor::on_event_disconnected( const zmq_event_t& event, const char* pAddress )    { Record( event, pAddress ); }
+	void SocketMonitor::on_event_unknown( const zmq_event_t& event, const char* pAddress )         { Record( event, pAddress ); }
+
+	//////////////////////////////////////////////////////////////////////////
+
+	uint32_t SocketMonitor::GetPeerCount() const
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_totals.m_peers;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	std::map<std::string, EndpointStats> SocketMonitor::GetEndpoints() const
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_endpoints;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	EndpointStats SocketMonitor::GetTotals() const
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_totals;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	uint64_t SocketMonitor::TakeEvents( std::vector<SocketEvent>& events )
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		events.insert( events.end(), m_pending.begin(), m_pending.end() );
+		m_pending.clear();
+
+		uint64_t lost = m_lostEvents;
+		m_lostEvents = 0;
+		return lost;
+	}
+}
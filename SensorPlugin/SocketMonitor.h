@@ -0,0 +1,127 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SocketMonitor.h - Connection events and counters for a ZMQ socket.
+//
+// ZMQ connects, reconnects and drops peers on its own I/O threads, so a
+// plugin only sees that a send or receive is slow, not why. A SocketMonitor
+// attaches zmq::monitor_t to one socket and reads its events on a thread of
+// its own. For every endpoint it counts accepted, connected, disconnected and
+// failed connections, keeps how many peers are connected, and how long the
+// endpoint has gone without one, so stalls can be lined up against the
+// latency figures.
+//
+// Events are also queued for the plugin to log from its update, since the
+// ANVEL logger is not called from other threads. Times are on the clock of
+// ClockSync::Now().
+//
+// Start() must be called on the thread that owns the socket, before it is
+// used, and Stop() (or the destructor) before the socket is closed. Like
+// FrameRing.h, this header does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef SocketMonitor_h__
+#define SocketMonitor_h__
+
+#include "zmq.hpp"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace VANE
+{
+	struct EndpointStats
+	{
+		EndpointStats();
+
+		uint32_t m_peers;           ///< Connected right now
+		uint64_t m_accepted;
+		uint64_t m_connected;
+		uint64_t m_disconnected;
+		uint64_t m_connectRetried;
+		uint64_t m_failed;          ///< Bind, accept and close failures
+		int64_t  m_lastConnect;     ///< 0 until the first peer
+		int64_t  m_lastDisconnect;  ///< 0 until a peer goes
+		int64_t  m_longestGap;      ///< Longest wait from a disconnect to the next peer, in microseconds
+		int64_t  m_peerlessSince;   ///< When the last peer went, or the endpoint came up
+		int64_t  m_peerlessTime;    ///< Microseconds without a peer before m_peerlessSince
+
+		///Total microseconds this endpoint has had no peer, up to now
+		int64_t GetPeerlessTime( int64_t now ) const;
+	};
+
+	struct SocketEvent
+	{
+		int64_t     m_time;
+		uint16_t    m_event;     ///< ZMQ_EVENT_*
+		int32_t     m_value;     ///< Error code, file descriptor or retry interval, depending on the event
+		std::string m_endpoint;
+		int64_t     m_duration;  ///< Disconnects: how long the peer was connected, 0 if unknown
+	};
+
+	const char* GetSocketEventName( uint16_t event );
+
+	class SocketMonitor : private zmq::monitor_t
+	{
+	public:
+		SocketMonitor();
+		~SocketMonitor();
+
+		///@param name Tells this monitor apart from the others on the context
+		///@return false if ZMQ cannot monitor the socket
+		bool Start( zmq::socket_t& socket, const std::string& name );
+		void Stop();
+		bool IsRunning() const { return m_thread.joinable(); }
+
+		///Peers connected to all endpoints
+		uint32_t GetPeerCount() const;
+		std::map<std::string, EndpointStats> GetEndpoints() const;
+		///The socket as a whole: counters summed, and the peers of every endpoint together
+		EndpointStats GetTotals() const;
+
+		///Move the events since the last call into events
+		///@return events lost because nobody took them in time
+		uint64_t TakeEvents( std::vector<SocketEvent>& events );
+
+	private: //[monitor_t methods, on the monitor thread]
+		virtual void on_monitor_started();
+		virtual void on_event_connected( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_connect_delayed( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_connect_retried( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_listening( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_bind_failed( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_accepted( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_accept_failed( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_closed( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_close_failed( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_disconnected( const zmq_event_t& event, const char* pAddress );
+		virtual void on_event_unknown( const zmq_event_t& event, const char* pAddress );
+
+	private:
+		enum { kMaxPendingEvents = 256 };
+
+		void Run( zmq::socket_t* pSocket, std::string address );
+		void Record( const zmq_event_t& event, const char* pAddress );
+		void Count( EndpointStats& stats, const zmq_event_t& event, int64_t now );
+
+		std::thread m_thread;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_startedCondition;
+		bool m_started;
+		bool m_failed;
+		std::map<std::string, EndpointStats> m_endpoints;
+		EndpointStats m_totals;
+		std::map<int32_t, int64_t> m_connectTimes;  ///< By file descriptor
+		std::deque<SocketEvent> m_pending;
+		uint64_t m_lostEvents;
+	};
+}
+
+#endif // SocketMonitor_h__
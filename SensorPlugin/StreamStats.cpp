@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StreamStats.cpp - Streaming health counters and their wire format.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StreamStats.h"
+
+#include <string.h>
+
+namespace VANE
+{
+	static inline void Put( uint8_t*& p, uint64_t value, int bytes )
+	{
+		for ( int i = 0; i < bytes; ++i )
+			*p++ = static_cast<uint8_t>( value >> (8 * i) );
+	}
+
+	static inline uint64_t Get( const uint8_t*& p, int bytes )
+	{
+		uint64_t value = 0;
+		for ( int i = 0; i < bytes; ++i )
+			value |= static_cast<uint64_t>( *p++ ) << (8 * i);
+		return value;
+	}
+
+	static inline void PutFloat( uint8_t*& p, float value )
+	{
+		uint32_t bits;
+		memcpy( &bits, &value, sizeof(bits) );
+		Put( p, bits, 4 );
+	}
+
+	static inline float GetFloat( const uint8_t*& p )
+	{
+		uint32_t bits = static_cast<uint32_t>( Get( p, 4 ) );
+		float value;
+		memcpy( &value, &bits, sizeof(value) );
+		return value;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	void WriteStatsSnapshot( const StreamStatsSnapshot& snapshot, uint8_t* pMessage )
+	{
+		uint8_t* p = pMessage;
+		Put( p, kStatsSnapshotMagic, 4 );
+		Put( p, kStatsSnapshotVersion, 2 );
+		Put( p, 0, 2 );
+		Put( p, static_cast<uint64_t>( snapshot.m_time ), 8 );
+		Put( p, snapshot.m_windowMs, 4 );
+		PutFloat( p, snapshot.m_fps );
+		PutFloat( p, snapshot.m_encodeP50 );
+		PutFloat( p, snapshot.m_encodeP95 );
+		PutFloat( p, snapshot.m_encodeP99 );
+		PutFloat( p, snapshot.m_bytesPerFrame );
+		PutFloat( p, snapshot.m_bitrateKbps );
+		Put( p, snapshot.m_queueDepth, 4 );
+		Put( p, snapshot.m_clients, 4 );
+		Put( p, snapshot.m_framesSent, 8 );
+		Put( p, snapshot.m_framesDropped, 8 );
+		Put( p, snapshot.m_connects, 4 );
+		Put( p, snapshot.m_disconnects, 4 );
+		Put( p, snapshot.m_peerlessMs, 4 );
+		Put( p, snapshot.m_longestGapMs, 4 );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	bool ReadStatsSnapshot( const uint8_t* pMessage, size_t size, StreamStatsSnapshot& snapshot )
+	{
+		if ( size < kStatsSnapshotSize )
+			return false;
+
+		const uint8_t* p = pMessage;
+		if ( Get( p, 4 ) != kStatsSnapshotMagic || Get( p, 2 ) != kStatsSnapshotVersion )
+			return false;
+		p += 2;
+
+		snapshot.m_time          = static_cast<int64_t>( Get( p, 8 ) );
+		snapshot.m_windowMs      = static_cast<uint32_t>( Get( p, 4 ) );
+		snapshot.m_fps           = GetFloat( p );
+		snapshot.m_encodeP50     = GetFloat( p );
+		snapshot.m_encodeP95     = GetFloat( p );
+		snapshot.m_encodeP99     = GetFloat( p );
+		snapshot.m_bytesPerFrame = GetFloat( p );
+		snapshot.m_bitrateKbps   = GetFloat( p );
+		snapshot.m_queueDepth    = static_cast<uint32_t>( Get( p, 4 ) );
+		snapshot.m_clients       = static_cast<uint32_t>( Get( p, 4 ) );
+		snapshot.m_framesSent    = Get( p, 8 );
+		snapshot.m_framesDropped = Get( p, 8 );
+		snapshot.m_connects      = static_cast<uint32_t>( Get( p, 4 ) );
+		snapshot.m_disconnects   = static_cast<uint32_t>( Get( p, 4 ) );
+		snapshot.m_peerlessMs    = static_cast<uint32_t>( Get( p, 4 ) );
+		snapshot.m_longestGapMs  = static_cast<uint32_t>( Get( p, 4 ) );
+		return true;
+	}
+}
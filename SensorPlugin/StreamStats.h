@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StreamStats.h - Streaming health counters and their wire format.
+//
+// SampleSensor gathers these over a short window (statsInterval), shows the
+// latest window as read-only properties in the property panel, and, when
+// statsPort is set, publishes each window on a ZMQ PUB socket at that port
+// for dashboards. A subscriber connects to tcp://<plugin address>:<statsPort>
+// with an empty subscription and receives one message per window.
+//
+// Snapshot layout, little endian, kStatsSnapshotSize bytes:
+//
+//   uint32 magic "ANST"     uint16 version       uint16 reserved
+//   int64  time (us)        uint32 window (ms)   float32 fps
+//   float32 encode p50 (ms) float32 encode p95   float32 encode p99
+//   float32 bytes/frame     float32 kbit/s       uint32 queue depth
+//   uint32 clients          uint64 frames sent   uint64 frames dropped
+//   uint32 connects         uint32 disconnects   uint32 no viewer (ms)
+//   uint32 longest reconnect gap (ms)
+//
+// Connects, disconnects and the time without a viewer are for the window, so
+// they line up with the latency and frame rate of the same window; they come
+// from the video socket's monitor (SocketMonitor.h). The time is on the clock
+// of ClockSync::Now(). Like FrameRing.h, this header
+// does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef StreamStats_h__
+#define StreamStats_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace VANE
+{
+	const uint32_t kStatsSnapshotMagic   = 0x54534E41; // "ANST"
+	const uint16_t kStatsSnapshotVersion = 2;
+	const uint32_t kStatsSnapshotSize    = 88;
+
+	struct StreamStatsSnapshot
+	{
+		int64_t  m_time;            ///< End of the window
+		uint32_t m_windowMs;
+		float    m_fps;             ///< Frames sent per second, all cameras together
+		float    m_encodeP50;       ///< Encode time percentiles in milliseconds
+		float    m_encodeP95;
+		float    m_encodeP99;
+		float    m_bytesPerFrame;
+		float    m_bitrateKbps;
+		uint32_t m_queueDepth;      ///< Most camera frames waiting to be encoded in one tick
+		uint32_t m_clients;         ///< Connected viewers
+		uint64_t m_framesSent;      ///< Since the sensor started
+		uint64_t m_framesDropped;   ///< Sampled for sending but not sent, since the sensor started
+		uint32_t m_connects;        ///< Viewers that connected during the window
+		uint32_t m_disconnects;
+		uint32_t m_peerlessMs;      ///< Time in the window with no viewer connected
+		uint32_t m_longestGapMs;    ///< Longest wait for a viewer to come back, since the sensor started
+	};
+
+	void WriteStatsSnapshot( const StreamStatsSnapshot& snapshot, uint8_t* pMessage );
+
+	///@return false if the message is not a snapshot this version understands
+	bool ReadStatsSnapshot( const uint8_t* pMessage, size_t size, StreamStatsSnapshot& snapshot );
+}
+
+#endif // StreamStats_h__
@@ -0,0 +1,189 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Trace.cpp - Spans of plugin work for chrome://tracing and Perfetto.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "Trace.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+namespace VANE
+{
+	namespace Trace
+	{
+		//Spans per thread between flushes, a 100 Hz tick with a dozen spans fills this in about 7 s
+		static const uint32_t kRingSize = 8192;
+
+		struct Event
+		{
+			const char* m_pName;
+			int64_t     m_begin;
+			int64_t     m_end;
+		};
+
+		struct ThreadRing
+		{
+			uint32_t m_threadID;
+			const char* m_pThreadName;
+			std::atomic<uint64_t> m_written;  ///< Events ever recorded, only the owning thread stores it
+			uint64_t m_flushed;               ///< Events up to here have been written out, flushes only
+			Event m_events[kRingSize];
+		};
+
+		static std::atomic<bool> s_enabled( true );
+
+		//Rings outlive their threads so the spans of a finished thread can still be flushed
+		static std::mutex s_ringsMutex;
+		static std::vector<ThreadRing*> s_rings;
+
+		static TRACE_THREAD_LOCAL ThreadRing* t_pRing = NULL;
+
+		static uint32_t GetThreadID()
+		{
+#ifdef _WIN32
+			return static_cast<uint32_t>( GetCurrentThreadId() );
+#else
+			return static_cast<uint32_t>( syscall( SYS_gettid ) );
+#endif
+		}
+
+		static uint32_t GetProcessID()
+		{
+#ifdef _WIN32
+			return static_cast<uint32_t>( GetCurrentProcessId() );
+#else
+			return static_cast<uint32_t>( getpid() );
+#endif
+		}
+
+		static ThreadRing* GetRing()
+		{
+			if ( !t_pRing )
+			{
+				ThreadRing* pRing = new ThreadRing;
+				pRing->m_threadID = GetThreadID();
+				pRing->m_pThreadName = NULL;
+				pRing->m_written = 0;
+				pRing->m_flushed = 0;
+
+				std::lock_guard<std::mutex> lock( s_ringsMutex );
+				s_rings.push_back( pRing );
+				t_pRing = pRing;
+			}
+			return t_pRing;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void SetEnabled( bool enabled )
+		{
+			s_enabled = enabled;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		bool IsEnabled()
+		{
+			return s_enabled.load( std::memory_order_relaxed );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void SetThreadName( const char* pName )
+		{
+			GetRing()->m_pThreadName = pName;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		void Record( const char* pName, int64_t begin, int64_t end )
+		{
+			ThreadRing* pRing = GetRing();
+			uint64_t index = pRing->m_written.load( std::memory_order_relaxed );
+
+			Event& event = pRing->m_events[index % kRingSize];
+			event.m_pName = pName;
+			event.m_begin = begin;
+			event.m_end = end;
+
+			pRing->m_written.store( index + 1, std::memory_order_release );
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+
+		int64_t Flush( const std::string& fileName, uint64_t* pLost )
+		{
+			FILE* pFile = fopen( fileName.c_str(), "ab" );
+			if ( !pFile )
+				return -1;
+
+			//A new file starts the array, appending adds to it
+			fseek( pFile, 0, SEEK_END );
+			if ( ftell( pFile ) == 0 )
+				fprintf( pFile, "[\n" );
+
+			uint32_t processID = GetProcessID();
+			std::vector<Event> events;
+			int64_t written = 0;
+			uint64_t lost = 0;
+
+			std::lock_guard<std::mutex> lock( s_ringsMutex );
+			for ( size_t r = 0; r < s_rings.size(); ++r )
+			{
+				ThreadRing& ring = *s_rings[r];
+
+				//Copy what the ring holds, then drop anything the owner overwrote meanwhile
+				uint64_t end = ring.m_written.load( std::memory_order_acquire );
+				uint64_t start = end > kRingSize ? end - kRingSize : 0;
+				if ( start < ring.m_flushed )
+					start = ring.m_flushed;
+
+				events.clear();
+				for ( uint64_t i = start; i < end; ++i )
+					events.push_back( ring.m_events[i % kRingSize] );
+
+				std::atomic_thread_fence( std::memory_order_acquire );
+				uint64_t after = ring.m_written.load( std::memory_order_relaxed );
+				uint64_t valid = after >= kRingSize ? after - kRingSize + 1 : 0;
+				uint64_t first = start < valid ? valid : start;
+
+				lost += first - ring.m_flushed;
+				ring.m_flushed = end;
+
+				if ( ring.m_pThreadName )
+				{
+					fprintf( pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n",
+						processID, ring.m_threadID, ring.m_pThreadName );
+				}
+
+				for ( uint64_t i = first; i < end; ++i )
+				{
+					const Event& event = events[static_cast<size_t>( i - start )];
+					fprintf( pFile, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%u,\"tid\":%u},\n",
+						event.m_pName, static_cast<long long>( event.m_begin ), static_cast<long long>( event.m_end - event.m_begin ),
+						processID, ring.m_threadID );
+					++written;
+				}
+			}
+
+			fclose( pFile );
+
+			if ( pLost )
+				*pLost = lost;
+			return written;
+		}
+	}
+}
@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Trace.h - Spans of plugin work for chrome://tracing and Perfetto.
+//
+// A Span notes the time it is created and, when it ends or goes out of
+// scope, adds a complete event to a ring buffer owned by the calling thread.
+// Only that thread writes its ring, so recording is two clock reads and a
+// few stores with no locking; the oldest spans are overwritten once a ring
+// is full. Flush() appends what the rings hold to a file in the Chrome trace
+// JSON array format and empties them. The closing bracket of that format is
+// optional, so both plugins, and later flushes, can append to the same file
+// and it still opens as one trace.
+//
+// Times are microseconds on the clock of ClockSync::Now(), events carry the
+// process and OS thread IDs, so spans from both plugins and the simulation
+// thread line up. Span names must be string literals (they are kept as
+// pointers). Each plugin library has rings of its own.
+//
+// Like FrameRing.h, this header does not depend on any ANVEL headers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Trace_h__
+#define Trace_h__
+
+#include "ClockSync.h"
+
+#include <string>
+
+namespace VANE
+{
+	namespace Trace
+	{
+		///Recording is on by default
+		void SetEnabled( bool enabled );
+		bool IsEnabled();
+
+		///Name the calling thread in the trace, pName must outlive the process' flushes
+		void SetThreadName( const char* pName );
+
+		///Add a span that ran from begin to end on the calling thread
+		void Record( const char* pName, int64_t begin, int64_t end );
+
+		///Append the spans of every thread to fileName and empty the rings
+		///@param pLost Set to the spans overwritten since the last flush because a ring was full
+		///@return the number of spans written, -1 if the file could not be opened
+		int64_t Flush( const std::string& fileName, uint64_t* pLost = NULL );
+
+		class Span
+		{
+		public:
+			explicit Span( const char* pName )
+				: m_pName( IsEnabled() ? pName : NULL )
+				, m_begin( m_pName ? ClockSync::Now() : 0 )
+			{
+			}
+
+			~Span() { End(); }
+
+			///End the span before the end of its scope
+			void End()
+			{
+				if ( m_pName )
+				{
+					Record( m_pName, m_begin, ClockSync::Now() );
+					m_pName = NULL;
+				}
+			}
+
+		private:
+			const char* m_pName;
+			int64_t     m_begin;
+
+			Span( const Span& );
+			void operator = ( const Span& );
+		};
+	}
+}
+
+#endif // Trace_h__
@@ -17,13 +17,30 @@
 #define JPGE_MAX(a,b) (((a)>(b))?(a):(b))
 #define JPGE_MIN(a,b) (((a)<(b))?(a):(b))
 
+#ifdef JPGE_PROFILE
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define JPGE_PROFILE_MARK() { if (m_pProfile) m_profile_mark = __rdtsc(); }
+#define JPGE_PROFILE_LAP(stage) profile_lap(stage)
+#define JPGE_PROFILE_COUNT(counter, n) { if (m_pProfile) m_pProfile->counter += (n); }
+#define JPGE_PROFILE_FLUSH_SCOPE() profile_flush_scope profile_flush(m_pProfile, m_profile_mark)
+#else
+#define JPGE_PROFILE_MARK()
+#define JPGE_PROFILE_LAP(stage)
+#define JPGE_PROFILE_COUNT(counter, n)
+#define JPGE_PROFILE_FLUSH_SCOPE()
+#endif
+
 namespace jpge {
 
 static inline void *jpge_malloc(size_t nSize) { return malloc(nSize); }
 static inline void jpge_free(void *p) { free(p); }
 
 // Various JPEG enums and tables.
-enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_RST0 = 0xD0, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_APP0 = 0xE0 };
 enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
 static uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
@@ -57,46 +74,82 @@ static uint8 s_ac_chroma_val[AC_CHROMA_CODES] =
 // Low-level helper functions.
 template <class T> inline void clear_obj(T &obj) { memset(&obj, 0, sizeof(obj)); }
 
-const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
-static inline uint8 clamp(int i) { if (static_cast<uint>(i) > 255U) { if (i < 0) i = 0; else if (i > 255) i = 255; } return static_cast<uint8>(i); }
+#ifdef JPGE_PROFILE
+void profile::reset()
+{
+  clear_obj(m_cycles);
+  m_images = m_passes = m_blocks = m_nonzero_coefficients = m_output_bytes = m_flushes = 0;
+}
 
-static void RGB_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels)
+const char *get_profile_stage_name(int stage)
 {
-  for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--)
-  {
-    const int r = pSrc[0], g = pSrc[1], b = pSrc[2];
-    pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
-    pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
-    pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
-  }
+  static const char *s_names[PROFILE_NUM_STAGES] = { "color", "load", "dct", "quant", "entropy", "flush", "other" };
+  return ((stage >= 0) && (stage < PROFILE_NUM_STAGES)) ? s_names[stage] : "unknown";
 }
 
-static void RGB_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels)
+// Charges the cycles since the last lap (or the start of process_scanline()) to stage.
+void jpeg_encoder::profile_lap(int stage)
 {
-  for ( ; num_pixels; pDst++, pSrc += 3, num_pixels--)
-    pDst[0] = static_cast<uint8>((pSrc[0] * YR + pSrc[1] * YG + pSrc[2] * YB + 32768) >> 16);
+  if (!m_pProfile) return;
+  uint64 now = __rdtsc();
+  m_pProfile->m_cycles[stage] += now - m_profile_mark;
+  m_profile_mark = now;
 }
 
-static void RGBA_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels)
+// Charges a flush to PROFILE_FLUSH and moves the mark past it, so the stage that triggered it doesn't pay for it too.
+class profile_flush_scope
+{
+public:
+  profile_flush_scope(profile *pProfile, uint64 &mark) : m_pProfile(pProfile), m_mark(mark), m_start(pProfile ? __rdtsc() : 0) { }
+  ~profile_flush_scope()
+  {
+    if (!m_pProfile) return;
+    uint64 cycles = __rdtsc() - m_start;
+    m_pProfile->m_cycles[PROFILE_FLUSH] += cycles;
+    m_mark += cycles;
+  }
+private:
+  profile_flush_scope(const profile_flush_scope &);
+  profile_flush_scope &operator =(const profile_flush_scope &);
+  profile *m_pProfile;
+  uint64 &m_mark;
+  uint64 m_start;
+};
+#endif
+
+const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
+static inline uint8 clamp(int i) { if (static_cast<uint>(i) > 255U) { if (i < 0) i = 0; else if (i > 255) i = 255; } return static_cast<uint8>(i); }
+
+// Color conversion of one scanline into the planar MCU rows, pDst holds the Y, Cb and Cr rows.
+template <int SrcBpp>
+static void RGBX_to_YCC(uint8** pDst, const uint8 *pSrc, int num_pixels)
 {
-  for ( ; num_pixels; pDst += 3, pSrc += 4, num_pixels--)
+  uint8 *pY = pDst[0], *pCb = pDst[1], *pCr = pDst[2];
+  for (int i = 0; i < num_pixels; i++, pSrc += SrcBpp)
   {
     const int r = pSrc[0], g = pSrc[1], b = pSrc[2];
-    pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
-    pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
-    pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+    pY[i]  = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+    pCb[i] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
+    pCr[i] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
   }
 }
 
-static void RGBA_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels)
+template <int SrcBpp>
+static void RGBX_to_Y(uint8** pDst, const uint8 *pSrc, int num_pixels)
 {
-  for ( ; num_pixels; pDst++, pSrc += 4, num_pixels--)
-    pDst[0] = static_cast<uint8>((pSrc[0] * YR + pSrc[1] * YG + pSrc[2] * YB + 32768) >> 16);
+  uint8 *pY = pDst[0];
+  for (int i = 0; i < num_pixels; i++, pSrc += SrcBpp)
+    pY[i] = static_cast<uint8>((pSrc[0] * YR + pSrc[1] * YG + pSrc[2] * YB + 32768) >> 16);
 }
 
-static void Y_to_YCC(uint8* pDst, const uint8* pSrc, int num_pixels)
+static void Y_to_YCC(uint8** pDst, const uint8* pSrc, int num_pixels)
 {
-  for( ; num_pixels; pDst += 3, pSrc++, num_pixels--) { pDst[0] = pSrc[0]; pDst[1] = 128; pDst[2] = 128; }
+  memcpy(pDst[0], pSrc, num_pixels); memset(pDst[1], 128, num_pixels); memset(pDst[2], 128, num_pixels);
+}
+
+static void Y_to_Y(uint8** pDst, const uint8* pSrc, int num_pixels)
+{
+  memcpy(pDst[0], pSrc, num_pixels);
 }
 
 // Forward DCT - DCT derived from jfdctint.
@@ -240,10 +293,13 @@ void jpeg_encoder::optimize_huffman_table(int table_num, int table_len)
     m_huff_val[table_num][num_used_syms - 1 - i] = static_cast<uint8>(pSyms[i].m_sym_index - 1);
 }
 
+// Writing to the output buffer, which is either the staging buffer for m_pStream or m_pBuffer's memory.
+#define JPGE_PUT_BYTE(c) { *m_pOut_buf++ = (c); if (--m_out_buf_left == 0) flush_output_buffer(); }
+
 // JPEG marker generation.
 void jpeg_encoder::emit_byte(uint8 i)
 {
-  m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_obj(i);
+  JPGE_PUT_BYTE(i);
 }
 
 void jpeg_encoder::emit_word(uint i)
@@ -352,6 +408,14 @@ void jpeg_encoder::emit_sos()
   emit_byte(0);
 }
 
+// Emit define restart interval
+void jpeg_encoder::emit_dri()
+{
+  emit_marker(M_DRI);
+  emit_word(4);
+  emit_word(m_params.m_restart_interval);
+}
+
 // Emit all markers at beginning of image file.
 void jpeg_encoder::emit_markers()
 {
@@ -360,6 +424,8 @@ void jpeg_encoder::emit_markers()
   emit_dqt();
   emit_sof();
   emit_dhts();
+  if (m_params.m_restart_interval)
+    emit_dri();
   emit_sos();
 }
 
@@ -417,8 +483,11 @@ void jpeg_encoder::first_pass_init()
 {
   m_bit_buffer = 0; m_bits_in = 0;
   memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+  m_mcus_until_restart = m_params.m_restart_interval;
+  m_restart_marker = 0;
   m_mcu_y_ofs = 0;
   m_pass_num = 1;
+  select_mcu_row_func();
 }
 
 bool jpeg_encoder::second_pass_init()
@@ -433,6 +502,7 @@ bool jpeg_encoder::second_pass_init()
   first_pass_init();
   emit_markers();
   m_pass_num = 2;
+  select_mcu_row_func();
   return true;
 }
 
@@ -478,19 +548,42 @@ bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
   m_image_bpl      = m_image_x * src_channels;
   m_image_x_mcu    = (m_image_x + m_mcu_x - 1) & (~(m_mcu_x - 1));
   m_image_y_mcu    = (m_image_y + m_mcu_y - 1) & (~(m_mcu_y - 1));
-  m_image_bpl_xlt  = m_image_x * m_num_components;
-  m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
+  m_mcu_line_size  = (m_image_x_mcu + 15) & ~15;
   m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
 
-  if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) return false;
-  for (int i = 1; i < m_mcu_y; i++)
-    m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
+  // Pick the color conversion once instead of for every scanline
+  if (m_num_components == 1)
+    m_pConvert_scanline = (m_image_bpp == 4) ? RGBX_to_Y<4> : ((m_image_bpp == 3) ? RGBX_to_Y<3> : Y_to_Y);
+  else
+    m_pConvert_scanline = (m_image_bpp == 4) ? RGBX_to_YCC<4> : ((m_image_bpp == 3) ? RGBX_to_YCC<3> : Y_to_YCC);
+
+  // One plane per component so block loads and downsampling read contiguous, aligned samples
+  const uint mcu_buf_size = m_mcu_line_size * m_mcu_y * m_num_components + 15;
+  m_pMcu_buf_allocator = m_pAllocator;
+  if ((m_pMcu_buf = (m_pAllocator ? m_pAllocator->alloc(mcu_buf_size) : jpge_malloc(mcu_buf_size))) == NULL) return false;
+  uint8 *pLine = reinterpret_cast<uint8*>((reinterpret_cast<size_t>(m_pMcu_buf) + 15) & ~static_cast<size_t>(15));
+  for (int c = 0; c < m_num_components; c++)
+  {
+    for (int i = 0; i < m_mcu_y; i++, pLine += m_mcu_line_size)
+      m_mcu_lines[c][i] = pLine;
+  }
 
   compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
   compute_quant_table(m_quantization_tables[1], m_params.m_no_chroma_discrim_flag ? s_std_lum_quant : s_std_croma_quant);
 
-  m_out_buf_left = JPGE_OUT_BUF_SIZE;
-  m_pOut_buf = m_out_buf;
+  if (m_pBuffer)
+  {
+    m_buffer_full = false;
+    m_pOut_buf = m_pBuffer->m_pBuf + m_pBuffer->m_size;
+    m_out_buf_left = m_pBuffer->m_capacity - m_pBuffer->m_size;
+    if (!m_out_buf_left)
+      flush_output_buffer();
+  }
+  else
+  {
+    m_out_buf_left = JPGE_OUT_BUF_SIZE;
+    m_pOut_buf = m_out_buf;
+  }
 
   if (m_params.m_two_pass_flag)
   {
@@ -515,7 +608,7 @@ void jpeg_encoder::load_block_8_8_grey(int x)
   x <<= 3;
   for (int i = 0; i < 8; i++, pDst += 8)
   {
-    pSrc = m_mcu_lines[i] + x;
+    pSrc = m_mcu_lines[0][i] + x;
     pDst[0] = pSrc[0] - 128; pDst[1] = pSrc[1] - 128; pDst[2] = pSrc[2] - 128; pDst[3] = pSrc[3] - 128;
     pDst[4] = pSrc[4] - 128; pDst[5] = pSrc[5] - 128; pDst[6] = pSrc[6] - 128; pDst[7] = pSrc[7] - 128;
   }
@@ -525,13 +618,13 @@ void jpeg_encoder::load_block_8_8(int x, int y, int c)
 {
   uint8 *pSrc;
   sample_array_t *pDst = m_sample_array;
-  x = (x * (8 * 3)) + c;
+  x <<= 3;
   y <<= 3;
   for (int i = 0; i < 8; i++, pDst += 8)
   {
-    pSrc = m_mcu_lines[y + i] + x;
-    pDst[0] = pSrc[0 * 3] - 128; pDst[1] = pSrc[1 * 3] - 128; pDst[2] = pSrc[2 * 3] - 128; pDst[3] = pSrc[3 * 3] - 128;
-    pDst[4] = pSrc[4 * 3] - 128; pDst[5] = pSrc[5 * 3] - 128; pDst[6] = pSrc[6 * 3] - 128; pDst[7] = pSrc[7 * 3] - 128;
+    pSrc = m_mcu_lines[c][y + i] + x;
+    pDst[0] = pSrc[0] - 128; pDst[1] = pSrc[1] - 128; pDst[2] = pSrc[2] - 128; pDst[3] = pSrc[3] - 128;
+    pDst[4] = pSrc[4] - 128; pDst[5] = pSrc[5] - 128; pDst[6] = pSrc[6] - 128; pDst[7] = pSrc[7] - 128;
   }
 }
 
@@ -539,16 +632,16 @@ void jpeg_encoder::load_block_16_8(int x, int c)
 {
   uint8 *pSrc1, *pSrc2;
   sample_array_t *pDst = m_sample_array;
-  x = (x * (16 * 3)) + c;
+  x <<= 4;
   int a = 0, b = 2;
   for (int i = 0; i < 16; i += 2, pDst += 8)
   {
-    pSrc1 = m_mcu_lines[i + 0] + x;
-    pSrc2 = m_mcu_lines[i + 1] + x;
-    pDst[0] = ((pSrc1[ 0 * 3] + pSrc1[ 1 * 3] + pSrc2[ 0 * 3] + pSrc2[ 1 * 3] + a) >> 2) - 128; pDst[1] = ((pSrc1[ 2 * 3] + pSrc1[ 3 * 3] + pSrc2[ 2 * 3] + pSrc2[ 3 * 3] + b) >> 2) - 128;
-    pDst[2] = ((pSrc1[ 4 * 3] + pSrc1[ 5 * 3] + pSrc2[ 4 * 3] + pSrc2[ 5 * 3] + a) >> 2) - 128; pDst[3] = ((pSrc1[ 6 * 3] + pSrc1[ 7 * 3] + pSrc2[ 6 * 3] + pSrc2[ 7 * 3] + b) >> 2) - 128;
-    pDst[4] = ((pSrc1[ 8 * 3] + pSrc1[ 9 * 3] + pSrc2[ 8 * 3] + pSrc2[ 9 * 3] + a) >> 2) - 128; pDst[5] = ((pSrc1[10 * 3] + pSrc1[11 * 3] + pSrc2[10 * 3] + pSrc2[11 * 3] + b) >> 2) - 128;
-    pDst[6] = ((pSrc1[12 * 3] + pSrc1[13 * 3] + pSrc2[12 * 3] + pSrc2[13 * 3] + a) >> 2) - 128; pDst[7] = ((pSrc1[14 * 3] + pSrc1[15 * 3] + pSrc2[14 * 3] + pSrc2[15 * 3] + b) >> 2) - 128;
+    pSrc1 = m_mcu_lines[c][i + 0] + x;
+    pSrc2 = m_mcu_lines[c][i + 1] + x;
+    pDst[0] = ((pSrc1[ 0] + pSrc1[ 1] + pSrc2[ 0] + pSrc2[ 1] + a) >> 2) - 128; pDst[1] = ((pSrc1[ 2] + pSrc1[ 3] + pSrc2[ 2] + pSrc2[ 3] + b) >> 2) - 128;
+    pDst[2] = ((pSrc1[ 4] + pSrc1[ 5] + pSrc2[ 4] + pSrc2[ 5] + a) >> 2) - 128; pDst[3] = ((pSrc1[ 6] + pSrc1[ 7] + pSrc2[ 6] + pSrc2[ 7] + b) >> 2) - 128;
+    pDst[4] = ((pSrc1[ 8] + pSrc1[ 9] + pSrc2[ 8] + pSrc2[ 9] + a) >> 2) - 128; pDst[5] = ((pSrc1[10] + pSrc1[11] + pSrc2[10] + pSrc2[11] + b) >> 2) - 128;
+    pDst[6] = ((pSrc1[12] + pSrc1[13] + pSrc2[12] + pSrc2[13] + a) >> 2) - 128; pDst[7] = ((pSrc1[14] + pSrc1[15] + pSrc2[14] + pSrc2[15] + b) >> 2) - 128;
     int temp = a; a = b; b = temp;
   }
 }
@@ -557,14 +650,14 @@ void jpeg_encoder::load_block_16_8_8(int x, int c)
 {
   uint8 *pSrc1;
   sample_array_t *pDst = m_sample_array;
-  x = (x * (16 * 3)) + c;
+  x <<= 4;
   for (int i = 0; i < 8; i++, pDst += 8)
   {
-    pSrc1 = m_mcu_lines[i + 0] + x;
-    pDst[0] = ((pSrc1[ 0 * 3] + pSrc1[ 1 * 3]) >> 1) - 128; pDst[1] = ((pSrc1[ 2 * 3] + pSrc1[ 3 * 3]) >> 1) - 128;
-    pDst[2] = ((pSrc1[ 4 * 3] + pSrc1[ 5 * 3]) >> 1) - 128; pDst[3] = ((pSrc1[ 6 * 3] + pSrc1[ 7 * 3]) >> 1) - 128;
-    pDst[4] = ((pSrc1[ 8 * 3] + pSrc1[ 9 * 3]) >> 1) - 128; pDst[5] = ((pSrc1[10 * 3] + pSrc1[11 * 3]) >> 1) - 128;
-    pDst[6] = ((pSrc1[12 * 3] + pSrc1[13 * 3]) >> 1) - 128; pDst[7] = ((pSrc1[14 * 3] + pSrc1[15 * 3]) >> 1) - 128;
+    pSrc1 = m_mcu_lines[c][i + 0] + x;
+    pDst[0] = ((pSrc1[ 0] + pSrc1[ 1]) >> 1) - 128; pDst[1] = ((pSrc1[ 2] + pSrc1[ 3]) >> 1) - 128;
+    pDst[2] = ((pSrc1[ 4] + pSrc1[ 5]) >> 1) - 128; pDst[3] = ((pSrc1[ 6] + pSrc1[ 7]) >> 1) - 128;
+    pDst[4] = ((pSrc1[ 8] + pSrc1[ 9]) >> 1) - 128; pDst[5] = ((pSrc1[10] + pSrc1[11]) >> 1) - 128;
+    pDst[6] = ((pSrc1[12] + pSrc1[13]) >> 1) - 128; pDst[7] = ((pSrc1[14] + pSrc1[15]) >> 1) - 128;
   }
 }
 
@@ -595,8 +688,47 @@ void jpeg_encoder::load_quantized_coefficients(int component_num)
 
 void jpeg_encoder::flush_output_buffer()
 {
+  JPGE_PROFILE_FLUSH_SCOPE();
+  if (m_pBuffer)
+  {
+    // Only called on a full buffer, or to update m_size at the end. After a failure the rest of the output is dropped into m_out_buf.
+    if ((!m_all_stream_writes_succeeded) || (m_buffer_full))
+    {
+      // Anything past the end of a buffer that could not grow means the image did not fit
+      if ((m_buffer_full) && (m_out_buf_left != JPGE_OUT_BUF_SIZE))
+        m_all_stream_writes_succeeded = false;
+      m_pOut_buf = m_out_buf;
+      m_out_buf_left = JPGE_OUT_BUF_SIZE;
+      return;
+    }
+    uint size = static_cast<uint>(m_pOut_buf - m_pBuffer->m_pBuf);
+    JPGE_PROFILE_COUNT(m_output_bytes, size - m_pBuffer->m_size);
+    m_pBuffer->m_size = size;
+    if (m_out_buf_left)
+      return;
+    JPGE_PROFILE_COUNT(m_flushes, 1);
+    uint min_capacity = m_pBuffer->m_capacity + JPGE_OUT_BUF_SIZE;
+    if ((m_pBuffer->m_pGrow) && (m_pBuffer->m_pGrow(*m_pBuffer, min_capacity)) && (m_pBuffer->m_capacity >= min_capacity))
+    {
+      m_pOut_buf = m_pBuffer->m_pBuf + m_pBuffer->m_size;
+      m_out_buf_left = m_pBuffer->m_capacity - m_pBuffer->m_size;
+    }
+    else
+    {
+      // Full, but the image may end right here. Only fail once another byte is written.
+      m_buffer_full = true;
+      m_pOut_buf = m_out_buf;
+      m_out_buf_left = JPGE_OUT_BUF_SIZE;
+    }
+    return;
+  }
+
   if (m_out_buf_left != JPGE_OUT_BUF_SIZE)
+  {
+    JPGE_PROFILE_COUNT(m_output_bytes, JPGE_OUT_BUF_SIZE - m_out_buf_left);
+    JPGE_PROFILE_COUNT(m_flushes, 1);
     m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(m_out_buf, JPGE_OUT_BUF_SIZE - m_out_buf_left);
+  }
   m_pOut_buf = m_out_buf;
   m_out_buf_left = JPGE_OUT_BUF_SIZE;
 }
@@ -607,7 +739,6 @@ void jpeg_encoder::put_bits(uint bits, uint len)
   while (m_bits_in >= 8)
   {
     uint8 c;
-    #define JPGE_PUT_BYTE(c) { *m_pOut_buf++ = (c); if (--m_out_buf_left == 0) flush_output_buffer(); }
     JPGE_PUT_BYTE(c = (uint8)((m_bit_buffer >> 16) & 0xFF));
     if (c == 0xFF) JPGE_PUT_BYTE(0);
     m_bit_buffer <<= 8;
@@ -688,6 +819,7 @@ void jpeg_encoder::code_coefficients_pass_two(int component_num)
 
   put_bits(codes[0][nbits], code_sizes[0][nbits]);
   if (nbits) put_bits(temp2 & ((1 << nbits) - 1), nbits);
+  JPGE_PROFILE_COUNT(m_nonzero_coefficients, pSrc[0] != 0);
 
   for (run_len = 0, i = 1; i < 64; i++)
   {
@@ -711,6 +843,7 @@ void jpeg_encoder::code_coefficients_pass_two(int component_num)
       j = (run_len << 4) + nbits;
       put_bits(codes[1][j], code_sizes[1][j]);
       put_bits(temp2 & ((1 << nbits) - 1), nbits);
+      JPGE_PROFILE_COUNT(m_nonzero_coefficients, 1);
       run_len = 0;
     }
   }
@@ -718,49 +851,93 @@ void jpeg_encoder::code_coefficients_pass_two(int component_num)
     put_bits(codes[1][0], code_sizes[1][0]);
 }
 
-void jpeg_encoder::code_block(int component_num)
+template <int Pass>
+inline void jpeg_encoder::code_block(int component_num)
 {
+  JPGE_PROFILE_LAP(PROFILE_LOAD_BLOCK);
   DCT2D(m_sample_array);
+  JPGE_PROFILE_LAP(PROFILE_DCT);
   load_quantized_coefficients(component_num);
-  if (m_pass_num == 1)
+  JPGE_PROFILE_LAP(PROFILE_QUANTIZE);
+  if (Pass == 1)
     code_coefficients_pass_one(component_num);
   else
+  {
     code_coefficients_pass_two(component_num);
+    JPGE_PROFILE_COUNT(m_blocks, 1);
+  }
+  JPGE_PROFILE_LAP(PROFILE_ENTROPY);
 }
 
-void jpeg_encoder::process_mcu_row()
+// Called before each MCU when restart markers are enabled.
+void jpeg_encoder::process_restart_interval()
 {
-  if (m_num_components == 1)
+  if (!m_mcus_until_restart)
   {
-    for (int i = 0; i < m_mcus_per_row; i++)
+    if (m_pass_num == 2)
     {
-      load_block_8_8_grey(i); code_block(0);
+      // Pad the current byte with 1 bits, then write RSTn straight into the output buffer (markers are not byte stuffed).
+      put_bits(0x7F, 7);
+      m_bit_buffer = 0; m_bits_in = 0;
+      JPGE_PUT_BYTE(0xFF);
+      JPGE_PUT_BYTE(static_cast<uint8>(M_RST0 + m_restart_marker));
+      m_restart_marker = (m_restart_marker + 1) & 7;
     }
+    memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+    m_mcus_until_restart = m_params.m_restart_interval;
   }
-  else if ((m_comp_h_samp[0] == 1) && (m_comp_v_samp[0] == 1))
-  {
-    for (int i = 0; i < m_mcus_per_row; i++)
-    {
-      load_block_8_8(i, 0, 0); code_block(0); load_block_8_8(i, 0, 1); code_block(1); load_block_8_8(i, 0, 2); code_block(2);
-    }
-  }
-  else if ((m_comp_h_samp[0] == 2) && (m_comp_v_samp[0] == 1))
+  m_mcus_until_restart--;
+  JPGE_PROFILE_LAP(PROFILE_ENTROPY);
+}
+
+// One MCU row, specialized for the subsampling mode, pass and whether restart markers are used, so the loop has no runtime branching on them.
+template <int Subsampling, int Pass, bool Restarts>
+void jpeg_encoder::process_mcu_row_impl()
+{
+  for (int i = 0; i < m_mcus_per_row; i++)
   {
-    for (int i = 0; i < m_mcus_per_row; i++)
+    if (Restarts) process_restart_interval();
+    switch (Subsampling)
     {
-      load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
-      load_block_16_8_8(i, 1); code_block(1); load_block_16_8_8(i, 2); code_block(2);
+      case Y_ONLY:
+        load_block_8_8_grey(i); code_block<Pass>(0);
+        break;
+      case H1V1:
+        load_block_8_8(i, 0, 0); code_block<Pass>(0); load_block_8_8(i, 0, 1); code_block<Pass>(1); load_block_8_8(i, 0, 2); code_block<Pass>(2);
+        break;
+      case H2V1:
+        load_block_8_8(i * 2 + 0, 0, 0); code_block<Pass>(0); load_block_8_8(i * 2 + 1, 0, 0); code_block<Pass>(0);
+        load_block_16_8_8(i, 1); code_block<Pass>(1); load_block_16_8_8(i, 2); code_block<Pass>(2);
+        break;
+      case H2V2:
+        load_block_8_8(i * 2 + 0, 0, 0); code_block<Pass>(0); load_block_8_8(i * 2 + 1, 0, 0); code_block<Pass>(0);
+        load_block_8_8(i * 2 + 0, 1, 0); code_block<Pass>(0); load_block_8_8(i * 2 + 1, 1, 0); code_block<Pass>(0);
+        load_block_16_8(i, 1); code_block<Pass>(1); load_block_16_8(i, 2); code_block<Pass>(2);
+        break;
     }
   }
-  else if ((m_comp_h_samp[0] == 2) && (m_comp_v_samp[0] == 2))
+}
+
+// Called whenever the pass changes, m_params is fixed for the life of the image.
+void jpeg_encoder::select_mcu_row_func()
+{
+  static const mcu_row_func s_funcs[4][2][2] =
   {
-    for (int i = 0; i < m_mcus_per_row; i++)
-    {
-      load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
-      load_block_8_8(i * 2 + 0, 1, 0); code_block(0); load_block_8_8(i * 2 + 1, 1, 0); code_block(0);
-      load_block_16_8(i, 1); code_block(1); load_block_16_8(i, 2); code_block(2);
-    }
-  }
+    { { &jpeg_encoder::process_mcu_row_impl<Y_ONLY, 1, false>, &jpeg_encoder::process_mcu_row_impl<Y_ONLY, 1, true> },
+      { &jpeg_encoder::process_mcu_row_impl<Y_ONLY, 2, false>, &jpeg_encoder::process_mcu_row_impl<Y_ONLY, 2, true> } },
+    { { &jpeg_encoder::process_mcu_row_impl<H1V1, 1, false>, &jpeg_encoder::process_mcu_row_impl<H1V1, 1, true> },
+      { &jpeg_encoder::process_mcu_row_impl<H1V1, 2, false>, &jpeg_encoder::process_mcu_row_impl<H1V1, 2, true> } },
+    { { &jpeg_encoder::process_mcu_row_impl<H2V1, 1, false>, &jpeg_encoder::process_mcu_row_impl<H2V1, 1, true> },
+      { &jpeg_encoder::process_mcu_row_impl<H2V1, 2, false>, &jpeg_encoder::process_mcu_row_impl<H2V1, 2, true> } },
+    { { &jpeg_encoder::process_mcu_row_impl<H2V2, 1, false>, &jpeg_encoder::process_mcu_row_impl<H2V2, 1, true> },
+      { &jpeg_encoder::process_mcu_row_impl<H2V2, 2, false>, &jpeg_encoder::process_mcu_row_impl<H2V2, 2, true> } }
+  };
+  m_pProcess_mcu_row = s_funcs[m_params.m_subsampling][(m_pass_num == 1) ? 0 : 1][(m_params.m_restart_interval != 0) ? 1 : 0];
+}
+
+void jpeg_encoder::process_mcu_row()
+{
+  (this->*m_pProcess_mcu_row)();
 }
 
 bool jpeg_encoder::terminate_pass_one()
@@ -776,8 +953,9 @@ bool jpeg_encoder::terminate_pass_one()
 bool jpeg_encoder::terminate_pass_two()
 {
   put_bits(0x7F, 7);
-  flush_output_buffer();
   emit_marker(M_EOI);
+  flush_output_buffer();
+  JPGE_PROFILE_COUNT(m_images, 1);
   m_pass_num++; // purposely bump up m_pass_num, for debugging
   return true;
 }
@@ -788,13 +966,15 @@ bool jpeg_encoder::process_end_of_image()
   {
     if (m_mcu_y_ofs < 16) // check here just to shut up static analysis
     {
-      for (int i = m_mcu_y_ofs; i < m_mcu_y; i++)
-        memcpy(m_mcu_lines[i], m_mcu_lines[m_mcu_y_ofs - 1], m_image_bpl_mcu);
+      for (int c = 0; c < m_num_components; c++)
+        for (int i = m_mcu_y_ofs; i < m_mcu_y; i++)
+          memcpy(m_mcu_lines[c][i], m_mcu_lines[c][m_mcu_y_ofs - 1], m_image_x_mcu);
     }
 
     process_mcu_row();
   }
 
+  JPGE_PROFILE_COUNT(m_passes, 1);
   if (m_pass_num == 1)
     return terminate_pass_one();
   else
@@ -805,39 +985,18 @@ void jpeg_encoder::load_mcu(const void *pSrc)
 {
   const uint8* Psrc = reinterpret_cast<const uint8*>(pSrc);
 
-  uint8* pDst = m_mcu_lines[m_mcu_y_ofs]; // OK to write up to m_image_bpl_xlt bytes to pDst
-
-  if (m_num_components == 1)
-  {
-    if (m_image_bpp == 4)
-      RGBA_to_Y(pDst, Psrc, m_image_x);
-    else if (m_image_bpp == 3)
-      RGB_to_Y(pDst, Psrc, m_image_x);
-    else
-      memcpy(pDst, Psrc, m_image_x);
-  }
-  else
+  uint8* pDst[3] = { m_mcu_lines[0][m_mcu_y_ofs], NULL, NULL };
+  if (m_num_components > 1)
   {
-    if (m_image_bpp == 4)
-      RGBA_to_YCC(pDst, Psrc, m_image_x);
-    else if (m_image_bpp == 3)
-      RGB_to_YCC(pDst, Psrc, m_image_x);
-    else
-      Y_to_YCC(pDst, Psrc, m_image_x);
+    pDst[1] = m_mcu_lines[1][m_mcu_y_ofs]; pDst[2] = m_mcu_lines[2][m_mcu_y_ofs];
   }
 
+  m_pConvert_scanline(pDst, Psrc, m_image_x);
+
   // Possibly duplicate pixels at end of scanline if not a multiple of 8 or 16
-  if (m_num_components == 1)
-    memset(m_mcu_lines[m_mcu_y_ofs] + m_image_bpl_xlt, pDst[m_image_bpl_xlt - 1], m_image_x_mcu - m_image_x);
-  else
-  {
-    const uint8 y = pDst[m_image_bpl_xlt - 3 + 0], cb = pDst[m_image_bpl_xlt - 3 + 1], cr = pDst[m_image_bpl_xlt - 3 + 2];
-    uint8 *q = m_mcu_lines[m_mcu_y_ofs] + m_image_bpl_xlt;
-    for (int i = m_image_x; i < m_image_x_mcu; i++)
-    {
-      *q++ = y; *q++ = cb; *q++ = cr;
-    }
-  }
+  for (int c = 0; c < m_num_components; c++)
+    memset(pDst[c] + m_image_x, pDst[c][m_image_x - 1], m_image_x_mcu - m_image_x);
+  JPGE_PROFILE_LAP(PROFILE_COLOR_CONVERT);
 
   if (++m_mcu_y_ofs == m_mcu_y)
   {
@@ -848,13 +1007,20 @@ void jpeg_encoder::load_mcu(const void *pSrc)
 
 void jpeg_encoder::clear()
 {
-  m_mcu_lines[0] = NULL;
+  m_pStream = NULL;
+  m_pBuffer = NULL;
+  m_pMcu_buf = NULL;
+  m_pMcu_buf_allocator = NULL;
   m_pass_num = 0;
   m_all_stream_writes_succeeded = true;
 }
 
-jpeg_encoder::jpeg_encoder()
+jpeg_encoder::jpeg_encoder() : m_pAllocator(NULL)
 {
+#ifdef JPGE_PROFILE
+  m_pProfile = NULL;
+  m_profile_mark = 0;
+#endif
   clear();
 }
 
@@ -872,15 +1038,28 @@ bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_c
   return jpg_open(width, height, src_channels);
 }
 
+bool jpeg_encoder::init(output_buffer *pBuffer, int width, int height, int src_channels, const params &comp_params)
+{
+  deinit();
+  if (((!pBuffer) || (pBuffer->m_size > pBuffer->m_capacity) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+  m_pBuffer = pBuffer;
+  m_params = comp_params;
+  return jpg_open(width, height, src_channels);
+}
+
 void jpeg_encoder::deinit()
 {
-  jpge_free(m_mcu_lines[0]);
+  if (m_pMcu_buf_allocator)
+    m_pMcu_buf_allocator->free(m_pMcu_buf);
+  else
+    jpge_free(m_pMcu_buf);
   clear();
 }
 
 bool jpeg_encoder::process_scanline(const void* pScanline)
 {
   if ((m_pass_num < 1) || (m_pass_num > 2)) return false;
+  JPGE_PROFILE_MARK();
   if (m_all_stream_writes_succeeded)
   {
     if (!pScanline)
@@ -892,6 +1071,7 @@ bool jpeg_encoder::process_scanline(const void* pScanline)
       load_mcu(pScanline);
     }
   }
+  JPGE_PROFILE_LAP(PROFILE_OTHER);
   return m_all_stream_writes_succeeded;
 }
 
@@ -975,46 +1155,18 @@ bool compress_image_to_jpeg_file(const char *pFilename, int width, int height, i
   return dst_stream.close();
 }
 
-class memory_stream : public output_stream
-{
-   memory_stream(const memory_stream &);
-   memory_stream &operator= (const memory_stream &);
-
-   uint8 *m_pBuf;
-   uint m_buf_size, m_buf_ofs;
-
-public:
-   memory_stream(void *pBuf, uint buf_size) : m_pBuf(static_cast<uint8*>(pBuf)), m_buf_size(buf_size), m_buf_ofs(0) { }
-
-   virtual ~memory_stream() { }
-
-   virtual bool put_buf(const void* pBuf, int len)
-   {
-      uint buf_remaining = m_buf_size - m_buf_ofs;
-      if ((uint)len > buf_remaining)
-         return false;
-      memcpy(m_pBuf + m_buf_ofs, pBuf, len);
-      m_buf_ofs += len;
-      return true;
-   }
-
-   uint get_size() const
-   {
-      return m_buf_ofs;
-   }
-};
-
 bool compress_image_to_jpeg_file_in_memory(void *pDstBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
 {
    if ((!pDstBuf) || (!buf_size))
       return false;
 
-   memory_stream dst_stream(pDstBuf, buf_size);
+   // Compress straight into the caller's buffer, failing if it fills up
+   output_buffer dst_buf(pDstBuf, buf_size);
 
    buf_size = 0;
 
    jpge::jpeg_encoder dst_image;
-   if (!dst_image.init(&dst_stream, width, height, num_channels, comp_params))
+   if (!dst_image.init(&dst_buf, width, height, num_channels, comp_params))
       return false;
 
    for (uint pass_index = 0; pass_index < dst_image.get_total_passes(); pass_index++)
@@ -1031,7 +1183,7 @@ bool compress_image_to_jpeg_file_in_memory(void *pDstBuf, int &buf_size, int wid
 
    dst_image.deinit();
 
-   buf_size = dst_stream.get_size();
+   buf_size = dst_buf.m_size;
    return true;
 }
 
@@ -19,12 +19,13 @@ namespace jpge
   // JPEG compression parameters structure.
   struct params
   {
-    inline params() : m_quality(85), m_subsampling(H2V2), m_no_chroma_discrim_flag(false), m_two_pass_flag(false) { }
+    inline params() : m_quality(85), m_subsampling(H2V2), m_no_chroma_discrim_flag(false), m_two_pass_flag(false), m_restart_interval(0) { }
 
     inline bool check() const
     {
       if ((m_quality < 1) || (m_quality > 100)) return false;
       if ((uint)m_subsampling > (uint)H2V2) return false;
+      if (m_restart_interval > 0xFFFF) return false;
       return true;
     }
 
@@ -43,6 +44,10 @@ namespace jpge
     bool m_no_chroma_discrim_flag;
 
     bool m_two_pass_flag;
+
+    // Number of MCUs between RSTn markers, 0 disables restart markers.
+    // Each restart interval can be decoded on its own, which lets a lossy transport drop or replace pieces of a frame.
+    uint m_restart_interval;
   };
   
   // Writes JPEG image to a file. 
@@ -63,7 +68,66 @@ namespace jpge
     virtual bool put_buf(const void* Pbuf, int len) = 0;
     template<class T> inline bool put_obj(const T& obj) { return put_buf(&obj, sizeof(T)); }
   };
+
+  // Memory destination that jpeg_encoder writes into directly, without an intermediate buffer or a put_buf() call per flush.
+  // When it fills up, m_pGrow (if set) must make m_pBuf at least min_capacity bytes, keeping the first m_size bytes.
+  struct output_buffer
+  {
+    output_buffer() : m_pBuf(0), m_size(0), m_capacity(0), m_pGrow(0), m_pUser(0) { }
+    output_buffer(void *pBuf, uint capacity) : m_pBuf(static_cast<uint8*>(pBuf)), m_size(0), m_capacity(capacity), m_pGrow(0), m_pUser(0) { }
+
+    uint8 *m_pBuf;
+    uint m_size;      // Bytes written so far, up to date once compression finishes
+    uint m_capacity;
+    bool (*m_pGrow)(output_buffer &buf, uint min_capacity);
+    void *m_pUser;
+  };
     
+  // Source of the encoder's working memory, for callers that want to avoid the global heap (e.g. a per-frame arena).
+  class allocator
+  {
+  public:
+    virtual ~allocator() { }
+    virtual void *alloc(uint size) = 0;
+    virtual void free(void *p) = 0;
+  };
+
+#ifdef JPGE_PROFILE
+  // Optional profiling, compiled in only when JPGE_PROFILE is defined.
+  // Every cycle spent inside process_scanline() is charged to exactly one stage (so the stages add up to the encoder's time),
+  // except that stream/buffer flushes are taken out of whichever stage triggered them. Cycles are read with rdtsc.
+  typedef unsigned long long uint64;
+
+  enum profile_stage_t
+  {
+    PROFILE_COLOR_CONVERT = 0,  // load_mcu(): RGB to YCbCr, edge padding
+    PROFILE_LOAD_BLOCK,         // 8x8 block loads and chroma downsampling
+    PROFILE_DCT,                // DCT2D()
+    PROFILE_QUANTIZE,           // load_quantized_coefficients()
+    PROFILE_ENTROPY,            // Huffman statistics (pass one) or coding (pass two), restart markers
+    PROFILE_FLUSH,              // flush_output_buffer()
+    PROFILE_OTHER,              // Huffman table optimization, headers, end of image
+    PROFILE_NUM_STAGES
+  };
+
+  const char *get_profile_stage_name(int stage);
+
+  // Accumulates over every image encoded by the encoders it is given to with set_profile().
+  struct profile
+  {
+    inline profile() { reset(); }
+    void reset();
+
+    uint64 m_cycles[PROFILE_NUM_STAGES];
+    uint64 m_images;
+    uint64 m_passes;
+    uint64 m_blocks;                // 8x8 blocks coded in the final pass
+    uint64 m_nonzero_coefficients;  // Nonzero quantized coefficients (DC and AC) coded in the final pass
+    uint64 m_output_bytes;
+    uint64 m_flushes;
+  };
+#endif
+
   // Lower level jpeg_encoder class - useful if more control is needed than the above helper functions.
   class jpeg_encoder
   {
@@ -78,9 +142,21 @@ namespace jpge
     // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
     // Returns false on out of memory or if a stream write fails.
     bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
+
+    // Same as above, but appends the compressed data to pBuffer.
+    bool init(output_buffer *pBuffer, int width, int height, int src_channels, const params &comp_params = params());
     
     const params &get_params() const { return m_params; }
+
+    // Allocate working memory from pAllocator instead of malloc/free, NULL restores the default.
+    // Takes effect at the next init(), and the allocator must outlive the image.
+    void set_allocator(allocator *pAllocator) { m_pAllocator = pAllocator; }
     
+#ifdef JPGE_PROFILE
+    // Accumulate stage cycles and counters into pProfile, NULL stops. The profile must outlive the image.
+    void set_profile(profile *pProfile) { m_pProfile = pProfile; }
+#endif
+
     // Deinitializes the compressor, freeing any allocated memory. May be called at any time.
     void deinit();
 
@@ -98,17 +174,23 @@ namespace jpge
     jpeg_encoder &operator =(const jpeg_encoder &);
 
     typedef int32 sample_array_t;
+    typedef void (jpeg_encoder::*mcu_row_func)();
+    typedef void (*convert_scanline_func)(uint8 **pDst, const uint8 *pSrc, int num_pixels);
         
     output_stream *m_pStream;
+    output_buffer *m_pBuffer;
     params m_params;
     uint8 m_num_components;
     uint8 m_comp_h_samp[3], m_comp_v_samp[3];
     int m_image_x, m_image_y, m_image_bpp, m_image_bpl;
     int m_image_x_mcu, m_image_y_mcu;
-    int m_image_bpl_xlt, m_image_bpl_mcu;
+    int m_mcu_line_size;
     int m_mcus_per_row;
     int m_mcu_x, m_mcu_y;
-    uint8 *m_mcu_lines[16];
+    uint8 *m_mcu_lines[3][16];  // Planar Y, Cb, Cr rows of the current MCU row, each 16 byte aligned
+    void *m_pMcu_buf;
+    allocator *m_pAllocator;
+    allocator *m_pMcu_buf_allocator;
     uint8 m_mcu_y_ofs;
     sample_array_t m_sample_array[64];
     int16 m_coefficient_array[64];
@@ -119,14 +201,24 @@ namespace jpge
     uint8 m_huff_val[4][256];
     uint32 m_huff_count[4][256];
     int m_last_dc_val[3];
+    uint m_mcus_until_restart;
+    uint8 m_restart_marker;
     enum { JPGE_OUT_BUF_SIZE = 2048 };
     uint8 m_out_buf[JPGE_OUT_BUF_SIZE];
     uint8 *m_pOut_buf;
     uint m_out_buf_left;
+    bool m_buffer_full;  // m_pBuffer could not grow, m_out_buf catches what follows so an exact fit still succeeds
     uint32 m_bit_buffer;
     uint m_bits_in;
     uint8 m_pass_num;
     bool m_all_stream_writes_succeeded;
+    mcu_row_func m_pProcess_mcu_row;
+    convert_scanline_func m_pConvert_scanline;
+#ifdef JPGE_PROFILE
+    profile *m_pProfile;
+    uint64 m_profile_mark;  // Cycle count where the current stage began
+    void profile_lap(int stage);
+#endif
         
     void optimize_huffman_table(int table_num, int table_len);
     void emit_byte(uint8 i);
@@ -138,6 +230,7 @@ namespace jpge
     void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
     void emit_dhts();
     void emit_sos();
+    void emit_dri();
     void emit_markers();
     void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val);
     void compute_quant_table(int32 *dst, int16 *src);
@@ -154,7 +247,10 @@ namespace jpge
     void put_bits(uint bits, uint len);
     void code_coefficients_pass_one(int component_num);
     void code_coefficients_pass_two(int component_num);
-    void code_block(int component_num);
+    template <int Pass> void code_block(int component_num);
+    void process_restart_interval();
+    template <int Subsampling, int Pass, bool Restarts> void process_mcu_row_impl();
+    void select_mcu_row_func();
     void process_mcu_row();
     bool terminate_pass_one();
     bool terminate_pass_two();
@@ -0,0 +1,214 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FrameStreamer - Out of process JPEG/ZMQ streamer for the sensor plugin.
+//
+// Reads raw lens frames from the shared memory ring published by the
+// SampleSensor (frameRingSlots="N" encodeInProcess="0" in the sensor XML),
+// compresses them and sends them to the Android client exactly like the
+// plugin would, so that none of the encoding cost lands on the sim thread.
+//
+// Usage:
+//   FrameStreamer [-ring name] [-bind endpoint] [-fps rate] [-quality q] [-sensor id]
+//
+// Defaults match the plugin: ring "anvel_frames", "tcp://*:9000", 15 fps,
+// quality 85, and every camera in the ring. Each send carries the newest
+// frame of every camera (or only of -sensor), one message per camera.
+//
+// Windows: build FrameStreamer.vcxproj from the solution.
+// Linux:   g++ -O2 -I../../SensorPlugin FrameStreamer.cpp ../../SensorPlugin/FrameRing.cpp
+//              ../../SensorPlugin/jpge.cpp -lzmq -lrt -o FrameStreamer
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "zmq.hpp"
+#include "jpge.h"
+#include "FrameRing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+using namespace VANE;
+
+//////////////////////////////////////////////////////////////////////////
+
+struct StreamerOptions
+{
+	StreamerOptions()
+		: ringName( FrameRing::kDefaultRingName )
+		, endpoint( "tcp://*:9000" )
+		, sendRate( 15 )
+		, quality( 85 )
+		, sensorID( 0 )
+		, filterSensor( false )
+	{
+	}
+
+	std::string ringName;
+	std::string endpoint;
+	int sendRate;
+	int quality;
+	uint64_t sensorID;
+	bool filterSensor;
+};
+
+static bool ParseOptions( int argc, char** argv, StreamerOptions& options )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		std::string arg = argv[i];
+		if ( i + 1 >= argc )
+			return false;
+
+		if ( arg == "-ring" )
+			options.ringName = argv[++i];
+		else if ( arg == "-bind" )
+			options.endpoint = argv[++i];
+		else if ( arg == "-fps" )
+			options.sendRate = atoi( argv[++i] );
+		else if ( arg == "-quality" )
+			options.quality = atoi( argv[++i] );
+		else if ( arg == "-sensor" )
+		{
+			options.sensorID = strtoull( argv[++i], NULL, 0 );
+			options.filterSensor = true;
+		}
+		else
+			return false;
+	}
+
+	return options.sendRate > 0 && options.quality >= 1 && options.quality <= 100;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+	StreamerOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		printf( "Usage: FrameStreamer [-ring name] [-bind endpoint] [-fps rate] [-quality q] [-sensor id]\n" );
+		return 1;
+	}
+
+	zmq::context_t context;
+	zmq::socket_t socket( context, ZMQ_PAIR );
+	socket.bind( options.endpoint.c_str() );
+	printf( "Streaming ring '%s' on %s\n", options.ringName.c_str(), options.endpoint.c_str() );
+
+	FrameRing::Reader reader;
+	std::vector<jpge::uint8> buffer;
+	//Newest frame of each camera since the last send
+	std::vector<FrameRing::FrameView> latest;
+
+	const std::chrono::microseconds framePeriod( 1000000 / options.sendRate );
+	std::chrono::steady_clock::time_point nextSend = std::chrono::steady_clock::now();
+
+	uint64_t sent = 0, dropped = 0, torn = 0, skipped = 0;
+
+	while ( true )
+	{
+		//(Re)attach whenever the plugin creates a new ring
+		if ( !reader.IsOpen() || !reader.IsWriterAlive() )
+		{
+			reader.Close();
+			if ( !reader.Open( options.ringName ) )
+			{
+				std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+				continue;
+			}
+			printf( "Attached to ring '%s'\n", options.ringName.c_str() );
+		}
+
+		if ( std::chrono::steady_clock::now() < nextSend )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+			continue;
+		}
+
+		//Always stream each camera's newest frame, a teleoperator has no use for stale ones. Every camera
+		//publishes in the same tick, so the ring is walked rather than jumping to its newest frame.
+		latest.clear();
+		FrameRing::FrameView view;
+		while ( true )
+		{
+			const uint64_t tornBefore = reader.GetTornCount();
+			if ( !reader.AcquireNext( view ) )
+			{
+				//A torn slot is passed over, anything else means there is nothing newer
+				if ( reader.GetTornCount() == tornBefore )
+					break;
+				continue;
+			}
+
+			if ( options.filterSensor && view.m_info.m_sensorID != options.sensorID )
+				continue;
+
+			size_t i = 0;
+			while ( i < latest.size() && latest[i].m_info.m_sensorID != view.m_info.m_sensorID )
+				++i;
+			if ( i == latest.size() )
+				latest.push_back( view );
+			else
+			{
+				latest[i] = view;
+				++skipped;
+			}
+		}
+
+		if ( latest.empty() )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+			continue;
+		}
+
+		nextSend += framePeriod;
+		if ( nextSend < std::chrono::steady_clock::now() )
+			nextSend = std::chrono::steady_clock::now();
+
+		for ( size_t i = 0; i < latest.size(); ++i )
+		{
+			const FrameRing::FrameView& frame = latest[i];
+			int size = frame.m_info.m_payloadSize;
+			buffer.resize( size > 1024 ? size : 1024 );
+
+			jpge::params params;
+			params.m_quality = options.quality;
+
+			//Encode straight out of shared memory, then make sure the plugin did not overwrite the slot meanwhile
+			bool compressed = jpge::compress_image_to_jpeg_file_in_memory( &buffer[0], size, frame.m_info.m_width, frame.m_info.m_height,
+				frame.m_info.m_channels, frame.m_pPixels, params );
+
+			if ( !reader.Validate( frame ) )
+			{
+				++torn;
+				continue;
+			}
+
+			if ( !compressed )
+			{
+				printf( "Failed to compress image\n" );
+				continue;
+			}
+
+			zmq::message_t image( size );
+			memcpy( image.data(), &buffer[0], size );
+			if ( socket.send( image, ZMQ_DONTWAIT ) )
+				++sent;
+			else
+				++dropped;
+
+			if ( (sent + dropped) % 300 == 0 )
+			{
+				printf( "sent %llu, dropped %llu, torn %llu, skipped %llu\n", (unsigned long long)sent, (unsigned long long)dropped,
+					(unsigned long long)(torn + reader.GetTornCount()), (unsigned long long)(skipped + reader.GetLappedCount()) );
+			}
+		}
+	}
+
+	return 0;
+}
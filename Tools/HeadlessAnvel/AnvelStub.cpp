@@ -0,0 +1,492 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AnvelStub.cpp - Implementation of the headless ANVEL stand-in.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "Core/Core.h"
+#include "Core/Commands.h"
+#include "Core/PropertyManager.h"
+#include "Simulation/Sensor.h"
+#include "Simulation/CameraSensor.h"
+#include "Simulation/Controller/ControllerManager.h"
+#include "Simulation/Vehicles/VehicleManager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+
+namespace VANE
+{
+	static const DataTypeGUID kNullGUID = { 0, 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } };
+
+	static VaneID RegisterBuiltInType( const char* pName )
+	{
+		return DataTypeManager::GetSingleton().RegisterDataType( DataTypeDescription( pName, pName, pName ), kNullGUID );
+	}
+
+	namespace Types
+	{
+		VaneID Sensor        = RegisterBuiltInType( "Sensor" );
+		VaneID SensorManager = RegisterBuiltInType( "SensorManager" );
+		VaneID Vehicle       = RegisterBuiltInType( "Vehicle" );
+		VaneID CameraSensor  = RegisterBuiltInType( "CameraSensor" );
+	}
+
+	const SensorType kSensorTypeCamera = "CameraSensor";
+	const float64 Sensor::kDefaultSampleRate = 10.0;
+	const Variant Variant::INVALID;
+
+	//////////////////////////////////////////////////////////////////////////
+	// Data types
+
+	DataTypeManager& DataTypeManager::GetSingleton()
+	{
+		static DataTypeManager s_instance;
+		return s_instance;
+	}
+
+	VaneID DataTypeManager::RegisterDataType( const DataTypeDescription& description, const DataTypeGUID& /*guid*/ )
+	{
+		for ( size_t i = 0; i < m_types.size(); ++i )
+		{
+			if ( m_types[i].typeName == description.typeName )
+				return i + 1;
+		}
+
+		m_types.push_back( description );
+		return m_types.size();
+	}
+
+	String DataTypeManager::GetTypeName( VaneID dataType ) const
+	{
+		if ( dataType == 0 || dataType > m_types.size() )
+			return String();
+		return m_types[dataType - 1].typeName;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// XML
+
+	namespace XmlUtils
+	{
+		String GetStringAttribute( const TiXmlElement* /*pElement*/, const String& /*name*/, const String& defaultValue )
+		{
+			return defaultValue;
+		}
+
+		uint32 GetUnsignedIntAttribute( const TiXmlElement* /*pElement*/, const String& /*name*/, uint32 defaultValue )
+		{
+			return defaultValue;
+		}
+
+		float64 GetDoubleAttribute( const TiXmlElement* /*pElement*/, const String& /*name*/, float64 defaultValue )
+		{
+			return defaultValue;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Logging
+
+	static uint32 s_logMask = kLogMsgWarning | kLogMsgError | kLogMsgSpecial | kLogMsgPlugin;
+
+	void LogMessage( const String& msg, LogMsgType type, bool /*flush*/, bool /*logToFileOnly*/ )
+	{
+		if ( !(type & s_logMask) )
+			return;
+
+		const char* pPrefix = "";
+		if ( type == kLogMsgWarning )
+			pPrefix = "warning: ";
+		else if ( type == kLogMsgError )
+			pPrefix = "error: ";
+
+		fprintf( stderr, "[anvel] %s%s\n", pPrefix, msg.c_str() );
+	}
+
+	void SetLogMessageMask( uint32 mask )
+	{
+		s_logMask = mask;
+	}
+
+	void ReportError( const char* pFile, int line )
+	{
+		fprintf( stderr, "[anvel] error: VANEError at %s:%d\n", pFile, line );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Properties
+
+	String Property::GetValueString() const
+	{
+		std::ostringstream stream;
+		switch ( m_type )
+		{
+		case kInt:      stream << *static_cast<int32*>( m_pValue ); break;
+		case kUnsigned: stream << *static_cast<uint32*>( m_pValue ); break;
+		case kDouble:   stream << *static_cast<float64*>( m_pValue ); break;
+		case kBool:     stream << (*static_cast<bool*>( m_pValue ) ? "true" : "false"); break;
+		case kString:   stream << *static_cast<String*>( m_pValue ); break;
+		}
+		return stream.str();
+	}
+
+	bool Property::SetValueString( const String& value )
+	{
+		char* pEnd = NULL;
+		switch ( m_type )
+		{
+		case kInt:      *static_cast<int32*>( m_pValue ) = static_cast<int32>( strtol( value.c_str(), &pEnd, 10 ) ); break;
+		case kUnsigned: *static_cast<uint32*>( m_pValue ) = static_cast<uint32>( strtoul( value.c_str(), &pEnd, 10 ) ); break;
+		case kDouble:   *static_cast<float64*>( m_pValue ) = strtod( value.c_str(), &pEnd ); break;
+		case kBool:     *static_cast<bool*>( m_pValue ) = (value == "true" || value == "1"); return true;
+		case kString:   *static_cast<String*>( m_pValue ) = value; return true;
+		}
+		return pEnd && pEnd != value.c_str() && *pEnd == 0;
+	}
+
+	PropertyManager& PropertyManager::GetSingleton()
+	{
+		static PropertyManager s_instance;
+		return s_instance;
+	}
+
+	void PropertyManager::RegisterPropertyProvider( VaneID dataType, IPropertyProvider* pProvider )
+	{
+		m_providers[dataType] = pProvider;
+	}
+
+	void PropertyManager::RegisterProperty( VaneID dataType, const String& name, const String& /*description*/, bool /*readOnly*/ )
+	{
+		m_names[dataType].push_back( name );
+	}
+
+	int PropertyManager::FindProperty( VaneID dataType, const String& name ) const
+	{
+		std::map<VaneID, StringVector>::const_iterator it = m_names.find( dataType );
+		if ( it == m_names.end() )
+			return -1;
+
+		for ( size_t i = 0; i < it->second.size(); ++i )
+		{
+			if ( it->second[i] == name )
+				return static_cast<int>( i );
+		}
+		return -1;
+	}
+
+	bool PropertyManager::SetProperty( VaneID objID, const String& name, const String& value )
+	{
+		VaneID dataType = GetDataType( objID );
+		int index = FindProperty( dataType, name );
+		if ( index < 0 || !m_providers.count( dataType ) )
+			return false;
+
+		IPropertyProvider* pProvider = m_providers[dataType];
+		ObjectPropertySet properties = pProvider->GetProperties( objID );
+		if ( index >= static_cast<int>( properties.properties.size() ) )
+			return false;
+
+		if ( !properties.properties[index].SetValueString( value ) )
+			return false;
+
+		pProvider->OnPropertyChanged( objID, index );
+		return true;
+	}
+
+	bool PropertyManager::GetProperty( VaneID objID, const String& name, String& value )
+	{
+		VaneID dataType = GetDataType( objID );
+		int index = FindProperty( dataType, name );
+		if ( index < 0 || !m_providers.count( dataType ) )
+			return false;
+
+		ObjectPropertySet properties = m_providers[dataType]->GetProperties( objID );
+		if ( index >= static_cast<int>( properties.properties.size() ) )
+			return false;
+
+		value = properties.properties[index].GetValueString();
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Commands
+
+	CommandManager& CommandManager::GetSingleton()
+	{
+		static CommandManager s_instance;
+		return s_instance;
+	}
+
+	CommandID CommandManager::RegisterCommand( const String& commandName, ICommandHandler* pHandler, uint32 /*flags*/ )
+	{
+		Registration registration;
+		registration.m_name = commandName;
+		registration.m_pHandler = pHandler;
+		m_commands.push_back( registration );
+		return static_cast<CommandID>( m_commands.size() );
+	}
+
+	void CommandManager::RegisterObjectAction( CommandID /*commandID*/, VaneID /*dataType*/, uint32 /*flags*/ )
+	{
+	}
+
+	CommandResult CommandManager::ExecuteCommand( const CommandName& commandName, const CommandParamList& parameterList )
+	{
+		for ( size_t i = 0; i < m_commands.size(); ++i )
+		{
+			if ( m_commands[i].m_name == commandName )
+				return m_commands[i].m_pHandler->HandleCommand( static_cast<CommandID>( i + 1 ), parameterList );
+		}
+		return CommandResult( kInvalidCommand, "Unknown command " + commandName );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Sensors
+
+	Sensor::Sensor( VaneID specificID, SensorStaticAssetParams& sensorParams, DynamicAssetParams& /*dynamicParams*/ )
+		: m_sampleRate( sensorParams.m_sampleRate > 0 ? sensorParams.m_sampleRate : kDefaultSampleRate )
+		, m_sampleTimeLeft( 0 )
+		, m_elapsedTime( 0 )
+		, m_lastSampleTime( 0 )
+		, m_fidelity( sensorParams.m_defaultFidelity )
+		, m_baseSensorID( SensorManager::GetSingleton().GetNextSensorID() )
+		, m_specificSensorID( specificID )
+		, m_name( sensorParams.m_assetName )
+		, m_type( sensorParams.m_sensorType )
+		, m_enabled( true )
+	{
+		m_sampleStep = 1.0 / m_sampleRate;
+	}
+
+	SensorManager& SensorManager::GetSingleton()
+	{
+		static SensorManager s_instance;
+		return s_instance;
+	}
+
+	void SensorManager::Update( TimeValue dt )
+	{
+		for ( size_t i = 0; i < m_sensors.size(); ++i )
+			m_sensors[i]->Update( dt );
+	}
+
+	void SensorManager::RegisterSensorFactory( const SensorType& sensorType, ISensorFactory* pFactory )
+	{
+		m_factories[sensorType] = pFactory;
+	}
+
+	void SensorManager::UnregisterSensorFactory( ISensorFactory* pFactory )
+	{
+		for ( std::map<SensorType, ISensorFactory*>::iterator it = m_factories.begin(); it != m_factories.end(); )
+		{
+			if ( it->second == pFactory )
+				m_factories.erase( it++ );
+			else
+				++it;
+		}
+	}
+
+	Sensor* SensorManager::CreateSensor( SensorStaticAssetParams& params, DynamicAssetParams& dynamicParams )
+	{
+		std::map<SensorType, ISensorFactory*>::iterator it = m_factories.find( params.m_sensorType );
+		if ( it == m_factories.end() )
+		{
+			LogMessage( "No sensor factory for " + params.m_sensorType, kLogMsgError );
+			return NULL;
+		}
+
+		Sensor* pSensor = it->second->CreateSensor( params, dynamicParams );
+		if ( pSensor )
+			AddSensor( pSensor );
+		return pSensor;
+	}
+
+	void SensorManager::AddSensor( Sensor* pSensor )
+	{
+		m_sensors.push_back( SensorPtr( pSensor ) );
+	}
+
+	void SensorManager::RemoveSensor( SensorID sensorID )
+	{
+		for ( size_t i = 0; i < m_sensors.size(); ++i )
+		{
+			if ( m_sensors[i]->GetID() == sensorID || m_sensors[i]->GetBaseSensorID() == sensorID )
+			{
+				m_sensors.erase( m_sensors.begin() + i );
+				return;
+			}
+		}
+	}
+
+	void SensorManager::ClearSensors()
+	{
+		//Newest first, the opposite of creation
+		while ( !m_sensors.empty() )
+			m_sensors.pop_back();
+	}
+
+	SensorPtr SensorManager::GetSensor( SensorID id )
+	{
+		for ( size_t i = 0; i < m_sensors.size(); ++i )
+		{
+			if ( m_sensors[i]->GetID() == id || m_sensors[i]->GetBaseSensorID() == id )
+				return m_sensors[i];
+		}
+		return SensorPtr();
+	}
+
+	SensorID SensorManager::GetNextSensorID()
+	{
+		return MakeID( Types::Sensor, m_sensorIDCount++ );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Cameras
+
+	CameraSensor::CameraSensor( VaneID specificID, CameraSensorStaticAssetParams& params, DynamicAssetParams& dynamicParams )
+		: Sensor( specificID, params, dynamicParams )
+		, m_lensParams( params.m_lensParams )
+		, m_lensData( params.m_lensParams.size() )
+	{
+		m_type = kSensorTypeCamera;
+	}
+
+	void CameraSensor::SetLensImage( uint32 lens, uint8* pPixels, uint32 renderTimeStamp )
+	{
+		if ( lens >= m_lensData.size() )
+			return;
+
+		m_lensData[lens].m_renderRequest.m_pOutputBuffer = pPixels;
+		m_lensData[lens].m_renderRequest.m_renderTimeStamp = renderTimeStamp;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Vehicles
+
+	namespace Vehicles
+	{
+		Manager& Manager::GetSingleton()
+		{
+			static Manager s_instance;
+			return s_instance;
+		}
+
+		Vehicle* Manager::CreateVehicle( const String& name )
+		{
+			Vehicle* pVehicle = new Vehicle( MakeID( Types::Vehicle, m_vehicleCount++ ), name );
+			m_vehicles.push_back( SharedPtr<Vehicle>( pVehicle ) );
+			return pVehicle;
+		}
+
+		void Manager::ClearVehicles()
+		{
+			m_vehicles.clear();
+		}
+
+		Vehicle* Manager::GetVehicle( VehicleID id )
+		{
+			for ( size_t i = 0; i < m_vehicles.size(); ++i )
+			{
+				if ( m_vehicles[i]->GetID() == id )
+					return m_vehicles[i].Get();
+			}
+			return NULL;
+		}
+
+		Vehicle* Manager::GetVehicle( const String& name )
+		{
+			for ( size_t i = 0; i < m_vehicles.size(); ++i )
+			{
+				if ( m_vehicles[i]->GetName() == name )
+					return m_vehicles[i].Get();
+			}
+			return NULL;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Controllers
+
+	namespace Controller
+	{
+		Manager& Manager::GetSingleton()
+		{
+			static Manager s_instance;
+			return s_instance;
+		}
+
+		void Manager::Update( TimeValue dt )
+		{
+			for ( ControllerPtrMap::iterator it = m_controllers.begin(); it != m_controllers.end(); ++it )
+				it->second->Update( dt );
+		}
+
+		void Manager::SetVehicleController( Vehicles::VehicleID id, const ControllerPtr& controller )
+		{
+			m_vehicleControllers[id] = controller;
+
+			Vehicles::Vehicle* pVehicle = Vehicles::Manager::GetSingleton().GetVehicle( id );
+			if ( pVehicle )
+				pVehicle->SetController( controller );
+
+			if ( !controller.IsNull() )
+				controller->OnAttachedToObject( id );
+		}
+
+		ControllerPtr Manager::GetController( ControllerID id )
+		{
+			ControllerPtrMap::iterator it = m_controllers.find( id );
+			if ( it != m_controllers.end() )
+				return it->second;
+			return ControllerPtr();
+		}
+
+		void Manager::RegisterController( const ControllerPtr& pController )
+		{
+			m_controllers[pController->GetControllerID()] = pController;
+		}
+
+		void Manager::UnregisterController( ControllerID id )
+		{
+			m_controllers.erase( id );
+
+			for ( VehicleControllerMap::iterator it = m_vehicleControllers.begin(); it != m_vehicleControllers.end(); )
+			{
+				if ( it->second.IsNull() || it->second->GetControllerID() == id || it->second->GetBaseControllerID() == id )
+					m_vehicleControllers.erase( it++ );
+				else
+					++it;
+			}
+		}
+
+		void Manager::ClearControllers()
+		{
+			m_vehicleControllers.clear();
+			m_controllers.clear();
+		}
+
+		ControllerID Manager::CreateControllerOfType( const String& typeName )
+		{
+			for ( ControllerFactoryMap::iterator it = m_factories.begin(); it != m_factories.end(); ++it )
+			{
+				if ( it->second->GetControllerType() == typeName )
+					return it->second->CreateControllerInterface();
+			}
+
+			LogMessage( "No controller factory for " + typeName, kLogMsgError );
+			return kInvalidVaneID;
+		}
+
+		void Manager::RegisterControllerFactory( IControllerFactory* pFac )
+		{
+			m_factories[pFac->GetControllerTypeId()] = pFac;
+		}
+
+		void Manager::UnregisterControllerFactory( IControllerFactory* pFac )
+		{
+			m_factories.erase( pFac->GetControllerTypeId() );
+		}
+	}
+}
@@ -0,0 +1,975 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// HeadlessAnvel - End-to-end streaming benchmark without ANVEL.
+//
+// The plugins normally only run inside ANVEL on Windows. This tool compiles
+// SampleSensor.cpp and ZMQVideo.cpp unchanged against a small stand-in for
+// the ANVEL SDK (include/ and AnvelStub.cpp: SensorManager, CameraSensor,
+// Vehicles::Manager, Controller::Manager, properties and commands) and runs
+// them from a synthetic simulation loop on Linux:
+//
+//   - N cameras present a new frame at the render rate, either a generated
+//     scene with a moving object or captured PPM frames played in a loop
+//   - one SampleSensor samples them at the tick rate and streams over ZMQ,
+//     or over UDP with -udp
+//   - M in-process viewers receive the stream. The ZMQ video socket is a
+//     PAIR socket that serves a single client, so more than one viewer needs
+//     the UDP transport
+//   - with -controller a ZMQVideo drives a vehicle, and a client answers
+//     its requests for a direction like the Android app does. The vehicle
+//     follows the throttle and steering with a simple kinematic model
+//   - with -external no clients are started, the endpoints are left to
+//     LoadClient or a phone
+//
+// It reports the time SensorManager::Update and Controller::Manager::Update
+// take per tick, the frames per second sent and received, and the latency
+// from the start of the tick that sampled a frame until each viewer has the
+// whole frame (and its first byte, with -chunk), and how long the frames of
+// each camera spent in each stage inside the sensor. Unless -fast is given the
+// loop runs in real time and ticks that start late are counted.
+//
+// -record base records the frames the sensor sends to <base> and, with
+// -controller, the commands and vehicle state to <base>-control, for
+// ReplayServer (see Recording.h). -capture base writes every frame the
+// cameras present at the tick rate to <base> through the capture writer, raw
+// or encoded with -capturecodec (see Capture.h). -replay base drives the
+// vehicle from the control inputs in a controller recording, <base>-control
+// of an earlier -record run, instead of a client, and reports how far it
+// strays from the recorded path. -minrate fps has the sensor follow the
+// vehicle's motion, streaming between fps while it stands still and -rate.
+// With -acks the ZMQ viewers ack every frame for the sensor's congestion
+// control (see RateControl.h), and -link kbps has them take as long over a
+// frame as a link of that speed would, so the queue builds up.
+//
+// Usage:
+//   HeadlessAnvel [-cameras n] [-size WxH] [-seconds s] [-tick hz] [-render hz] [-fast]
+//                 [-codec name] [-quality q] [-rate fps] [-chunk bytes] [-motion px]
+//                 [-udp port] [-clients n] [-drop percent] [-controller] [-external]
+//                 [-frames a.ppm,b.ppm] [-bind address] [-stats port] [-trace file] [-record base]
+//                 [-capture base] [-capturecodec raw|name] [-replay base]
+//                 [-minrate fps] [-acks] [-link kbps] [-verbose]
+//
+// Linux:   g++ -O2 -std=c++11 -Iinclude -I../../SensorPlugin -I../../ControllerPlugin
+//              HeadlessAnvel.cpp AnvelStub.cpp ../../SensorPlugin/SampleSensor.cpp
+//              ../../SensorPlugin/FrameCodec.cpp ../../SensorPlugin/FrameArena.cpp
+//              ../../SensorPlugin/FrameRing.cpp ../../SensorPlugin/DatagramVideo.cpp
+//              ../../SensorPlugin/Qoi.cpp ../../SensorPlugin/jpge.cpp ../../SensorPlugin/LatencyStats.cpp
+//              ../../SensorPlugin/ClockSync.cpp ../../SensorPlugin/StreamStats.cpp
+//              ../../SensorPlugin/SocketMonitor.cpp ../../SensorPlugin/Trace.cpp ../../SensorPlugin/AsyncLog.cpp
+//              ../../SensorPlugin/Recording.cpp ../../SensorPlugin/Capture.cpp ../../SensorPlugin/RateControl.cpp
+//              ../../ControllerPlugin/ZMQVideo.cpp -lzmq -lpthread -lrt -o HeadlessAnvel
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "zmq.hpp"
+#include "SampleSensor.h"
+#include "ZMQVideo.h"
+#include "DatagramVideo.h"
+#include "SocketMonitor.h"
+#include "RateControl.h"
+
+#include "Core/PropertyManager.h"
+#include "Core/StringConverter.h"
+#include "Simulation/CameraSensor.h"
+#include "Simulation/Controller/ControllerManager.h"
+#include "Simulation/Vehicles/VehicleManager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace VANE;
+
+//////////////////////////////////////////////////////////////////////////
+
+struct HarnessOptions
+{
+	HarnessOptions()
+		: cameras( 1 )
+		, width( 640 )
+		, height( 480 )
+		, seconds( 10 )
+		, tickRate( 100 )
+		, renderRate( 30 )
+		, realtime( true )
+		, codec( "jpeg" )
+		, quality( 85 )
+		, sendRate( 15 )
+		, chunkSize( 0 )
+		, motion( 4 )
+		, udpPort( 0 )
+		, clients( 1 )
+		, dropPercent( 0 )
+		, controller( false )
+		, external( false )
+		, bindAddress( "127.0.0.1" )
+		, statsPort( 0 )
+		, captureCodec( "raw" )
+		, minSendRate( 0 )
+		, acks( false )
+		, linkKbps( 0 )
+		, verbose( false )
+	{
+	}
+
+	int cameras;
+	int width;
+	int height;
+	double seconds;
+	double tickRate;
+	double renderRate;
+	bool realtime;
+	std::string codec;
+	int quality;
+	int sendRate;
+	int chunkSize;
+	int motion;
+	int udpPort;
+	int clients;
+	int dropPercent;
+	bool controller;
+	bool external;    ///< No in-process clients, something else connects
+	std::vector<std::string> frames;
+	std::string bindAddress;
+	int statsPort;    ///< Publish the streaming stats, see StreamStats.h
+	std::string traceFile;  ///< Append the plugins' spans here at the end, see Trace.h
+	std::string recordBase; ///< Record the session under this name, see Recording.h
+	std::string captureBase;  ///< Capture every frame under this name, see Capture.h
+	std::string captureCodec;
+	std::string replayBase;   ///< Controller recording to drive the vehicle from instead of a client
+	int minSendRate;          ///< Scale the frame rate down to this with the vehicle's motion, 0 to stream at -rate
+	bool acks;                ///< ZMQ viewers ack the frames they receive
+	int linkKbps;             ///< ZMQ viewers receive no faster than this, 0 for as fast as they can
+	bool verbose;
+};
+
+static std::vector<std::string> SplitList( const std::string& list )
+{
+	std::vector<std::string> items;
+	size_t start = 0;
+	while ( start <= list.size() )
+	{
+		size_t comma = list.find( ',', start );
+		if ( comma == std::string::npos )
+			comma = list.size();
+		if ( comma > start )
+			items.push_back( list.substr( start, comma - start ) );
+		start = comma + 1;
+	}
+	return items;
+}
+
+///Connection counters of every endpoint a plugin socket has seen
+static void PrintEndpoints( const char* pLabel, const SocketMonitor* pMonitor )
+{
+	if ( !pMonitor )
+		return;
+
+	int64_t now = ClockSync::Now();
+	std::map<std::string, EndpointStats> endpoints = pMonitor->GetEndpoints();
+	for ( std::map<std::string, EndpointStats>::const_iterator it = endpoints.begin(); it != endpoints.end(); ++it )
+	{
+		const EndpointStats& endpoint = it->second;
+		printf( "  %-22s %s: %u accepted, %u disconnected, %u failed, %u connected now, %.2f s without a peer\n", pLabel,
+			it->first.c_str(), static_cast<uint32_t>( endpoint.m_accepted ), static_cast<uint32_t>( endpoint.m_disconnected ),
+			static_cast<uint32_t>( endpoint.m_failed ), endpoint.m_peers, endpoint.GetPeerlessTime( now ) / 1e6 );
+	}
+}
+
+static bool ParseOptions( int argc, char** argv, HarnessOptions& options )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		std::string arg = argv[i];
+
+		if ( arg == "-fast" )
+		{
+			options.realtime = false;
+			continue;
+		}
+		if ( arg == "-controller" )
+		{
+			options.controller = true;
+			continue;
+		}
+		if ( arg == "-external" )
+		{
+			options.external = true;
+			continue;
+		}
+		if ( arg == "-acks" )
+		{
+			options.acks = true;
+			continue;
+		}
+		if ( arg == "-verbose" )
+		{
+			options.verbose = true;
+			continue;
+		}
+
+		if ( i + 1 >= argc )
+			return false;
+
+		std::string value = argv[++i];
+		if ( arg == "-cameras" )
+			options.cameras = atoi( value.c_str() );
+		else if ( arg == "-size" )
+		{
+			if ( sscanf( value.c_str(), "%dx%d", &options.width, &options.height ) != 2 )
+				return false;
+		}
+		else if ( arg == "-seconds" )
+			options.seconds = atof( value.c_str() );
+		else if ( arg == "-tick" )
+			options.tickRate = atof( value.c_str() );
+		else if ( arg == "-render" )
+			options.renderRate = atof( value.c_str() );
+		else if ( arg == "-codec" )
+			options.codec = value;
+		else if ( arg == "-quality" )
+			options.quality = atoi( value.c_str() );
+		else if ( arg == "-rate" )
+			options.sendRate = atoi( value.c_str() );
+		else if ( arg == "-chunk" )
+			options.chunkSize = atoi( value.c_str() );
+		else if ( arg == "-motion" )
+			options.motion = atoi( value.c_str() );
+		else if ( arg == "-udp" )
+			options.udpPort = atoi( value.c_str() );
+		else if ( arg == "-clients" )
+			options.clients = atoi( value.c_str() );
+		else if ( arg == "-drop" )
+			options.dropPercent = atoi( value.c_str() );
+		else if ( arg == "-frames" )
+			options.frames = SplitList( value );
+		else if ( arg == "-bind" )
+			options.bindAddress = value;
+		else if ( arg == "-stats" )
+			options.statsPort = atoi( value.c_str() );
+		else if ( arg == "-trace" )
+			options.traceFile = value;
+		else if ( arg == "-record" )
+			options.recordBase = value;
+		else if ( arg == "-capture" )
+			options.captureBase = value;
+		else if ( arg == "-capturecodec" )
+			options.captureCodec = value;
+		else if ( arg == "-replay" )
+		{
+			options.replayBase = value;
+			options.controller = true;
+		}
+		else if ( arg == "-link" )
+			options.linkKbps = atoi( value.c_str() );
+		else if ( arg == "-minrate" )
+		{
+			options.minSendRate = atoi( value.c_str() );
+			options.controller = true;
+		}
+		else
+			return false;
+	}
+
+	return options.cameras > 0 && options.width >= 16 && options.height >= 16 && options.seconds > 0
+		&& options.tickRate > 0 && options.renderRate > 0 && options.sendRate > 0 && options.clients >= 0;
+}
+
+static double Now()
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Camera content
+
+struct Image
+{
+	int width;
+	int height;
+	std::vector<uint8_t> pixels;
+};
+
+static bool LoadPpm( const std::string& file, Image& image )
+{
+	FILE* pFile = fopen( file.c_str(), "rb" );
+	if ( !pFile )
+		return false;
+
+	int maxValue = 0;
+	bool ok = fscanf( pFile, "P6 %d %d %d", &image.width, &image.height, &maxValue ) == 3 && fgetc( pFile ) != EOF
+		&& image.width > 0 && image.height > 0 && maxValue == 255;
+	if ( ok )
+	{
+		image.pixels.resize( static_cast<size_t>(image.width) * image.height * 3 );
+		ok = fread( &image.pixels[0], 1, image.pixels.size(), pFile ) == image.pixels.size();
+	}
+	fclose( pFile );
+	return ok;
+}
+
+///A textured background with a box that moves across it, so that the stream
+///has the detail of a rendered scene and some but not all of it changes
+class SyntheticScene
+{
+public:
+	SyntheticScene( int width, int height, int motion )
+		: m_width( width )
+		, m_height( height )
+		, m_motion( motion )
+		, m_background( static_cast<size_t>(width) * height * 3 )
+	{
+		uint32_t seed = 0x2545F491;
+		for ( int y = 0; y < height; ++y )
+		{
+			uint8_t* pRow = &m_background[static_cast<size_t>(y) * width * 3];
+			for ( int x = 0; x < width; ++x )
+			{
+				seed = seed * 1664525 + 1013904223;
+				int grain = static_cast<int>( seed >> 28 ) - 8;
+				int cell = ((x >> 5) + (y >> 5)) & 1 ? 24 : 0;
+				pRow[x * 3 + 0] = Clamp( 60 + x * 120 / width + cell + grain );
+				pRow[x * 3 + 1] = Clamp( 90 + y * 100 / height + grain );
+				pRow[x * 3 + 2] = Clamp( 140 - y * 60 / height + cell / 2 + grain );
+			}
+		}
+	}
+
+	///Draw frame number frame of a camera, cameras see the box at different places
+	void Render( int camera, uint32_t frame, uint8_t* pPixels ) const
+	{
+		memcpy( pPixels, &m_background[0], m_background.size() );
+
+		int boxWidth = m_width / 4;
+		int boxHeight = m_height / 4;
+		int span = m_width - boxWidth;
+		int boxX = static_cast<int>( (frame * m_motion + camera * m_width / 3) % span );
+		int boxY = (m_height - boxHeight) / 2;
+
+		for ( int y = boxY; y < boxY + boxHeight; ++y )
+		{
+			uint8_t* pRow = pPixels + (static_cast<size_t>(y) * m_width + boxX) * 3;
+			for ( int x = 0; x < boxWidth; ++x )
+			{
+				bool stripe = ((x + y) >> 3) & 1;
+				pRow[x * 3 + 0] = stripe ? 230 : 40;
+				pRow[x * 3 + 1] = stripe ? 200 : 30;
+				pRow[x * 3 + 2] = 20;
+			}
+		}
+	}
+
+private:
+	static uint8_t Clamp( int v ) { return static_cast<uint8_t>( v < 0 ? 0 : (v > 255 ? 255 : v) ); }
+
+	int m_width;
+	int m_height;
+	uint32_t m_motion;
+	std::vector<uint8_t> m_background;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Clients
+
+struct ViewerStats
+{
+	ViewerStats() : m_bytes( 0 ), m_concealed( 0 ) { }
+
+	std::vector<uint32_t> m_frameNumbers; ///< Index of each frame in the order sent
+	std::vector<double>   m_firstByte;
+	std::vector<double>   m_complete;
+	uint64_t m_bytes;
+	uint64_t m_concealed;
+};
+
+///A viewer on the ZMQ PAIR socket. With chunking, frames are rebuilt from
+///kChunkFirst through kChunkLast messages.
+static void RunZmqViewer( const HarnessOptions& options, ViewerStats& stats, const std::atomic<bool>& stop )
+{
+	zmq::context_t context( 1 );
+	zmq::socket_t socket( context, ZMQ_PAIR );
+	socket.connect( "tcp://" + options.bindAddress + ":9000" );
+
+	//Ask for a keyframe, as a client does when it connects
+	zmq::message_t request( 1 );
+	*static_cast<char*>( request.data() ) = 'k';
+	socket.send( request );
+
+	uint32_t frameNumber = 0;
+	double firstByte = 0;
+	size_t frameSize = 0;
+	std::vector<uint8_t> tail;  ///< End of the frame so far, where the trailer is
+	while ( !stop )
+	{
+		zmq_pollitem_t item = { static_cast<void*>( socket ), 0, ZMQ_POLLIN, 0 };
+		if ( zmq::poll( &item, 1, 50 ) <= 0 )
+			continue;
+
+		zmq::message_t message;
+		while ( socket.recv( &message, ZMQ_DONTWAIT ) )
+		{
+			double now = Now();
+			stats.m_bytes += message.size();
+
+			const uint8_t* pData = static_cast<const uint8_t*>( message.data() );
+			size_t size = message.size();
+			if ( options.chunkSize > 0 && message.size() > 0 )
+			{
+				uint8_t flags = pData[0];
+				if ( flags & 0x01 )
+				{
+					firstByte = now;
+					frameSize = 0;
+					tail.clear();
+				}
+				frameSize += size - 1;
+				tail.insert( tail.end(), pData + 1, pData + size );
+				if ( tail.size() > ClockSync::kTrailerSize )
+					tail.erase( tail.begin(), tail.end() - ClockSync::kTrailerSize );
+				if ( !(flags & 0x02) )
+					continue;
+			}
+			else
+			{
+				firstByte = now;
+				frameSize = size;
+				tail.assign( pData + (size > ClockSync::kTrailerSize ? size - ClockSync::kTrailerSize : 0), pData + size );
+			}
+
+			//The frame is only all there once a link of that speed could have carried it
+			if ( options.linkKbps > 0 )
+			{
+				std::this_thread::sleep_for( std::chrono::microseconds( frameSize * 8000 / options.linkKbps ) );
+				now = Now();
+			}
+
+			ClockSync::FrameTimes times;
+			if ( options.acks && !tail.empty() && ClockSync::ReadTrailer( &tail[0], tail.size(), times ) )
+			{
+				RateControl::Ack ack;
+				ack.m_sequence = times.m_sequence;
+				ack.m_received = ClockSync::Now();
+
+				uint8_t acks[RateControl::kMaxAckMessageSize];
+				size_t ackSize = RateControl::WriteAcks( &ack, 1, acks );
+				zmq::message_t reply( ackSize );
+				memcpy( reply.data(), acks, ackSize );
+				socket.send( reply );
+			}
+
+			stats.m_frameNumbers.push_back( frameNumber++ );
+			stats.m_firstByte.push_back( firstByte );
+			stats.m_complete.push_back( now );
+		}
+	}
+
+	int linger = 0;
+	socket.setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+}
+
+///A viewer on the UDP transport. Every camera is numbered on its own and the harness's
+///cameras all send in every tick, in the order of their IDs, so the order sent follows from both.
+static void RunUdpViewer( const HarnessOptions& options, ViewerStats& stats, const std::atomic<bool>& stop )
+{
+	DatagramVideo::Address sender;
+	DatagramVideo::Receiver receiver;
+	if ( !DatagramVideo::ResolveAddress( options.bindAddress, static_cast<uint16_t>(options.udpPort), sender ) || !receiver.Open( sender ) )
+	{
+		fprintf( stderr, "Failed to open a UDP viewer\n" );
+		return;
+	}
+	receiver.GetSocket().SetDropRate( options.dropPercent / 100.0 );
+
+	std::vector<uint8_t> jpeg;
+	DatagramVideo::FrameResult result;
+	while ( !stop )
+	{
+		if ( !receiver.Receive( jpeg, result, 50 ) )
+			continue;
+
+		double now = Now();
+		stats.m_bytes += jpeg.size();
+		if ( result.m_concealedSegments > 0 )
+			++stats.m_concealed;
+
+		stats.m_frameNumbers.push_back( result.m_frameNumber * options.cameras + result.m_stream );
+		stats.m_firstByte.push_back( now );
+		stats.m_complete.push_back( now );
+	}
+	receiver.Close();
+}
+
+///Answers ZMQVideo's request for a direction every time it asks
+static void RunControllerClient( const HarnessOptions& options, uint64_t& exchanges, const std::atomic<bool>& stop )
+{
+	static const char kCommands[] = "ffffllrrbbss";
+
+	zmq::context_t context( 1 );
+	zmq::socket_t socket( context, ZMQ_PAIR );
+	socket.connect( "tcp://" + options.bindAddress + ":5555" );
+
+	while ( !stop )
+	{
+		zmq_pollitem_t item = { static_cast<void*>( socket ), 0, ZMQ_POLLIN, 0 };
+		if ( zmq::poll( &item, 1, 50 ) <= 0 )
+			continue;
+
+		zmq::message_t request;
+		while ( socket.recv( &request, ZMQ_DONTWAIT ) )
+		{
+			zmq::message_t reply( 2 );
+			char* pReply = static_cast<char*>( reply.data() );
+			pReply[0] = kCommands[(exchanges / 4) % (sizeof(kCommands) - 1)];
+			pReply[1] = 0;
+			socket.send( reply );
+			++exchanges;
+		}
+	}
+
+	int linger = 0;
+	socket.setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Vehicle
+
+///Drive the vehicle from its controller's inputs. The speeds follow the
+///inverse of ZMQVideo's calibration with a lag, and the vehicle turns about z.
+static void MoveVehicle( Vehicles::Vehicle& vehicle, TimeValue dt )
+{
+	static const double kTimeConstant = 0.3;
+
+	Controller::ControllerPtr pController = vehicle.GetController();
+	if ( pController.IsNull() )
+		return;
+
+	double targetSpeed = pController->GetInput( "Throttle" ) / 0.6129;
+	double targetYawRate = -pController->GetInput( "Steering" ) / 0.1179;
+	double blend = std::min( dt / kTimeConstant, 1.0 );
+	double speed = vehicle.GetForwardSpeed() + (targetSpeed - vehicle.GetForwardSpeed()) * blend;
+	double yawRate = vehicle.GetYawRateAsDouble() + (targetYawRate - vehicle.GetYawRateAsDouble()) * blend;
+
+	Vector3 position = vehicle.GetPosition();
+	Quaternion orientation = vehicle.GetOrientation();
+	double heading = 2 * atan2( orientation.z, orientation.w ) + yawRate * dt;
+	position.x += speed * cos( heading ) * dt;
+	position.y += speed * sin( heading ) * dt;
+
+	vehicle.SetPose( position, Quaternion( cos( heading / 2 ), 0, 0, sin( heading / 2 ) ) );
+	vehicle.SetSpeeds( speed, yawRate );
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Reporting
+
+static double Percentile( const std::vector<double>& sorted, double p )
+{
+	if ( sorted.empty() )
+		return 0;
+	size_t index = static_cast<size_t>( p * (sorted.size() - 1) + 0.5 );
+	return sorted[std::min( index, sorted.size() - 1 )];
+}
+
+///Print mean and percentiles of a set of durations in seconds, as milliseconds
+static void PrintTimes( const char* pLabel, std::vector<double> times )
+{
+	if ( times.empty() )
+	{
+		printf( "  %-22s none\n", pLabel );
+		return;
+	}
+
+	std::sort( times.begin(), times.end() );
+	double sum = 0;
+	for ( size_t i = 0; i < times.size(); ++i )
+		sum += times[i];
+
+	printf( "  %-22s mean %7.3f  p50 %7.3f  p90 %7.3f  p99 %7.3f  max %7.3f ms\n", pLabel,
+		sum / times.size() * 1000, Percentile( times, 0.5 ) * 1000, Percentile( times, 0.9 ) * 1000,
+		Percentile( times, 0.99 ) * 1000, times.back() * 1000 );
+}
+
+///Destroy the plugins' objects and then the plugins. Their ZMQ sockets have to be
+///closed before the process exits, or the ZMQ context waits on them forever.
+static void DestroyPlugins( Controller::ZMQVideoFactory* pControllerFactory, SampleSensorFactory* pSensorFactory )
+{
+	//Controllers go before their factory, sensors before theirs
+	Controller::Manager::GetSingleton().ClearControllers();
+	Vehicles::Manager::GetSingleton().ClearVehicles();
+	delete pControllerFactory;
+	SensorManager::GetSingleton().ClearSensors();
+	delete pSensorFactory;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+	HarnessOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		printf( "Usage: HeadlessAnvel [-cameras n] [-size WxH] [-seconds s] [-tick hz] [-render hz] [-fast]\n"
+			"                     [-codec name] [-quality q] [-rate fps] [-chunk bytes] [-motion px]\n"
+			"                     [-udp port] [-clients n] [-drop percent] [-controller] [-external]\n"
+			"                     [-frames a.ppm,b.ppm] [-bind address] [-stats port] [-trace file] [-record base]\n"
+			"                     [-capture base] [-capturecodec raw|name] [-replay base]\n"
+			"                     [-minrate fps] [-acks] [-link kbps] [-verbose]\n" );
+		return 1;
+	}
+
+	if ( options.external )
+		options.clients = 0;
+	else if ( options.udpPort == 0 && options.clients != 1 )
+	{
+		printf( "The ZMQ video socket is a PAIR socket and serves exactly one client, use -udp for %d\n", options.clients );
+		return 1;
+	}
+
+	//Captured frames set the resolution
+	std::vector<Image> recorded( options.frames.size() );
+	for ( size_t i = 0; i < options.frames.size(); ++i )
+	{
+		if ( !LoadPpm( options.frames[i], recorded[i] ) )
+		{
+			printf( "Failed to read %s\n", options.frames[i].c_str() );
+			return 1;
+		}
+		if ( i > 0 && (recorded[i].width != recorded[0].width || recorded[i].height != recorded[0].height) )
+		{
+			printf( "%s is not the same size as %s\n", options.frames[i].c_str(), options.frames[0].c_str() );
+			return 1;
+		}
+	}
+	if ( !recorded.empty() )
+	{
+		options.width = recorded[0].width;
+		options.height = recorded[0].height;
+	}
+
+	if ( options.verbose )
+		SetLogMessageMask( 0xffffffff );
+
+	//The plugins pick their interface from the 192.168.1.x network unless told otherwise
+	setenv( "ANVEL_BIND_ADDRESS", options.bindAddress.c_str(), 1 );
+
+	//Cameras
+	DynamicAssetParams dynamicParams;
+	std::vector<CameraSensor*> cameras;
+	std::vector< std::vector<uint8_t> > cameraPixels( options.cameras );
+	for ( int i = 0; i < options.cameras; ++i )
+	{
+		CameraSensorStaticAssetParams cameraParams;
+		cameraParams.m_sensorType = kSensorTypeCamera;
+		cameraParams.m_assetName = "Camera" + StringConverter::ToString( i );
+		cameraParams.m_sampleRate = options.renderRate;
+		cameraParams.m_lensParams.resize( 1 );
+		cameraParams.m_lensParams[0].m_resolutionX = options.width;
+		cameraParams.m_lensParams[0].m_resolutionY = options.height;
+
+		CameraSensor* pCamera = new CameraSensor( MakeID( Types::CameraSensor, i ), cameraParams, dynamicParams );
+		SensorManager::GetSingleton().AddSensor( pCamera );
+		cameras.push_back( pCamera );
+
+		if ( recorded.empty() )
+			cameraPixels[i].resize( static_cast<size_t>(options.width) * options.height * 3 );
+	}
+	SyntheticScene scene( options.width, options.height, options.motion );
+
+	//The sensor, with the same defaults as an XML entry that only names it
+	SampleSensorFactory* pSensorFactory = new SampleSensorFactory();
+
+	SampleSensorStaticAssetParams sensorParams;
+	sensorParams.m_sensorType = kSensorTypeSampleSensor;
+	sensorParams.m_assetName = "HeadlessSampleSensor";
+	sensorParams.m_sampleRate = options.tickRate;
+	sensorParams.m_intData = 0;
+	sensorParams.m_frameRingSlots = 0;
+	sensorParams.m_encodeInProcess = true;
+	sensorParams.m_udpPort = options.udpPort;
+	sensorParams.m_udpDatagramSize = DatagramVideo::kDefaultDatagramSize;
+	sensorParams.m_udpDropPercent = 0;
+	sensorParams.m_codec = options.codec;
+	sensorParams.m_bitrate = 2000;
+	sensorParams.m_keyframeInterval = 0;
+	sensorParams.m_intraRefresh = true;
+	sensorParams.m_tileSize = 64;
+	sensorParams.m_refreshInterval = 30;
+	sensorParams.m_streamChunkSize = options.chunkSize;
+	sensorParams.m_latencyReportInterval = 0;
+	sensorParams.m_frameTimestamps = true;
+	sensorParams.m_statsInterval = 1000;
+	sensorParams.m_statsPort = options.statsPort;
+	sensorParams.m_trace = !options.traceFile.empty();
+	sensorParams.m_record = options.recordBase;
+	sensorParams.m_recordSegmentMB = Recording::kDefaultSegmentMB;
+	sensorParams.m_capture = options.captureBase;
+	sensorParams.m_captureCodec = options.captureCodec;
+	sensorParams.m_captureSegmentMB = Recording::kDefaultCaptureSegmentMB;
+	sensorParams.m_captureBatchMB = Recording::kDefaultCaptureBatchMB;
+	sensorParams.m_captureQueueMB = Recording::kDefaultCaptureQueueMB;
+	sensorParams.m_motionVehicle = options.minSendRate > 0 ? "HeadlessVehicle" : "";
+	sensorParams.m_minSendRate = options.minSendRate;
+	sensorParams.m_motionFullSpeed = 10.0;
+	sensorParams.m_motionFullYawRate = 0.5;
+	sensorParams.m_targetQueueDelay = RateControl::kDefaultTargetDelayMs;
+
+	SampleSensor* pSensor = static_cast<SampleSensor*>( SensorManager::GetSingleton().CreateSensor( sensorParams, dynamicParams ) );
+	if ( !pSensor )
+	{
+		DestroyPlugins( NULL, pSensorFactory );
+		return 1;
+	}
+
+	//Through the property system, as the ANVEL property panel would
+	if ( !PropertyManager::GetSingleton().SetProperty( pSensor->GetID(), "Quality Factor", StringConverter::ToString( options.quality ) )
+		|| !PropertyManager::GetSingleton().SetProperty( pSensor->GetID(), "Frame Rate", StringConverter::ToString( options.sendRate ) ) )
+	{
+		printf( "Failed to set the sensor properties\n" );
+		DestroyPlugins( NULL, pSensorFactory );
+		return 1;
+	}
+
+	//The controller, attached with the command the ANVEL menu runs
+	Controller::ZMQVideoFactory* pControllerFactory = NULL;
+	Vehicles::Vehicle* pVehicle = NULL;
+	if ( options.controller )
+	{
+		pControllerFactory = new Controller::ZMQVideoFactory();
+		pVehicle = Vehicles::Manager::GetSingleton().CreateVehicle( "HeadlessVehicle" );
+
+		CommandParamList parameters;
+		parameters.push_back( Variant( pVehicle->GetID() ) );
+		CommandResult result = CommandManager::GetSingleton().ExecuteCommand( "UseZMQVideo", parameters );
+		if ( !result.Succeeded() )
+		{
+			printf( "UseZMQVideo failed: %s\n", result.m_msg.c_str() );
+			DestroyPlugins( pControllerFactory, pSensorFactory );
+			return 1;
+		}
+
+		if ( !options.recordBase.empty() )
+		{
+			parameters.clear();
+			parameters.push_back( Variant( String( options.recordBase + "-control" ) ) );
+			if ( CommandManager::GetSingleton().ExecuteCommand( "StartControllerRecording", parameters ).Failed() )
+			{
+				printf( "Failed to start the controller recording\n" );
+				DestroyPlugins( pControllerFactory, pSensorFactory );
+				return 1;
+			}
+		}
+
+		if ( !options.replayBase.empty() )
+		{
+			parameters.clear();
+			parameters.push_back( Variant( String( options.replayBase + "-control" ) ) );
+			if ( CommandManager::GetSingleton().ExecuteCommand( "StartControllerReplay", parameters ).Failed() )
+			{
+				printf( "Failed to replay %s-control\n", options.replayBase.c_str() );
+				DestroyPlugins( pControllerFactory, pSensorFactory );
+				return 1;
+			}
+		}
+	}
+
+	//Clients
+	std::atomic<bool> stop( false );
+	std::vector<ViewerStats> viewers( options.clients );
+	std::vector<std::thread> threads;
+	for ( int i = 0; i < options.clients; ++i )
+	{
+		if ( options.udpPort != 0 )
+			threads.push_back( std::thread( RunUdpViewer, std::cref( options ), std::ref( viewers[i] ), std::cref( stop ) ) );
+		else
+			threads.push_back( std::thread( RunZmqViewer, std::cref( options ), std::ref( viewers[i] ), std::cref( stop ) ) );
+	}
+
+	uint64_t exchanges = 0;
+	if ( options.controller && !options.external && options.replayBase.empty() )
+		threads.push_back( std::thread( RunControllerClient, std::cref( options ), std::ref( exchanges ), std::cref( stop ) ) );
+
+	//Give the clients time to connect and subscribe
+	std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+
+	printf( "%d camera(s) %dx%d %s, %s q%d at %d fps, %g Hz ticks for %g s%s, %d %s client(s)%s%s\n",
+		options.cameras, options.width, options.height, recorded.empty() ? "synthetic" : "recorded",
+		options.codec.c_str(), options.quality, options.sendRate, options.tickRate, options.seconds,
+		options.realtime ? "" : " as fast as possible", options.clients, options.udpPort ? "UDP" : "ZMQ",
+		options.controller ? ", controller" : "", options.external ? ", external" : "" );
+
+	//The simulation loop
+	const TimeValue dt = 1.0 / options.tickRate;
+	const uint32_t ticks = static_cast<uint32_t>( options.seconds * options.tickRate + 0.5 );
+
+	std::vector<double> sensorTimes;
+	std::vector<double> sendingSensorTimes;
+	std::vector<double> controllerTimes;
+	std::vector<double> sendTimes; ///< Start of the tick that sent each frame
+	sensorTimes.reserve( ticks );
+	controllerTimes.reserve( ticks );
+
+	TimeValue simTime = 0;
+	TimeValue nextRender = 0;
+	uint32_t renderedFrames = 0;
+	uint32_t lateTicks = 0;
+	double start = Now();
+
+	for ( uint32_t tick = 0; tick < ticks; ++tick )
+	{
+		if ( options.realtime )
+		{
+			double due = start + tick * dt;
+			double now = Now();
+			if ( now < due )
+				std::this_thread::sleep_for( std::chrono::duration<double>( due - now ) );
+			else if ( now - due > dt )
+				++lateTicks;
+		}
+
+		//Render
+		if ( simTime >= nextRender )
+		{
+			for ( int i = 0; i < options.cameras; ++i )
+			{
+				uint8_t* pPixels;
+				if ( recorded.empty() )
+				{
+					pPixels = &cameraPixels[i][0];
+					scene.Render( i, renderedFrames, pPixels );
+				}
+				else
+				{
+					pPixels = &recorded[(renderedFrames + i) % recorded.size()].pixels[0];
+				}
+				cameras[i]->SetLensImage( 0, pPixels, static_cast<uint32>( simTime * 1000 ) );
+			}
+			++renderedFrames;
+			nextRender += 1.0 / options.renderRate;
+		}
+
+		uint64_t sentBefore = pSensor->GetFramesSent();
+		double tickStart = Now();
+		SensorManager::GetSingleton().Update( dt );
+		double sensorDone = Now();
+		Controller::Manager::GetSingleton().Update( dt );
+		double controllerDone = Now();
+
+		if ( pVehicle )
+			MoveVehicle( *pVehicle, dt );
+
+		uint64_t sent = pSensor->GetFramesSent() - sentBefore;
+		sendTimes.insert( sendTimes.end(), static_cast<size_t>( sent ), tickStart );
+		sensorTimes.push_back( sensorDone - tickStart );
+		if ( sent )
+			sendingSensorTimes.push_back( sensorDone - tickStart );
+		controllerTimes.push_back( controllerDone - sensorDone );
+
+		simTime += dt;
+	}
+	double elapsed = Now() - start;
+
+	//Let the last frames arrive
+	std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+	stop = true;
+	for ( size_t i = 0; i < threads.size(); ++i )
+		threads[i].join();
+
+	//Report
+	printf( "  %-22s %u in %.2f s, %u late\n", "ticks", ticks, elapsed, lateTicks );
+	PrintTimes( "sensor update", sensorTimes );
+	PrintTimes( "  sending ticks", sendingSensorTimes );
+	if ( options.controller )
+		PrintTimes( "controller update", controllerTimes );
+	printf( "  %-22s %u  %.1f fps\n", "frames sent", static_cast<uint32_t>( sendTimes.size() ), sendTimes.size() / elapsed );
+
+	//Where each stream's frames spent their time inside the sensor
+	const std::map<VaneID, StreamLatency>& latency = pSensor->GetLatency();
+	for ( std::map<VaneID, StreamLatency>::const_iterator it = latency.begin(); it != latency.end(); ++it )
+	{
+		printf( "  camera %-15u %u repeated frames, p50/p95/p99/max ms:\n", static_cast<uint32_t>( it->first & 0xffffffff ),
+			static_cast<uint32_t>( it->second.GetRepeatedFrames() ) );
+		printf( "    %s\n", it->second.Format().c_str() );
+	}
+
+	//The last stats window, as the property panel shows it
+	static const char* kStatProperties[] = { "Achieved Frame Rate", "Encode Time p50", "Encode Time p95", "Encode Time p99",
+		"Bytes Per Frame", "Bitrate", "Queue Depth", "Dropped Frames", "Connected Clients", "Viewer Connects",
+		"Viewer Disconnects", "Time Without Viewer", "Target Frame Rate", "Congestion Level", "Queueing Delay", "Delivered Bitrate" };
+	printf( "  %-22s", "stats properties" );
+	for ( size_t i = 0; i < sizeof(kStatProperties) / sizeof(kStatProperties[0]); ++i )
+	{
+		String value;
+		if ( PropertyManager::GetSingleton().GetProperty( pSensor->GetID(), kStatProperties[i], value ) )
+			printf( "%s%s %s", i ? ", " : " ", kStatProperties[i], value.c_str() );
+	}
+	printf( "\n" );
+	PrintEndpoints( "video socket", pSensor->GetVideoMonitor() );
+
+	int result = 0;
+	for ( int i = 0; i < options.clients; ++i )
+	{
+		const ViewerStats& viewer = viewers[i];
+		std::vector<double> latency;
+		std::vector<double> firstByte;
+		for ( size_t f = 0; f < viewer.m_complete.size(); ++f )
+		{
+			uint32_t index = viewer.m_frameNumbers[f];
+			if ( index >= sendTimes.size() )
+				continue;
+			latency.push_back( viewer.m_complete[f] - sendTimes[index] );
+			firstByte.push_back( viewer.m_firstByte[f] - sendTimes[index] );
+		}
+
+		size_t received = viewer.m_complete.size();
+		printf( "  client %-15d %u frames  %.1f fps  %.1f KB/frame  %.2f Mbit/s  %u missing", i,
+			static_cast<uint32_t>( received ), received / elapsed, received ? viewer.m_bytes / 1024.0 / received : 0.0,
+			viewer.m_bytes * 8 / elapsed / 1e6, static_cast<uint32_t>( sendTimes.size() > received ? sendTimes.size() - received : 0 ) );
+		if ( options.udpPort )
+			printf( "  %u concealed", static_cast<uint32_t>( viewer.m_concealed ) );
+		printf( "\n" );
+
+		PrintTimes( "  latency", latency );
+		if ( options.chunkSize > 0 )
+			PrintTimes( "  first byte", firstByte );
+
+		//A slow link still holds frames when the run ends
+		if ( received == 0 || (options.udpPort == 0 && options.linkKbps == 0 && received != sendTimes.size()) )
+			result = 1;
+	}
+
+	if ( options.controller )
+	{
+		Controller::ControllerPtr pController = pVehicle->GetController();
+		Vector3 position = pVehicle->GetPosition();
+		printf( "  %-22s %u exchanges, throttle %.3f steering %.3f, vehicle at %.2f, %.2f\n", "controller", static_cast<uint32_t>( exchanges ),
+			pController.IsNull() ? 0.0 : pController->GetInput( "Throttle" ),
+			pController.IsNull() ? 0.0 : pController->GetInput( "Steering" ), position.x, position.y );
+		if ( exchanges == 0 && !options.external && options.replayBase.empty() )
+			result = 1;
+		if ( !pController.IsNull() )
+			PrintEndpoints( "control socket", static_cast<Controller::ZMQVideo*>( pController.Get() )->GetControlMonitor() );
+	}
+
+	//Through the commands, as the ANVEL console would
+	if ( !options.traceFile.empty() )
+	{
+		CommandParamList parameters;
+		parameters.push_back( Variant( String( options.traceFile ) ) );
+		if ( CommandManager::GetSingleton().ExecuteCommand( "WriteSensorTrace", parameters ).Failed()
+			|| (options.controller && CommandManager::GetSingleton().ExecuteCommand( "WriteControllerTrace", parameters ).Failed()) )
+		{
+			printf( "Failed to write the trace to %s\n", options.traceFile.c_str() );
+			result = 1;
+		}
+	}
+
+	DestroyPlugins( pControllerFactory, pSensorFactory );
+	return result;
+}
@@ -0,0 +1,174 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Commands.h - Headless stand-in for ANVEL's command system.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Commands_h__
+#define Headless_Commands_h__
+
+#include "Core/Core.h"
+
+namespace VANE
+{
+	namespace VariantType
+	{
+		enum Value
+		{
+			kInvalid,
+			kVaneID,
+			kFloat64,
+			kString
+		};
+	}
+
+	///Just enough of ANVEL's variant for command parameters
+	class Variant
+	{
+	public:
+		Variant() : m_type( VariantType::kInvalid ), m_id( kInvalidVaneID ), m_double( 0 ) { }
+		Variant( VaneID id ) : m_type( VariantType::kVaneID ), m_id( id ), m_double( 0 ) { }
+		Variant( float64 value ) : m_type( VariantType::kFloat64 ), m_id( kInvalidVaneID ), m_double( value ) { }
+		Variant( const String& value ) : m_type( VariantType::kString ), m_id( kInvalidVaneID ), m_double( 0 ), m_string( value ) { }
+
+		VariantType::Value GetType() const { return m_type; }
+		VaneID GetVaneIDValue() const { return m_id; }
+		float64 GetDoubleValue() const { return m_double; }
+		const String& GetStringValue() const { return m_string; }
+
+		static const Variant INVALID;
+
+	private:
+		VariantType::Value m_type;
+		VaneID  m_id;
+		float64 m_double;
+		String  m_string;
+	};
+
+	typedef std::vector<Variant> VariantVector;
+
+	typedef String        CommandName;
+	typedef uint32        CommandID;
+	typedef uint32        CommandResultID;
+	typedef Variant       CommandParameter;
+	typedef VariantType::Value CommandParameterType;
+	typedef VariantVector CommandParamList;
+
+	const CommandResultID kInvalidResultID = 0;
+
+	///Command registration flags
+	enum CommandFlags
+	{
+		kCmdHidden = 0x01
+	};
+
+	enum CommandResultValue
+	{
+		kCommandSuccess,
+		kCommandFail
+	};
+
+	enum CommandErrorType
+	{
+		kNoCommandError,
+		kInvalidCommand,
+		kInvalidParameters,
+		kParameterOutsideRange
+	};
+
+	enum CommandSuccessTag
+	{
+		Success = 0
+	};
+
+	struct CommandResult
+	{
+		CommandResult( CommandSuccessTag, CommandResultID resultID = kInvalidResultID )
+			: m_result( kCommandSuccess ), m_error( kNoCommandError ), m_resultID( resultID ), m_msg( "Command Success" ) { }
+
+		CommandResult()
+			: m_result( kCommandFail ), m_error( kInvalidCommand ), m_resultID( kInvalidResultID ) { }
+
+		CommandResult( CommandErrorType type, const String& msg = "", CommandResultID resultID = kInvalidResultID )
+			: m_result( kCommandFail ), m_error( type ), m_resultID( resultID ), m_msg( msg ) { }
+
+		CommandResult( CommandResultValue result, CommandErrorType type, const String& msg, CommandResultID resultID = kInvalidResultID )
+			: m_result( result ), m_error( type ), m_resultID( resultID ), m_msg( msg ) { }
+
+		bool Succeeded() const { return m_result == kCommandSuccess; }
+		bool Failed() const    { return m_result == kCommandFail; }
+
+		CommandResultValue m_result;
+		CommandErrorType   m_error;
+		CommandResultID    m_resultID;
+		String             m_msg;
+	};
+
+	struct ParameterDescription
+	{
+		ParameterDescription( CommandParameterType type, const String& name, const String& description )
+			: m_type( type ), m_name( name ), m_description( description ) { }
+
+		CommandParameterType m_type;
+		String m_name;
+		String m_description;
+	};
+
+	typedef std::vector<ParameterDescription> ParameterDescriptionList;
+
+	struct CommandDescription
+	{
+		CommandDescription() : m_id( 0 ) { }
+		CommandDescription( CommandID id, const String& description ) : m_id( id ), m_description( description ) { }
+
+		CommandID m_id;
+		String    m_description;
+		ParameterDescriptionList m_parameters;
+	};
+
+	class ICommandHandler
+	{
+	public:
+		virtual ~ICommandHandler() { }
+
+		virtual CommandResult HandleCommand( CommandID commandID, const CommandParamList& parameterList ) = 0;
+	};
+
+	class CommandGroup : public ICommandHandler
+	{
+	public:
+		explicit CommandGroup( const String& name ) : m_name( name ) { }
+
+		void AddCommand( const CommandDescription& description ) { m_descriptions.push_back( description ); }
+		const String& GetName() const { return m_name; }
+
+	private:
+		String m_name;
+		std::vector<CommandDescription> m_descriptions;
+	};
+
+	class CommandManager
+	{
+	public:
+		static CommandManager& GetSingleton();
+
+		CommandID RegisterCommand( const String& commandName, ICommandHandler* pHandler, uint32 flags = 0 );
+		void RegisterObjectAction( CommandID commandID, VaneID dataType, uint32 flags );
+
+		///Run a command by name, as the ANVEL console or a script would
+		CommandResult ExecuteCommand( const CommandName& commandName, const CommandParamList& parameterList );
+
+	private:
+		CommandManager() { }
+
+		struct Registration
+		{
+			CommandName      m_name;
+			ICommandHandler* m_pHandler;
+		};
+
+		std::vector<Registration> m_commands; ///< Indexed by CommandID - 1
+	};
+}
+
+#endif // Headless_Commands_h__
@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// ControllerInterface.h - Headless stand-in for ANVEL's vehicle controllers.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_ControllerInterface_h__
+#define Headless_ControllerInterface_h__
+
+#include "Core/Core.h"
+
+namespace VANE
+{
+	namespace Controller
+	{
+		typedef uint32  ControlInputIndex;
+		typedef float64 ControlValue;
+		typedef String  ControlName;
+		typedef VaneID  ControllerID;
+		typedef String  ControllerType;
+
+		enum ControlType
+		{
+			kControlTypeButton = 0,
+			kControlTypeAxis
+		};
+
+		enum ControlMode
+		{
+			kControlModePassive = 0,
+			kControlModeActive  = 1
+		};
+
+		const ControlValue kDefaultControlValue = 0.0f;
+
+		struct ControlInput
+		{
+			ControlInput() { }
+			ControlInput( const ControlName& name, ControlType type ) : m_type( type ), m_name( name ) { }
+
+			ControlType m_type;
+			ControlName m_name;
+		};
+
+		class ControllerInterface
+		{
+		public:
+			virtual ~ControllerInterface() { }
+
+			virtual void Update( TimeValue dt ) = 0;
+			virtual void OnAttachedToObject( VaneID objectID ) { VANE_UNUSED( objectID ); }
+
+			virtual ControlValue GetInput( ControlInputIndex index ) const = 0;
+			virtual ControlValue GetInput( const ControlName& name ) const = 0;
+			virtual std::vector<ControlValue> GetInputs() const = 0;
+			virtual void ClearInputs() = 0;
+			virtual std::vector<ControlInput> GetControls() const = 0;
+			virtual void SetControlMode( ControlMode mode ) { VANE_UNUSED( mode ); }
+			virtual void AddControllable( VaneID controllableID ) { VANE_UNUSED( controllableID ); }
+
+			virtual ControllerType GetType() const = 0;
+			virtual ControllerID GetControllerID() const = 0;
+			virtual ControllerID GetBaseControllerID() const = 0;
+		};
+
+		typedef SharedPtr<ControllerInterface> ControllerPtr;
+		typedef std::map<ControllerID, ControllerPtr> ControllerPtrMap;
+
+		class IControllerFactory
+		{
+		public:
+			virtual ~IControllerFactory() { }
+
+			virtual ControllerID CreateControllerInterface() = 0;
+			virtual ControllerType GetControllerType() const = 0;
+			virtual ControllerID GetControllerTypeId() const = 0;
+			virtual void DestroyControllerInterface( ControllerID id ) { VANE_UNUSED( id ); }
+			virtual ControllerPtr GetController( ControllerID id ) { VANE_UNUSED( id ); return ControllerPtr(); }
+			virtual void SerializeControllers( TiXmlElement* pParent ) const = 0;
+			virtual void DeserializeControllers( const TiXmlElement* pParent ) = 0;
+		};
+	}
+}
+
+#endif // Headless_ControllerInterface_h__
@@ -0,0 +1,229 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Core.h - Headless stand-in for the ANVEL core types.
+//
+// Only the parts of the SDK that the sensor and controller plugins use are
+// declared, with the same names and signatures as the real headers, so the
+// plugin sources compile against this tree unchanged. See HeadlessAnvel.cpp.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Core_h__
+#define Headless_Core_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+class TiXmlElement;
+class TiXmlNode;
+
+#define VaneSimExport
+#define VaneCoreExport
+
+#define VANE_UNUSED( x ) (void)(x)
+#define VANE_UNREFERENCED_PARAM( x ) (void)(x)
+
+namespace VANE
+{
+	using std::vector;
+
+	typedef int8_t   int8;
+	typedef int16_t  int16;
+	typedef int32_t  int32;
+	typedef int64_t  int64;
+	typedef uint8_t  uint8;
+	typedef uint16_t uint16;
+	typedef uint32_t uint32;
+	typedef uint64_t uint64;
+	typedef float    float32;
+	typedef double   float64;
+
+	typedef std::string String;
+	typedef std::vector<String> StringVector;
+
+	///Simulation time in seconds
+	typedef float64 TimeValue;
+
+	//////////////////////////////////////////////////////////////////////////
+	// IDs
+
+	///The data type lives in the upper 32 bits, the instance in the lower ones
+	typedef uint64 VaneID;
+	typedef std::vector<VaneID> VaneIdVector;
+	typedef std::set<VaneID> VaneIdSet;
+
+	const VaneID kInvalidVaneID = 0;
+
+	inline VaneID MakeID( VaneID dataType, VaneID index ) { return (dataType << 32) | (index & 0xffffffff); }
+	inline uint32 GetDataType( VaneID id ) { return static_cast<uint32>( id >> 32 ); }
+
+	//////////////////////////////////////////////////////////////////////////
+	// Reference counted pointer
+
+	template<class T>
+	class SharedPtr
+	{
+	public:
+		SharedPtr() { }
+		template<class U> explicit SharedPtr( U* p ) : m_p( p ) { }
+		template<class U> SharedPtr( const SharedPtr<U>& rhs ) : m_p( rhs.m_p ) { }
+
+		T* Get() const { return m_p.get(); }
+		T* GetPointer() const { return m_p.get(); }
+		bool IsNull() const { return !m_p; }
+		void SetNull() { m_p.reset(); }
+
+		T* operator->() const { return m_p.get(); }
+		T& operator*() const { return *m_p; }
+
+	private:
+		template<class U> friend class SharedPtr;
+
+		std::shared_ptr<T> m_p;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// Data types
+
+	struct DataTypeGUID
+	{
+		uint32 data1;
+		uint16 data2;
+		uint16 data3;
+		uint8  data4[8];
+	};
+
+	struct DataTypeDescription
+	{
+		DataTypeDescription( const String& name, const String& displayName, const String& description )
+			: typeName( name )
+			, typeDisplayName( displayName )
+			, typeDescription( description )
+		{
+		}
+
+		String typeName;
+		String typeDisplayName;
+		String typeDescription;
+		VaneIdVector typeIsA;
+	};
+
+	class DataTypeManager
+	{
+	public:
+		static DataTypeManager& GetSingleton();
+
+		///@return the new type's ID, or the existing one if the name is already registered
+		VaneID RegisterDataType( const DataTypeDescription& description, const DataTypeGUID& guid );
+		String GetTypeName( VaneID dataType ) const;
+
+	private:
+		DataTypeManager() { }
+
+		std::vector<DataTypeDescription> m_types;
+	};
+
+	namespace Types
+	{
+		extern VaneID Sensor;
+		extern VaneID SensorManager;
+		extern VaneID Vehicle;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Assets
+
+	class StaticAssetParams
+	{
+	public:
+		StaticAssetParams() : m_isPlaceable( false ) { }
+		virtual ~StaticAssetParams() { }
+
+		String m_assetName;
+		String m_assetPreview;
+		String m_category;
+		bool   m_isPlaceable;
+	};
+
+	typedef SharedPtr<StaticAssetParams> StaticAssetParamsPtr;
+
+	class DynamicAssetParams
+	{
+	public:
+		virtual ~DynamicAssetParams() { }
+
+		String m_instanceName;
+	};
+
+	typedef SharedPtr<DynamicAssetParams> DynamicAssetParamsPtr;
+
+	///There is no XML in the headless host, every attribute reads as its default
+	namespace XmlUtils
+	{
+		String  GetStringAttribute( const TiXmlElement* pElement, const String& name, const String& defaultValue = "" );
+		uint32  GetUnsignedIntAttribute( const TiXmlElement* pElement, const String& name, uint32 defaultValue = 0 );
+		float64 GetDoubleAttribute( const TiXmlElement* pElement, const String& name, float64 defaultValue = 0.0 );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Logging
+
+	enum LogMsgType
+	{
+		kLogMsgStandard = 0x01,
+		kLogMsgWarning  = 0x02,
+		kLogMsgError    = 0x04,
+		kLogMsgSpecial  = 0x08,
+		kLogMsgPlugin   = 0x10
+	};
+
+	void LogMessage( const String& msg, LogMsgType type = kLogMsgStandard, bool flush = true, bool logToFileOnly = false );
+
+	///Headless only: which LogMsgType bits are printed, everything but standard messages by default
+	void SetLogMessageMask( uint32 mask );
+
+	void ReportError( const char* pFile, int line );
+	#define VANEError() VANE::ReportError( __FILE__, __LINE__ )
+
+	//////////////////////////////////////////////////////////////////////////
+	// Math and units, only the members the plugins read
+
+	struct Vector3
+	{
+		Vector3() : x( 0 ), y( 0 ), z( 0 ) { }
+		Vector3( float64 x_, float64 y_, float64 z_ ) : x( x_ ), y( y_ ), z( z_ ) { }
+
+		float64 x, y, z;
+	};
+
+	struct Quaternion
+	{
+		Quaternion() : w( 1 ), x( 0 ), y( 0 ), z( 0 ) { }
+		Quaternion( float64 w_, float64 x_, float64 y_, float64 z_ ) : w( w_ ), x( x_ ), y( y_ ), z( z_ ) { }
+
+		float64 w, x, y, z;
+	};
+
+	namespace Units
+	{
+		typedef float64 Speed;        ///< m/s
+		typedef float64 RadialSpeed;  ///< rad/s
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	namespace Math
+	{
+		template<class T> inline T Clamp( T value, T low, T high ) { return value < low ? low : (value > high ? high : value); }
+		template<class T> inline T Abs( T value ) { return value < 0 ? -value : value; }
+	}
+}
+
+#endif // Headless_Core_h__
@@ -0,0 +1,12 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Logger.h - Headless stand-in, LogMessage is declared in Core.h.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Logger_h__
+#define Headless_Logger_h__
+
+#include "Core/Core.h"
+
+#endif // Headless_Logger_h__
@@ -0,0 +1,28 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Plugin.h - Headless stand-in for the ANVEL plugin interface.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Plugin_h__
+#define Headless_Plugin_h__
+
+#include "Core/Core.h"
+
+namespace VANE
+{
+	namespace Plugins
+	{
+		class Plugin
+		{
+		public:
+			virtual ~Plugin() { }
+
+			virtual void Initialize() = 0;
+			virtual void Shutdown() = 0;
+			virtual String GetName() const = 0;
+		};
+	}
+}
+
+#endif // Headless_Plugin_h__
@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Property.h - Headless stand-in for ANVEL's object properties.
+//
+// A Property refers to the member it was built from, so the host can read
+// and change plugin settings the same way the ANVEL property panel does.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Property_h__
+#define Headless_Property_h__
+
+#include "Core/Core.h"
+
+namespace VANE
+{
+	typedef uint32 PropertyIndex;
+
+	class Property
+	{
+	public:
+		enum ValueType
+		{
+			kInt,
+			kUnsigned,
+			kDouble,
+			kBool,
+			kString
+		};
+
+		explicit Property( int32& value )   : m_type( kInt ),      m_pValue( &value ) { }
+		explicit Property( uint32& value )  : m_type( kUnsigned ), m_pValue( &value ) { }
+		explicit Property( float64& value ) : m_type( kDouble ),   m_pValue( &value ) { }
+		explicit Property( bool& value )    : m_type( kBool ),     m_pValue( &value ) { }
+		explicit Property( String& value )  : m_type( kString ),   m_pValue( &value ) { }
+
+		ValueType GetType() const { return m_type; }
+
+		String GetValueString() const;
+		///Parse value into the referenced member
+		bool SetValueString( const String& value );
+
+	private:
+		ValueType m_type;
+		void*     m_pValue;
+	};
+
+	typedef std::vector<Property> PropertyGroupInstance;
+
+	struct ObjectPropertySet
+	{
+		PropertyGroupInstance properties;
+		VaneIdVector isAIds;
+	};
+
+	class IPropertyProvider
+	{
+	public:
+		virtual ~IPropertyProvider() { }
+
+		virtual ObjectPropertySet GetProperties( VaneID objID ) = 0;
+		virtual VaneIdVector GetIdsOfType( const VaneID dataType ) const = 0;
+		virtual void OnPropertyChanged( VaneID objId, PropertyIndex index ) { VANE_UNUSED( objId ); VANE_UNUSED( index ); }
+	};
+}
+
+#endif // Headless_Property_h__
@@ -0,0 +1,37 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PropertyManager.h - Headless stand-in for ANVEL's property registry.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_PropertyManager_h__
+#define Headless_PropertyManager_h__
+
+#include "Core/Property.h"
+
+namespace VANE
+{
+	class PropertyManager
+	{
+	public:
+		static PropertyManager& GetSingleton();
+
+		void RegisterPropertyProvider( VaneID dataType, IPropertyProvider* pProvider );
+		void RegisterProperty( VaneID dataType, const String& name, const String& description, bool readOnly );
+
+		///Headless only: index of a registered property, -1 if there is none by that name
+		int FindProperty( VaneID dataType, const String& name ) const;
+
+		///Set a property of an object and notify its provider, as the property panel would
+		bool SetProperty( VaneID objID, const String& name, const String& value );
+		bool GetProperty( VaneID objID, const String& name, String& value );
+
+	private:
+		PropertyManager() { }
+
+		std::map<VaneID, IPropertyProvider*> m_providers;
+		std::map<VaneID, StringVector>       m_names;
+	};
+}
+
+#endif // Headless_PropertyManager_h__
@@ -0,0 +1,29 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StringConverter.h - Headless stand-in for ANVEL's string conversions.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_StringConverter_h__
+#define Headless_StringConverter_h__
+
+#include "Core/Core.h"
+
+#include <sstream>
+
+namespace VANE
+{
+	class StringConverter
+	{
+	public:
+		template<class T>
+		static String ToString( const T& value )
+		{
+			std::ostringstream stream;
+			stream << value;
+			return stream.str();
+		}
+	};
+}
+
+#endif // Headless_StringConverter_h__
@@ -0,0 +1,84 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// CameraSensor.h - Headless stand-in for ANVEL's camera sensor.
+//
+// Nothing is rendered. The host points each lens at an RGB frame of its own
+// (generated or loaded from disk) through SetLensImage, and the plugins read
+// it back through GetLensData exactly as they read a rendered lens.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_CameraSensor_h__
+#define Headless_CameraSensor_h__
+
+#include "Simulation/Sensor.h"
+#include "Simulation/Renderer.h"
+
+namespace VANE
+{
+	namespace Types
+	{
+		extern VaneID CameraSensor;
+	}
+
+	extern const SensorType kSensorTypeCamera;
+
+	struct LensParams
+	{
+		LensParams()
+			: m_verticalFOV( 45 )
+			, m_horizontalFOV( 60 )
+			, m_resolutionX( 0 )
+			, m_resolutionY( 0 )
+			, m_enabled( true )
+		{
+		}
+
+		float64 m_verticalFOV;
+		float64 m_horizontalFOV;
+		uint32  m_resolutionX;
+		uint32  m_resolutionY;
+		bool    m_enabled;
+	};
+
+	///Unlike ANVEL's, the output buffer belongs to the host rather than the lens
+	struct LensData
+	{
+		LensData()
+			: m_renderTargetID( Rendering::kInvalidRenderTargetID )
+			, m_lastVisualizationTimestamp( 0 )
+		{	}
+
+		Rendering::RenderRequestData m_renderRequest;
+		Rendering::RenderTargetID m_renderTargetID;
+		uint32 m_lastVisualizationTimestamp;
+	};
+
+	class CameraSensorStaticAssetParams
+		: public SensorStaticAssetParams
+	{
+	public:
+		vector<LensParams> m_lensParams;
+	};
+
+	class CameraSensor : public Sensor
+	{
+	public:
+		CameraSensor( VaneID specificID, CameraSensorStaticAssetParams& params, DynamicAssetParams& dynamicParams );
+
+		///Lenses are rendered by the host, so there is nothing to do here
+		virtual void Update( TimeValue /*dt*/ ) { }
+
+		const std::vector<LensData>& GetLensData() const { return m_lensData; }
+		const std::vector<LensParams>& GetLensParams() const { return m_lensParams; }
+
+		///Headless only: present a new RGB frame on a lens, pPixels must stay valid until the next one
+		void SetLensImage( uint32 lens, uint8* pPixels, uint32 renderTimeStamp );
+
+	private:
+		std::vector<LensParams> m_lensParams;
+		std::vector<LensData>   m_lensData;
+	};
+}
+
+#endif // Headless_CameraSensor_h__
@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// ControllerManager.h - Headless stand-in for ANVEL's Controller::Manager.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_ControllerManager_h__
+#define Headless_ControllerManager_h__
+
+#include "Core/ControllerInterface.h"
+#include "Simulation/Vehicles/Vehicle.h"
+
+namespace VANE
+{
+	namespace Controller
+	{
+		typedef std::map<Vehicles::VehicleID, ControllerPtr> VehicleControllerMap;
+		typedef std::map<VaneID, IControllerFactory*> ControllerFactoryMap;
+
+		class Manager
+		{
+		public:
+			static Manager& GetSingleton();
+
+			///Update every registered controller
+			void Update( TimeValue dt );
+
+			void SetVehicleController( Vehicles::VehicleID id, const ControllerPtr& controller );
+			ControllerPtr GetController( ControllerID id );
+
+			void RegisterController( const ControllerPtr& pController );
+			void UnregisterController( ControllerID id );
+			///Drop every controller, before the factories that own them go away
+			void ClearControllers();
+
+			ControllerID GetNextControllerID() { return m_currentControllerID++; }
+
+			ControllerID CreateControllerOfType( const String& typeName );
+
+			void RegisterControllerFactory( IControllerFactory* pFac );
+			void UnregisterControllerFactory( IControllerFactory* pFac );
+
+		private:
+			Manager() : m_currentControllerID( 1 ) { }
+
+			ControllerPtrMap     m_controllers;
+			VehicleControllerMap m_vehicleControllers;
+			ControllerFactoryMap m_factories;
+			ControllerID         m_currentControllerID;
+		};
+	}
+}
+
+#endif // Headless_ControllerManager_h__
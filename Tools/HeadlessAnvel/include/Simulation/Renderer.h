@@ -0,0 +1,34 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Renderer.h - Headless stand-in for ANVEL's render requests.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Renderer_h__
+#define Headless_Renderer_h__
+
+#include "Core/Core.h"
+
+namespace VANE
+{
+	namespace Rendering
+	{
+		typedef uint32 RenderTargetID;
+		const RenderTargetID kInvalidRenderTargetID = 0xffffffff;
+
+		struct RenderRequestData
+		{
+			RenderRequestData()
+				: m_pOutputBuffer( NULL )
+				, m_renderTimeStamp( 0 )
+				, m_renderStatus( 0 )
+			{	}
+
+			uint8* m_pOutputBuffer;
+			uint32 m_renderTimeStamp;
+			uint32 m_renderStatus;
+		};
+	}
+}
+
+#endif // Headless_Renderer_h__
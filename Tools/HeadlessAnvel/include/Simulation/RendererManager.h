@@ -0,0 +1,12 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RendererManager.h - Headless stand-in, there is no renderer to manage.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_RendererManager_h__
+#define Headless_RendererManager_h__
+
+#include "Simulation/Renderer.h"
+
+#endif // Headless_RendererManager_h__
@@ -0,0 +1,116 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Sensor.h - Headless stand-in for ANVEL's sensor base and SensorManager.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Sensor_h__
+#define Headless_Sensor_h__
+
+#include "Core/Core.h"
+#include "Core/Property.h"
+
+namespace VANE
+{
+	typedef String SensorType;
+
+	class Sensor;
+
+	class SensorStaticAssetParams
+		: public StaticAssetParams
+	{
+	public:
+		SensorStaticAssetParams() : m_sampleRate( 0 ), m_defaultFidelity( 1.0f ) { }
+
+		String     m_worldObjectAssetName;
+		SensorType m_sensorType;
+		float64    m_sampleRate;
+		float32    m_defaultFidelity;
+	};
+
+	class ISensorFactory
+	{
+	public:
+		virtual Sensor* CreateSensor( SensorStaticAssetParams& params, DynamicAssetParams& dynamicParams ) = 0;
+		virtual StaticAssetParamsPtr ParseXmlParams( const TiXmlElement* pXmlElement ) = 0;
+		virtual ~ISensorFactory() { }
+	};
+
+	typedef VaneID SensorID;
+	const SensorID kInvalidSensorID = 0x00;
+
+	class Sensor
+	{
+	public:
+		friend class SensorManager;
+
+		static const float64 kDefaultSampleRate;
+
+		Sensor( VaneID specificID, SensorStaticAssetParams& sensorParams, DynamicAssetParams& dynamicParams );
+		virtual ~Sensor() { }
+
+		inline SensorType GetSensorType() const { return m_type; }
+		inline double GetSampleRate() const { return m_sampleRate; }
+		inline double GetSampleStep() const { return m_sampleStep; }
+		inline float64 GetLastSampleTime() const { return m_lastSampleTime; }
+		inline String GetName() const { return m_name; }
+
+		virtual void Update( TimeValue dt ) = 0;
+
+		VaneID GetBaseSensorID() const { return m_baseSensorID; }
+		VaneID GetID() const { return m_specificSensorID; }
+
+	protected:
+		float64 m_sampleRate;
+		float64 m_sampleStep;
+		float64 m_sampleTimeLeft;
+		float64 m_elapsedTime;
+		float64 m_lastSampleTime;
+		float32 m_fidelity;
+
+		SensorID m_baseSensorID;
+		SensorID m_specificSensorID;
+		String m_name;
+		SensorType m_type;
+		bool m_enabled;
+	};
+
+	typedef SharedPtr<Sensor> SensorPtr;
+	typedef std::vector<SensorPtr> SensorList;
+	typedef std::vector<SensorID> SensorIDList;
+
+	///Unlike ANVEL's, the headless SensorManager owns the sensors added to it
+	class SensorManager
+	{
+	public:
+		static SensorManager& GetSingleton();
+
+		///Update every sensor, in the order they were added
+		void Update( TimeValue dt );
+
+		void RegisterSensorFactory( const SensorType& sensorType, ISensorFactory* pFactory );
+		void UnregisterSensorFactory( ISensorFactory* pFactory );
+
+		///Headless only: create a sensor through the factory registered for params.m_sensorType and add it
+		Sensor* CreateSensor( SensorStaticAssetParams& params, DynamicAssetParams& dynamicParams );
+
+		const std::vector<SensorPtr>& GetAllSensors() { return m_sensors; }
+
+		void AddSensor( Sensor* pSensor );
+		void RemoveSensor( SensorID sensorID );
+		void ClearSensors();
+
+		///Look a sensor up by either its base or its specific ID
+		SensorPtr GetSensor( SensorID id );
+		SensorID GetNextSensorID();
+
+	private:
+		SensorManager() : m_sensorIDCount( 0 ) { }
+
+		SensorList m_sensors;
+		std::map<SensorType, ISensorFactory*> m_factories;
+		VaneID m_sensorIDCount;
+	};
+}
+
+#endif // Headless_Sensor_h__
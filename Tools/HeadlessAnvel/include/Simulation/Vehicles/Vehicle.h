@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Vehicle.h - Headless stand-in for an ANVEL vehicle.
+//
+// There is no dynamics model. A vehicle remembers which controller drives
+// it, so the host can read back the inputs the controller produced, and
+// holds a pose and speeds that the host moves it with.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_Vehicle_h__
+#define Headless_Vehicle_h__
+
+#include "Core/ControllerInterface.h"
+#include "Simulation/Sensor.h"
+
+namespace VANE
+{
+	namespace Vehicles
+	{
+		typedef VaneID VehicleID;
+
+		class Vehicle
+		{
+		public:
+			Vehicle( VehicleID id, const String& name )
+				: m_id( id )
+				, m_name( name )
+				, m_inputEnabled( false )
+				, m_externallyControlled( false )
+				, m_forwardSpeed( 0 )
+				, m_yawRate( 0 )
+			{
+			}
+
+			VehicleID GetID() const { return m_id; }
+			const String& GetName() const { return m_name; }
+
+			inline void SetInputEnabled( bool enabled ) { m_inputEnabled = enabled; }
+			inline bool GetInputEnabled() const { return m_inputEnabled; }
+			inline void SetExternallyControlled( bool externallyControlled ) { m_externallyControlled = externallyControlled; }
+			inline bool IsExternallyControlled() const { return m_externallyControlled; }
+
+			void SetController( const Controller::ControllerPtr& pController ) { m_pController = pController; }
+			const Controller::ControllerPtr& GetController() const { return m_pController; }
+
+			Vector3 GetPosition() const { return m_position; }
+			Quaternion GetOrientation() const { return m_orientation; }
+			Units::Speed GetForwardSpeed() const { return m_forwardSpeed; }
+			Units::RadialSpeed GetYawRate() const { return m_yawRate; }
+			float64 GetYawRateAsDouble() const { return m_yawRate; }
+
+			///Headless only: the host integrates the motion
+			void SetPose( const Vector3& position, const Quaternion& orientation ) { m_position = position; m_orientation = orientation; }
+			void SetSpeeds( Units::Speed forwardSpeed, Units::RadialSpeed yawRate ) { m_forwardSpeed = forwardSpeed; m_yawRate = yawRate; }
+
+		private:
+			VehicleID m_id;
+			String    m_name;
+			bool      m_inputEnabled;
+			bool      m_externallyControlled;
+			Controller::ControllerPtr m_pController;
+			Vector3    m_position;
+			Quaternion m_orientation;
+			Units::Speed       m_forwardSpeed;
+			Units::RadialSpeed m_yawRate;
+		};
+	}
+}
+
+#endif // Headless_Vehicle_h__
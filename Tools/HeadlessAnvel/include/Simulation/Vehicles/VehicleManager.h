@@ -0,0 +1,38 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// VehicleManager.h - Headless stand-in for ANVEL's Vehicles::Manager.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_VehicleManager_h__
+#define Headless_VehicleManager_h__
+
+#include "Simulation/Vehicles/Vehicle.h"
+
+namespace VANE
+{
+	namespace Vehicles
+	{
+		///Owns the vehicles created through it
+		class Manager
+		{
+		public:
+			static Manager& GetSingleton();
+
+			///Headless only: add a vehicle with no body or dynamics
+			Vehicle* CreateVehicle( const String& name );
+			void ClearVehicles();
+
+			Vehicle* GetVehicle( VehicleID id );
+			Vehicle* GetVehicle( const String& name );
+
+		private:
+			Manager() : m_vehicleCount( 0 ) { }
+
+			std::vector< SharedPtr<Vehicle> > m_vehicles;
+			VaneID m_vehicleCount;
+		};
+	}
+}
+
+#endif // Headless_VehicleManager_h__
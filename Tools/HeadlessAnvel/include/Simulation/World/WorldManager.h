@@ -0,0 +1,12 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// WorldManager.h - Headless stand-in, the plugins use nothing from it.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef Headless_WorldManager_h__
+#define Headless_WorldManager_h__
+
+#include "Core/Core.h"
+
+#endif // Headless_WorldManager_h__
@@ -0,0 +1,713 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// JpegBench - Throughput, size and quality benchmark for jpge.
+//
+// Encodes synthetic content (flat, noisy and a rendered looking "natural"
+// scene) and any captured frames given with -frames, across resolutions,
+// qualities, subsampling modes, one or two passes and the three ways of
+// driving the encoder:
+//   memory  compress_image_to_jpeg_file_in_memory
+//   buffer  jpeg_encoder into a growable output_buffer with a FrameArena
+//   stream  jpeg_encoder into an output_stream
+// and prints MPix/s, bytes per frame and PSNR (decoded with libjpeg) for
+// each case. All three paths must produce the same bytes, which is checked
+// on every run.
+//
+// To validate an optimization, record the output of the current encoder
+// first and compare against it afterwards. Synthetic content is generated
+// from a fixed seed, so the hashes are stable across machines:
+//   JpegBench -write-baseline before.txt
+//   (change jpge.cpp, rebuild)
+//   JpegBench -check-baseline before.txt
+//
+// Captured frames are binary PPM (P6) files, e.g. a lens frame saved from
+// the ring or converted with "ffmpeg -i frame.png frame.ppm". They are only
+// encoded at their own resolution.
+//
+// Built with -DJPGE_PROFILE, each case is also encoded again with jpge's
+// profiling counters attached and prints how the encoder's cycles split
+// between color conversion, block loads, DCT, quantization, entropy coding,
+// flushes and the rest, with cycles, nonzero coefficients and output bits
+// per block. The profiled runs are not part of MPix/s.
+//
+// Usage:
+//   JpegBench [-sizes 320x240,...] [-quality 50,85,95] [-subsampling y,h1v1,h2v1,h2v2]
+//             [-passes 1,2] [-content flat,noise,natural] [-api memory,buffer,stream]
+//             [-frames a.ppm,b.ppm] [-seconds s] [-write-baseline file] [-check-baseline file]
+//
+// Linux:   g++ -O2 -I../../SensorPlugin JpegBench.cpp ../../SensorPlugin/jpge.cpp
+//              ../../SensorPlugin/FrameArena.cpp -ljpeg -o JpegBench
+//          (add -DJPGE_PROFILE for the stage breakdown)
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "jpge.h"
+#include "FrameArena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <jpeglib.h>
+
+using namespace VANE;
+
+//////////////////////////////////////////////////////////////////////////
+
+struct Image
+{
+	std::string name;
+	int width;
+	int height;
+	std::vector<uint8_t> pixels; ///< RGB
+};
+
+struct BenchOptions
+{
+	BenchOptions()
+		: seconds( 0.5 )
+	{
+	}
+
+	std::vector<std::string> sizes;
+	std::vector<std::string> qualities;
+	std::vector<std::string> subsamplings;
+	std::vector<std::string> passes;
+	std::vector<std::string> contents;
+	std::vector<std::string> apis;
+	std::vector<std::string> frames;
+	double seconds;
+	std::string writeBaseline;
+	std::string checkBaseline;
+};
+
+static std::vector<std::string> SplitList( const std::string& list )
+{
+	std::vector<std::string> items;
+	size_t start = 0;
+	while ( start <= list.size() )
+	{
+		size_t end = list.find( ',', start );
+		if ( end == std::string::npos )
+			end = list.size();
+		if ( end > start )
+			items.push_back( list.substr( start, end - start ) );
+		start = end + 1;
+	}
+	return items;
+}
+
+static bool ParseOptions( int argc, char** argv, BenchOptions& options )
+{
+	options.sizes = SplitList( "320x240,640x480,1280x720,1920x1080,3840x2160" );
+	options.qualities = SplitList( "50,85,95" );
+	options.subsamplings = SplitList( "y,h1v1,h2v1,h2v2" );
+	options.passes = SplitList( "1,2" );
+	options.contents = SplitList( "flat,noise,natural" );
+	options.apis = SplitList( "memory,buffer,stream" );
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		std::string arg = argv[i];
+		if ( i + 1 >= argc )
+			return false;
+
+		if ( arg == "-sizes" )
+			options.sizes = SplitList( argv[++i] );
+		else if ( arg == "-quality" )
+			options.qualities = SplitList( argv[++i] );
+		else if ( arg == "-subsampling" )
+			options.subsamplings = SplitList( argv[++i] );
+		else if ( arg == "-passes" )
+			options.passes = SplitList( argv[++i] );
+		else if ( arg == "-content" )
+			options.contents = SplitList( argv[++i] );
+		else if ( arg == "-api" )
+			options.apis = SplitList( argv[++i] );
+		else if ( arg == "-frames" )
+			options.frames = SplitList( argv[++i] );
+		else if ( arg == "-seconds" )
+			options.seconds = atof( argv[++i] );
+		else if ( arg == "-write-baseline" )
+			options.writeBaseline = argv[++i];
+		else if ( arg == "-check-baseline" )
+			options.checkBaseline = argv[++i];
+		else
+			return false;
+	}
+
+	return options.seconds >= 0 && !options.apis.empty();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Content
+
+///Small deterministic generator so synthetic frames are identical everywhere
+class Random
+{
+public:
+	explicit Random( uint32_t seed ) : m_state( seed ? seed : 1 ) { }
+
+	uint32_t Next()
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return m_state;
+	}
+
+private:
+	uint32_t m_state;
+};
+
+static inline uint8_t Clamp( int v )
+{
+	return static_cast<uint8_t>( v < 0 ? 0 : (v > 255 ? 255 : v) );
+}
+
+///Lattice value noise in [0, 255], smooth over roughly cell pixels
+static int ValueNoise( int x, int y, int cell, uint32_t seed )
+{
+	const int cx = x / cell, cy = y / cell;
+	const int fx = (x % cell) * 256 / cell, fy = (y % cell) * 256 / cell;
+
+	int corners[4];
+	for ( int i = 0; i < 4; ++i )
+	{
+		uint32_t h = (cx + (i & 1)) * 374761393u + (cy + (i >> 1)) * 668265263u + seed * 2246822519u;
+		h = (h ^ (h >> 13)) * 1274126177u;
+		corners[i] = (h ^ (h >> 16)) & 0xFF;
+	}
+
+	const int top = corners[0] + (corners[1] - corners[0]) * fx / 256;
+	const int bottom = corners[2] + (corners[3] - corners[2]) * fx / 256;
+	return top + (bottom - top) * fy / 256;
+}
+
+static void MakeFlat( Image& image )
+{
+	//A few large untextured regions, like an empty sky over a plain ground plane
+	for ( int y = 0; y < image.height; ++y )
+	{
+		uint8_t* pRow = &image.pixels[y * image.width * 3];
+		const bool sky = y < image.height / 2;
+		for ( int x = 0; x < image.width; ++x )
+		{
+			pRow[x * 3 + 0] = sky ? 120 : 90;
+			pRow[x * 3 + 1] = sky ? 160 : 110;
+			pRow[x * 3 + 2] = sky ? 220 : 70;
+		}
+	}
+}
+
+static void MakeNoise( Image& image )
+{
+	//Worst case for the entropy coder
+	Random random( 12345 );
+	for ( size_t i = 0; i < image.pixels.size(); ++i )
+		image.pixels[i] = static_cast<uint8_t>( random.Next() >> 24 );
+}
+
+static void MakeNatural( Image& image )
+{
+	//Sky gradient, textured terrain, some hard edged objects and fine detail, scaled with the resolution
+	const int scale = image.width / 160 > 1 ? image.width / 160 : 1;
+	Random random( 777 );
+
+	for ( int y = 0; y < image.height; ++y )
+	{
+		uint8_t* pRow = &image.pixels[y * image.width * 3];
+		const int horizon = image.height * 2 / 5;
+		for ( int x = 0; x < image.width; ++x )
+		{
+			int r, g, b;
+			if ( y < horizon )
+			{
+				const int t = y * 255 / horizon;
+				const int cloud = ValueNoise( x, y, 24 * scale, 1 ) > 170 ? 40 : 0;
+				r = 90 + t / 4 + cloud; g = 140 + t / 5 + cloud; b = 230 - t / 6 + cloud / 2;
+			}
+			else
+			{
+				const int coarse = ValueNoise( x, y, 16 * scale, 2 );
+				const int fine = ValueNoise( x, y, 2 + scale / 2, 3 );
+				const int shade = (y - horizon) * 60 / (image.height - horizon);
+				r = 70 + coarse / 4 + fine / 6 + shade; g = 90 + coarse / 3 + fine / 6 + shade; b = 40 + coarse / 6 + shade / 2;
+			}
+			pRow[x * 3 + 0] = Clamp( r );
+			pRow[x * 3 + 1] = Clamp( g );
+			pRow[x * 3 + 2] = Clamp( b );
+		}
+	}
+
+	for ( int i = 0; i < 12; ++i )
+	{
+		const int w = (random.Next() % 40 + 10) * scale, h = (random.Next() % 30 + 10) * scale;
+		const int x0 = random.Next() % image.width, y0 = image.height / 3 + random.Next() % (image.height * 2 / 3);
+		const uint8_t r = random.Next() >> 24, g = random.Next() >> 24, b = random.Next() >> 24;
+		for ( int y = y0; y < y0 + h && y < image.height; ++y )
+		{
+			for ( int x = x0; x < x0 + w && x < image.width; ++x )
+			{
+				uint8_t* p = &image.pixels[(y * image.width + x) * 3];
+				const int edge = (x == x0 || y == y0) ? 40 : 0;
+				p[0] = Clamp( r - edge ); p[1] = Clamp( g - edge ); p[2] = Clamp( b - edge );
+			}
+		}
+	}
+}
+
+static bool MakeSynthetic( const std::string& content, int width, int height, Image& image )
+{
+	image.width = width;
+	image.height = height;
+	image.pixels.assign( static_cast<size_t>(width) * height * 3, 0 );
+
+	char name[64];
+	sprintf( name, "%s_%dx%d", content.c_str(), width, height );
+	image.name = name;
+
+	if ( content == "flat" )
+		MakeFlat( image );
+	else if ( content == "noise" )
+		MakeNoise( image );
+	else if ( content == "natural" )
+		MakeNatural( image );
+	else
+		return false;
+	return true;
+}
+
+static bool LoadPpm( const std::string& file, Image& image )
+{
+	FILE* pFile = fopen( file.c_str(), "rb" );
+	if ( !pFile )
+		return false;
+
+	int maxValue = 0;
+	bool ok = fscanf( pFile, "P6 %d %d %d", &image.width, &image.height, &maxValue ) == 3 && fgetc( pFile ) != EOF
+		&& image.width > 0 && image.height > 0 && maxValue == 255;
+	if ( ok )
+	{
+		image.pixels.resize( static_cast<size_t>(image.width) * image.height * 3 );
+		ok = fread( &image.pixels[0], 1, image.pixels.size(), pFile ) == image.pixels.size();
+	}
+	fclose( pFile );
+
+	size_t slash = file.find_last_of( "/\\" );
+	image.name = slash == std::string::npos ? file : file.substr( slash + 1 );
+	return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Encoding
+
+class VectorStream : public jpge::output_stream
+{
+public:
+	explicit VectorStream( std::vector<uint8_t>& output ) : m_output( output ) { }
+
+	virtual bool put_buf( const void* pBuf, int len )
+	{
+		const uint8_t* pBytes = static_cast<const uint8_t*>( pBuf );
+		m_output.insert( m_output.end(), pBytes, pBytes + len );
+		return true;
+	}
+
+private:
+	VectorStream& operator=( const VectorStream& );
+
+	std::vector<uint8_t>& m_output;
+};
+
+static bool GrowVector( jpge::output_buffer& buffer, jpge::uint minCapacity )
+{
+	std::vector<uint8_t>& output = *static_cast<std::vector<uint8_t>*>( buffer.m_pUser );
+	output.resize( minCapacity > output.size() * 2 ? minCapacity : output.size() * 2 );
+	buffer.m_pBuf = &output[0];
+	buffer.m_capacity = static_cast<jpge::uint>( output.size() );
+	return true;
+}
+
+static bool FeedScanlines( jpge::jpeg_encoder& encoder, const Image& image )
+{
+	for ( jpge::uint pass = 0; pass < encoder.get_total_passes(); ++pass )
+	{
+		for ( int y = 0; y < image.height; ++y )
+		{
+			if ( !encoder.process_scanline( &image.pixels[y * image.width * 3] ) )
+				return false;
+		}
+		if ( !encoder.process_scanline( NULL ) )
+			return false;
+	}
+	return true;
+}
+
+static bool Encode( const std::string& api, const Image& image, const jpge::params& params, FrameArena& arena, std::vector<uint8_t>& output )
+{
+	if ( api == "memory" )
+	{
+		int size = image.width * image.height * 3 + 1024;
+		output.resize( size );
+		if ( !jpge::compress_image_to_jpeg_file_in_memory( &output[0], size, image.width, image.height, 3, &image.pixels[0], params ) )
+			return false;
+		output.resize( size );
+		return true;
+	}
+
+	if ( api == "buffer" )
+	{
+		if ( output.size() < 4096 )
+			output.resize( 4096 );
+		jpge::output_buffer buffer( &output[0], static_cast<jpge::uint>( output.size() ) );
+		buffer.m_pGrow = GrowVector;
+		buffer.m_pUser = &output;
+
+		arena.Reset();
+		jpge::jpeg_encoder encoder;
+		encoder.set_allocator( &arena );
+		if ( !encoder.init( &buffer, image.width, image.height, 3, params ) || !FeedScanlines( encoder, image ) )
+			return false;
+		output.resize( buffer.m_size );
+		return true;
+	}
+
+	if ( api == "stream" )
+	{
+		output.clear();
+		VectorStream stream( output );
+		jpge::jpeg_encoder encoder;
+		return encoder.init( &stream, image.width, image.height, 3, params ) && FeedScanlines( encoder, image );
+	}
+
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Measurement
+
+static double Now()
+{
+	timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static uint64_t HashBytes( const std::vector<uint8_t>& data )
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for ( size_t i = 0; i < data.size(); ++i )
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	return hash;
+}
+
+struct DecodeError
+{
+	jpeg_error_mgr base;
+	jmp_buf jump;
+};
+
+static void OnDecodeError( j_common_ptr pInfo )
+{
+	longjmp( reinterpret_cast<DecodeError*>( pInfo->err )->jump, 1 );
+}
+
+///PSNR of the decoded image against the source, against its luma for grey output. -1 if it does not decode.
+static double ComputePsnr( const Image& image, const std::vector<uint8_t>& jpeg )
+{
+	jpeg_decompress_struct info;
+	DecodeError error;
+	info.err = jpeg_std_error( &error.base );
+	error.base.error_exit = OnDecodeError;
+	if ( setjmp( error.jump ) )
+	{
+		jpeg_destroy_decompress( &info );
+		return -1;
+	}
+
+	jpeg_create_decompress( &info );
+	jpeg_mem_src( &info, const_cast<unsigned char*>( &jpeg[0] ), static_cast<unsigned long>( jpeg.size() ) );
+	jpeg_read_header( &info, TRUE );
+	info.dct_method = JDCT_ISLOW;
+	jpeg_start_decompress( &info );
+
+	const int channels = info.output_components;
+	std::vector<uint8_t> row( info.output_width * channels );
+	double squaredError = 0;
+	while ( info.output_scanline < info.output_height )
+	{
+		const int y = info.output_scanline;
+		JSAMPROW pRow = &row[0];
+		jpeg_read_scanlines( &info, &pRow, 1 );
+
+		const uint8_t* pSrc = &image.pixels[y * image.width * 3];
+		for ( int x = 0; x < image.width; ++x, pSrc += 3 )
+		{
+			if ( channels == 1 )
+			{
+				//Same fixed point weights jpge uses
+				const int luma = (pSrc[0] * 19595 + pSrc[1] * 38470 + pSrc[2] * 7471 + 32768) >> 16;
+				const double d = row[x] - luma;
+				squaredError += d * d;
+			}
+			else
+			{
+				for ( int c = 0; c < 3; ++c )
+				{
+					const double d = row[x * 3 + c] - pSrc[c];
+					squaredError += d * d;
+				}
+			}
+		}
+	}
+
+	jpeg_finish_decompress( &info );
+	jpeg_destroy_decompress( &info );
+
+	const double mse = squaredError / (static_cast<double>(image.width) * image.height * (channels == 1 ? 1 : 3));
+	return mse > 0 ? 10.0 * log10( 255.0 * 255.0 / mse ) : 99.0;
+}
+
+static bool ParseSubsampling( const std::string& name, jpge::subsampling_t& subsampling )
+{
+	if ( name == "y" )
+		subsampling = jpge::Y_ONLY;
+	else if ( name == "h1v1" )
+		subsampling = jpge::H1V1;
+	else if ( name == "h2v1" )
+		subsampling = jpge::H2V1;
+	else if ( name == "h2v2" )
+		subsampling = jpge::H2V2;
+	else
+		return false;
+	return true;
+}
+
+#ifdef JPGE_PROFILE
+///Encode through an output_buffer with a profile attached for the time budget, then print where the cycles went
+static bool PrintProfile( const Image& image, const jpge::params& params, FrameArena& arena, double seconds )
+{
+	jpge::profile profile;
+	std::vector<uint8_t> output( 4096 );
+	const double start = Now();
+	do
+	{
+		jpge::output_buffer buffer( &output[0], static_cast<jpge::uint>( output.size() ) );
+		buffer.m_pGrow = GrowVector;
+		buffer.m_pUser = &output;
+
+		arena.Reset();
+		jpge::jpeg_encoder encoder;
+		encoder.set_allocator( &arena );
+		encoder.set_profile( &profile );
+		if ( !encoder.init( &buffer, image.width, image.height, 3, params ) || !FeedScanlines( encoder, image ) )
+			return false;
+	} while ( Now() - start < seconds );
+
+	jpge::uint64 total = 0;
+	for ( int i = 0; i < jpge::PROFILE_NUM_STAGES; ++i )
+		total += profile.m_cycles[i];
+	if ( !total || !profile.m_blocks )
+		return false;
+
+	printf( "  stages:" );
+	for ( int i = 0; i < jpge::PROFILE_NUM_STAGES; ++i )
+		printf( " %s %.1f%%", jpge::get_profile_stage_name( i ), 100.0 * profile.m_cycles[i] / total );
+
+	const double blocks = static_cast<double>( profile.m_blocks );
+	printf( "\n  %.0f cycles/block, %.1f nonzero coefficients/block, %.1f bits/block, %.1f flushes/image\n",
+		total / blocks, profile.m_nonzero_coefficients / blocks, profile.m_output_bytes * 8.0 / blocks,
+		profile.m_flushes / static_cast<double>( profile.m_images ) );
+	return true;
+}
+#endif
+
+static std::map<std::string, uint64_t> LoadBaseline( const std::string& file )
+{
+	std::map<std::string, uint64_t> baseline;
+	FILE* pFile = fopen( file.c_str(), "r" );
+	if ( !pFile )
+		return baseline;
+
+	char key[256];
+	unsigned long long hash;
+	while ( fscanf( pFile, "%255s %llx", key, &hash ) == 2 )
+		baseline[key] = hash;
+	fclose( pFile );
+	return baseline;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+	BenchOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		printf( "Usage: JpegBench [-sizes 320x240,...] [-quality 50,85,95] [-subsampling y,h1v1,h2v1,h2v2]\n"
+			"                 [-passes 1,2] [-content flat,noise,natural] [-api memory,buffer,stream]\n"
+			"                 [-frames a.ppm,b.ppm] [-seconds s] [-write-baseline file] [-check-baseline file]\n" );
+		return 1;
+	}
+
+	std::vector<Image> images;
+	for ( size_t c = 0; c < options.contents.size(); ++c )
+	{
+		for ( size_t s = 0; s < options.sizes.size(); ++s )
+		{
+			int width = 0, height = 0;
+			Image image;
+			if ( sscanf( options.sizes[s].c_str(), "%dx%d", &width, &height ) != 2 || width <= 0 || height <= 0
+				|| !MakeSynthetic( options.contents[c], width, height, image ) )
+			{
+				printf( "Bad content or size: %s %s\n", options.contents[c].c_str(), options.sizes[s].c_str() );
+				return 1;
+			}
+			images.push_back( image );
+		}
+	}
+	for ( size_t f = 0; f < options.frames.size(); ++f )
+	{
+		Image image;
+		if ( !LoadPpm( options.frames[f], image ) )
+		{
+			printf( "Could not read %s, expected a binary PPM (P6)\n", options.frames[f].c_str() );
+			return 1;
+		}
+		images.push_back( image );
+	}
+
+	std::map<std::string, uint64_t> baseline;
+	if ( !options.checkBaseline.empty() )
+	{
+		baseline = LoadBaseline( options.checkBaseline );
+		if ( baseline.empty() )
+		{
+			printf( "Could not read baseline %s\n", options.checkBaseline.c_str() );
+			return 1;
+		}
+	}
+	FILE* pBaselineOut = NULL;
+	if ( !options.writeBaseline.empty() && !(pBaselineOut = fopen( options.writeBaseline.c_str(), "w" )) )
+	{
+		printf( "Could not write baseline %s\n", options.writeBaseline.c_str() );
+		return 1;
+	}
+
+	printf( "%-28s %4s %5s %5s %-7s %9s %10s %7s\n", "image", "q", "ss", "pass", "api", "MPix/s", "bytes", "PSNR" );
+
+	FrameArena arena;
+	std::vector<uint8_t> output, reference;
+	int failures = 0, mismatches = 0, checked = 0;
+
+	for ( size_t i = 0; i < images.size(); ++i )
+	{
+		const Image& image = images[i];
+		const double megapixels = image.width * static_cast<double>( image.height ) / 1e6;
+
+		for ( size_t q = 0; q < options.qualities.size(); ++q )
+		for ( size_t s = 0; s < options.subsamplings.size(); ++s )
+		for ( size_t p = 0; p < options.passes.size(); ++p )
+		{
+			jpge::params params;
+			params.m_quality = atoi( options.qualities[q].c_str() );
+			params.m_two_pass_flag = options.passes[p] == "2";
+			if ( !ParseSubsampling( options.subsamplings[s], params.m_subsampling ) || !params.check() )
+			{
+				printf( "Bad quality or subsampling: %s %s\n", options.qualities[q].c_str(), options.subsamplings[s].c_str() );
+				return 1;
+			}
+
+			char key[256];
+			sprintf( key, "%s/q%d/%s/p%s", image.name.c_str(), params.m_quality, options.subsamplings[s].c_str(), options.passes[p].c_str() );
+
+			for ( size_t a = 0; a < options.apis.size(); ++a )
+			{
+				const std::string& api = options.apis[a];
+
+				//Warm up, then repeat until the time budget is used
+				if ( !Encode( api, image, params, arena, output ) )
+				{
+					printf( "%-28s %4d %5s %5s %-7s FAILED\n", image.name.c_str(), params.m_quality,
+						options.subsamplings[s].c_str(), options.passes[p].c_str(), api.c_str() );
+					++failures;
+					continue;
+				}
+
+				int iterations = 0;
+				const double start = Now();
+				double elapsed = 0;
+				do
+				{
+					Encode( api, image, params, arena, output );
+					++iterations;
+					elapsed = Now() - start;
+				} while ( elapsed < options.seconds );
+
+				const double psnr = ComputePsnr( image, output );
+				printf( "%-28s %4d %5s %5s %-7s %9.1f %10u %7.2f\n", image.name.c_str(), params.m_quality,
+					options.subsamplings[s].c_str(), options.passes[p].c_str(), api.c_str(),
+					megapixels * iterations / elapsed, static_cast<unsigned>( output.size() ), psnr );
+				if ( psnr < 0 )
+					++failures;
+
+				//Every way of driving the encoder has to give the same bytes
+				if ( a == 0 )
+				{
+					reference = output;
+				}
+				else if ( output != reference )
+				{
+					printf( "  MISMATCH: %s differs from %s\n", api.c_str(), options.apis[0].c_str() );
+					++mismatches;
+				}
+			}
+
+#ifdef JPGE_PROFILE
+			if ( !PrintProfile( image, params, arena, options.seconds ) )
+			{
+				printf( "  profile FAILED\n" );
+				++failures;
+			}
+#endif
+
+			const uint64_t hash = HashBytes( reference );
+			if ( pBaselineOut )
+				fprintf( pBaselineOut, "%s %016llx\n", key, static_cast<unsigned long long>( hash ) );
+
+			if ( !baseline.empty() )
+			{
+				std::map<std::string, uint64_t>::const_iterator it = baseline.find( key );
+				if ( it == baseline.end() )
+				{
+					printf( "  not in baseline: %s\n", key );
+				}
+				else
+				{
+					++checked;
+					if ( it->second != hash )
+					{
+						printf( "  MISMATCH: %s differs from the baseline\n", key );
+						++mismatches;
+					}
+				}
+			}
+		}
+	}
+
+	if ( pBaselineOut )
+		fclose( pBaselineOut );
+
+	if ( !baseline.empty() )
+		printf( "%d cases checked against %s\n", checked, options.checkBaseline.c_str() );
+	printf( "%d failures, %d mismatches\n", failures, mismatches );
+	return failures || mismatches ? 1 : 0;
+}
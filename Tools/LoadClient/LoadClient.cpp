@@ -0,0 +1,740 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LoadClient - Emulates many Android viewers and controllers at once.
+//
+// Opens concurrent sessions against the plugin endpoints and talks to them
+// the way the Android app does (ZeroMQReceive / ZeroMQSend):
+//
+//   viewer      PAIR socket connected to the video port (9000) that reads
+//               frames, or a DatagramVideo subscriber with -udp. Chunked
+//               frames (streamChunkSize) are reassembled. Every frame is
+//               validated: JPEG marker structure and size, QOI header and
+//               end marker, tiles container and every patch in it, or an
+//               H.264 start code.
+//   controller  PAIR socket connected to the control port (5555) that answers
+//               each request from ZMQVideo with the current direction. The
+//               direction changes at the -commands rate.
+//
+// -slow makes the first -slow-count viewers (all of them by default) take
+// that long over every frame, like a phone that decodes too slowly, and
+// -hwm limits how many frames ZMQ queues for them. -ramp spreads the
+// session starts over that many seconds.
+//
+// For every session it reports throughput, invalid frames, the gaps between
+// frames and, over UDP, frames lost and concealed. For controllers it reports
+// the interval between requests and how long a new command waited before the
+// plugin picked it up.
+//
+// Viewer n and controller n act as one phone. The controller takes part in
+// the clock exchange on the control channel (ClockSync.h) and the viewer uses
+// the result to turn the capture timestamps at the end of each JPEG frame into
+// end to end latency and jitter, which the controller reports back to ZMQVideo.
+// -legacy answers with bare directions like the original app, so there is no
+// clock to measure latency with. -invalid n makes every nth answer carry a
+// direction ZMQVideo does not know, like a misbehaving client.
+//
+// -stats subscribes to the streaming stats SampleSensor publishes on that port
+// (statsPort, StreamStats.h) and prints the last window it received.
+//
+// Both plugin endpoints are ZMQ PAIR sockets, which talk to one peer at a
+// time. Extra ZMQ sessions stay connected but receive nothing, which shows
+// up as sessions with no frames or requests. The UDP transport serves every
+// subscriber.
+//
+// Usage:
+//   LoadClient -server host [-viewers n] [-controllers n] [-udp] [-video-port p]
+//              [-control-port p] [-seconds s] [-ramp s] [-slow ms] [-slow-count n]
+//              [-hwm n] [-commands hz] [-reply-delay ms] [-legacy] [-stats port]
+//              [-invalid n]
+//
+// Windows: build LoadClient.vcxproj from the solution.
+// Linux:   g++ -O2 -std=c++11 -I../../SensorPlugin LoadClient.cpp ../../SensorPlugin/DatagramVideo.cpp
+//              ../../SensorPlugin/ClockSync.cpp ../../SensorPlugin/StreamStats.cpp -lzmq -lpthread -o LoadClient
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "zmq.hpp"
+#include "DatagramVideo.h"
+#include "FrameCodec.h"
+#include "ClockSync.h"
+#include "StreamStats.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace VANE;
+
+//////////////////////////////////////////////////////////////////////////
+
+struct LoadOptions
+{
+	LoadOptions()
+		: viewers( 1 )
+		, controllers( 0 )
+		, udp( false )
+		, videoPort( 0 )
+		, controlPort( 5555 )
+		, seconds( 10 )
+		, ramp( 0 )
+		, slowMs( 0 )
+		, slowCount( -1 )
+		, hwm( 0 )
+		, commandRate( 2 )
+		, replyDelayMs( 0 )
+		, legacy( false )
+		, statsPort( 0 )
+		, invalidEvery( 0 )
+	{
+	}
+
+	std::string server;
+	int viewers;
+	int controllers;
+	bool udp;
+	int videoPort;    ///< 0 picks 9000 for ZMQ and 9001 for UDP
+	int controlPort;
+	double seconds;
+	double ramp;
+	int slowMs;
+	int slowCount;    ///< Viewers that are slow, -1 for all of them
+	int hwm;          ///< ZMQ receive high water mark, 0 keeps the default
+	double commandRate;
+	int replyDelayMs;
+	bool legacy;      ///< No clock exchange
+	int statsPort;    ///< 0 for no stats subscriber
+	int invalidEvery; ///< Controllers send an unknown direction every nth answer, 0 for never
+};
+
+static bool ParseOptions( int argc, char** argv, LoadOptions& options )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		std::string arg = argv[i];
+
+		if ( arg == "-udp" )
+		{
+			options.udp = true;
+			continue;
+		}
+		if ( arg == "-legacy" )
+		{
+			options.legacy = true;
+			continue;
+		}
+
+		if ( i + 1 >= argc )
+			return false;
+
+		std::string value = argv[++i];
+		if ( arg == "-server" )
+			options.server = value;
+		else if ( arg == "-viewers" )
+			options.viewers = atoi( value.c_str() );
+		else if ( arg == "-controllers" )
+			options.controllers = atoi( value.c_str() );
+		else if ( arg == "-video-port" )
+			options.videoPort = atoi( value.c_str() );
+		else if ( arg == "-control-port" )
+			options.controlPort = atoi( value.c_str() );
+		else if ( arg == "-seconds" )
+			options.seconds = atof( value.c_str() );
+		else if ( arg == "-ramp" )
+			options.ramp = atof( value.c_str() );
+		else if ( arg == "-slow" )
+			options.slowMs = atoi( value.c_str() );
+		else if ( arg == "-slow-count" )
+			options.slowCount = atoi( value.c_str() );
+		else if ( arg == "-hwm" )
+			options.hwm = atoi( value.c_str() );
+		else if ( arg == "-commands" )
+			options.commandRate = atof( value.c_str() );
+		else if ( arg == "-reply-delay" )
+			options.replyDelayMs = atoi( value.c_str() );
+		else if ( arg == "-stats" )
+			options.statsPort = atoi( value.c_str() );
+		else if ( arg == "-invalid" )
+			options.invalidEvery = atoi( value.c_str() );
+		else
+			return false;
+	}
+
+	if ( options.videoPort == 0 )
+		options.videoPort = options.udp ? 9001 : 9000;
+
+	return !options.server.empty() && options.viewers >= 0 && options.controllers >= 0
+		&& options.viewers + options.controllers > 0 && options.seconds > 0 && options.commandRate > 0;
+}
+
+static double Now()
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void SleepMs( double ms )
+{
+	if ( ms > 0 )
+		std::this_thread::sleep_for( std::chrono::duration<double, std::milli>( ms ) );
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Frame validation
+
+static inline uint32_t Get16BE( const uint8_t* p ) { return (p[0] << 8) | p[1]; }
+static inline uint32_t Get32BE( const uint8_t* p ) { return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static inline uint32_t Get16LE( const uint8_t* p ) { return p[0] | (p[1] << 8); }
+static inline uint32_t Get32LE( const uint8_t* p ) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+///SOI, well formed marker segments up to a frame header and a scan, and EOI at the end
+static bool ValidateJpeg( const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height )
+{
+	if ( size < 4 || pData[0] != 0xFF || pData[1] != 0xD8 || pData[size - 2] != 0xFF || pData[size - 1] != 0xD9 )
+		return false;
+
+	bool haveFrame = false;
+	size_t pos = 2;
+	while ( pos + 4 <= size )
+	{
+		if ( pData[pos] != 0xFF )
+			return false;
+
+		uint8_t marker = pData[pos + 1];
+		uint32_t length = Get16BE( pData + pos + 2 );
+		if ( length < 2 || pos + 2 + length > size )
+			return false;
+
+		if ( marker >= 0xC0 && marker <= 0xC3 && length >= 7 )
+		{
+			height = Get16BE( pData + pos + 5 );
+			width = Get16BE( pData + pos + 7 );
+			haveFrame = width > 0 && height > 0;
+		}
+		else if ( marker == 0xDA )
+		{
+			return haveFrame;
+		}
+		pos += 2 + length;
+	}
+	return false;
+}
+
+static bool ValidateQoi( const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height )
+{
+	static const uint8_t kEnd[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	if ( size < 14 + 8 || memcmp( pData, "qoif", 4 ) != 0 || memcmp( pData + size - 8, kEnd, 8 ) != 0 )
+		return false;
+
+	width = Get32BE( pData + 4 );
+	height = Get32BE( pData + 8 );
+	return width > 0 && height > 0 && (pData[12] == 3 || pData[12] == 4);
+}
+
+///The container from FrameCodec.h, with every patch inside the frame and a valid JPEG
+static bool ValidateTiles( const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height )
+{
+	if ( size < kTileFrameHeaderSize || Get32LE( pData ) != kTileFrameMagic || Get16LE( pData + 4 ) != kTileFrameVersion )
+		return false;
+
+	width = Get32LE( pData + 8 );
+	height = Get32LE( pData + 12 );
+	uint32_t patches = Get32LE( pData + 16 );
+
+	size_t pos = kTileFrameHeaderSize;
+	for ( uint32_t i = 0; i < patches; ++i )
+	{
+		if ( pos + kTilePatchHeaderSize > size )
+			return false;
+
+		uint32_t x = Get16LE( pData + pos );
+		uint32_t y = Get16LE( pData + pos + 2 );
+		uint32_t patchWidth = Get16LE( pData + pos + 4 );
+		uint32_t patchHeight = Get16LE( pData + pos + 6 );
+		uint32_t jpegSize = Get32LE( pData + pos + 8 );
+		pos += kTilePatchHeaderSize;
+
+		uint32_t jpegWidth, jpegHeight;
+		if ( pos + jpegSize > size || x + patchWidth > width || y + patchHeight > height
+			|| !ValidateJpeg( pData + pos, jpegSize, jpegWidth, jpegHeight ) || jpegWidth != patchWidth || jpegHeight != patchHeight )
+		{
+			return false;
+		}
+		pos += jpegSize;
+	}
+	return pos == size;
+}
+
+///@return the codec name, or NULL if the frame is not valid in any of them
+static const char* ValidateFrame( const std::vector<uint8_t>& frame )
+{
+	if ( frame.empty() )
+		return NULL;
+
+	const uint8_t* pData = &frame[0];
+	size_t size = frame.size();
+	uint32_t width = 0, height = 0;
+
+	if ( ValidateJpeg( pData, size, width, height ) )
+		return "jpeg";
+	if ( ValidateQoi( pData, size, width, height ) )
+		return "qoi";
+	if ( ValidateTiles( pData, size, width, height ) )
+		return "tiles";
+	if ( size >= 4 && pData[0] == 0 && pData[1] == 0 && (pData[2] == 1 || (pData[2] == 0 && pData[3] == 1)) )
+		return "h264";
+	return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Sessions
+
+///What the viewer and the controller of one phone share
+struct PhoneClock
+{
+	PhoneClock()
+		: m_synced( false )
+		, m_offset( 0 )
+		, m_hasLatency( false )
+		, m_latency( 0 )
+		, m_jitter( 0 )
+	{
+	}
+
+	std::atomic<bool>    m_synced;
+	std::atomic<int64_t> m_offset;     ///< Our clock - server clock, in microseconds
+	std::atomic<bool>    m_hasLatency;
+	std::atomic<int32_t> m_latency;    ///< Latest frame latency, in microseconds
+	std::atomic<int32_t> m_jitter;
+};
+
+struct SessionStats
+{
+	SessionStats()
+		: m_started( 0 )
+		, m_finished( 0 )
+		, m_frames( 0 )
+		, m_bytes( 0 )
+		, m_invalid( 0 )
+		, m_dropped( 0 )
+		, m_concealed( 0 )
+		, m_pCodec( NULL )
+		, m_slow( false )
+		, m_pClock( NULL )
+		, m_jitter( 0 )
+	{
+	}
+
+	double   m_started;
+	double   m_finished;
+	uint64_t m_frames;    ///< Frames for viewers, requests for controllers
+	uint64_t m_bytes;
+	uint64_t m_invalid;
+	uint64_t m_dropped;
+	uint64_t m_concealed;
+	const char* m_pCodec;
+	bool     m_slow;
+	std::vector<double> m_gaps;   ///< Seconds between frames or requests
+	std::vector<double> m_delays; ///< Controllers: seconds from a new command to the plugin taking it
+	PhoneClock* m_pClock;
+	std::vector<double> m_latencies; ///< Viewers: seconds from capture to the whole frame being here
+	double   m_jitter;               ///< Viewers: smoothed change in latency from frame to frame, as in RTP
+};
+
+///Take the capture timestamps off the end of a frame and work out its latency
+static void MeasureLatency( std::vector<uint8_t>& frame, int64_t received, SessionStats& stats )
+{
+	ClockSync::FrameTimes times;
+	if ( frame.empty() || !ClockSync::ReadTrailer( &frame[0], frame.size(), times ) )
+		return;
+
+	frame.resize( frame.size() - ClockSync::kTrailerSize );
+
+	PhoneClock& clock = *stats.m_pClock;
+	if ( !clock.m_synced )
+		return;
+
+	double latency = (received - (times.m_captured + clock.m_offset)) / 1e6;
+	if ( !stats.m_latencies.empty() )
+		stats.m_jitter += (fabs( latency - stats.m_latencies.back() ) - stats.m_jitter) / 16;
+	stats.m_latencies.push_back( latency );
+
+	clock.m_latency = static_cast<int32_t>( latency * 1e6 );
+	clock.m_jitter = static_cast<int32_t>( stats.m_jitter * 1e6 );
+	clock.m_hasLatency = true;
+}
+
+static void FinishFrame( std::vector<uint8_t>& frame, double& lastFrame, SessionStats& stats )
+{
+	double now = Now();
+	if ( lastFrame > 0 )
+		stats.m_gaps.push_back( now - lastFrame );
+	lastFrame = now;
+
+	MeasureLatency( frame, ClockSync::Now(), stats );
+
+	++stats.m_frames;
+	stats.m_bytes += frame.size();
+
+	const char* pCodec = ValidateFrame( frame );
+	if ( !pCodec )
+		++stats.m_invalid;
+	else
+		stats.m_pCodec = pCodec;
+}
+
+static void RunZmqViewer( const LoadOptions& options, double startAt, SessionStats& stats, const std::atomic<bool>& stop )
+{
+	SleepMs( (startAt - Now()) * 1000 );
+
+	zmq::context_t context( 1 );
+	zmq::socket_t socket( context, ZMQ_PAIR );
+	if ( options.hwm > 0 )
+		socket.setsockopt( ZMQ_RCVHWM, &options.hwm, sizeof(options.hwm) );
+	socket.connect( "tcp://" + options.server + ":" + std::to_string( static_cast<long long>(options.videoPort) ) );
+	stats.m_started = Now();
+
+	std::vector<uint8_t> frame;
+	bool inChunkedFrame = false;
+	double lastFrame = 0;
+	while ( !stop )
+	{
+		zmq_pollitem_t item = { static_cast<void*>( socket ), 0, ZMQ_POLLIN, 0 };
+		if ( zmq::poll( &item, 1, 50 ) <= 0 )
+			continue;
+
+		zmq::message_t message;
+		if ( !socket.recv( &message, ZMQ_DONTWAIT ) || message.size() == 0 )
+			continue;
+
+		const uint8_t* pData = static_cast<const uint8_t*>( message.data() );
+		uint8_t first = pData[0];
+
+		//A whole frame starts with its own magic bytes, a chunk with its flags (see SampleSensor.cpp)
+		if ( first == 0x01 || first == 0x03 || (inChunkedFrame && first <= 0x02) )
+		{
+			if ( first & 0x01 )
+				frame.clear();
+			frame.insert( frame.end(), pData + 1, pData + message.size() );
+			inChunkedFrame = !(first & 0x02);
+			if ( inChunkedFrame )
+				continue;
+		}
+		else
+		{
+			frame.assign( pData, pData + message.size() );
+		}
+
+		FinishFrame( frame, lastFrame, stats );
+		if ( stats.m_slow )
+			SleepMs( options.slowMs );
+	}
+
+	int linger = 0;
+	socket.setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+	stats.m_finished = Now();
+}
+
+static void RunUdpViewer( const LoadOptions& options, double startAt, SessionStats& stats, const std::atomic<bool>& stop )
+{
+	SleepMs( (startAt - Now()) * 1000 );
+
+	DatagramVideo::Address sender;
+	DatagramVideo::Receiver receiver;
+	if ( !DatagramVideo::ResolveAddress( options.server, static_cast<uint16_t>(options.videoPort), sender ) || !receiver.Open( sender ) )
+	{
+		fprintf( stderr, "Failed to open a UDP viewer\n" );
+		return;
+	}
+	stats.m_started = Now();
+
+	std::vector<uint8_t> frame;
+	DatagramVideo::FrameResult result;
+	double lastFrame = 0;
+	while ( !stop )
+	{
+		if ( !receiver.Receive( frame, result, 50 ) )
+			continue;
+
+		FinishFrame( frame, lastFrame, stats );
+		if ( stats.m_slow )
+			SleepMs( options.slowMs );
+	}
+
+	stats.m_dropped = receiver.GetDroppedFrames();
+	stats.m_concealed = receiver.GetConcealedFrames();
+	receiver.Close();
+	stats.m_finished = Now();
+}
+
+struct StatsFeed
+{
+	StatsFeed()
+		: m_messages( 0 )
+		, m_invalid( 0 )
+	{
+	}
+
+	uint64_t m_messages;
+	uint64_t m_invalid;
+	StreamStatsSnapshot m_last;
+};
+
+///Keeps the latest streaming stats window the sensor publishes
+static void RunStatsSubscriber( const LoadOptions& options, StatsFeed& feed, const std::atomic<bool>& stop )
+{
+	zmq::context_t context( 1 );
+	zmq::socket_t socket( context, ZMQ_SUB );
+	int timeout = 100;
+	socket.setsockopt( ZMQ_RCVTIMEO, &timeout, sizeof(timeout) );
+	socket.setsockopt( ZMQ_SUBSCRIBE, "", 0 );
+	socket.connect( "tcp://" + options.server + ":" + std::to_string( static_cast<long long>(options.statsPort) ) );
+
+	while ( !stop )
+	{
+		zmq::message_t message;
+		if ( !socket.recv( &message ) )
+			continue;
+
+		if ( ReadStatsSnapshot( static_cast<const uint8_t*>( message.data() ), message.size(), feed.m_last ) )
+			++feed.m_messages;
+		else
+			++feed.m_invalid;
+	}
+
+	int linger = 0;
+	socket.setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+///Answers every request the way ZeroMQSend does, with the direction currently held,
+///followed by the timestamps for the clock exchange
+static void RunController( const LoadOptions& options, double startAt, int index, SessionStats& stats, const std::atomic<bool>& stop )
+{
+	static const char kCommands[] = "flrbqwets";
+
+	SleepMs( (startAt - Now()) * 1000 );
+
+	zmq::context_t context( 1 );
+	zmq::socket_t socket( context, ZMQ_PAIR );
+	socket.connect( "tcp://" + options.server + ":" + std::to_string( static_cast<long long>(options.controlPort) ) );
+	stats.m_started = Now();
+
+	uint32_t command = index;
+	double commandIssued = stats.m_started;
+	bool commandDelivered = false;
+	double lastRequest = 0;
+	while ( !stop )
+	{
+		double now = Now();
+		if ( now - commandIssued >= 1.0 / options.commandRate )
+		{
+			++command;
+			commandIssued = now;
+			commandDelivered = false;
+		}
+
+		zmq_pollitem_t item = { static_cast<void*>( socket ), 0, ZMQ_POLLIN, 0 };
+		if ( zmq::poll( &item, 1, 20 ) <= 0 )
+			continue;
+
+		zmq::message_t request;
+		if ( !socket.recv( &request, ZMQ_DONTWAIT ) )
+			continue;
+
+		int64_t received = ClockSync::Now();
+		ClockSync::Request syncRequest;
+		bool sync = !options.legacy && ClockSync::ReadRequest( static_cast<const uint8_t*>( request.data() ), request.size(), syncRequest );
+		if ( sync && syncRequest.m_roundTrip > 0 )
+		{
+			stats.m_pClock->m_offset = syncRequest.m_offset;
+			stats.m_pClock->m_synced = true;
+		}
+
+		now = Now();
+		if ( lastRequest > 0 )
+			stats.m_gaps.push_back( now - lastRequest );
+		lastRequest = now;
+		++stats.m_frames;
+
+		SleepMs( options.replyDelayMs );
+
+		char direction = kCommands[command % (sizeof(kCommands) - 1)];
+		if ( options.invalidEvery > 0 && stats.m_frames % options.invalidEvery == 0 )
+			direction = '?';
+		if ( sync )
+		{
+			ClockSync::Reply syncReply;
+			syncReply.m_direction = direction;
+			syncReply.m_requestSent = syncRequest.m_sent;
+			syncReply.m_received = received;
+			syncReply.m_hasLatency = stats.m_pClock->m_hasLatency;
+			syncReply.m_latency = stats.m_pClock->m_latency;
+			syncReply.m_jitter = stats.m_pClock->m_jitter;
+
+			uint8_t data[ClockSync::kReplyWithLatencySize];
+			syncReply.m_replied = ClockSync::Now();
+			size_t size = ClockSync::WriteReply( syncReply, data );
+			zmq::message_t reply( size );
+			memcpy( reply.data(), data, size );
+			socket.send( reply );
+			stats.m_bytes += reply.size();
+		}
+		else
+		{
+			zmq::message_t reply( 2 );
+			char* pReply = static_cast<char*>( reply.data() );
+			pReply[0] = direction;
+			pReply[1] = 0;
+			socket.send( reply );
+			stats.m_bytes += reply.size();
+		}
+
+		if ( !commandDelivered )
+		{
+			stats.m_delays.push_back( Now() - commandIssued );
+			commandDelivered = true;
+		}
+	}
+
+	int linger = 0;
+	socket.setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+	stats.m_finished = Now();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Reporting
+
+static double Percentile( const std::vector<double>& sorted, double p )
+{
+	if ( sorted.empty() )
+		return 0;
+	size_t index = static_cast<size_t>( p * (sorted.size() - 1) + 0.5 );
+	return sorted[std::min( index, sorted.size() - 1 )];
+}
+
+static void PrintTimes( const char* pLabel, std::vector<double> times )
+{
+	if ( times.empty() )
+		return;
+
+	std::sort( times.begin(), times.end() );
+	printf( "    %-12s p50 %7.1f  p90 %7.1f  p99 %7.1f  max %7.1f ms\n", pLabel,
+		Percentile( times, 0.5 ) * 1000, Percentile( times, 0.9 ) * 1000, Percentile( times, 0.99 ) * 1000, times.back() * 1000 );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+	LoadOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		printf( "Usage: LoadClient -server host [-viewers n] [-controllers n] [-udp] [-video-port p]\n"
+			"                  [-control-port p] [-seconds s] [-ramp s] [-slow ms] [-slow-count n]\n"
+			"                  [-hwm n] [-commands hz] [-reply-delay ms] [-legacy] [-stats port]\n"
+			"                  [-invalid n]\n" );
+		return 1;
+	}
+
+	int sessions = options.viewers + options.controllers;
+	std::vector<SessionStats> stats( sessions );
+	std::vector<PhoneClock> clocks( std::max( options.viewers, options.controllers ) );
+	std::vector<std::thread> threads;
+	std::atomic<bool> stop( false );
+
+	StatsFeed statsFeed;
+	if ( options.statsPort > 0 )
+		threads.push_back( std::thread( RunStatsSubscriber, std::cref( options ), std::ref( statsFeed ), std::cref( stop ) ) );
+
+	double start = Now();
+	for ( int i = 0; i < sessions; ++i )
+	{
+		double startAt = start + (sessions > 1 ? options.ramp * i / (sessions - 1) : 0);
+		stats[i].m_pClock = &clocks[i < options.viewers ? i : i - options.viewers];
+		if ( i < options.viewers )
+		{
+			stats[i].m_slow = options.slowMs > 0 && (options.slowCount < 0 || i < options.slowCount);
+			if ( options.udp )
+				threads.push_back( std::thread( RunUdpViewer, std::cref( options ), startAt, std::ref( stats[i] ), std::cref( stop ) ) );
+			else
+				threads.push_back( std::thread( RunZmqViewer, std::cref( options ), startAt, std::ref( stats[i] ), std::cref( stop ) ) );
+		}
+		else
+		{
+			threads.push_back( std::thread( RunController, std::cref( options ), startAt, i - options.viewers, std::ref( stats[i] ), std::cref( stop ) ) );
+		}
+	}
+
+	printf( "%d %s viewer(s) and %d controller(s) against %s for %g s\n", options.viewers, options.udp ? "UDP" : "ZMQ",
+		options.controllers, options.server.c_str(), options.ramp + options.seconds );
+
+	SleepMs( (options.ramp + options.seconds) * 1000 );
+	stop = true;
+	for ( size_t i = 0; i < threads.size(); ++i )
+		threads[i].join();
+
+	//Report
+	uint64_t totalFrames = 0, totalBytes = 0, totalInvalid = 0;
+	int idleSessions = 0;
+	for ( int i = 0; i < sessions; ++i )
+	{
+		const SessionStats& session = stats[i];
+		double active = session.m_finished > session.m_started ? session.m_finished - session.m_started : 0;
+		if ( session.m_frames == 0 )
+			++idleSessions;
+
+		if ( i < options.viewers )
+		{
+			totalFrames += session.m_frames;
+			totalBytes += session.m_bytes;
+			totalInvalid += session.m_invalid;
+
+			printf( "  viewer %-4d %6u frames  %6.1f fps  %7.2f Mbit/s  %s  %u invalid", i, static_cast<uint32_t>( session.m_frames ),
+				active > 0 ? session.m_frames / active : 0.0, active > 0 ? session.m_bytes * 8 / active / 1e6 : 0.0,
+				session.m_pCodec ? session.m_pCodec : "-", static_cast<uint32_t>( session.m_invalid ) );
+			if ( options.udp )
+				printf( "  %u dropped  %u concealed", static_cast<uint32_t>( session.m_dropped ), static_cast<uint32_t>( session.m_concealed ) );
+			printf( "%s\n", session.m_slow ? "  (slow)" : "" );
+			PrintTimes( "frame gap", session.m_gaps );
+			PrintTimes( "latency", session.m_latencies );
+			if ( !session.m_latencies.empty() )
+				printf( "    %-12s %7.1f ms\n", "jitter", session.m_jitter * 1000 );
+		}
+		else
+		{
+			printf( "  control %-3d %6u requests  %6.1f /s\n", i - options.viewers, static_cast<uint32_t>( session.m_frames ),
+				active > 0 ? session.m_frames / active : 0.0 );
+			PrintTimes( "interval", session.m_gaps );
+			PrintTimes( "command age", session.m_delays );
+			if ( session.m_pClock->m_synced )
+				printf( "    %-12s %7.3f ms\n", "clock offset", session.m_pClock->m_offset / 1000.0 );
+		}
+	}
+
+	if ( options.statsPort > 0 )
+	{
+		const StreamStatsSnapshot& last = statsFeed.m_last;
+		printf( "  stats       %u windows, %u invalid\n", static_cast<uint32_t>( statsFeed.m_messages ), static_cast<uint32_t>( statsFeed.m_invalid ) );
+		if ( statsFeed.m_messages > 0 )
+		{
+			printf( "    %-12s %.1f fps  encode p50/p95/p99 %.2f/%.2f/%.2f ms  %.0f B/frame  %.0f kbit/s\n", "last window",
+				last.m_fps, last.m_encodeP50, last.m_encodeP95, last.m_encodeP99, last.m_bytesPerFrame, last.m_bitrateKbps );
+			printf( "    %-12s queue depth %u  %u client(s)  %u sent  %u dropped\n", "", last.m_queueDepth, last.m_clients,
+				static_cast<uint32_t>( last.m_framesSent ), static_cast<uint32_t>( last.m_framesDropped ) );
+			printf( "    %-12s %u connects  %u disconnects  %u ms without a viewer  longest gap %u ms\n", "", last.m_connects,
+				last.m_disconnects, last.m_peerlessMs, last.m_longestGapMs );
+		}
+	}
+
+	printf( "  total       %6u frames  %.2f Mbit/s  %u invalid  %d idle session(s)\n", static_cast<uint32_t>( totalFrames ),
+		totalBytes * 8 / options.seconds / 1e6, static_cast<uint32_t>( totalInvalid ), idleSessions );
+
+	return totalInvalid > 0 ? 1 : 0;
+}
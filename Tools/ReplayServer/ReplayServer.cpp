@@ -0,0 +1,404 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// ReplayServer - Serves a recorded session over the plugin protocol.
+//
+// Plays back a recording made by the sensor plugin (record="base" in the
+// sensor XML, or HeadlessAnvel -record) without ANVEL, so viewers, LoadClient
+// and the Android app can be pointed at the same session again and again:
+//
+//   video    PAIR socket bound like the sensor's (port 9000). Frames are sent
+//            whole, as recorded, and JPEG frames get a fresh timestamp
+//            trailer so clients still measure latency (ClockSync.h).
+//   control  If <base>-control exists (StartControllerRecording), a PAIR
+//            socket bound like ZMQVideo's (port 5555) that sends a clock
+//            request wherever the recording has a command, and takes the
+//            client's replies without waiting for them.
+//
+// Records go out at their recorded simulation time, scaled by -speed; 0 sends
+// them as fast as the sockets take them. -start seeks to a simulation time
+// through the index, without reading the segments before it, and -loop
+// starts over at the end. -info lists what a recording holds and exits.
+// Encoded captures (Capture.h) replay like recordings; raw frames are skipped.
+//
+// Usage:
+//   ReplayServer -recording base [-speed x] [-start seconds] [-loop] [-info]
+//                [-video endpoint] [-control endpoint]
+//
+// Windows: build ReplayServer.vcxproj from the solution.
+// Linux:   g++ -O2 -std=c++11 -I../../SensorPlugin ReplayServer.cpp ../../SensorPlugin/Recording.cpp
+//              ../../SensorPlugin/ClockSync.cpp ../../SensorPlugin/FrameCodec.cpp ../../SensorPlugin/FrameArena.cpp
+//              ../../SensorPlugin/jpge.cpp ../../SensorPlugin/Qoi.cpp -lzmq -o ReplayServer
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "zmq.hpp"
+#include "Recording.h"
+#include "ClockSync.h"
+#include "FrameCodec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+using namespace VANE;
+
+//////////////////////////////////////////////////////////////////////////
+
+struct ReplayOptions
+{
+	ReplayOptions()
+		: speed( 1.0 )
+		, start( 0 )
+		, loop( false )
+		, info( false )
+		, videoEndpoint( "tcp://*:9000" )
+		, controlEndpoint( "tcp://*:5555" )
+	{
+	}
+
+	std::string recording;
+	double speed;    ///< Simulation seconds per second, 0 for as fast as possible
+	double start;    ///< Simulation time to start at, in seconds
+	bool loop;
+	bool info;
+	std::string videoEndpoint;
+	std::string controlEndpoint;
+};
+
+static bool ParseOptions( int argc, char** argv, ReplayOptions& options )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		std::string arg = argv[i];
+		if ( arg == "-loop" )
+		{
+			options.loop = true;
+			continue;
+		}
+		if ( arg == "-info" )
+		{
+			options.info = true;
+			continue;
+		}
+
+		if ( i + 1 >= argc )
+			return false;
+
+		if ( arg == "-recording" )
+			options.recording = argv[++i];
+		else if ( arg == "-speed" )
+			options.speed = atof( argv[++i] );
+		else if ( arg == "-start" )
+			options.start = atof( argv[++i] );
+		else if ( arg == "-video" )
+			options.videoEndpoint = argv[++i];
+		else if ( arg == "-control" )
+			options.controlEndpoint = argv[++i];
+		else
+			return false;
+	}
+
+	return !options.recording.empty() && options.speed >= 0 && options.start >= 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+static const char* GetKindName( uint32_t kind )
+{
+	switch ( kind )
+	{
+	case Recording::kRecordFrame:        return "frames";
+	case Recording::kRecordControl:      return "commands";
+	case Recording::kRecordVehicleState: return "vehicle states";
+	case Recording::kRecordRawFrame:     return "raw frames";
+	case Recording::kRecordControlInput: return "control inputs";
+	default:                             return "unknown records";
+	}
+}
+
+///What a recording holds, from its index alone
+static void PrintInfo( const std::string& base, Recording::Reader& reader )
+{
+	uint64_t count = reader.GetRecordCount();
+	printf( "%s: %u segment(s), %llu records", base.c_str(), reader.GetSegmentCount(), static_cast<unsigned long long>( count ) );
+	if ( reader.GetTruncatedCount() > 0 )
+		printf( ", %llu incomplete at the end", static_cast<unsigned long long>( reader.GetTruncatedCount() ) );
+	printf( "\n" );
+	if ( count == 0 )
+		return;
+
+	Recording::RecordInfo first, last;
+	reader.GetInfo( 0, first );
+	reader.GetInfo( count - 1, last );
+	printf( "  sim time %.3f to %.3f s, recorded over %.3f s\n", first.m_simTime / 1e6, last.m_simTime / 1e6,
+		(last.m_wallTime - first.m_wallTime) / 1e6 );
+
+	//Kind, then lens, format and camera for frames
+	std::map<uint64_t, uint64_t> records;
+	std::map<uint64_t, uint64_t> bytes;
+	for ( uint64_t i = 0; i < count; ++i )
+	{
+		Recording::RecordInfo info;
+		reader.GetInfo( i, info );
+		uint64_t key = static_cast<uint64_t>( info.m_kind ) << 56;
+		if ( info.m_kind == Recording::kRecordFrame || info.m_kind == Recording::kRecordRawFrame )
+			key |= (static_cast<uint64_t>( info.m_lens ) << 40) | (static_cast<uint64_t>( info.m_format ) << 32) | info.m_channel;
+		++records[key];
+		bytes[key] += info.m_size;
+	}
+
+	for ( std::map<uint64_t, uint64_t>::const_iterator it = records.begin(); it != records.end(); ++it )
+	{
+		uint32_t kind = static_cast<uint32_t>( it->first >> 56 );
+		uint32_t lens = static_cast<uint32_t>( (it->first >> 40) & 0xffff );
+		printf( "  %-14s %8llu  %10.1f KB", GetKindName( kind ), static_cast<unsigned long long>( it->second ), bytes[it->first] / 1024.0 );
+		if ( kind == Recording::kRecordFrame )
+		{
+			printf( "  %s, camera %u", GetFrameCodecName( static_cast<FrameCodecType>( (it->first >> 32) & 0xff ) ),
+				static_cast<uint32_t>( it->first & 0xffffffff ) );
+		}
+		else if ( kind == Recording::kRecordRawFrame )
+		{
+			printf( "  camera %u", static_cast<uint32_t>( it->first & 0xffffffff ) );
+		}
+		if ( lens > 0 )
+			printf( ", lens %u", lens );
+		printf( "\n" );
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+struct ReplayStats
+{
+	ReplayStats() : m_framesSent( 0 ), m_framesDropped( 0 ), m_requests( 0 ), m_requestsSkipped( 0 ), m_replies( 0 ), m_late( 0 ) { }
+
+	uint64_t m_framesSent;
+	uint64_t m_framesDropped;    ///< No viewer was connected, or it fell too far behind
+	uint64_t m_requests;
+	uint64_t m_requestsSkipped;  ///< The client had not answered the previous one yet
+	uint64_t m_replies;
+	uint64_t m_late;             ///< Records sent more than a millisecond after they were due
+};
+
+///A frame as the sensor sent it, with a new trailer for JPEG
+static void SendFrame( zmq::socket_t& socket, const Recording::RecordInfo& info, std::vector<uint8_t>& payload, ReplayStats& stats )
+{
+	if ( info.m_format == kFrameCodecJpeg )
+	{
+		ClockSync::FrameTimes times;
+		times.m_captured = ClockSync::Now();
+		times.m_encoded = times.m_captured;
+		times.m_sequence = static_cast<uint32_t>( stats.m_framesSent );
+
+		size_t size = payload.size();
+		payload.resize( size + ClockSync::kTrailerSize );
+		ClockSync::WriteTrailer( times, &payload[size] );
+	}
+
+	zmq::message_t message( payload.size() );
+	memcpy( message.data(), &payload[0], payload.size() );
+	if ( socket.send( message, ZMQ_DONTWAIT ) )
+		++stats.m_framesSent;
+	else
+		++stats.m_framesDropped;
+}
+
+///Take whatever arrived: replies to our requests, and keyframe requests from viewers which a recording cannot honour
+static void TakeReplies( zmq::socket_t& video, zmq::socket_t* pControl, ClockSync::Estimator& clock, bool& awaitingReply, ReplayStats& stats )
+{
+	zmq::message_t message;
+	while ( video.recv( &message, ZMQ_DONTWAIT ) )
+	{
+	}
+
+	if ( !pControl )
+		return;
+
+	while ( pControl->recv( &message, ZMQ_DONTWAIT ) )
+	{
+		int64_t received = ClockSync::Now();
+		awaitingReply = false;
+		++stats.m_replies;
+
+		ClockSync::Reply reply;
+		if ( ClockSync::ReadReply( static_cast<const uint8_t*>( message.data() ), message.size(), reply ) )
+			clock.AddSample( reply.m_requestSent, reply.m_received, reply.m_replied, received );
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+	ReplayOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		printf( "Usage: ReplayServer -recording base [-speed x] [-start seconds] [-loop] [-info]\n"
+			"                    [-video endpoint] [-control endpoint]\n" );
+		return 1;
+	}
+
+	Recording::Reader frames;
+	if ( !frames.Open( options.recording ) )
+	{
+		printf( "Failed to open the recording %s\n", options.recording.c_str() );
+		return 1;
+	}
+
+	std::string controlBase = options.recording + "-control";
+	Recording::Reader commands;
+	bool hasCommands = commands.Open( controlBase );
+
+	if ( options.info )
+	{
+		PrintInfo( options.recording, frames );
+		if ( hasCommands )
+			PrintInfo( controlBase, commands );
+		return 0;
+	}
+
+	int64_t start = static_cast<int64_t>( options.start * 1e6 );
+	if ( frames.FindSimTime( start ) == frames.GetRecordCount() && (!hasCommands || commands.FindSimTime( start ) == commands.GetRecordCount()) )
+	{
+		printf( "The recording ends before %.3f s\n", options.start );
+		return 1;
+	}
+
+	zmq::context_t context;
+	zmq::socket_t video( context, ZMQ_PAIR );
+	video.bind( options.videoEndpoint.c_str() );
+
+	zmq::socket_t* pControl = NULL;
+	if ( hasCommands )
+	{
+		pControl = new zmq::socket_t( context, ZMQ_PAIR );
+		pControl->bind( options.controlEndpoint.c_str() );
+	}
+
+	char pace[32];
+	sprintf( pace, options.speed > 0 ? "at %gx" : "as fast as possible", options.speed );
+	printf( "Replaying %s (%llu records)%s%s on %s%s%s %s from %.3f s\n", options.recording.c_str(),
+		static_cast<unsigned long long>( frames.GetRecordCount() ), hasCommands ? " and " : "", hasCommands ? controlBase.c_str() : "",
+		options.videoEndpoint.c_str(), hasCommands ? " and " : "", hasCommands ? options.controlEndpoint.c_str() : "",
+		pace, options.start );
+
+	ReplayStats stats;
+	ClockSync::Estimator clock;
+	bool awaitingReply = false;
+	std::vector<uint8_t> payload;
+	std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+
+	do
+	{
+		//Both recordings are merged in simulation time order
+		uint64_t nextFrame = frames.FindSimTime( start );
+		uint64_t nextCommand = hasCommands ? commands.FindSimTime( start ) : 0;
+		std::chrono::steady_clock::time_point passStart = std::chrono::steady_clock::now();
+
+		for ( ;; )
+		{
+			Recording::RecordInfo frameInfo, commandInfo;
+			bool haveFrame = frames.GetInfo( nextFrame, frameInfo );
+			bool haveCommand = hasCommands && commands.GetInfo( nextCommand, commandInfo );
+			if ( !haveFrame && !haveCommand )
+				break;
+
+			bool isFrame = haveFrame && (!haveCommand || frameInfo.m_simTime <= commandInfo.m_simTime);
+			Recording::Reader& reader = isFrame ? frames : commands;
+			uint64_t sequence = isFrame ? nextFrame++ : nextCommand++;
+			int64_t simTime = isFrame ? frameInfo.m_simTime : commandInfo.m_simTime;
+
+			//Vehicle states, control inputs and raw captured frames are for offline review, the protocol has no place for them
+			if ( !isFrame && commandInfo.m_kind != Recording::kRecordControl )
+				continue;
+			if ( isFrame && frameInfo.m_kind != Recording::kRecordFrame )
+				continue;
+
+			if ( options.speed > 0 )
+			{
+				std::chrono::steady_clock::time_point due = passStart
+					+ std::chrono::microseconds( static_cast<int64_t>( (simTime - start) / options.speed ) );
+				while ( std::chrono::steady_clock::now() < due )
+				{
+					TakeReplies( video, pControl, clock, awaitingReply, stats );
+					std::this_thread::sleep_for( std::min( due - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration( std::chrono::milliseconds( 1 ) ) ) );
+				}
+				if ( std::chrono::steady_clock::now() - due > std::chrono::milliseconds( 1 ) )
+					++stats.m_late;
+			}
+			TakeReplies( video, pControl, clock, awaitingReply, stats );
+
+			Recording::RecordInfo info;
+			if ( !reader.Read( sequence, info, payload ) )
+			{
+				printf( "Failed to read record %llu\n", static_cast<unsigned long long>( sequence ) );
+				continue;
+			}
+
+			if ( isFrame )
+			{
+				if ( info.m_kind == Recording::kRecordFrame && !payload.empty() )
+					SendFrame( video, info, payload, stats );
+				continue;
+			}
+
+			//Like ZMQVideo, ask for a direction with a clock request, but never wait for the answer
+			if ( awaitingReply )
+			{
+				++stats.m_requestsSkipped;
+				continue;
+			}
+
+			ClockSync::Request request;
+			request.m_sent = ClockSync::Now();
+			request.m_offset = clock.GetOffset();
+			request.m_roundTrip = clock.IsValid() ? clock.GetRoundTrip() : 0;
+
+			zmq::message_t message( ClockSync::kRequestSize );
+			ClockSync::WriteRequest( request, static_cast<uint8_t*>( message.data() ) );
+			if ( pControl->send( message, ZMQ_DONTWAIT ) )
+			{
+				awaitingReply = true;
+				++stats.m_requests;
+			}
+			else
+			{
+				++stats.m_requestsSkipped;
+			}
+		}
+	}
+	while ( options.loop );
+
+	//Let the last replies in
+	std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+	TakeReplies( video, pControl, clock, awaitingReply, stats );
+
+	double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - began ).count();
+	printf( "Sent %llu frames in %.2f s (%.1f fps), %llu dropped, %llu late\n", static_cast<unsigned long long>( stats.m_framesSent ),
+		elapsed, stats.m_framesSent / elapsed, static_cast<unsigned long long>( stats.m_framesDropped ),
+		static_cast<unsigned long long>( stats.m_late ) );
+	if ( hasCommands )
+	{
+		printf( "Sent %llu control requests, %llu skipped, %llu replies", static_cast<unsigned long long>( stats.m_requests ),
+			static_cast<unsigned long long>( stats.m_requestsSkipped ), static_cast<unsigned long long>( stats.m_replies ) );
+		if ( clock.IsValid() )
+			printf( ", round trip %.3f ms", clock.GetRoundTrip() / 1000.0 );
+		printf( "\n" );
+	}
+
+	int linger = 0;
+	video.setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+	if ( pControl )
+	{
+		pControl->setsockopt( ZMQ_LINGER, &linger, sizeof(linger) );
+		delete pControl;
+	}
+	return 0;
+}
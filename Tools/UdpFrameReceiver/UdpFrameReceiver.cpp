@@ -0,0 +1,129 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// UdpFrameReceiver - Reference client for the UDP frame transport.
+//
+// Subscribes to a SampleSensor running with udpPort="N" in the sensor XML,
+// reassembles the JPEG frames, conceals lost segments with the camera's
+// previous frame and prints how many frames arrived whole, patched or not
+// at all.
+// -drop discards the given percentage of incoming datagrams, which is enough
+// to exercise the concealment over a loopback or wired connection.
+//
+// Usage:
+//   UdpFrameReceiver -server host [-port port] [-drop percent] [-save file.jpg]
+//
+// Windows: build UdpFrameReceiver.vcxproj from the solution.
+// Linux:   g++ -O2 -I../../SensorPlugin UdpFrameReceiver.cpp ../../SensorPlugin/DatagramVideo.cpp
+//              -o UdpFrameReceiver
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "DatagramVideo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace VANE;
+
+//////////////////////////////////////////////////////////////////////////
+
+struct ReceiverOptions
+{
+	ReceiverOptions()
+		: port( 9001 )
+		, dropPercent( 0 )
+	{
+	}
+
+	std::string server;
+	int port;
+	int dropPercent;
+	std::string saveFile;
+};
+
+static bool ParseOptions( int argc, char** argv, ReceiverOptions& options )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		std::string arg = argv[i];
+		if ( i + 1 >= argc )
+			return false;
+
+		if ( arg == "-server" )
+			options.server = argv[++i];
+		else if ( arg == "-port" )
+			options.port = atoi( argv[++i] );
+		else if ( arg == "-drop" )
+			options.dropPercent = atoi( argv[++i] );
+		else if ( arg == "-save" )
+			options.saveFile = argv[++i];
+		else
+			return false;
+	}
+
+	return !options.server.empty() && options.port > 0 && options.port < 65536
+		&& options.dropPercent >= 0 && options.dropPercent < 100;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+	ReceiverOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		printf( "Usage: UdpFrameReceiver -server host [-port port] [-drop percent] [-save file.jpg]\n" );
+		return 1;
+	}
+
+	DatagramVideo::Address sender;
+	if ( !DatagramVideo::ResolveAddress( options.server, static_cast<uint16_t>(options.port), sender ) )
+	{
+		printf( "Could not resolve %s\n", options.server.c_str() );
+		return 1;
+	}
+
+	DatagramVideo::Receiver receiver;
+	if ( !receiver.Open( sender ) )
+	{
+		printf( "Could not open a UDP socket\n" );
+		return 1;
+	}
+	receiver.GetSocket().SetDropRate( options.dropPercent / 100.0 );
+	printf( "Subscribed to %s:%d\n", options.server.c_str(), options.port );
+
+	std::vector<uint8_t> jpeg;
+	uint64_t received = 0;
+
+	while ( true )
+	{
+		DatagramVideo::FrameResult result;
+		if ( !receiver.Receive( jpeg, result, 1000 ) )
+			continue;
+
+		++received;
+
+		if ( !options.saveFile.empty() )
+		{
+			FILE* pFile = fopen( options.saveFile.c_str(), "wb" );
+			if ( pFile )
+			{
+				fwrite( &jpeg[0], 1, jpeg.size(), pFile );
+				fclose( pFile );
+			}
+		}
+
+		if ( received % 100 == 0 )
+		{
+			printf( "camera %u frame %u: complete %llu, concealed %llu, dropped %llu, late datagrams %llu, injected drops %llu\n",
+				result.m_stream, result.m_frameNumber,
+				(unsigned long long)receiver.GetCompleteFrames(), (unsigned long long)receiver.GetConcealedFrames(),
+				(unsigned long long)receiver.GetDroppedFrames(), (unsigned long long)receiver.GetLateDatagrams(),
+				(unsigned long long)receiver.GetSocket().GetInjectedDrops() );
+		}
+	}
+
+	return 0;
+}